@@ -9,6 +9,17 @@
 #include <vector>
 
 namespace kuiper_infer {
+/// 通道分块排布中每一块的通道数，和一个AVX2寄存器中float的数量相同
+constexpr uint32_t kChannelBlockSize = 8;
+
+/**
+ * 张量数据在内存中的排布
+ */
+enum class TensorLayout {
+  kNCHW = 0,    /// 每个通道是一个列主序的矩阵，各个通道依次存放
+  kNCHW8c = 1,  /// 每kChannelBlockSize个通道为一块，块内同一位置的各个通道连续存放
+};
+
 template<typename T = float>
 class Tensor {};
 
@@ -49,6 +60,32 @@ class Tensor<float> {
    */
   explicit Tensor(const std::vector<uint32_t> &shapes);
 
+  /**
+   * 在外部内存上创建一个张量，张量不持有这块内存
+   * @param raw_ptr 外部内存的起始地址
+   * @param channels 张量的通道数
+   * @param rows 张量的行数
+   * @param cols 张量的列数
+   */
+  explicit Tensor(float *raw_ptr, uint32_t channels, uint32_t rows,
+                  uint32_t cols);
+
+  /**
+   * 在外部内存上创建一个张量，张量不持有这块内存
+   * @param raw_ptr 外部内存的起始地址
+   * @param shapes 张量的维度
+   */
+  explicit Tensor(float *raw_ptr, const std::vector<uint32_t> &shapes);
+
+  /**
+   * 在外部内存上创建一个张量，张量持有外部内存的引用，
+   * 张量存在期间这块内存不会被释放
+   * @param raw_ptr 外部内存的起始地址，和外部内存的持有者共享引用计数
+   * @param shapes 张量的维度
+   */
+  explicit Tensor(const std::shared_ptr<float> &raw_ptr,
+                  const std::vector<uint32_t> &shapes);
+
   Tensor(const Tensor &tensor);
 
   Tensor(Tensor &&tensor) noexcept;
@@ -182,6 +219,14 @@ class Tensor<float> {
    */
   void Fill(const std::vector<float> &values, bool row_major = true);
 
+  /**
+   * 使用一段连续内存中的数据初始化张量，不需要先复制到数组中
+   * @param values 用来初始化张量的数据
+   * @param size 数据的数量，需要和张量的元素数量相同
+   * @param row_major 数据是否是行主序的
+   */
+  void Fill(const float *values, uint32_t size, bool row_major = true);
+
   /**
    * 返回Tensor内的所有数据
    * @param row_major 是否是行主序列的
@@ -242,9 +287,39 @@ class Tensor<float> {
    */
   float *matrix_raw_ptr(uint32_t index);
 
+  /**
+   * 返回张量数据在内存中的排布
+   * @return 张量数据的排布
+   */
+  TensorLayout layout() const;
+
+  /**
+   * 设置张量数据的排布，只修改排布的标记而不重新排列数据。
+   * kNCHW8c排布要求通道数是kChannelBlockSize的整数倍，
+   * 此时slice、at等接口仍然按照kNCHW排布解释数据，需要通过channel_raw_ptr访问
+   * @param layout 张量数据的排布
+   */
+  void set_layout(TensorLayout layout);
+
+  /**
+   * 返回同一个通道中相邻的两个元素在内存中的距离
+   * @return kNCHW排布时为1，kNCHW8c排布时为kChannelBlockSize
+   */
+  uint32_t pixel_stride() const;
+
+  /**
+   * 返回第channel个通道的起始地址，该通道中按列主序的第i个元素
+   * 位于channel_raw_ptr(channel)[i * pixel_stride()]
+   * @param channel 第channel个通道
+   * @return 第channel个通道的起始地址
+   */
+  float *channel_raw_ptr(uint32_t channel);
+
  private:
   std::vector<uint32_t> raw_shapes_;  // 张量数据的实际尺寸大小
   arma::fcube data_;                  // 张量数据
+  TensorLayout layout_ = TensorLayout::kNCHW;  // 张量数据在内存中的排布
+  std::shared_ptr<float> memory_holder_;       // 外部内存的引用，为空时张量不持有外部内存
 };
 
 using ftensor = Tensor<float>;
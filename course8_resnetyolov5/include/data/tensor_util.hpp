@@ -104,5 +104,14 @@ std::shared_ptr<Tensor<float>> TensorCreate(
 std::shared_ptr<Tensor<float>> TensorClone(
     std::shared_ptr<Tensor<float>> tensor);
 
+/**
+ * 将张量的数据重新排列为另一种排布，返回新的张量
+ * @param tensor 待重新排列的张量
+ * @param layout 新张量的排布
+ * @return 排布为layout的新张量
+ */
+std::shared_ptr<Tensor<float>> TensorReorder(
+    const std::shared_ptr<Tensor<float>>& tensor, TensorLayout layout);
+
 }  // namespace kuiper_infer
 #endif  // KUIPER_INFER_TENSOR_UTIL_H
@@ -0,0 +1,141 @@
+#ifndef KUIPER_INFER_DATA_TENSOR_VIEW_HPP_
+#define KUIPER_INFER_DATA_TENSOR_VIEW_HPP_
+#include <memory>
+#include <vector>
+#include "data/tensor.hpp"
+
+namespace kuiper_infer {
+/**
+ * 张量上不持有内存的视图，通过形状、步长和偏移量访问张量的存储。
+ * 视图的维度按照pytorch的顺序排列，例如[channels, rows, cols]，
+ * 切片、维度重排以及满足条件的reshape都只修改形状和步长，不复制数据
+ */
+class TensorView {
+ public:
+  /**
+   * 创建覆盖整个张量的视图，维度为[channels, rows, cols]
+   * @param tensor 视图所引用的张量，视图存在期间张量不会被释放
+   */
+  explicit TensorView(const std::shared_ptr<Tensor<float>>& tensor);
+
+  /**
+   * 在张量的存储上创建任意形状和步长的视图
+   * @param tensor 视图所引用的张量
+   * @param shapes 视图的形状
+   * @param strides 视图每个维度的步长，以元素为单位
+   * @param offset 视图的第一个元素在张量存储中的偏移量
+   */
+  TensorView(const std::shared_ptr<Tensor<float>>& tensor,
+             std::vector<uint32_t> shapes, std::vector<uint32_t> strides,
+             uint32_t offset = 0);
+
+  /**
+   * 返回视图的形状
+   * @return 视图的形状
+   */
+  const std::vector<uint32_t>& shapes() const;
+
+  /**
+   * 返回视图每个维度的步长
+   * @return 视图的步长
+   */
+  const std::vector<uint32_t>& strides() const;
+
+  /**
+   * 返回视图中元素的数量
+   * @return 元素的数量
+   */
+  uint32_t size() const;
+
+  /**
+   * 返回视图第一个元素的地址，其他元素的地址通过步长计算
+   * @return 第一个元素的地址
+   */
+  float* data() const;
+
+  /**
+   * 返回特定位置的元素
+   * @param indices 元素在每个维度上的位置
+   * @return 特定位置的元素
+   */
+  float& at(const std::vector<uint32_t>& indices) const;
+
+  /**
+   * 在某个维度上截取一段连续的范围，例如截取一部分通道
+   * @param dim 需要截取的维度
+   * @param start 截取的起始位置
+   * @param length 截取的长度
+   * @return 截取之后的视图
+   */
+  TensorView Slice(uint32_t dim, uint32_t start, uint32_t length) const;
+
+  /**
+   * 重新排列视图的维度，和pytorch的permute相同
+   * @param dims 新视图的每个维度对应原视图中的维度
+   * @return 重排之后的视图
+   */
+  TensorView Permute(const std::vector<uint32_t>& dims) const;
+
+  /**
+   * 按照行主序reshape视图，和pytorch的reshape相同。
+   * 被合并的维度在存储中连续时只修改形状和步长，否则复制到新的存储中
+   * @param shapes 新的形状
+   * @return reshape之后的视图
+   */
+  TensorView Reshape(const std::vector<uint32_t>& shapes) const;
+
+  /**
+   * 判断视图是否可以不复制数据直接reshape到新的形状
+   * @param shapes 新的形状
+   * @return 可以直接reshape时返回true
+   */
+  bool IsReshapeView(const std::vector<uint32_t>& shapes) const;
+
+  /**
+   * 判断视图在存储中的排布是否和同样形状的Tensor相同，
+   * 相同时可以直接在视图的存储上创建张量
+   * @return 排布相同时返回true
+   */
+  bool IsTensorLayout() const;
+
+  /**
+   * 将视图转换为张量，排布和Tensor相同时返回共享存储、不持有内存的张量，
+   * 此时需要保证原张量的存活时间，否则复制到新的张量中
+   * @return 转换之后的张量
+   */
+  std::shared_ptr<Tensor<float>> ToTensor() const;
+
+  /**
+   * 判断形状为tensor_shapes的张量按照行主序reshape到shapes之后，
+   * 是否可以继续使用原来的存储，也就是reshape前后的内存排布完全相同
+   * @param tensor_shapes 张量的形状
+   * @param shapes 新的形状，最多三个维度
+   * @return 可以使用原来的存储时返回true
+   */
+  static bool IsReshapeInPlace(const std::vector<uint32_t>& tensor_shapes,
+                               const std::vector<uint32_t>& shapes);
+
+ private:
+  /**
+   * 计算不复制数据reshape之后的步长
+   * @param shapes 新的形状
+   * @param strides 新的步长
+   * @return 可以不复制数据时返回true
+   */
+  bool ReshapeStrides(const std::vector<uint32_t>& shapes,
+                      std::vector<uint32_t>& strides) const;
+
+  /**
+   * 按照行主序将视图中的元素复制到一段连续的内存中
+   * @param output 连续内存的起始地址，至少可以容纳size()个元素
+   */
+  void CopyRowMajor(float* output) const;
+
+  std::shared_ptr<Tensor<float>> tensor_;  /// 视图引用的张量
+  float* data_ = nullptr;                  /// 视图第一个元素的地址
+  std::vector<uint32_t> shapes_;           /// 视图的形状
+  std::vector<uint32_t> strides_;          /// 视图每个维度的步长
+};
+
+}  // namespace kuiper_infer
+#endif  // KUIPER_INFER_DATA_TENSOR_VIEW_HPP_
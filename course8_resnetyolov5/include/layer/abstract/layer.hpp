@@ -24,6 +24,7 @@
 #ifndef KUIPER_INFER_SOURCE_LAYER_LAYER_HPP_
 #define KUIPER_INFER_SOURCE_LAYER_LAYER_HPP_
 #include <glog/logging.h>
+#include <map>
 #include <memory>
 #include <string>
 #include <utility>
@@ -95,6 +96,20 @@ class Layer {
    */
   virtual void set_bias(const std::vector<float>& bias);
 
+  /**
+   * 使用一段连续内存设置Layer的权重，例如权重文件的内存映射
+   * @param weights 权重的起始地址
+   * @param size 权重的数量
+   */
+  virtual void set_weights(const float* weights, uint32_t size);
+
+  /**
+   * 使用一段连续内存设置Layer的偏移量
+   * @param bias 偏移量的起始地址
+   * @param size 偏移量的数量
+   */
+  virtual void set_bias(const float* bias, uint32_t size);
+
   /**
    * 返回层的名称
    * @return 层的名称
@@ -108,9 +123,29 @@ class Layer {
   void set_runtime_operator(
       const std::shared_ptr<RuntimeOperator>& runtime_operator);
 
+  /**
+   * 返回Layer计算时所需要的临时空间大小
+   * @return 临时空间中float元素的数量，不需要临时空间时返回0
+   */
+  virtual size_t workspace_size() const;
+
+  /**
+   * 设置Layer计算时所使用的临时空间，由计算图中的多个Layer共享
+   * @param workspace 临时空间
+   */
+  void set_workspace(const std::shared_ptr<arma::fvec>& workspace);
+
+  /**
+   * 返回Layer在创建时重新排布过的权重，保存计划文件时会一起写入，
+   * 从计划文件创建Layer时以"packed."加上名称作为节点的属性传回
+   * @return 排布后的权重，不需要排布权重的Layer返回空
+   */
+  virtual std::map<std::string, arma::fmat> packed_weights() const;
+
  protected:
   std::weak_ptr<RuntimeOperator> runtime_operator_;
   std::string layer_name_;  /// Layer的名称
+  std::shared_ptr<arma::fvec> workspace_;  /// Layer计算时使用的临时空间
 };
 
 }  // namespace kuiper_infer
@@ -88,6 +88,20 @@ class ParamLayer : public Layer {
   void set_bias(
       const std::vector<std::shared_ptr<Tensor<float>>> &bias) override;
 
+  /**
+   * 使用一段连续内存设置权重参数，数据直接填入各个权重张量
+   * @param weights 权重参数的起始地址
+   * @param size 权重参数的数量
+   */
+  void set_weights(const float *weights, uint32_t size) override;
+
+  /**
+   * 使用一段连续内存设置偏移量参数
+   * @param bias 偏移量参数的起始地址
+   * @param size 偏移量参数的数量
+   */
+  void set_bias(const float *bias, uint32_t size) override;
+
  protected:
   std::vector<std::shared_ptr<Tensor<float>>> weights_;
   std::vector<std::shared_ptr<Tensor<float>>> bias_;
@@ -17,6 +17,7 @@
 
 #include <initializer_list>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
@@ -160,6 +161,10 @@ public:
     std::vector<int> shape;
 
     std::vector<char> data;
+
+    // set when the graph is loaded with map_weights, the weights then stay in the memory
+    // mapped bin file and data is empty
+    std::shared_ptr<const char> mapped_data;
 };
 
 bool operator==(const Attribute& lhs, const Attribute& rhs);
@@ -208,7 +213,9 @@ public:
     Graph();
     ~Graph();
 
-    int load(const std::string& parampath, const std::string& binpath);
+    // map_weights references the attributes inside the memory mapped bin file instead of
+    // reading them into Attribute::data
+    int load(const std::string& parampath, const std::string& binpath, bool map_weights = false);
     int save(const std::string& parampath, const std::string& binpath);
 
     int python(const std::string& pypath, const std::string& binpath);
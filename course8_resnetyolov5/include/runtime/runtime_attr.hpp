@@ -5,6 +5,7 @@
 #ifndef KUIPER_INFER_INCLUDE_PARSER_RUNTIME_ATTR_HPP_
 #define KUIPER_INFER_INCLUDE_PARSER_RUNTIME_ATTR_HPP_
 #include <glog/logging.h>
+#include <memory>
 #include <vector>
 #include "runtime_datatype.hpp"
 #include "status_code.hpp"
@@ -17,6 +18,10 @@ struct RuntimeAttribute {
   std::vector<int> shape;         /// 节点中的形状信息
   RuntimeDataType type = RuntimeDataType::kTypeUnknown;  /// 节点中的数据类型
 
+  /// 权重文件内存映射中的权重参数，不为空时weight_data为空
+  std::shared_ptr<const char> mapped_weight;
+  size_t mapped_weight_size = 0;  /// 内存映射中权重参数的字节数
+
   /**
    * 从节点中加载权重参数
    * @tparam T 权重类型
@@ -25,6 +30,22 @@ struct RuntimeAttribute {
   template <class T>  //
   std::vector<T> get(bool need_clear_weight = true);
 
+  /**
+   * 返回权重参数的起始地址，不复制权重
+   * @tparam T 权重类型
+   * @return 权重参数的起始地址，元素数量为weight_count<T>()
+   */
+  template <class T>
+  const T* weight_ptr() const;
+
+  /**
+   * 返回权重参数的元素数量
+   * @tparam T 权重类型
+   * @return 权重参数的元素数量
+   */
+  template <class T>
+  size_t weight_count() const;
+
   /**
    * 清除权重
    */
@@ -32,27 +53,38 @@ struct RuntimeAttribute {
 };
 
 template <class T>
-std::vector<T> RuntimeAttribute::get(bool need_clear_weight) {
+const T* RuntimeAttribute::weight_ptr() const {
   /// 检查节点属性中的权重类型
-  CHECK(!weight_data.empty());
   CHECK(type != RuntimeDataType::kTypeUnknown);
-  std::vector<T> weights;
   switch (type) {
     case RuntimeDataType::kTypeFloat32: {  /// 加载的数据类型是float
       const bool is_float = std::is_same<T, float>::value;
       CHECK_EQ(is_float, true);
-      const uint32_t float_size = sizeof(float);
-      CHECK_EQ(weight_data.size() % float_size, 0);
-      for (uint32_t i = 0; i < weight_data.size() / float_size; ++i) {
-        float weight = *((float*)weight_data.data() + i);
-        weights.push_back(weight);
-      }
       break;
     }
     default: {
       LOG(FATAL) << "Unknown weight data type: " << int(type);
     }
   }
+  if (mapped_weight != nullptr) {
+    return reinterpret_cast<const T*>(mapped_weight.get());
+  }
+  CHECK(!weight_data.empty());
+  return reinterpret_cast<const T*>(weight_data.data());
+}
+
+template <class T>
+size_t RuntimeAttribute::weight_count() const {
+  const size_t weight_bytes =
+      mapped_weight != nullptr ? mapped_weight_size : weight_data.size();
+  CHECK_EQ(weight_bytes % sizeof(T), 0);
+  return weight_bytes / sizeof(T);
+}
+
+template <class T>
+std::vector<T> RuntimeAttribute::get(bool need_clear_weight) {
+  const T* weight_begin = this->weight_ptr<T>();
+  std::vector<T> weights(weight_begin, weight_begin + this->weight_count<T>());
   if (need_clear_weight) {
     this->ClearWeight();
   }
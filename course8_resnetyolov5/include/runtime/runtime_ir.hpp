@@ -6,6 +6,7 @@
 #include <map>
 #include <memory>
 #include <queue>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -70,9 +71,143 @@ class RuntimeGraph {
   static std::shared_ptr<Layer> CreateLayer(
       const std::shared_ptr<RuntimeOperator> &op);
 
+  /**
+   * 计算图的推理，批次大小可以是1到最大批次大小之间的任意值，
+   * 批次大小变化时重新划分输出张量，已经分配的内存足够时不会重新分配
+   * @param inputs 计算图的输入，每个样本一个张量
+   * @param debug 为true时记录每个节点的执行时间、输入输出形状、访存量和
+   * 计算量，推理结束后按照层的类型汇总输出
+   * @return 计算图的输出，输出张量持有所在内存的引用，计算图析构之后仍然有效，
+   * 但是下一次推理复用这块内存时会被覆盖
+   */
   std::vector<std::shared_ptr<Tensor<float>>> Forward(
       const std::vector<std::shared_ptr<Tensor<float>>> &inputs, bool debug);
 
+  /**
+   * 设置debug模式下chrome://tracing文件的路径，为空时不写入文件
+   * @param trace_path 文件路径
+   */
+  void set_trace_path(const std::string &trace_path);
+
+  /**
+   * 设置计算图的执行方式
+   * @param parallel 为true时，同一层级中没有依赖关系的节点会被并行执行，
+   * 线程在这些节点之间平分，节点内部的并行循环使用各自分到的线程
+   * @param num_threads 并行执行时的线程数量，为0时使用OpenMP默认的线程数量
+   */
+  void set_parallel_execution(bool parallel, uint32_t num_threads = 0);
+
+  /**
+   * 返回计算图是否并行执行
+   * @return 并行执行返回true
+   */
+  bool parallel_execution() const;
+
+  /**
+   * 设置是否在构建计算图时进行算子融合，需要在Build之前调用
+   * @param operator_fusion 是否进行算子融合
+   */
+  void set_operator_fusion(bool operator_fusion);
+
+  /**
+   * 返回构建计算图时是否进行算子融合
+   * @return 进行算子融合返回true
+   */
+  bool operator_fusion() const;
+
+  /**
+   * 设置是否对计算节点的输出张量进行内存规划，
+   * 规划后生命周期不重叠的输出张量会共享同一块内存
+   * @param memory_planning 是否进行内存规划
+   */
+  void set_memory_planning(bool memory_planning);
+
+  /**
+   * 返回计算节点的输出张量是否经过内存规划
+   * @return 经过内存规划返回true
+   */
+  bool memory_planning() const;
+
+  /**
+   * 设置在通道维度上拼接时，前驱节点是否直接写入cat输出张量中对应的通道，
+   * 关闭后cat节点把每个输入复制到输出张量中
+   * @param cat_views 前驱节点是否直接写入cat的输出张量
+   */
+  void set_cat_views(bool cat_views);
+
+  /**
+   * 返回前驱节点是否直接写入cat的输出张量
+   * @return 直接写入时返回true
+   */
+  bool cat_views() const;
+
+  /**
+   * 设置是否在构建之后保留计算节点的权重，保留之后才可以调用SavePlan，
+   * 需要在Build或者LoadPlan之前调用
+   * @param plan_export 是否保留计算节点的权重
+   */
+  void set_plan_export(bool plan_export);
+
+  /**
+   * 返回构建之后是否保留计算节点的权重
+   * @return 保留权重返回true
+   */
+  bool plan_export() const;
+
+  /**
+   * 将构建完成的计算图保存为二进制的计划文件，其中包括拓扑顺序、
+   * 操作数的形状、计算节点的参数和权重以及Layer重新排布过的权重
+   * @param plan_path 计划文件的路径
+   * @return 是否保存成功
+   */
+  bool SavePlan(const std::string &plan_path) const;
+
+  /**
+   * 从计划文件中加载构建完成的计算图，跳过pnnx模型的解析、算子融合、
+   * 拓扑排序和权重的重新排布，计划文件中的权重通过内存映射直接引用
+   * @param plan_path 计划文件的路径
+   * @return 是否加载成功
+   */
+  bool LoadPlan(const std::string &plan_path);
+
+  /**
+   * 设置是否使用通道分块的排布(NCHW8c)，需要在Build或者LoadPlan之前调用。
+   * 卷积、最大池化、上采样、SiLU、ReLU、Sigmoid、cat和不需要广播的表达式
+   * 组成的区域内部使用分块排布，只有在区域的边界，
+   * 也就是从计算图的输入读取或者写入计算图的输出时转换排布
+   * @param blocked_layout 是否使用通道分块的排布
+   */
+  void set_blocked_layout(bool blocked_layout);
+
+  /**
+   * 返回是否使用通道分块的排布
+   * @return 使用通道分块的排布返回true
+   */
+  bool blocked_layout() const;
+
+  /**
+   * 设置计算图的最大批次大小，需要在Build或者LoadPlan之前调用。
+   * 设置之后模型文件中的批次大小被忽略，推理时的批次大小不能超过最大批次大小；
+   * 为0时最大批次大小等于模型文件中的批次大小
+   * @param max_batch_size 最大批次大小
+   */
+  void set_max_batch_size(uint32_t max_batch_size);
+
+  /**
+   * 返回计算图的最大批次大小
+   * @return 最大批次大小，为0时表示使用模型文件中的批次大小
+   */
+  uint32_t max_batch_size() const;
+
+  /**
+   * 将BatchNorm节点的参数折叠到卷积节点的权重和偏移量中
+   * @param conv_op 卷积节点
+   * @param bn_op BatchNorm节点
+   * @return 是否折叠成功
+   */
+  static bool FoldBatchNorm(const std::shared_ptr<RuntimeOperator> &conv_op,
+                            const std::shared_ptr<RuntimeOperator> &bn_op);
+
  private:
   /**
    * 初始化kuiper infer计算图节点中的输入操作数
@@ -112,6 +247,151 @@ class RuntimeGraph {
 
   void ReverseTopo(const std::shared_ptr<RuntimeOperator> &root_op);
 
+  /**
+   * 将卷积之后的BatchNorm、ReLU和SiLU节点合并到卷积节点中，
+   * 被合并节点的后继节点改为直接使用卷积节点的输出
+   */
+  void FuseOperators();
+
+  /**
+   * 根据各个Layer的需求，分配计算图中共享的临时空间
+   */
+  void InitGraphWorkspace();
+
+  /**
+   * 规划计算节点的输出张量在内存中的位置，张量在第一次推理时才会分配
+   * @param memory_planning 为true时根据拓扑顺序计算每个输出张量的生命周期，
+   * 生命周期不重叠的张量复用同一块内存；为false时每个输出张量使用独立的内存
+   */
+  void InitGraphOutputs(bool memory_planning);
+
+  /**
+   * 按照批次大小为计算节点的输入和输出操作数划分张量，
+   * 已经分配的内存能够放下这个批次时直接复用
+   * @param batch_size 批次大小
+   */
+  void InitGraphBatch(uint32_t batch_size);
+
+  /**
+   * 返回指向arena内部的指针，指针和arena共享引用计数
+   * @param ptr arena内部的地址
+   * @return 持有arena引用的指针
+   */
+  std::shared_ptr<float> ArenaPointer(float *ptr) const;
+
+  /**
+   * 找出输出可以直接写入torch.cat输出张量中的节点，在通道维度上拼接时
+   * 这些节点的输出张量是cat输出张量中的一段通道，cat在推理时不需要复制
+   * @return 节点的名称到cat节点和起始通道的映射
+   */
+  std::map<std::string, std::pair<std::shared_ptr<RuntimeOperator>, uint32_t>>
+  CatChannelViews() const;
+
+  /**
+   * 找出展平前后内存排布相同的flatten节点，这些节点的输出张量
+   * 直接使用前驱节点输出张量的存储，flatten在推理时不需要复制
+   * @param cat_views 已经作为cat输出视图的节点
+   * @return flatten节点的名称到前驱节点的映射
+   */
+  std::map<std::string, std::shared_ptr<RuntimeOperator>> FlattenViews(
+      const std::map<std::string,
+                     std::pair<std::shared_ptr<RuntimeOperator>, uint32_t>>
+          &cat_views) const;
+
+  /**
+   * 找出输出张量使用通道分块排布的节点。节点和它的所有后继节点都支持分块排布，
+   * 并且输出的通道数是kChannelBlockSize的整数倍时才使用分块排布；
+   * 除卷积以外的节点要求输入和输出的排布相同
+   * @return 输出张量使用分块排布的节点名称
+   */
+  std::set<std::string> BlockedLayoutOperators() const;
+
+  /**
+   * 找出可以级联计算的连续最大池化节点，例如yolov5的SPPF中连续三个5x5池化，
+   * 第一个池化节点在一次遍历中逐个通道计算自己和后继池化节点的输出
+   * @param blocked_operators 输出张量使用分块排布的节点，级联的节点排布相同
+   * @return 第一个池化节点的名称到后继池化节点的映射，后继节点按照级联的顺序排列
+   */
+  std::map<std::string, std::vector<std::shared_ptr<RuntimeOperator>>>
+  CascadePoolings(const std::set<std::string> &blocked_operators) const;
+
+  /**
+   * 按照拓扑顺序把计算节点划分为层级，节点的层级比所有前驱节点的层级大一，
+   * 同一层级的节点之间没有依赖，可以同时执行
+   */
+  void InitScheduleLevels();
+
+  /**
+   * 根据计算节点的后继节点名称建立节点之间的连接
+   */
+  void InitOperatorsOutputLink();
+
+  /**
+   * 为输入和输出节点之外的计算节点创建Layer，需要保存计划文件时
+   * 先保留一份节点的权重，因为Layer在创建时会释放节点中的权重
+   */
+  void InitOperatorsLayer();
+
+  /**
+   * 执行一个计算节点，并将它的输出传递给后继节点
+   * @param current_op 当前计算节点
+   * @param inputs 计算图的输入，只有输入节点会用到
+   * @param debug 是否记录节点的执行时间、形状、访存量和计算量
+   */
+  void ExecuteOperator(
+      const std::shared_ptr<RuntimeOperator> &current_op,
+      const std::vector<std::shared_ptr<Tensor<float>>> &inputs, bool debug);
+
+  /**
+   * 按照拓扑顺序依次执行计算图中的节点
+   * @param inputs 计算图的输入
+   * @param debug 是否记录各个节点的执行信息
+   */
+  void ForwardSerial(const std::vector<std::shared_ptr<Tensor<float>>> &inputs,
+                     bool debug);
+
+  /**
+   * 按照层级依次执行计算图中的节点。只有一个节点的层级直接执行，
+   * Layer内部的并行循环使用全部线程；有多个节点的层级中每个节点由一个线程执行，
+   * 线程在节点内部再开启嵌套的并行循环，平分剩余的线程
+   * @param inputs 计算图的输入
+   * @param debug 是否记录各个节点的执行信息
+   */
+  void ForwardParallel(
+      const std::vector<std::shared_ptr<Tensor<float>>> &inputs, bool debug);
+
+  /**
+   * 使用某个线程独占的临时空间执行计算节点
+   * @param op 计算节点
+   * @param thread_id 线程的编号，对应thread_workspaces_中的临时空间
+   * @param inputs 计算图的输入
+   * @param debug 是否记录各个节点的执行信息
+   */
+  void ExecuteOperatorOnThread(
+      const std::shared_ptr<RuntimeOperator> &op, int thread_id,
+      const std::vector<std::shared_ptr<Tensor<float>>> &inputs, bool debug);
+
+  /**
+   * 估算计算节点的浮点运算次数
+   * @param op 计算节点
+   * @return 浮点运算次数
+   */
+  static uint64_t OperatorFlops(const std::shared_ptr<RuntimeOperator> &op);
+
+  /**
+   * 估算计算节点读写输入、输出和权重的字节数
+   * @param op 计算节点
+   * @return 字节数
+   */
+  static uint64_t OperatorBytes(const std::shared_ptr<RuntimeOperator> &op);
+
+  /**
+   * 返回计算节点输入和输出的形状，例如[1,3,224,224] -> [1,64,112,112]
+   * @param op 计算节点
+   * @return 形状的字符串
+   */
+  static std::string OperatorShapes(const std::shared_ptr<RuntimeOperator> &op);
+
   /**
  * 探查下一层的计算节点
  * @param current_op 当前计算节点
@@ -135,15 +415,54 @@ class RuntimeGraph {
    */
   GraphState graph_state() const;
  private:
+  /// 输出张量的内存规划结果，内存块的大小和批次大小成正比，所以只记录单个样本的情况
+  struct OutputPlan {
+    std::vector<std::shared_ptr<RuntimeOperator>>
+        operators;                    /// 独立占用内存块的节点
+    std::vector<size_t> tensor_sizes; /// 节点中单个输出张量的元素数量
+    std::vector<size_t> offsets;      /// 单个样本时节点的内存块在arena中的偏移量
+    size_t arena_size = 0;            /// 单个样本时arena中float元素的数量
+    uint32_t max_batch_size = 0;      /// 计算图的最大批次大小
+    std::map<std::string, std::pair<std::shared_ptr<RuntimeOperator>, uint32_t>>
+        cat_views;                    /// 输出写入cat输出张量中的节点
+    std::map<std::string, std::shared_ptr<RuntimeOperator>>
+        flatten_views;                /// 直接使用前驱节点输出张量的flatten节点
+    std::set<std::string> blocked_operators; /// 输出张量使用分块排布的节点
+  };
+
   GraphState graph_state_ = GraphState::NeedInit;
   std::string input_name_;  /// 计算图输入节点的名称
   std::string output_name_; /// 计算图输出节点的名称
   std::string param_path_;  /// 计算图的结构文件
   std::string bin_path_;    /// 计算图的权重文件
+  std::string trace_path_;  /// debug模式下chrome://tracing文件的路径
 
   std::vector<std::shared_ptr<RuntimeOperator>> operators_;
   std::map<std::string, std::shared_ptr<RuntimeOperator>> operators_maps_;
   std::vector<std::shared_ptr<RuntimeOperator>> topo_operators_;
+  std::shared_ptr<arma::fvec> workspace_; /// 计算图中各个Layer共享的临时空间
+  size_t workspace_size_ = 0;             /// 临时空间中float元素的数量
+
+  bool operator_fusion_ = true;           /// 是否在构建时进行算子融合
+  bool memory_planning_ = true;           /// 是否对输出张量进行内存规划
+  bool cat_views_ = true;                 /// cat的前驱节点是否直接写入cat的输出张量
+  std::shared_ptr<arma::fvec>
+      activation_arena_;  /// 内存规划后输出张量共享的内存
+  OutputPlan output_plan_;                /// 输出张量的内存规划结果
+  uint32_t max_batch_size_ = 0;           /// 计算图的最大批次大小，为0时使用模型文件中的批次大小
+  uint32_t batch_size_ = 0;               /// 当前输出张量对应的批次大小，为0时还没有分配
+
+  bool parallel_execution_ = false;       /// 是否并行执行计算图中的节点
+  uint32_t num_threads_ = 0;              /// 并行执行时的线程数量
+  std::vector<std::shared_ptr<arma::fvec>>
+      thread_workspaces_; /// 并行执行时每个线程独占的临时空间，按需分配
+  std::vector<std::vector<std::shared_ptr<RuntimeOperator>>>
+      schedule_levels_;   /// 并行执行时按照层级划分的计算节点
+
+  bool blocked_layout_ = false;           /// 是否使用通道分块的排布
+  bool plan_export_ = false;              /// 构建之后是否保留节点的权重
+  std::map<std::string, std::map<std::string, std::shared_ptr<RuntimeAttribute>>>
+      plan_attributes_;  /// 保存计划文件时使用的节点权重
 
   std::unique_ptr<pnnx::Graph> graph_; /// pnnx的graph
 };
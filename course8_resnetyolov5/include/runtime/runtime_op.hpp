@@ -62,23 +62,39 @@ struct RuntimeOperator {
 
 class RuntimeOperatorUtils {
 public:
+  /**
+   * 返回操作数的批次大小，设置了最大批次大小时使用最大批次大小，
+   * 否则使用模型文件中的批次大小，模型文件中的批次大小是动态的(-1)时需要设置
+   * @param shapes 操作数的形状，第一维是批次大小
+   * @param max_batch_size 计算图的最大批次大小，为0时表示没有设置
+   * @return 操作数的批次大小
+   */
+  static int32_t OperandBatchSize(const std::vector<int32_t>& shapes,
+                                  uint32_t max_batch_size);
+
   /**
    * 如果图是第一次运行，则根据节点输入operand的形状准备好后续Layer计算中所需要的Tensor
    * 如果图是第二次以上运行，则检查输入operand的形状和operand中张量的形状是否匹配
    * @param operators 计算图中的计算节点
+   * @param max_batch_size 计算图的最大批次大小，为0时使用模型文件中的批次大小
    */
   static void InitOperatorInput(
-      const std::vector<std::shared_ptr<RuntimeOperator>>& operators);
+      const std::vector<std::shared_ptr<RuntimeOperator>>& operators,
+      uint32_t max_batch_size = 0);
 
   /**
    * 如果图是第一次运行，则根据节点输出operand的形状准备好后续Layer计算中所需要的Tensor
    * 如果图是第二次以上运行，则检查输出operand的形状和operand中张量的形状是否匹配
    * @param pnnx_operators pnnx图节点
    * @param operators KuiperInfer计算图中的计算节点
+   * @param allocate_datas 是否为输出操作数分配张量，为false时只记录形状，
+   * 张量由计算图的内存规划统一分配
+   * @param max_batch_size 计算图的最大批次大小，为0时使用模型文件中的批次大小
    */
   static void InitOperatorOutput(
       const std::vector<pnnx::Operator*>& pnnx_operators,
-      const std::vector<std::shared_ptr<RuntimeOperator>>& operators);
+      const std::vector<std::shared_ptr<RuntimeOperator>>& operators,
+      bool allocate_datas = true, uint32_t max_batch_size = 0);
 };
 
 }  // namespace kuiper_infer
@@ -18,6 +18,7 @@ struct RuntimeOperand {
   std::vector<int32_t> shapes;                          /// 操作数的形状
   std::vector<std::shared_ptr<Tensor<float>>> datas;    /// 存储操作数
   RuntimeDataType type = RuntimeDataType::kTypeUnknown; /// 操作数的类型，一般是float
+  TensorLayout layout = TensorLayout::kNCHW;            /// 操作数中张量的排布
 };
 }
 #endif //KUIPER_INFER_INCLUDE_PARSER_RUNTIME_OPERAND_HPP_
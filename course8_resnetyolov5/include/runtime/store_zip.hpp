@@ -16,6 +16,7 @@
 #define PNNX_STOREZIP_H
 
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -33,11 +34,18 @@ class StoreZipReader
 
   int read_file(const std::string& name, char* data);
 
+  // returns the data of a stored file inside the memory mapped archive without copying,
+  // the returned pointer keeps the mapping alive. returns null when the archive is not mapped
+  std::shared_ptr<const char> map_file(const std::string& name);
+
   int close();
 
  private:
   FILE* fp;
 
+  // the whole archive mapped read only, shared by all the pointers returned from map_file
+  std::shared_ptr<const char> mapping;
+
   struct StoreZipMeta
   {
     size_t offset;
@@ -0,0 +1,39 @@
+#ifndef KUIPER_INFER_INCLUDE_UTILS_MATH_ACTIVATION_HPP_
+#define KUIPER_INFER_INCLUDE_UTILS_MATH_ACTIVATION_HPP_
+#include <cstdint>
+
+namespace kuiper_infer {
+/**
+ * 激活函数计算时使用的指令集
+ */
+enum class ActivationIsa {
+  kScalar = 0,
+  kAVX2 = 1,
+  kAVX512 = 2,
+};
+
+/**
+ * 返回当前CPU上激活函数所使用的指令集，第一次调用时检测CPU支持的指令集，
+ * 不支持AVX2时使用标量实现
+ * @return 激活函数使用的指令集
+ */
+ActivationIsa ActivationDispatchIsa();
+
+/**
+ * 逐元素计算sigmoid(x) = 1 / (1 + exp(-x))
+ * @param input 输入数据
+ * @param output 输出数据，可以和输入是同一块内存
+ * @param size 元素的数量
+ */
+void ApplySigmoid(const float* input, float* output, uint32_t size);
+
+/**
+ * 逐元素计算silu(x) = x / (1 + exp(-x))
+ * @param input 输入数据
+ * @param output 输出数据，可以和输入是同一块内存
+ * @param size 元素的数量
+ */
+void ApplySiLU(const float* input, float* output, uint32_t size);
+
+}  // namespace kuiper_infer
+#endif  // KUIPER_INFER_INCLUDE_UTILS_MATH_ACTIVATION_HPP_
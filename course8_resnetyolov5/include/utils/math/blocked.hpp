@@ -0,0 +1,62 @@
+#ifndef KUIPER_INFER_INCLUDE_UTILS_MATH_BLOCKED_HPP_
+#define KUIPER_INFER_INCLUDE_UTILS_MATH_BLOCKED_HPP_
+#include <cstdint>
+
+namespace kuiper_infer {
+/**
+ * 返回当前CPU上是否使用AVX2计算分块排布的内核，第一次调用时检测CPU支持的指令集，
+ * 不支持AVX2时使用标量实现
+ * @return 是否使用AVX2
+ */
+bool BlockedKernelsUseAVX2();
+
+/**
+ * 分块排布的最大池化，计算一个通道块的全部输出，
+ * 每个位置上的kChannelBlockSize个通道作为一个向量计算
+ * @param input 输入通道块，大小为input_h * input_w * kChannelBlockSize
+ * @param input_h 输入的高度
+ * @param input_w 输入的宽度
+ * @param output 输出通道块，大小为output_h * output_w * kChannelBlockSize
+ * @param output_h 输出的高度
+ * @param output_w 输出的宽度
+ * @param pooling_h 池化窗口的高度
+ * @param pooling_w 池化窗口的宽度
+ * @param stride_h 高度方向的步长
+ * @param stride_w 宽度方向的步长
+ * @param padding_h 高度方向的填充
+ * @param padding_w 宽度方向的填充
+ */
+void BlockedMaxPooling(const float* input, uint32_t input_h, uint32_t input_w,
+                       float* output, uint32_t output_h, uint32_t output_w,
+                       uint32_t pooling_h, uint32_t pooling_w,
+                       uint32_t stride_h, uint32_t stride_w,
+                       uint32_t padding_h, uint32_t padding_w);
+
+/**
+ * 把矩阵乘法的结果加上偏置后写入一个通道块，
+ * output[p * kChannelBlockSize + j] = result[p * result_stride + j] + bias[j]
+ * @param result 矩阵乘法的结果，每个位置上的kChannelBlockSize个通道连续存放
+ * @param result_stride 结果中相邻两个位置的间隔
+ * @param bias kChannelBlockSize个通道的偏置
+ * @param output 输出通道块
+ * @param plane_size 一个通道中元素的数量
+ */
+void BlockedAddBias(const float* result, uint32_t result_stride,
+                    const float* bias, float* output, uint32_t plane_size);
+
+/**
+ * 分块排布的邻近上采样，计算一个通道块的全部输出
+ * @param input 输入通道块，高度为input_h
+ * @param input_h 输入的高度
+ * @param output 输出通道块，大小为output_h * output_w * kChannelBlockSize
+ * @param output_h 输出的高度
+ * @param output_w 输出的宽度
+ * @param scale_h 高度方向的放大倍数
+ * @param scale_w 宽度方向的放大倍数
+ */
+void BlockedUpSampleNearest(const float* input, uint32_t input_h, float* output,
+                            uint32_t output_h, uint32_t output_w,
+                            uint32_t scale_h, uint32_t scale_w);
+
+}  // namespace kuiper_infer
+#endif  // KUIPER_INFER_INCLUDE_UTILS_MATH_BLOCKED_HPP_
@@ -19,6 +19,7 @@
 
         __m128 fmath::exp_ps(__m128);
         __m256 fmath::exp_ps256(__m256);
+        __m512 fmath::exp_ps512(__m512);
         __m128 fmath::log_ps(__m128);
 
         double fmath::expd_v(double *, size_t n);
@@ -668,8 +669,24 @@ inline __m128 exp_ps(__m128 x)
 
   return t;
 }
-#ifdef __AVX2__
-inline __m256 exp_ps256(__m256 x) {
+/*
+        exp_ps256/exp_ps512 are also available without -mavx2/-mavx512f on gcc
+        and clang, they carry the target attribute and must only be called from
+        functions with the same target after checking the cpu at runtime
+*/
+#if defined(__AVX2__)
+#define FMATH_TARGET_AVX2
+#elif defined(__GNUC__)
+#define FMATH_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#if defined(__AVX512F__)
+#define FMATH_TARGET_AVX512
+#elif defined(__GNUC__)
+#define FMATH_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+#ifdef FMATH_TARGET_AVX2
+inline FMATH_TARGET_AVX2 __m256 exp_ps256(__m256 x) {
   using namespace local;
   const ExpVar<>& expVar = C<>::expVar;
 
@@ -722,6 +739,28 @@ inline __m256 exp_ps256(__m256 x) {
 }
 #endif
 
+#ifdef FMATH_TARGET_AVX512
+inline FMATH_TARGET_AVX512 __m512 exp_ps512(__m512 x) {
+  using namespace local;
+  const ExpVar<>& expVar = C<>::expVar;
+
+  x = _mm512_min_ps(x, _mm512_set1_ps(expVar.maxX[0]));
+  x = _mm512_max_ps(x, _mm512_set1_ps(expVar.minX[0]));
+  __m512i r = _mm512_cvtps_epi32(_mm512_mul_ps(x, _mm512_set1_ps(expVar.a[0])));
+  __m512 t = _mm512_sub_ps(
+      x, _mm512_mul_ps(_mm512_cvtepi32_ps(r), _mm512_set1_ps(expVar.b[0])));
+  t = _mm512_add_ps(t, _mm512_set1_ps(expVar.f1[0]));
+  __m512i v16 = _mm512_and_si512(r, _mm512_set1_epi32(expVar.mask_s[0]));
+  __m512i u16 = _mm512_add_epi32(r, _mm512_set1_epi32(expVar.i127s[0]));
+  u16 = _mm512_srli_epi32(u16, expVar.s);
+  u16 = _mm512_slli_epi32(u16, 23);
+  __m512i ti = _mm512_i32gather_epi32(v16, (const int*)expVar.tbl, 4);
+  __m512 t0 = _mm512_castsi512_ps(_mm512_or_si512(ti, u16));
+  t = _mm512_mul_ps(t, t0);
+  return t;
+}
+#endif
+
 inline float log(float x) {
   using namespace local;
   const LogVar<>& logVar = C<>::logVar;
@@ -29,6 +29,7 @@
 #include <mutex>
 #include <string>
 #include <utility>
+#include <vector>
 namespace kuiper_infer {
 namespace utils {
 using Time = std::chrono::steady_clock;
@@ -41,10 +42,25 @@ struct LayerTimeState {
         layer_name_(std::move(layer_name)),
         layer_type_(std::move(layer_type)) {}
 
-  long duration_time_;      // 时间消耗
+  long duration_time_;      // 时间消耗，单位为微秒
   std::mutex time_mutex_;   // 修改duration_time_时，所需要获取的锁
   std::string layer_name_;  // 层的名称
   std::string layer_type_;  // 层的类型
+  uint32_t call_count_ = 0;  // 层的执行次数
+  uint64_t flops_ = 0;       // 估算的浮点运算次数
+  uint64_t bytes_ = 0;       // 读写的输入、输出和权重的字节数
+};
+
+// 一个层的一次执行记录，用于导出chrome://tracing格式的文件
+struct LayerTraceEvent {
+  std::string layer_name_;  // 层的名称
+  std::string layer_type_;  // 层的类型
+  std::string shapes_;      // 层的输入和输出形状
+  long start_time_ = 0;     // 开始执行的时间，单位为微秒
+  long duration_time_ = 0;  // 时间消耗，单位为微秒
+  int thread_id_ = 0;       // 执行该层的线程
+  uint64_t flops_ = 0;      // 估算的浮点运算次数
+  uint64_t bytes_ = 0;      // 读写的字节数
 };
 
 // 各类型层的时间消耗记录map类型
@@ -69,11 +85,25 @@ class LayerTimeStatesSingleton {
    */
   static PtrLayerTimeStatesCollector SingletonInstance();
 
+  /**
+   * 记录一个层的一次执行
+   * @param trace_event 层的执行记录
+   */
+  static void AddTraceEvent(LayerTraceEvent trace_event);
+
+  /**
+   * 返回所有层的执行记录
+   * @return 按记录顺序排列的执行记录
+   */
+  static std::vector<LayerTraceEvent> TraceEvents();
+
  private:
   // 修改时间消耗记录map必须获取的锁
   static std::mutex mutex_;
   // 各类型层的时间消耗记录map
   static PtrLayerTimeStatesCollector time_states_collector_;
+  // 各个层的执行记录
+  static std::vector<LayerTraceEvent> trace_events_;
 };
 
 // 记录一个层的执行时间
@@ -84,6 +114,19 @@ class LayerTimeLogging {
    */
   explicit LayerTimeLogging(std::string layer_name, std::string layer_type);
 
+  /**
+   * 记录一个层的开始执行时间，以及该层的形状、计算量和访存量
+   * @param layer_name 层的名称
+   * @param layer_type 层的类型
+   * @param shapes 层的输入和输出形状
+   * @param flops 估算的浮点运算次数
+   * @param bytes 读写的字节数
+   * @param thread_id 执行该层的线程
+   */
+  explicit LayerTimeLogging(std::string layer_name, std::string layer_type,
+                            std::string shapes, uint64_t flops, uint64_t bytes,
+                            int thread_id = 0);
+
   /**
    * 记录一个层的结束执行时间
    */
@@ -94,11 +137,26 @@ class LayerTimeLogging {
    */
   static void SummaryLogging();
 
+  /**
+   * 将所有层的执行记录写入chrome://tracing格式的json文件
+   * @param trace_path 文件路径
+   * @return 是否写入成功
+   */
+  static bool WriteChromeTrace(const std::string& trace_path);
+
  private:
   // 层的名称
   std::string layer_name_;
   // 层的类型
   std::string layer_type_;
+  // 层的输入和输出形状
+  std::string shapes_;
+  // 估算的浮点运算次数
+  uint64_t flops_ = 0;
+  // 读写的字节数
+  uint64_t bytes_ = 0;
+  // 执行该层的线程
+  int thread_id_ = 0;
   // 层的开始执行时间
   std::chrono::steady_clock::time_point start_time_;
 };
@@ -0,0 +1,103 @@
+#include "utils/math/activation.hpp"
+#include <cmath>
+#include "utils/math/fmath.hpp"
+
+namespace kuiper_infer {
+using ActivationKernel = void (*)(const float*, float*, uint32_t);
+
+struct ActivationKernels {
+  ActivationIsa isa = ActivationIsa::kScalar;
+  ActivationKernel sigmoid = nullptr;
+  ActivationKernel silu = nullptr;
+};
+
+template <bool silu>
+static void ActivateScalar(const float* input, float* output, uint32_t size) {
+  for (uint32_t i = 0; i < size; ++i) {
+    const float x = input[i];
+    const float y = 1.f / (1.f + std::exp(-x));
+    output[i] = silu ? x * y : y;
+  }
+}
+
+#ifdef FMATH_TARGET_AVX2
+template <bool silu>
+__attribute__((target("avx2"))) static void ActivateAVX2(const float* input,
+                                                         float* output,
+                                                         uint32_t size) {
+  const __m256 one = _mm256_set1_ps(1.f);
+  const __m256 sign = _mm256_set1_ps(-0.f);
+  uint32_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const __m256 x = _mm256_loadu_ps(input + i);
+    const __m256 e = fmath::exp_ps256(_mm256_xor_ps(x, sign));
+    _mm256_storeu_ps(output + i,
+                     _mm256_div_ps(silu ? x : one, _mm256_add_ps(one, e)));
+  }
+  if (i < size) {
+    // 不足8个的元素使用掩码读写，保证结果和整块计算时一致
+    const __m256i mask =
+        _mm256_cmpgt_epi32(_mm256_set1_epi32(int32_t(size - i)),
+                           _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    const __m256 x = _mm256_maskload_ps(input + i, mask);
+    const __m256 e = fmath::exp_ps256(_mm256_xor_ps(x, sign));
+    _mm256_maskstore_ps(output + i, mask,
+                        _mm256_div_ps(silu ? x : one, _mm256_add_ps(one, e)));
+  }
+}
+#endif
+
+#ifdef FMATH_TARGET_AVX512
+template <bool silu>
+__attribute__((target("avx512f"))) static void ActivateAVX512(
+    const float* input, float* output, uint32_t size) {
+  const __m512 one = _mm512_set1_ps(1.f);
+  uint32_t i = 0;
+  for (; i < size; i += 16) {
+    const uint32_t remain = size - i;
+    const __mmask16 mask =
+        remain >= 16 ? __mmask16(0xffff) : __mmask16((1u << remain) - 1);
+    const __m512 x = _mm512_maskz_loadu_ps(mask, input + i);
+    const __m512 e = fmath::exp_ps512(_mm512_sub_ps(_mm512_setzero_ps(), x));
+    _mm512_mask_storeu_ps(output + i, mask,
+                          _mm512_div_ps(silu ? x : one, _mm512_add_ps(one, e)));
+  }
+}
+#endif
+
+static ActivationKernels SelectActivationKernels() {
+  ActivationKernels kernels;
+  kernels.sigmoid = ActivateScalar<false>;
+  kernels.silu = ActivateScalar<true>;
+#if defined(__GNUC__) && defined(FMATH_TARGET_AVX2) && \
+    defined(FMATH_TARGET_AVX512)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    kernels.isa = ActivationIsa::kAVX512;
+    kernels.sigmoid = ActivateAVX512<false>;
+    kernels.silu = ActivateAVX512<true>;
+  } else if (__builtin_cpu_supports("avx2")) {
+    kernels.isa = ActivationIsa::kAVX2;
+    kernels.sigmoid = ActivateAVX2<false>;
+    kernels.silu = ActivateAVX2<true>;
+  }
+#endif
+  return kernels;
+}
+
+static const ActivationKernels& GetActivationKernels() {
+  static const ActivationKernels kernels = SelectActivationKernels();
+  return kernels;
+}
+
+ActivationIsa ActivationDispatchIsa() { return GetActivationKernels().isa; }
+
+void ApplySigmoid(const float* input, float* output, uint32_t size) {
+  GetActivationKernels().sigmoid(input, output, size);
+}
+
+void ApplySiLU(const float* input, float* output, uint32_t size) {
+  GetActivationKernels().silu(input, output, size);
+}
+
+}  // namespace kuiper_infer
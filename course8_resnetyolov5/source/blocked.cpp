@@ -0,0 +1,196 @@
+#include "utils/math/blocked.hpp"
+#include <algorithm>
+#include <limits>
+#include "data/tensor.hpp"
+#include "utils/math/fmath.hpp"
+
+namespace kuiper_infer {
+using MaxPoolingKernel = void (*)(const float*, uint32_t, uint32_t, float*,
+                                  uint32_t, uint32_t, uint32_t, uint32_t,
+                                  uint32_t, uint32_t, uint32_t, uint32_t);
+using AddBiasKernel = void (*)(const float*, uint32_t, const float*, float*,
+                               uint32_t);
+using UpSampleKernel = void (*)(const float*, uint32_t, float*, uint32_t,
+                                uint32_t, uint32_t, uint32_t);
+
+struct BlockedKernels {
+  bool avx2 = false;
+  MaxPoolingKernel max_pooling = nullptr;
+  AddBiasKernel add_bias = nullptr;
+  UpSampleKernel upsample = nullptr;
+};
+
+static void MaxPoolingScalar(const float* input, uint32_t input_h,
+                             uint32_t input_w, float* output, uint32_t output_h,
+                             uint32_t output_w, uint32_t pooling_h,
+                             uint32_t pooling_w, uint32_t stride_h,
+                             uint32_t stride_w, uint32_t padding_h,
+                             uint32_t padding_w) {
+  for (uint32_t ow = 0; ow < output_w; ++ow) {
+    // 池化窗口和输入重叠的范围，填充的位置不会成为最大值
+    const int32_t w_start = int32_t(ow * stride_w) - int32_t(padding_w);
+    const int32_t w_begin = std::max(w_start, 0);
+    const int32_t w_end =
+        std::min(w_start + int32_t(pooling_w), int32_t(input_w));
+    for (uint32_t oh = 0; oh < output_h; ++oh) {
+      const int32_t h_start = int32_t(oh * stride_h) - int32_t(padding_h);
+      const int32_t h_begin = std::max(h_start, 0);
+      const int32_t h_end =
+          std::min(h_start + int32_t(pooling_h), int32_t(input_h));
+
+      float max_values[kChannelBlockSize];
+      std::fill(max_values, max_values + kChannelBlockSize,
+                std::numeric_limits<float>::lowest());
+      for (int32_t w = w_begin; w < w_end; ++w) {
+        for (int32_t h = h_begin; h < h_end; ++h) {
+          const float* pixel_ptr =
+              input + (h + w * input_h) * kChannelBlockSize;
+          for (uint32_t j = 0; j < kChannelBlockSize; ++j) {
+            max_values[j] = std::max(max_values[j], pixel_ptr[j]);
+          }
+        }
+      }
+      std::copy(max_values, max_values + kChannelBlockSize,
+                output + (oh + ow * output_h) * kChannelBlockSize);
+    }
+  }
+}
+
+static void AddBiasScalar(const float* result, uint32_t result_stride,
+                          const float* bias, float* output,
+                          uint32_t plane_size) {
+  for (uint32_t p = 0; p < plane_size; ++p) {
+    const float* result_ptr = result + size_t(p) * result_stride;
+    float* pixel_ptr = output + size_t(p) * kChannelBlockSize;
+    for (uint32_t j = 0; j < kChannelBlockSize; ++j) {
+      pixel_ptr[j] = result_ptr[j] + bias[j];
+    }
+  }
+}
+
+static void UpSampleScalar(const float* input, uint32_t input_h, float* output,
+                           uint32_t output_h, uint32_t output_w,
+                           uint32_t scale_h, uint32_t scale_w) {
+  for (uint32_t w = 0; w < output_w; ++w) {
+    const float* input_col_ptr =
+        input + (w / scale_w) * input_h * kChannelBlockSize;
+    float* output_col_ptr = output + w * output_h * kChannelBlockSize;
+    for (uint32_t h = 0; h < output_h; ++h) {
+      const float* pixel_ptr =
+          input_col_ptr + (h / scale_h) * kChannelBlockSize;
+      std::copy(pixel_ptr, pixel_ptr + kChannelBlockSize,
+                output_col_ptr + h * kChannelBlockSize);
+    }
+  }
+}
+
+#ifdef FMATH_TARGET_AVX2
+// 一个位置上的8个通道正好是一个__m256
+static_assert(kChannelBlockSize == 8, "The AVX2 blocked kernels need 8 lanes");
+
+__attribute__((target("avx2"))) static void MaxPoolingAVX2(
+    const float* input, uint32_t input_h, uint32_t input_w, float* output,
+    uint32_t output_h, uint32_t output_w, uint32_t pooling_h,
+    uint32_t pooling_w, uint32_t stride_h, uint32_t stride_w,
+    uint32_t padding_h, uint32_t padding_w) {
+  const __m256 lowest = _mm256_set1_ps(std::numeric_limits<float>::lowest());
+  for (uint32_t ow = 0; ow < output_w; ++ow) {
+    const int32_t w_start = int32_t(ow * stride_w) - int32_t(padding_w);
+    const int32_t w_begin = std::max(w_start, 0);
+    const int32_t w_end =
+        std::min(w_start + int32_t(pooling_w), int32_t(input_w));
+    for (uint32_t oh = 0; oh < output_h; ++oh) {
+      const int32_t h_start = int32_t(oh * stride_h) - int32_t(padding_h);
+      const int32_t h_begin = std::max(h_start, 0);
+      const int32_t h_end =
+          std::min(h_start + int32_t(pooling_h), int32_t(input_h));
+
+      __m256 max_value = lowest;
+      for (int32_t w = w_begin; w < w_end; ++w) {
+        const float* col_ptr = input + size_t(w) * input_h * kChannelBlockSize;
+        for (int32_t h = h_begin; h < h_end; ++h) {
+          max_value = _mm256_max_ps(
+              max_value, _mm256_loadu_ps(col_ptr + h * kChannelBlockSize));
+        }
+      }
+      _mm256_storeu_ps(output + (oh + ow * output_h) * kChannelBlockSize,
+                       max_value);
+    }
+  }
+}
+
+__attribute__((target("avx2"))) static void AddBiasAVX2(
+    const float* result, uint32_t result_stride, const float* bias,
+    float* output, uint32_t plane_size) {
+  const __m256 bias_value = _mm256_loadu_ps(bias);
+  for (uint32_t p = 0; p < plane_size; ++p) {
+    const __m256 result_value =
+        _mm256_loadu_ps(result + size_t(p) * result_stride);
+    _mm256_storeu_ps(output + size_t(p) * kChannelBlockSize,
+                     _mm256_add_ps(result_value, bias_value));
+  }
+}
+
+__attribute__((target("avx2"))) static void UpSampleAVX2(
+    const float* input, uint32_t input_h, float* output, uint32_t output_h,
+    uint32_t output_w, uint32_t scale_h, uint32_t scale_w) {
+  for (uint32_t w = 0; w < output_w; ++w) {
+    const float* input_col_ptr =
+        input + (w / scale_w) * input_h * kChannelBlockSize;
+    float* output_col_ptr = output + w * output_h * kChannelBlockSize;
+    for (uint32_t h = 0; h < output_h; ++h) {
+      const __m256 pixel = _mm256_loadu_ps(
+          input_col_ptr + (h / scale_h) * kChannelBlockSize);
+      _mm256_storeu_ps(output_col_ptr + h * kChannelBlockSize, pixel);
+    }
+  }
+}
+#endif
+
+static BlockedKernels SelectBlockedKernels() {
+  BlockedKernels kernels;
+  kernels.max_pooling = MaxPoolingScalar;
+  kernels.add_bias = AddBiasScalar;
+  kernels.upsample = UpSampleScalar;
+#if defined(__GNUC__) && defined(FMATH_TARGET_AVX2)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.avx2 = true;
+    kernels.max_pooling = MaxPoolingAVX2;
+    kernels.add_bias = AddBiasAVX2;
+    kernels.upsample = UpSampleAVX2;
+  }
+#endif
+  return kernels;
+}
+
+static const BlockedKernels& GetBlockedKernels() {
+  static const BlockedKernels kernels = SelectBlockedKernels();
+  return kernels;
+}
+
+bool BlockedKernelsUseAVX2() { return GetBlockedKernels().avx2; }
+
+void BlockedMaxPooling(const float* input, uint32_t input_h, uint32_t input_w,
+                       float* output, uint32_t output_h, uint32_t output_w,
+                       uint32_t pooling_h, uint32_t pooling_w,
+                       uint32_t stride_h, uint32_t stride_w,
+                       uint32_t padding_h, uint32_t padding_w) {
+  GetBlockedKernels().max_pooling(input, input_h, input_w, output, output_h,
+                                  output_w, pooling_h, pooling_w, stride_h,
+                                  stride_w, padding_h, padding_w);
+}
+
+void BlockedAddBias(const float* result, uint32_t result_stride,
+                    const float* bias, float* output, uint32_t plane_size) {
+  GetBlockedKernels().add_bias(result, result_stride, bias, output, plane_size);
+}
+
+void BlockedUpSampleNearest(const float* input, uint32_t input_h, float* output,
+                            uint32_t output_h, uint32_t output_w,
+                            uint32_t scale_h, uint32_t scale_w) {
+  GetBlockedKernels().upsample(input, input_h, output, output_h, output_w,
+                               scale_h, scale_w);
+}
+
+}  // namespace kuiper_infer
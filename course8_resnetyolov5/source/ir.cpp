@@ -410,6 +410,29 @@ Attribute::Attribute(const std::initializer_list<int>& _shape, const std::vector
     }
 }
 
+// the attribute bytes live either in data or in the memory mapped bin file
+static const char* attribute_bytes(const Attribute& a)
+{
+    if (a.mapped_data)
+        return a.mapped_data.get();
+
+    return a.data.data();
+}
+
+static size_t attribute_bytesize(const Attribute& a)
+{
+    if (!a.mapped_data)
+        return a.data.size();
+
+    size_t size = 1;
+    for (int i : a.shape)
+    {
+        size *= i;
+    }
+
+    return size * type_to_elemsize(a.type);
+}
+
 bool operator==(const Attribute& lhs, const Attribute& rhs)
 {
     if (lhs.type != rhs.type)
@@ -421,7 +444,11 @@ bool operator==(const Attribute& lhs, const Attribute& rhs)
     if (lhs.shape != rhs.shape)
         return false;
 
-    if (lhs.data != rhs.data)
+    const size_t bytesize = attribute_bytesize(lhs);
+    if (bytesize != attribute_bytesize(rhs))
+        return false;
+
+    if (bytesize != 0 && memcmp(attribute_bytes(lhs), attribute_bytes(rhs), bytesize) != 0)
         return false;
 
     return true;
@@ -456,9 +483,14 @@ Attribute operator+(const Attribute& a, const Attribute& b)
     c.shape = a.shape;
     c.shape[0] += b.shape[0]; // concat the first dim
 
-    c.data.resize(a.data.size() + b.data.size());
-    memcpy(c.data.data(), a.data.data(), a.data.size());
-    memcpy(c.data.data() + a.data.size(), b.data.data(), b.data.size());
+    const size_t a_bytesize = attribute_bytesize(a);
+    const size_t b_bytesize = attribute_bytesize(b);
+
+    c.data.resize(a_bytesize + b_bytesize);
+    if (a_bytesize != 0)
+        memcpy(c.data.data(), attribute_bytes(a), a_bytesize);
+    if (b_bytesize != 0)
+        memcpy(c.data.data() + a_bytesize, attribute_bytes(b), b_bytesize);
 
     return c;
 }
@@ -637,7 +669,7 @@ static void load_shape(Operator* op, const std::string& key, const std::string&
     }
 }
 
-static void load_attribute(Operator* op, const std::string& key, const std::string& value, StoreZipReader& szr)
+static void load_attribute(Operator* op, const std::string& key, const std::string& value, StoreZipReader& szr, bool map_weights)
 {
     Attribute& a = op->attrs[key];
 
@@ -689,11 +721,23 @@ static void load_attribute(Operator* op, const std::string& key, const std::stri
         fprintf(stderr, "file size not match expect %lu but got %lu\n", bytesize, filesize);
     }
 
+    if (map_weights && filesize == bytesize)
+    {
+        // reference the stored file in place when it is aligned to its element type,
+        // otherwise fall back to reading a copy
+        std::shared_ptr<const char> mapped_data = szr.map_file(filename);
+        if (mapped_data && (size_t)mapped_data.get() % type_to_elemsize(a.type) == 0)
+        {
+            a.mapped_data = mapped_data;
+            return;
+        }
+    }
+
     a.data.resize(bytesize);
     szr.read_file(filename, (char*)a.data.data());
 }
 
-int Graph::load(const std::string& parampath, const std::string& binpath)
+int Graph::load(const std::string& parampath, const std::string& binpath, bool map_weights)
 {
     std::ifstream is(parampath, std::ios::in | std::ios::binary);
     if (!is.good())
@@ -778,7 +822,7 @@ int Graph::load(const std::string& parampath, const std::string& binpath)
             if (key[0] == '@')
             {
                 // attribute
-                load_attribute(op, key.substr(1), value, szr);
+                load_attribute(op, key.substr(1), value, szr, map_weights);
             }
             else if (key[0] == '$')
             {
@@ -917,7 +961,7 @@ int Graph::save(const std::string& parampath, const std::string& binpath)
             fprintf(paramfp, type_to_string(attr.type));
 
             std::string filename = op->name + "." + it.first;
-            szw.write_file(filename, attr.data.data(), attr.data.size());
+            szw.write_file(filename, attribute_bytes(attr), attribute_bytesize(attr));
         }
 
         if (op->inputnames.size() == op->inputs.size())
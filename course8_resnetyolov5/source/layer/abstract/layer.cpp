@@ -48,6 +48,14 @@ void Layer::set_weights(
   LOG(FATAL) << this->layer_name_ << " layer not implement yet!";
 }
 
+void Layer::set_weights(const float* weights, uint32_t size) {
+  LOG(FATAL) << this->layer_name_ << " layer not implement yet!";
+}
+
+void Layer::set_bias(const float* bias, uint32_t size) {
+  LOG(FATAL) << this->layer_name_ << " layer not implement yet!";
+}
+
 InferStatus Layer::Forward(
     const std::vector<std::shared_ptr<Tensor<float>>>& inputs,
     std::vector<std::shared_ptr<Tensor<float>>>& outputs) {
@@ -89,4 +97,12 @@ void Layer::set_runtime_operator(
   this->runtime_operator_ = runtime_operator;
 }
 
+size_t Layer::workspace_size() const { return 0; }
+
+void Layer::set_workspace(const std::shared_ptr<arma::fvec>& workspace) {
+  this->workspace_ = workspace;
+}
+
+std::map<std::string, arma::fmat> Layer::packed_weights() const { return {}; }
+
 }  // namespace kuiper_infer
\ No newline at end of file
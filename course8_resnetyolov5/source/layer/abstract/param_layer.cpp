@@ -84,7 +84,15 @@ void ParamLayer::set_bias(
 }
 
 void ParamLayer::set_weights(const std::vector<float>& weights) {
-  const uint32_t elem_size = weights.size();
+  this->set_weights(weights.data(), weights.size());
+}
+
+void ParamLayer::set_bias(const std::vector<float>& bias) {
+  this->set_bias(bias.data(), bias.size());
+}
+
+void ParamLayer::set_weights(const float* weights, uint32_t size) {
+  const uint32_t elem_size = size;
 
   uint32_t weight_size = 0;
   const uint32_t batch_size = this->weights_.size();
@@ -97,15 +105,12 @@ void ParamLayer::set_weights(const std::vector<float>& weights) {
   const uint32_t blob_size = elem_size / batch_size;
   for (uint32_t idx = 0; idx < batch_size; ++idx) {
     const uint32_t start_offset = idx * blob_size;
-    const uint32_t end_offset = start_offset + blob_size;
-    const auto& sub_values = std::vector<float>{weights.begin() + start_offset,
-                                                weights.begin() + end_offset};
-    this->weights_.at(idx)->Fill(sub_values);
+    this->weights_.at(idx)->Fill(weights + start_offset, blob_size);
   }
 }
 
-void ParamLayer::set_bias(const std::vector<float>& bias) {
-  const uint32_t elem_size = bias.size();
+void ParamLayer::set_bias(const float* bias, uint32_t size) {
+  const uint32_t elem_size = size;
 
   uint32_t bias_size = 0;
   const uint32_t batch_size = this->bias_.size();
@@ -119,10 +124,7 @@ void ParamLayer::set_bias(const std::vector<float>& bias) {
   const uint32_t blob_size = elem_size / batch_size;
   for (uint32_t idx = 0; idx < batch_size; ++idx) {
     const uint32_t start_offset = idx * blob_size;
-    const uint32_t end_offset = start_offset + blob_size;
-    const auto& sub_values = std::vector<float>{bias.begin() + start_offset,
-                                                bias.begin() + end_offset};
-    this->bias_.at(idx)->Fill(sub_values);
+    this->bias_.at(idx)->Fill(bias + start_offset, blob_size);
   }
 }
 
@@ -100,6 +100,7 @@ InferStatus CatLayer::Forward(
       if (output == nullptr || output->empty()) {
         output = std::make_shared<Tensor<float>>(in_channels * packet_size,
                                                  rows, cols);
+        output->set_layout(input->layout());
         outputs.at(i) = output;
       }
       CHECK(output->channels() == in_channels * packet_size &&
@@ -107,9 +108,18 @@ InferStatus CatLayer::Forward(
           << "The output tensor array in the cat layer "
              "has an incorrectly sized tensor "
           << i << " th";
+      // 分块排布时每个输入的通道数都是块大小的整数倍，
+      // 输入在输出张量中同样是一段连续的块，可以和NCHW排布一样整体复制
+      CHECK(output->layout() == input->layout())
+          << "The input and output tensor layout of the cat layer do not match "
+          << j << " th";
       const uint32_t plane_size = rows * cols;
-      memcpy(output->raw_ptr(start_channel * plane_size), input->raw_ptr(),
-             sizeof(float) * plane_size * in_channels);
+      // 计算图会让前驱节点直接写入输出张量，此时输入已经在输出张量中
+      float* output_ptr = output->raw_ptr(start_channel * plane_size);
+      if (output_ptr != input->raw_ptr()) {
+        memcpy(output_ptr, input->raw_ptr(),
+               sizeof(float) * plane_size * in_channels);
+      }
       start_channel += input->channels();
     }
   }
@@ -23,11 +23,48 @@
 
 #include "convolution.hpp"
 #include <glog/logging.h>
+#include <algorithm>
+#include <cmath>
 #include "data/tensor_util.hpp"
 #include "layer/abstract/layer_factory.hpp"
 #include "runtime/runtime_ir.hpp"
+#include "utils/math/activation.hpp"
+#include "utils/math/blocked.hpp"
 
 namespace kuiper_infer {
+static inline float ConvActivate(ConvActivation activation, float value) {
+  switch (activation) {
+    case ConvActivation::kReLU:
+      return value > 0.f ? value : 0.f;
+    case ConvActivation::kSiLU:
+      return value / (1.f + std::exp(-value));
+    default:
+      return value;
+  }
+}
+
+/**
+ * 对一段连续的内存原地计算激活函数，SiLU使用向量化的实现
+ * @param activation 激活函数的类型
+ * @param data 需要计算激活函数的数据
+ * @param size 元素的数量
+ */
+static void ConvActivateInplace(ConvActivation activation, float* data,
+                                uint32_t size) {
+  switch (activation) {
+    case ConvActivation::kReLU:
+      for (uint32_t j = 0; j < size; ++j) {
+        data[j] = data[j] > 0.f ? data[j] : 0.f;
+      }
+      break;
+    case ConvActivation::kSiLU:
+      ApplySiLU(data, data, size);
+      break;
+    default:
+      break;
+  }
+}
+
 ConvolutionLayer::ConvolutionLayer(uint32_t output_channel, uint32_t in_channel,
                                    uint32_t kernel_h, uint32_t kernel_w,
                                    uint32_t padding_h, uint32_t padding_w,
@@ -39,14 +76,59 @@ ConvolutionLayer::ConvolutionLayer(uint32_t output_channel, uint32_t in_channel,
       padding_h_(padding_h),
       padding_w_(padding_w),
       stride_h_(stride_h),
-      stride_w_(stride_w) {
+      stride_w_(stride_w),
+      kernel_h_(kernel_h),
+      kernel_w_(kernel_w) {
   if (groups != 1) {
     in_channel /= groups;
   }
+  this->kernel_count_ = output_channel;
+  this->kernel_c_ = in_channel;
   this->InitWeightParam(output_channel, in_channel, kernel_h, kernel_w);
   if (use_bias_) {
     this->InitBiasParam(output_channel, 1, 1, 1);
   }
+
+  // 1x1且没有填充的卷积不需要展开输入
+  if (IsAlgorithmSupported(ConvAlgorithm::kPointwise)) {
+    algorithm_ = ConvAlgorithm::kPointwise;
+  } else if (IsAlgorithmSupported(ConvAlgorithm::kPointwiseStrided)) {
+    algorithm_ = ConvAlgorithm::kPointwiseStrided;
+  } else if (IsAlgorithmSupported(ConvAlgorithm::kWinograd) &&
+             in_channel >= 16 && output_channel >= 16) {
+    // 通道数较少时输入和输出变换的开销会超过矩阵乘节省的计算量
+    algorithm_ = ConvAlgorithm::kWinograd;
+  } else {
+    algorithm_ = ConvAlgorithm::kIm2Col;
+  }
+}
+
+bool ConvolutionLayer::IsAlgorithmSupported(ConvAlgorithm algorithm) const {
+  switch (algorithm) {
+    case ConvAlgorithm::kPointwise:
+      return kernel_h_ == 1 && kernel_w_ == 1 && padding_h_ == 0 &&
+             padding_w_ == 0 && stride_h_ == 1 && stride_w_ == 1;
+    case ConvAlgorithm::kPointwiseStrided:
+      return kernel_h_ == 1 && kernel_w_ == 1 && padding_h_ == 0 &&
+             padding_w_ == 0;
+    case ConvAlgorithm::kWinograd:
+      return kernel_h_ == 3 && kernel_w_ == 3 && stride_h_ == 1 &&
+             stride_w_ == 1 && groups_ == 1;
+    default:
+      return true;
+  }
+}
+
+void ConvolutionLayer::set_algorithm(ConvAlgorithm algorithm) {
+  CHECK(IsAlgorithmSupported(algorithm))
+      << "The convolution layer does not support this algorithm";
+  CHECK(!this->weights_.empty())
+      << "The convolution layer created from a plan has no raw kernels to "
+         "repack for another algorithm";
+  this->algorithm_ = algorithm;
+  // 卷积核的排布和计算方法相关，需要在下一次推理时重新初始化
+  this->kernel_matrix_arr_.clear();
+  this->winograd_kernel_arr_.clear();
 }
 
 InferStatus ConvolutionLayer::Forward(
@@ -63,13 +145,14 @@ InferStatus ConvolutionLayer::Forward(
     return InferStatus::kInferFailedInputOutSizeMatchError;
   }
 
-  if (weights_.empty()) {
+  // 从计划文件创建时只保留排布后的卷积核，不再持有原始的卷积核
+  if (weights_.empty() && kernel_matrix_arr_.empty()) {
     LOG(ERROR) << "The number of kernel matrix in the convolution layer should "
                   "be greater than zero";
     return InferStatus::kInferFailedWeightParameterError;
   }
 
-  if (this->use_bias_ && this->bias_.size() != this->weights_.size()) {
+  if (this->use_bias_ && this->bias_.size() != this->kernel_count_) {
     LOG(ERROR) << "The number of kernel matrix and bias matrix do not match";
     return InferStatus::kInferFailedBiasParameterError;
   }
@@ -80,37 +163,27 @@ InferStatus ConvolutionLayer::Forward(
     return InferStatus::kInferFailedStrideParameterError;
   }
 
-  const uint32_t kernel_count = this->weights_.size();
-  const uint32_t kernel_h = this->weights_.at(0)->rows();
-  const uint32_t kernel_w = this->weights_.at(0)->cols();
-  const uint32_t kernel_c = this->weights_.at(0)->channels();
-  const uint32_t row_len = kernel_h * kernel_w;
+  const uint32_t kernel_count = this->kernel_count_;
+  const uint32_t kernel_h = this->kernel_h_;
+  const uint32_t kernel_w = this->kernel_w_;
+  const uint32_t kernel_c = this->kernel_c_;
   CHECK(kernel_h > 0 && kernel_w > 0 && kernel_c > 0)
       << "The size of kernel matrix in the convolution layer should be greater "
          "than zero";
 
-  for (uint32_t k = 0; k < kernel_count; ++k) {
+  for (uint32_t k = 0; k < this->weights_.size(); ++k) {
     const std::shared_ptr<Tensor<float>>& kernel = this->weights_.at(k);
     CHECK(kernel->rows() == kernel_h);
     CHECK(kernel->cols() == kernel_w);
     CHECK(kernel->channels() == kernel_c);
   }
-  const uint32_t kernel_count_group = kernel_count / groups_;
   const uint32_t batch_size = inputs.size();
 
   if (kernel_matrix_arr_.empty()) {
     this->InitIm2ColWeight();
   }
-
-  if (!kernel_matrix_arr_.empty()) {
-    if (groups_ == 1) {
-      CHECK(kernel_matrix_arr_.size() == kernel_count_group)
-          << "The number of kernel matrix and kernel_count_group do not match";
-    } else {
-      CHECK(kernel_matrix_arr_.size() == kernel_count)
-          << "The number of kernel matrix and kernel_count do not match";
-    }
-  }
+  CHECK(kernel_matrix_arr_.size() == groups_)
+      << "The number of kernel matrix and groups do not match";
 
   for (uint32_t i = 0; i < batch_size; ++i) {
     const std::shared_ptr<Tensor<float>>& input = inputs.at(i);
@@ -145,53 +218,238 @@ InferStatus ConvolutionLayer::Forward(
     CHECK(input_c_group == kernel_c) << "The number of channel for the kernel "
                                         "matrix and input tensor do not match";
 
-    for (uint32_t g = 0; g < groups_; ++g) {
-      const auto& input_matrix =
-          Im2Col(input, kernel_w, kernel_h, input->cols(), input->rows(),
-                 input_c_group, g, row_len, col_len);
-      std::shared_ptr<Tensor<float>> output_tensor = outputs.at(i);
-      if (output_tensor == nullptr || output_tensor->empty()) {
-        output_tensor =
-            std::make_shared<Tensor<float>>(kernel_count, output_h, output_w);
-        outputs.at(i) = output_tensor;
-      }
+    std::shared_ptr<Tensor<float>> output_tensor = outputs.at(i);
+    if (output_tensor == nullptr || output_tensor->empty()) {
+      output_tensor =
+          std::make_shared<Tensor<float>>(kernel_count, output_h, output_w);
+      outputs.at(i) = output_tensor;
+    }
 
-      CHECK(output_tensor->rows() == output_h &&
-            output_tensor->cols() == output_w &&
-            output_tensor->channels() == kernel_count)
-          << "The output tensor array in the convolution layer has an "
-             "incorrectly sized tensor "
-          << i << "th";
+    CHECK(output_tensor->rows() == output_h &&
+          output_tensor->cols() == output_w &&
+          output_tensor->channels() == kernel_count)
+        << "The output tensor array in the convolution layer has an "
+           "incorrectly sized tensor "
+        << i << "th";
+  }
 
-      const uint32_t kernel_count_group_start = kernel_count_group * g;
-      for (uint32_t k = 0; k < kernel_count_group; ++k) {
-        arma::frowvec kernel;
-        if (groups_ == 1) {
-          kernel = kernel_matrix_arr_.at(k);
-        } else {
-          kernel = kernel_matrix_arr_.at(kernel_count_group_start + k);
+  // 输出较小时把多个样本的输入矩阵拼接在一起，批次合并到矩阵乘的N维度，
+  // 一次矩阵乘完成多个样本的计算
+  const uint32_t batch_fold = this->BatchFold(inputs, outputs);
+  for (uint32_t i = 0; i < batch_size; i += batch_fold) {
+    const uint32_t samples = std::min(batch_fold, batch_size - i);
+    if (samples == 1) {
+      this->ConvSingle(inputs.at(i), outputs.at(i));
+    } else {
+      this->ConvBatch(inputs, outputs, i, samples);
+    }
+  }
+  return InferStatus::kInferSuccess;
+}
+
+void ConvolutionLayer::ConvSingle(const sftensor& input,
+                                  const sftensor& output_tensor) {
+  const uint32_t kernel_count_group = this->kernel_count_ / groups_;
+  const uint32_t kernel_h = this->kernel_h_;
+  const uint32_t kernel_w = this->kernel_w_;
+  const uint32_t row_len = kernel_h * kernel_w;
+  const uint32_t input_c_group = input->channels() / groups_;
+  const uint32_t output_h = output_tensor->rows();
+  const uint32_t output_w = output_tensor->cols();
+  const uint32_t col_len = output_h * output_w;
+
+  // 分块排布的输出先由矩阵乘写入临时空间，再按块排列到输出张量中，
+  // Winograd的输出变换逐个元素写入，不需要额外的空间
+  const bool blocked_output =
+      output_tensor->layout() == TensorLayout::kNCHW8c &&
+      algorithm_ != ConvAlgorithm::kWinograd;
+  const size_t gemm_workspace_size =
+      blocked_output ? size_t(kernel_count_group) * col_len : 0;
+
+  switch (algorithm_) {
+    case ConvAlgorithm::kWinograd: {
+      WinogradF23(input, output_tensor, output_h, output_w);
+      break;
+    }
+    case ConvAlgorithm::kPointwise:
+      if (input->layout() == TensorLayout::kNCHW) {
+        float* gemm_workspace =
+            blocked_output ? Im2ColWorkspace(gemm_workspace_size) : nullptr;
+        // 输入张量中每个通道是连续存放的，可以直接作为
+        // (output_h * output_w) x input_c_group 的矩阵参与计算
+        for (uint32_t g = 0; g < groups_; ++g) {
+          const arma::fmat input_matrix(
+              input->matrix_raw_ptr(g * input_c_group), col_len,
+              input_c_group, false, true);
+          ConvGemmBias(input_matrix, output_tensor, g, kernel_count_group,
+                       output_w, output_h, false, gemm_workspace);
         }
-        ConvGemmBias(input_matrix, output_tensor, g, k, kernel_count_group,
-                     kernel, output_w, output_h);
+        break;
+      }
+      // 分块排布的输入和带步长的1x1卷积一样，需要先收集到临时空间中
+      [[fallthrough]];
+    case ConvAlgorithm::kPointwiseStrided: {
+      const size_t gather_size = size_t(input_c_group) * col_len;
+      float* workspace_ptr =
+          Im2ColWorkspace(gather_size + gemm_workspace_size);
+      float* gemm_workspace =
+          blocked_output ? workspace_ptr + gather_size : nullptr;
+      arma::fmat input_matrix(workspace_ptr, col_len, input_c_group, false,
+                              true);
+      for (uint32_t g = 0; g < groups_; ++g) {
+        PointwiseStridedGather(input, input_c_group, g, output_h, output_w,
+                               input_matrix);
+        ConvGemmBias(input_matrix, output_tensor, g, kernel_count_group,
+                     output_w, output_h, false, gemm_workspace);
+      }
+      break;
+    }
+    default: {
+      // im2col的结果存放在临时空间中，避免每次计算都重新申请内存
+      const size_t im2col_size = size_t(input_c_group) * row_len * col_len;
+      float* workspace_ptr =
+          Im2ColWorkspace(im2col_size + gemm_workspace_size);
+      float* gemm_workspace =
+          blocked_output ? workspace_ptr + im2col_size : nullptr;
+      arma::fmat input_matrix(workspace_ptr, input_c_group * row_len,
+                              col_len, false, true);
+      for (uint32_t g = 0; g < groups_; ++g) {
+        Im2Col(input, kernel_w, kernel_h, input->cols(), input->rows(),
+               input_c_group, g, row_len, col_len, input_matrix);
+        // 一个group内的所有卷积核通过一次矩阵乘完成计算
+        ConvGemmBias(input_matrix, output_tensor, g, kernel_count_group,
+                     output_w, output_h, true, gemm_workspace);
+      }
+      break;
+    }
+  }
+}
+
+void ConvolutionLayer::ConvBatch(const std::vector<sftensor>& inputs,
+                                 const std::vector<sftensor>& outputs,
+                                 uint32_t start, uint32_t samples) {
+  const sftensor& first_input = inputs.at(start);
+  const sftensor& first_output = outputs.at(start);
+  const uint32_t kernel_count_group = this->kernel_count_ / groups_;
+  const uint32_t kernel_h = this->kernel_h_;
+  const uint32_t kernel_w = this->kernel_w_;
+  const uint32_t row_len = kernel_h * kernel_w;
+  const uint32_t input_c_group = first_input->channels() / groups_;
+  const uint32_t output_h = first_output->rows();
+  const uint32_t output_w = first_output->cols();
+  const uint32_t col_len = output_h * output_w;
+  const size_t batch_len = size_t(samples) * col_len;
+
+  // im2col的矩阵按列拼接为(input_c_group * row_len) x batch_len，
+  // 1x1卷积收集的矩阵按行拼接为batch_len x input_c_group
+  const bool is_im2col_matrix = algorithm_ == ConvAlgorithm::kIm2Col;
+  const size_t input_matrix_size =
+      size_t(input_c_group) * (is_im2col_matrix ? row_len : 1) * batch_len;
+  const size_t gemm_size = size_t(kernel_count_group) * batch_len;
+  float* workspace_ptr = Im2ColWorkspace(input_matrix_size + gemm_size);
+  arma::fmat input_matrix =
+      is_im2col_matrix
+          ? arma::fmat(workspace_ptr, input_c_group * row_len, batch_len,
+                       false, true)
+          : arma::fmat(workspace_ptr, batch_len, input_c_group, false, true);
+  float* gemm_workspace = workspace_ptr + input_matrix_size;
+  const bool blocked_output = first_output->layout() == TensorLayout::kNCHW8c;
+
+  for (uint32_t g = 0; g < groups_; ++g) {
+    for (uint32_t s = 0; s < samples; ++s) {
+      const sftensor& input = inputs.at(start + s);
+      if (is_im2col_matrix) {
+        Im2Col(input, kernel_w, kernel_h, input->cols(), input->rows(),
+               input_c_group, g, row_len, col_len, input_matrix, s * col_len);
+      } else {
+        PointwiseStridedGather(input, input_c_group, g, output_h, output_w,
+                               input_matrix, s * col_len);
+      }
+    }
+
+    const arma::fmat& kernel = this->kernel_matrix_arr_.at(g);
+    CHECK(kernel.n_rows == kernel_count_group &&
+          kernel.n_cols == (is_im2col_matrix ? input_matrix.n_rows
+                                             : input_matrix.n_cols))
+        << "The kernel matrix and the input matrix of the convolution layer "
+           "do not match";
+    if (blocked_output) {
+      // 每个样本的结果是output_t中连续的col_len列
+      arma::fmat output_t(gemm_workspace, kernel_count_group, batch_len, false,
+                          true);
+      if (is_im2col_matrix) {
+        output_t = kernel * input_matrix;
+      } else {
+        output_t = kernel * input_matrix.t();
+      }
+      for (uint32_t s = 0; s < samples; ++s) {
+        const arma::fmat sample_t(output_t.colptr(s * col_len),
+                                  kernel_count_group, col_len, false, true);
+        this->PackBlockedOutput(sample_t, outputs.at(start + s), g);
+      }
+    } else {
+      // 每个样本的结果是output中连续的col_len行，按通道复制到输出张量中
+      arma::fmat output(gemm_workspace, batch_len, kernel_count_group, false,
+                        true);
+      if (is_im2col_matrix) {
+        output = input_matrix.t() * kernel.t();
+      } else {
+        output = input_matrix * kernel.t();
+      }
+      for (uint32_t s = 0; s < samples; ++s) {
+        arma::fmat sample_output(
+            outputs.at(start + s)->matrix_raw_ptr(g * kernel_count_group),
+            col_len, kernel_count_group, false, true);
+        sample_output = output.rows(s * col_len, (s + 1) * col_len - 1);
+        this->BiasActivate(sample_output, g);
       }
     }
   }
-  return InferStatus::kInferSuccess;
 }
 
-arma::fmat ConvolutionLayer::Im2Col(sftensor input, uint32_t kernel_w,
-                                    uint32_t kernel_h, uint32_t input_w,
-                                    uint32_t input_h, uint32_t input_c_group,
-                                    uint32_t group, uint32_t row_len,
-                                    uint32_t col_len) const {
-  arma::fmat input_matrix(input_c_group * row_len, col_len);
+uint32_t ConvolutionLayer::BatchFoldSize(uint32_t batch_size,
+                                         uint32_t col_len) const {
+  if (batch_size <= 1 || col_len == 0 ||
+      algorithm_ == ConvAlgorithm::kWinograd) {
+    return 1;
+  }
+  return std::max(1u, std::min(batch_size, kBatchFoldColumns / col_len));
+}
+
+uint32_t ConvolutionLayer::BatchFold(
+    const std::vector<sftensor>& inputs,
+    const std::vector<sftensor>& outputs) const {
+  const sftensor& first_input = inputs.front();
+  const sftensor& first_output = outputs.front();
+  for (uint32_t i = 1; i < inputs.size(); ++i) {
+    if (inputs.at(i)->shapes() != first_input->shapes() ||
+        inputs.at(i)->layout() != first_input->layout() ||
+        outputs.at(i)->layout() != first_output->layout()) {
+      return 1;
+    }
+  }
+  return BatchFoldSize(inputs.size(),
+                       first_output->rows() * first_output->cols());
+}
+
+void ConvolutionLayer::Im2Col(sftensor input, uint32_t kernel_w,
+                              uint32_t kernel_h, uint32_t input_w,
+                              uint32_t input_h, uint32_t input_c_group,
+                              uint32_t group, uint32_t row_len,
+                              uint32_t col_len, arma::fmat& input_matrix,
+                              uint32_t col_offset) const {
+  CHECK(input_matrix.n_rows == input_c_group * row_len &&
+        input_matrix.n_cols >= col_offset + col_len)
+      << "The im2col matrix of the convolution layer has a wrong size";
   const uint32_t input_padded_h = input_h + 2 * padding_h_;
   const uint32_t input_padded_w = input_w + 2 * padding_w_;
   const float padding_value = 0.f;
+  // 分块排布时同一个通道中相邻的元素间隔kChannelBlockSize
+  const uint32_t pixel_stride = input->pixel_stride();
   for (uint32_t ic = 0; ic < input_c_group; ++ic) {
     float* input_channel_ptr =
-        input->matrix_raw_ptr(ic + group * input_c_group);
-    uint32_t current_col = 0;
+        input->channel_raw_ptr(ic + group * input_c_group);
+    uint32_t current_col = col_offset;
     uint32_t channel_row = ic * row_len;
     for (uint32_t w = 0; w < input_padded_w - kernel_w + 1; w += stride_w_) {
       for (uint32_t r = 0; r < input_padded_h - kernel_h + 1; r += stride_h_) {
@@ -205,7 +463,8 @@ arma::fmat ConvolutionLayer::Im2Col(sftensor input, uint32_t kernel_w,
                 (kh + r < input_h + padding_h_ &&
                  kw + w < input_w + padding_w_)) {
               float* region_ptr =
-                  input_channel_ptr + region_w + (r + kh - padding_h_);
+                  input_channel_ptr +
+                  (region_w + (r + kh - padding_h_)) * pixel_stride;
               *input_matrix_ptr = *region_ptr;
             } else {
               *input_matrix_ptr = padding_value;  // only support zero mode
@@ -216,32 +475,222 @@ arma::fmat ConvolutionLayer::Im2Col(sftensor input, uint32_t kernel_w,
       }
     }
   }
-  return input_matrix;
 }
 
-void ConvolutionLayer::ConvGemmBias(
-    const arma::fmat& input_matrix, sftensor output_tensor, uint32_t group,
-    uint32_t kernel_index, uint32_t kernel_count_group,
-    const arma::frowvec& kernel, uint32_t output_w, uint32_t output_h) const {
+void ConvolutionLayer::PointwiseStridedGather(sftensor input,
+                                              uint32_t input_c_group,
+                                              uint32_t group, uint32_t output_h,
+                                              uint32_t output_w,
+                                              arma::fmat& input_matrix,
+                                              uint32_t row_offset) const {
+  CHECK(input_matrix.n_rows >= row_offset + output_h * output_w &&
+        input_matrix.n_cols == input_c_group)
+      << "The gather matrix of the convolution layer has a wrong size";
+  const uint32_t input_h = input->rows();
+  const uint32_t pixel_stride = input->pixel_stride();
+  for (uint32_t ic = 0; ic < input_c_group; ++ic) {
+    const float* input_channel_ptr =
+        input->channel_raw_ptr(ic + group * input_c_group);
+    float* input_matrix_ptr = input_matrix.colptr(ic) + row_offset;
+    for (uint32_t w = 0; w < output_w; ++w) {
+      const float* input_col_ptr =
+          input_channel_ptr + w * stride_w_ * input_h * pixel_stride;
+      for (uint32_t h = 0; h < output_h; ++h) {
+        *input_matrix_ptr = *(input_col_ptr + h * stride_h_ * pixel_stride);
+        input_matrix_ptr += 1;
+      }
+    }
+  }
+}
+
+float* ConvolutionLayer::Im2ColWorkspace(size_t workspace_size) {
+  // 优先使用计算图分配的共享临时空间，空间不足时(例如单独使用该层)由层自己持有
+  if (this->workspace_ == nullptr || this->workspace_->n_elem < workspace_size) {
+    this->workspace_ = std::make_shared<arma::fvec>(workspace_size);
+  }
+  return this->workspace_->memptr();
+}
+
+size_t ConvolutionLayer::workspace_size() const {
+  if (this->runtime_operator_.expired()) {
+    return 0;
+  }
+  const auto& runtime_operator = this->runtime_operator_.lock();
+  if (runtime_operator->input_operands_seq.empty()) {
+    return 0;
+  }
+  const auto& input_operand = runtime_operator->input_operands_seq.front();
+  const std::vector<int32_t>& input_shapes = input_operand->shapes;
+  if (input_shapes.size() != 4) {
+    return 0;
+  }
+  const auto& output_operand = runtime_operator->output_operands;
+  const bool blocked_input = input_operand->layout == TensorLayout::kNCHW8c;
+  const bool blocked_output = output_operand != nullptr &&
+                              output_operand->layout == TensorLayout::kNCHW8c;
+
+  const uint32_t kernel_h = this->kernel_h_;
+  const uint32_t kernel_w = this->kernel_w_;
+  const uint32_t input_c_group = input_shapes.at(1) / groups_;
+  const int32_t output_h =
+      (input_shapes.at(2) + 2 * int32_t(padding_h_) - int32_t(kernel_h)) /
+          int32_t(stride_h_) +
+      1;
+  const int32_t output_w =
+      (input_shapes.at(3) + 2 * int32_t(padding_w_) - int32_t(kernel_w)) /
+          int32_t(stride_w_) +
+      1;
+  if (output_h <= 0 || output_w <= 0) {
+    return 0;
+  }
+  if (algorithm_ == ConvAlgorithm::kWinograd) {
+    // 16个变换后的输入矩阵和16个矩阵乘的结果
+    const size_t tiles = size_t((output_h + 1) / 2) * ((output_w + 1) / 2);
+    return 16 * tiles * (input_c_group + this->kernel_count_);
+  }
+
+  const size_t col_len = size_t(output_h) * output_w;
+  // 分块排布的输出需要额外存放一个group的矩阵乘结果
+  const size_t gemm_workspace_size =
+      blocked_output ? this->kernel_count_ / groups_ * col_len : 0;
+  const bool is_im2col_matrix = algorithm_ == ConvAlgorithm::kIm2Col;
+  size_t single_size = size_t(input_c_group) * kernel_h * kernel_w * col_len +
+                       gemm_workspace_size;
+  if (algorithm_ == ConvAlgorithm::kPointwise) {
+    single_size =
+        (blocked_input ? input_c_group * col_len : 0) + gemm_workspace_size;
+  }
+
+  // 合并多个样本时需要存放拼接之后的输入矩阵和矩阵乘的结果
+  const uint32_t batch_fold =
+      BatchFoldSize(uint32_t(std::max(input_shapes.at(0), 1)), col_len);
+  if (batch_fold <= 1) {
+    return single_size;
+  }
+  const size_t batch_len = batch_fold * col_len;
+  const size_t batch_size =
+      size_t(input_c_group) * (is_im2col_matrix ? kernel_h * kernel_w : 1) *
+          batch_len +
+      this->kernel_count_ / groups_ * batch_len;
+  return std::max(single_size, batch_size);
+}
+
+ConvAlgorithm ConvolutionLayer::algorithm() const { return this->algorithm_; }
+
+void ConvolutionLayer::set_activation(ConvActivation activation) {
+  this->activation_ = activation;
+}
+
+ConvActivation ConvolutionLayer::activation() const {
+  return this->activation_;
+}
+
+void ConvolutionLayer::ConvGemmBias(const arma::fmat& input_matrix,
+                                    sftensor output_tensor, uint32_t group,
+                                    uint32_t kernel_count_group,
+                                    uint32_t output_w, uint32_t output_h,
+                                    bool is_im2col_matrix,
+                                    float* gemm_workspace) const {
+  if (output_tensor->layout() == TensorLayout::kNCHW8c) {
+    CHECK(gemm_workspace != nullptr)
+        << "The blocked output of the convolution layer needs a workspace";
+    const arma::fmat& kernel = this->kernel_matrix_arr_.at(group);
+    const uint32_t input_c_size =
+        is_im2col_matrix ? input_matrix.n_rows : input_matrix.n_cols;
+    CHECK(kernel.n_rows == kernel_count_group && kernel.n_cols == input_c_size)
+        << "The kernel matrix and the input matrix of the convolution layer "
+           "do not match";
+    // 结果的每一列是同一个位置上当前group的所有输出通道，
+    // 和分块排布中每个位置上连续存放的8个通道方向相同
+    arma::fmat output_t(gemm_workspace, kernel_count_group,
+                        output_h * output_w, false, true);
+    if (is_im2col_matrix) {
+      output_t = kernel * input_matrix;
+    } else {
+      output_t = kernel * input_matrix.t();
+    }
+    this->PackBlockedOutput(output_t, output_tensor, group);
+    return;
+  }
+
+  // 输出张量中属于当前group的通道在内存中是连续的，
+  // 每一列对应一个输出通道，大小为output_h * output_w
   arma::fmat output(
-      output_tensor->matrix_raw_ptr(kernel_index + group * kernel_count_group),
-      output_h, output_w, false, true);
+      output_tensor->matrix_raw_ptr(group * kernel_count_group),
+      output_h * output_w, kernel_count_group, false, true);
 
-  CHECK(output.size() == output_h * output_w)
-      << "Output_h x output_w for the convolution layer "
-         "should be output tensor size";
+  const arma::fmat& kernel = this->kernel_matrix_arr_.at(group);
+  if (is_im2col_matrix) {
+    CHECK(kernel.n_rows == kernel_count_group &&
+          kernel.n_cols == input_matrix.n_rows)
+        << "The kernel matrix and the input matrix of the convolution layer "
+           "do not match";
+    // (kernel * input_matrix)^T，直接写入输出张量的通道中
+    output = input_matrix.t() * kernel.t();
+  } else {
+    // 输入矩阵已经是(output_h * output_w) x input_c_group的排布
+    CHECK(kernel.n_rows == kernel_count_group &&
+          kernel.n_cols == input_matrix.n_cols)
+        << "The kernel matrix and the input matrix of the convolution layer "
+           "do not match";
+    output = input_matrix * kernel.t();
+  }
+  this->BiasActivate(output, group);
+}
 
+void ConvolutionLayer::BiasActivate(arma::fmat& output, uint32_t group) const {
   if (!this->bias_.empty() && this->use_bias_) {
-    std::shared_ptr<Tensor<float>> bias;
-    bias = this->bias_.at(kernel_index);
-    if (bias != nullptr && !bias->empty()) {
-      float bias_value = bias->index(0);
-      output = kernel * input_matrix + bias_value;
-    } else {
-      LOG(FATAL) << "Bias tensor is empty or nullptr";
+    CHECK(group < this->bias_matrix_arr_.size())
+        << "Bias tensor is empty or nullptr";
+    output.each_row() += this->bias_matrix_arr_.at(group);
+  }
+  ConvActivateInplace(this->activation_, output.memptr(), output.n_elem);
+}
+
+void ConvolutionLayer::PackBlockedOutput(const arma::fmat& output_t,
+                                         sftensor output_tensor,
+                                         uint32_t group) const {
+  const uint32_t kernel_count_group = output_t.n_rows;
+  const uint32_t plane_size = output_t.n_cols;
+  const uint32_t channel_start = group * kernel_count_group;
+  CHECK(output_tensor->rows() * output_tensor->cols() == plane_size &&
+        channel_start + kernel_count_group <= output_tensor->channels())
+      << "The output tensor of the convolution layer has a wrong size";
+
+  const bool has_bias = !this->bias_.empty() && this->use_bias_;
+  if (has_bias) {
+    CHECK(group < this->bias_matrix_arr_.size())
+        << "Bias tensor is empty or nullptr";
+  }
+  const float* bias_ptr =
+      has_bias ? this->bias_matrix_arr_.at(group).memptr() : nullptr;
+
+  if (channel_start % kChannelBlockSize == 0 &&
+      kernel_count_group % kChannelBlockSize == 0) {
+    // group中的通道正好组成若干个完整的块，每次处理一个位置上的8个通道
+    float* output_ptr = output_tensor->raw_ptr();
+    for (uint32_t k = 0; k < kernel_count_group; k += kChannelBlockSize) {
+      float bias[kChannelBlockSize] = {0.f};
+      if (bias_ptr != nullptr) {
+        std::copy(bias_ptr + k, bias_ptr + k + kChannelBlockSize, bias);
+      }
+      float* block_ptr =
+          output_ptr + size_t(channel_start + k) * plane_size;
+      BlockedAddBias(output_t.memptr() + k, output_t.n_rows, bias, block_ptr,
+                     plane_size);
+      // 一个块在存储中是连续的，整块计算激活函数
+      ConvActivateInplace(activation_, block_ptr,
+                          plane_size * kChannelBlockSize);
     }
   } else {
-    output = kernel * input_matrix;
+    for (uint32_t k = 0; k < kernel_count_group; ++k) {
+      const float bias_value = bias_ptr != nullptr ? bias_ptr[k] : 0.f;
+      float* channel_ptr = output_tensor->channel_raw_ptr(channel_start + k);
+      for (uint32_t p = 0; p < plane_size; ++p) {
+        channel_ptr[p * kChannelBlockSize] =
+            ConvActivate(activation_, output_t.at(k, p) + bias_value);
+      }
+    }
   }
 }
 
@@ -262,38 +711,292 @@ void ConvolutionLayer::InitIm2ColWeight() {
     CHECK(kernel->channels() == kernel_c);
   }
 
-  if (groups_ == 1) {
-    const uint32_t kernel_count_group = kernel_count / groups_;
-    std::vector<arma::frowvec> kernel_matrix_arr(kernel_count_group);
-    arma::frowvec kernel_matrix_c(row_len * kernel_c);
+  // 将每个group的所有卷积核展开并打包为一个矩阵
+  // 矩阵的大小为kernel_count_group x (kernel_c * kernel_h * kernel_w)
+  CHECK(kernel_count % groups_ == 0);
+  const uint32_t kernel_count_group = kernel_count / groups_;
+  std::vector<arma::fmat> kernel_matrix_arr(groups_);
+  for (uint32_t g = 0; g < groups_; ++g) {
+    arma::fmat kernel_matrix_t(row_len * kernel_c, kernel_count_group);
     for (uint32_t k = 0; k < kernel_count_group; ++k) {
-      const std::shared_ptr<Tensor<float>>& kernel = this->weights_.at(k);
+      const std::shared_ptr<Tensor<float>>& kernel =
+          this->weights_.at(k + g * kernel_count_group);
       for (uint32_t ic = 0; ic < kernel->channels(); ++ic) {
-        memcpy(kernel_matrix_c.memptr() + row_len * ic,
+        memcpy(kernel_matrix_t.colptr(k) + row_len * ic,
                kernel->matrix_raw_ptr(ic), row_len * sizeof(float));
       }
-      kernel_matrix_arr.at(k) = kernel_matrix_c;
     }
-    this->kernel_matrix_arr_ = std::move(kernel_matrix_arr);
-  } else {
-    // group != 1
-    const uint32_t kernel_count_group = kernel_count / groups_;
-    std::vector<arma::frowvec> kernel_matrix_arr;
+    kernel_matrix_arr.at(g) = kernel_matrix_t.t();
+  }
+  this->kernel_matrix_arr_ = std::move(kernel_matrix_arr);
+  this->InitBiasMatrix();
+
+  if (this->algorithm_ == ConvAlgorithm::kWinograd) {
+    this->InitWinogradWeight();
+  }
+}
+
+void ConvolutionLayer::InitBiasMatrix() {
+  // 偏移量同样按照group进行打包，在矩阵乘之后统一相加
+  const uint32_t kernel_count = this->kernel_count_;
+  const uint32_t kernel_count_group = kernel_count / groups_;
+  this->bias_matrix_arr_.clear();
+  if (this->use_bias_ && !this->bias_.empty()) {
+    CHECK(this->bias_.size() == kernel_count);
     for (uint32_t g = 0; g < groups_; ++g) {
-      arma::fmat kernel_matrix_c(1, row_len * kernel_c);
+      arma::frowvec bias_matrix(kernel_count_group);
       for (uint32_t k = 0; k < kernel_count_group; ++k) {
-        const std::shared_ptr<Tensor<float>>& kernel =
-            this->weights_.at(k + g * kernel_count_group);
-        for (uint32_t ic = 0; ic < kernel->channels(); ++ic) {
-          memcpy(kernel_matrix_c.memptr() + row_len * ic,
-                 kernel->matrix_raw_ptr(ic), row_len * sizeof(float));
+        const std::shared_ptr<Tensor<float>>& bias =
+            this->bias_.at(k + g * kernel_count_group);
+        CHECK(bias != nullptr && !bias->empty())
+            << "Bias tensor is empty or nullptr";
+        bias_matrix.at(k) = bias->index(0);
+      }
+      this->bias_matrix_arr_.push_back(bias_matrix);
+    }
+  }
+}
+
+bool ConvolutionLayer::LoadPackedWeights(
+    const std::map<std::string, std::shared_ptr<RuntimeAttribute>>& attrs) {
+  const uint32_t kernel_count = this->kernel_count_;
+  CHECK(kernel_count > 0) << "kernel count must greater than zero";
+  const uint32_t kernel_count_group = kernel_count / groups_;
+  const uint32_t kernel_c = this->kernel_c_;
+  const uint32_t row_len = this->kernel_h_ * this->kernel_w_;
+
+  // 读取一个排布后的矩阵，形状不一致时说明计划文件与当前的卷积层不匹配。
+  // 计划文件的内存映射中的矩阵直接作为卷积核使用，卷积层持有映射的引用
+  std::vector<std::shared_ptr<const char>> packed_holders;
+  auto load_matrix = [&attrs, &packed_holders](const std::string& name,
+                                               uint32_t rows, uint32_t cols,
+                                               arma::fmat& matrix) {
+    const auto& attr_iter = attrs.find("packed." + name);
+    if (attr_iter == attrs.end()) {
+      return false;
+    }
+    const auto& attr = attr_iter->second;
+    if (attr->shape.size() != 2 || attr->shape.at(0) != int(rows) ||
+        attr->shape.at(1) != int(cols) ||
+        attr->weight_count<float>() != size_t(rows) * cols) {
+      return false;
+    }
+    if (attr->mapped_weight != nullptr) {
+      // 卷积核在推理时只会被读取，映射是只读的也不影响
+      matrix = arma::fmat(const_cast<float*>(attr->weight_ptr<float>()), rows,
+                          cols, false, true);
+      packed_holders.push_back(attr->mapped_weight);
+    } else {
+      matrix.set_size(rows, cols);
+      memcpy(matrix.memptr(), attr->weight_ptr<float>(),
+             sizeof(float) * matrix.n_elem);
+    }
+    return true;
+  };
+
+  std::vector<arma::fmat> kernel_matrix_arr(groups_);
+  for (uint32_t g = 0; g < groups_; ++g) {
+    if (!load_matrix("im2col." + std::to_string(g), kernel_count_group,
+                     row_len * kernel_c, kernel_matrix_arr.at(g))) {
+      return false;
+    }
+  }
+
+  std::vector<arma::fmat> winograd_kernel_arr;
+  if (this->algorithm_ == ConvAlgorithm::kWinograd) {
+    winograd_kernel_arr.resize(16);
+    for (uint32_t i = 0; i < 16; ++i) {
+      if (!load_matrix("winograd." + std::to_string(i), kernel_count, kernel_c,
+                       winograd_kernel_arr.at(i))) {
+        return false;
+      }
+    }
+  }
+
+  this->kernel_matrix_arr_ = std::move(kernel_matrix_arr);
+  this->winograd_kernel_arr_ = std::move(winograd_kernel_arr);
+  this->packed_holders_ = std::move(packed_holders);
+  this->InitBiasMatrix();
+  return true;
+}
+
+std::map<std::string, arma::fmat> ConvolutionLayer::packed_weights() const {
+  std::map<std::string, arma::fmat> packed_weights;
+  for (uint32_t g = 0; g < kernel_matrix_arr_.size(); ++g) {
+    packed_weights.insert(
+        {"im2col." + std::to_string(g), kernel_matrix_arr_.at(g)});
+  }
+  for (uint32_t i = 0; i < winograd_kernel_arr_.size(); ++i) {
+    packed_weights.insert(
+        {"winograd." + std::to_string(i), winograd_kernel_arr_.at(i)});
+  }
+  return packed_weights;
+}
+
+void ConvolutionLayer::InitWinogradWeight() {
+  CHECK(IsAlgorithmSupported(ConvAlgorithm::kWinograd));
+  const uint32_t kernel_count = this->weights_.size();
+  const uint32_t kernel_c = this->weights_.at(0)->channels();
+
+  // U = G * g * G^T，G = [1, 0, 0; 0.5, 0.5, 0.5; 0.5, -0.5, 0.5; 0, 0, 1]
+  // 变换后第xi个位置的值组成矩阵winograd_kernel_arr_[xi]，大小为
+  // kernel_count x kernel_c
+  std::vector<arma::fmat> winograd_kernel_arr(16);
+  for (arma::fmat& winograd_kernel : winograd_kernel_arr) {
+    winograd_kernel.set_size(kernel_count, kernel_c);
+  }
+
+  for (uint32_t k = 0; k < kernel_count; ++k) {
+    const std::shared_ptr<Tensor<float>>& kernel = this->weights_.at(k);
+    for (uint32_t ic = 0; ic < kernel_c; ++ic) {
+      const float* g = kernel->matrix_raw_ptr(ic);
+      // g[h + w * 3]，先对每一列进行变换
+      float gg[4][3];
+      for (uint32_t w = 0; w < 3; ++w) {
+        const float g0 = g[w * 3];
+        const float g1 = g[w * 3 + 1];
+        const float g2 = g[w * 3 + 2];
+        gg[0][w] = g0;
+        gg[1][w] = 0.5f * (g0 + g1 + g2);
+        gg[2][w] = 0.5f * (g0 - g1 + g2);
+        gg[3][w] = g2;
+      }
+      // 再对每一行进行变换
+      for (uint32_t i = 0; i < 4; ++i) {
+        const float t0 = gg[i][0];
+        const float t1 = gg[i][1];
+        const float t2 = gg[i][2];
+        winograd_kernel_arr.at(i * 4 + 0).at(k, ic) = t0;
+        winograd_kernel_arr.at(i * 4 + 1).at(k, ic) = 0.5f * (t0 + t1 + t2);
+        winograd_kernel_arr.at(i * 4 + 2).at(k, ic) = 0.5f * (t0 - t1 + t2);
+        winograd_kernel_arr.at(i * 4 + 3).at(k, ic) = t2;
+      }
+    }
+  }
+  this->winograd_kernel_arr_ = std::move(winograd_kernel_arr);
+}
+
+void ConvolutionLayer::WinogradF23(sftensor input, sftensor output_tensor,
+                                   uint32_t output_h, uint32_t output_w) {
+  CHECK(winograd_kernel_arr_.size() == 16)
+      << "The winograd kernel of the convolution layer is not initialized";
+  const uint32_t input_c = input->channels();
+  const uint32_t input_h = input->rows();
+  const uint32_t input_w = input->cols();
+  const uint32_t kernel_count = this->kernel_count_;
+
+  // 每个tile计算2x2的输出，需要读取4x4的输入
+  const uint32_t tiles_h = (output_h + 1) / 2;
+  const uint32_t tiles_w = (output_w + 1) / 2;
+  const uint32_t tiles = tiles_h * tiles_w;
+
+  const size_t input_trans_size = size_t(input_c) * tiles;
+  const size_t output_trans_size = size_t(kernel_count) * tiles;
+  float* workspace_ptr =
+      Im2ColWorkspace(16 * (input_trans_size + output_trans_size));
+  float* input_trans_ptr = workspace_ptr;
+  float* output_trans_ptr = workspace_ptr + 16 * input_trans_size;
+
+  // 输入变换V = B^T * d * B，
+  // B^T = [1, 0, -1, 0; 0, 1, 1, 0; 0, -1, 1, 0; 0, 1, 0, -1]
+  // 变换后第xi个位置的值组成大小为input_c x tiles的矩阵
+  const uint32_t input_stride = input->pixel_stride();
+  for (uint32_t ic = 0; ic < input_c; ++ic) {
+    const float* input_channel_ptr = input->channel_raw_ptr(ic);
+    for (uint32_t tw = 0; tw < tiles_w; ++tw) {
+      for (uint32_t th = 0; th < tiles_h; ++th) {
+        const int32_t h_start = int32_t(th * 2) - int32_t(padding_h_);
+        const int32_t w_start = int32_t(tw * 2) - int32_t(padding_w_);
+        float d[4][4];
+        for (int32_t j = 0; j < 4; ++j) {
+          const int32_t w = w_start + j;
+          for (int32_t i = 0; i < 4; ++i) {
+            const int32_t h = h_start + i;
+            if (h < 0 || w < 0 || h >= int32_t(input_h) ||
+                w >= int32_t(input_w)) {
+              d[i][j] = 0.f;
+            } else {
+              d[i][j] = input_channel_ptr[(h + w * input_h) * input_stride];
+            }
+          }
+        }
+
+        float t[4][4];
+        for (uint32_t j = 0; j < 4; ++j) {
+          t[0][j] = d[0][j] - d[2][j];
+          t[1][j] = d[1][j] + d[2][j];
+          t[2][j] = d[2][j] - d[1][j];
+          t[3][j] = d[1][j] - d[3][j];
+        }
+
+        const uint32_t tile_index = th + tw * tiles_h;
+        float* v_ptr = input_trans_ptr + tile_index * input_c + ic;
+        for (uint32_t i = 0; i < 4; ++i) {
+          v_ptr[(i * 4 + 0) * input_trans_size] = t[i][0] - t[i][2];
+          v_ptr[(i * 4 + 1) * input_trans_size] = t[i][1] + t[i][2];
+          v_ptr[(i * 4 + 2) * input_trans_size] = t[i][2] - t[i][1];
+          v_ptr[(i * 4 + 3) * input_trans_size] = t[i][1] - t[i][3];
+        }
+      }
+    }
+  }
+
+  // 16次独立的矩阵乘M = U * V
+  for (uint32_t xi = 0; xi < 16; ++xi) {
+    const arma::fmat input_trans(input_trans_ptr + xi * input_trans_size,
+                                 input_c, tiles, false, true);
+    arma::fmat output_trans(output_trans_ptr + xi * output_trans_size,
+                            kernel_count, tiles, false, true);
+    output_trans = this->winograd_kernel_arr_.at(xi) * input_trans;
+  }
+
+  // 输出变换Y = A^T * M * A，A^T = [1, 1, 1, 0; 0, 1, -1, -1]
+  const bool has_bias = !this->bias_.empty() && this->use_bias_;
+  if (has_bias) {
+    CHECK(!this->bias_matrix_arr_.empty())
+        << "Bias tensor is empty or nullptr";
+  }
+  const uint32_t output_stride = output_tensor->pixel_stride();
+  for (uint32_t k = 0; k < kernel_count; ++k) {
+    const float bias_value =
+        has_bias ? this->bias_matrix_arr_.front().at(k) : 0.f;
+    float* output_channel_ptr = output_tensor->channel_raw_ptr(k);
+    for (uint32_t tw = 0; tw < tiles_w; ++tw) {
+      for (uint32_t th = 0; th < tiles_h; ++th) {
+        const uint32_t tile_index = th + tw * tiles_h;
+        const float* m_ptr = output_trans_ptr + tile_index * kernel_count + k;
+        float m[4][4];
+        for (uint32_t xi = 0; xi < 16; ++xi) {
+          m[xi / 4][xi % 4] = m_ptr[xi * output_trans_size];
+        }
+
+        float t[2][4];
+        for (uint32_t j = 0; j < 4; ++j) {
+          t[0][j] = m[0][j] + m[1][j] + m[2][j];
+          t[1][j] = m[1][j] - m[2][j] - m[3][j];
+        }
+
+        for (uint32_t i = 0; i < 2; ++i) {
+          const uint32_t h = th * 2 + i;
+          if (h >= output_h) {
+            continue;
+          }
+          const float y0 = t[i][0] + t[i][1] + t[i][2];
+          const float y1 = t[i][1] - t[i][2] - t[i][3];
+          const uint32_t w = tw * 2;
+          output_channel_ptr[(h + w * output_h) * output_stride] =
+              y0 + bias_value;
+          if (w + 1 < output_w) {
+            output_channel_ptr[(h + (w + 1) * output_h) * output_stride] =
+                y1 + bias_value;
+          }
         }
-        kernel_matrix_arr.emplace_back(kernel_matrix_c);
       }
     }
-    CHECK(kernel_matrix_arr.size() == kernel_count);
-    this->kernel_matrix_arr_ = std::move(kernel_matrix_arr);
   }
+  // 输出张量的所有通道都由这次变换写入，最后整体计算激活函数
+  ConvActivateInplace(activation_, output_tensor->raw_ptr(),
+                      output_tensor->size());
 }
 
 ParseParameterAttrStatus ConvolutionLayer::GetInstance(
@@ -452,8 +1155,8 @@ ParseParameterAttrStatus ConvolutionLayer::GetInstance(
       return ParseParameterAttrStatus::kAttrMissingBias;
     }
 
-    const std::vector<float>& bias_values = bias->get<float>();
-    conv_layer->set_bias(bias_values);
+    conv_layer->set_bias(bias->weight_ptr<float>(), bias->weight_count<float>());
+    bias->ClearWeight();
   }
 
   if (attrs.find("weight") == attrs.end()) {
@@ -468,13 +1171,48 @@ ParseParameterAttrStatus ConvolutionLayer::GetInstance(
     return ParseParameterAttrStatus::kAttrMissingWeight;
   }
 
-  const std::vector<float>& weight_values = weight->get<float>();
-  conv_layer->set_weights(weight_values);
-
   auto conv_layer_derived =
       std::dynamic_pointer_cast<ConvolutionLayer>(conv_layer);
   CHECK(conv_layer_derived != nullptr);
-  conv_layer_derived->InitIm2ColWeight();
+  // 从计划文件创建时直接引用保存的排布结果
+  const bool packed_loaded = conv_layer_derived->LoadPackedWeights(attrs);
+  for (const auto& [name, attr] : attrs) {
+    if (name.find("packed.") == 0) {
+      attr->ClearWeight();
+    }
+  }
+
+  if (weight->weight_count<float>() > 0) {
+    // 直接从权重文件的内存映射填入卷积核，不经过中间数组
+    conv_layer->set_weights(weight->weight_ptr<float>(),
+                            weight->weight_count<float>());
+  } else if (packed_loaded) {
+    // 计划文件中有排布结果时不保存原始的卷积核，卷积层也不再持有
+    conv_layer_derived->weights_.clear();
+  } else {
+    LOG(ERROR) << "The weight attribute is empty and no packed kernel is "
+                  "found";
+    return ParseParameterAttrStatus::kAttrMissingWeight;
+  }
+  weight->ClearWeight();
+  if (!packed_loaded) {
+    conv_layer_derived->InitIm2ColWeight();
+  }
+
+  // 由计算图的算子融合写入，表示卷积之后的激活函数已经合并到卷积层中
+  if (params.find("activation") != params.end()) {
+    auto activation = std::dynamic_pointer_cast<RuntimeParameterString>(
+        params.at("activation"));
+    CHECK(activation != nullptr)
+        << "The activation parameter of the convolution layer is not a string";
+    if (activation->value == "relu") {
+      conv_layer_derived->set_activation(ConvActivation::kReLU);
+    } else if (activation->value == "silu") {
+      conv_layer_derived->set_activation(ConvActivation::kSiLU);
+    } else {
+      LOG(FATAL) << "Unsupported fused activation: " << activation->value;
+    }
+  }
   return ParseParameterAttrStatus::kParameterAttrParseSuccess;
 }
 
@@ -26,6 +26,24 @@
 #include "layer/abstract/param_layer.hpp"
 
 namespace kuiper_infer {
+/// 卷积层的计算方法，在创建卷积层时根据卷积核的参数选择
+enum class ConvAlgorithm {
+  kIm2Col = 0,            /// 通用的im2col + gemm
+  kPointwise = 1,         /// 1x1卷积且步长为1，输入张量本身就是im2col矩阵
+  kPointwiseStrided = 2,  /// 1x1卷积且步长大于1，按步长采样输入后进行gemm
+  kWinograd = 3,          /// 3x3卷积且步长为1，使用Winograd F(2x2,3x3)
+};
+
+/// 多个样本合并到一次矩阵乘时，拼接之后矩阵的最大列数
+constexpr uint32_t kBatchFoldColumns = 4096;
+
+/// 卷积层融合的激活函数，在加上偏移量之后直接作用于输出
+enum class ConvActivation {
+  kNone = 0,
+  kReLU = 1,
+  kSiLU = 2,
+};
+
 class ConvolutionLayer : public ParamLayer {
  public:
   explicit ConvolutionLayer(uint32_t output_channel, uint32_t in_channel,
@@ -47,15 +65,135 @@ class ConvolutionLayer : public ParamLayer {
    */
   void InitIm2ColWeight();
 
+  /**
+   * 使用计划文件中保存的排布结果初始化kernel，跳过重新排布
+   * @param attrs 计算节点的属性，排布结果以"packed."开头
+   * @return 排布结果与当前卷积层的参数和计算方法一致时返回true
+   */
+  bool LoadPackedWeights(
+      const std::map<std::string, std::shared_ptr<RuntimeAttribute>>& attrs);
+
+  /**
+   * 返回每个group打包后的卷积核矩阵以及Winograd变换后的卷积核矩阵
+   * @return 排布后的卷积核
+   */
+  std::map<std::string, arma::fmat> packed_weights() const override;
+
+  /**
+   * 根据输入操作数的形状计算im2col所需要的临时空间
+   * @return 临时空间中float元素的数量
+   */
+  size_t workspace_size() const override;
+
+  /**
+   * 返回卷积层所使用的计算方法
+   * @return 卷积层的计算方法
+   */
+  ConvAlgorithm algorithm() const;
+
+  /**
+   * 设置卷积层的计算方法，主要用于不同计算方法之间的结果对比
+   * @param algorithm 卷积层的计算方法，必须适用于当前卷积层的参数
+   */
+  void set_algorithm(ConvAlgorithm algorithm);
+
+  /**
+   * 判断卷积层的参数是否可以使用某种计算方法
+   * @param algorithm 卷积层的计算方法
+   * @return 可以使用返回true
+   */
+  bool IsAlgorithmSupported(ConvAlgorithm algorithm) const;
+
+  /**
+   * 设置卷积层融合的激活函数
+   * @param activation 激活函数的类型
+   */
+  void set_activation(ConvActivation activation);
+
+  /**
+   * 返回卷积层融合的激活函数
+   * @return 激活函数的类型
+   */
+  ConvActivation activation() const;
+
  private:
   void ConvGemmBias(const arma::fmat& input_matrix, sftensor output_tensor,
-                    uint32_t group, uint32_t kernel_index,
-                    uint32_t kernel_count_group, const arma::frowvec& kernel,
-                    uint32_t output_w, uint32_t output_h) const;
+                    uint32_t group, uint32_t kernel_count_group,
+                    uint32_t output_w, uint32_t output_h,
+                    bool is_im2col_matrix,
+                    float* gemm_workspace = nullptr) const;
+
+  /**
+   * 将一个group的矩阵乘结果加上偏移量和激活函数之后，写入分块排布的输出张量
+   * @param output_t 矩阵乘的结果，大小为kernel_count_group x (output_h * output_w)
+   * @param output_tensor 分块排布的输出张量
+   * @param group 当前的group
+   */
+  void PackBlockedOutput(const arma::fmat& output_t, sftensor output_tensor,
+                         uint32_t group) const;
+
+  void PointwiseStridedGather(sftensor input, uint32_t input_c_group,
+                              uint32_t group, uint32_t output_h,
+                              uint32_t output_w, arma::fmat& input_matrix,
+                              uint32_t row_offset = 0) const;
+
+  void Im2Col(sftensor input, uint32_t kernel_w, uint32_t kernel_h,
+              uint32_t input_w, uint32_t input_h, uint32_t input_c_group,
+              uint32_t group, uint32_t row_len, uint32_t col_len,
+              arma::fmat& input_matrix, uint32_t col_offset = 0) const;
+
+  /**
+   * 计算一个样本的卷积
+   * @param input 输入张量
+   * @param output_tensor 输出张量，大小已经检查过
+   */
+  void ConvSingle(const sftensor& input, const sftensor& output_tensor);
+
+  /**
+   * 多个样本的输入矩阵按列(im2col)或者按行(1x1卷积)拼接在一起，
+   * 每个group只需要一次矩阵乘，再把结果分别写入每个样本的输出张量
+   * @param inputs 输入张量
+   * @param outputs 输出张量，大小已经检查过
+   * @param start 第一个样本的位置
+   * @param samples 一起计算的样本数量
+   */
+  void ConvBatch(const std::vector<sftensor>& inputs,
+                 const std::vector<sftensor>& outputs, uint32_t start,
+                 uint32_t samples);
+
+  /**
+   * 计算一次矩阵乘中合并的样本数量，输出越小合并的样本越多，
+   * 拼接之后矩阵的列数不超过kBatchFoldColumns，Winograd不合并
+   * @param batch_size 批次的大小
+   * @param col_len 一个样本的输出大小output_h * output_w
+   * @return 合并的样本数量，为1时逐个样本计算
+   */
+  uint32_t BatchFoldSize(uint32_t batch_size, uint32_t col_len) const;
+
+  /**
+   * 根据输入和输出张量计算合并的样本数量，所有样本的形状和排布相同时才合并
+   * @param inputs 输入张量
+   * @param outputs 输出张量
+   * @return 合并的样本数量
+   */
+  uint32_t BatchFold(const std::vector<sftensor>& inputs,
+                     const std::vector<sftensor>& outputs) const;
+
+  /**
+   * 在一个group的输出矩阵上加上偏移量并计算激活函数
+   * @param output 输出矩阵，每一列对应一个输出通道
+   * @param group 当前的group
+   */
+  void BiasActivate(arma::fmat& output, uint32_t group) const;
+
+  void WinogradF23(sftensor input, sftensor output_tensor, uint32_t output_h,
+                   uint32_t output_w);
+
+  void InitWinogradWeight();
+
+  void InitBiasMatrix();
 
-  arma::fmat Im2Col(sftensor input, uint32_t kernel_w, uint32_t kernel_h,
-                    uint32_t input_w, uint32_t input_h, uint32_t input_c_group,
-                    uint32_t group, uint32_t row_len, uint32_t col_len) const;
+  float* Im2ColWorkspace(size_t workspace_size);
 
  private:
   bool use_bias_ = false;
@@ -64,7 +202,17 @@ class ConvolutionLayer : public ParamLayer {
   uint32_t padding_w_ = 0;
   uint32_t stride_h_ = 1;
   uint32_t stride_w_ = 1;
-  std::vector<arma::frowvec> kernel_matrix_arr_;
+  uint32_t kernel_h_ = 0;
+  uint32_t kernel_w_ = 0;
+  uint32_t kernel_count_ = 0;  /// 卷积核的数量，等于输出通道数
+  uint32_t kernel_c_ = 0;      /// 每个卷积核的通道数，等于每个group的输入通道数
+  ConvAlgorithm algorithm_ = ConvAlgorithm::kIm2Col;
+  ConvActivation activation_ = ConvActivation::kNone;
+  std::vector<arma::fmat> kernel_matrix_arr_;   /// 每个group打包后的卷积核矩阵
+  std::vector<arma::frowvec> bias_matrix_arr_;  /// 每个group打包后的偏移量
+  std::vector<arma::fmat> winograd_kernel_arr_;  /// 变换后的16个卷积核矩阵
+  std::vector<std::shared_ptr<const char>>
+      packed_holders_;  /// 引用计划文件中的排布结果时，持有计划文件的内存映射
 };
 
 }  // namespace kuiper_infer
@@ -22,14 +22,219 @@
 // Created by fss on 22-11-18.
 
 #include "expression.hpp"
-#include <stack>
+#include <algorithm>
 #include "data/tensor_util.hpp"
 #include "layer/abstract/layer_factory.hpp"
+#include "utils/math/fmath.hpp"
 
 namespace kuiper_infer {
 ExpressionLayer::ExpressionLayer(std::string statement)
     : NonParamLayer("Expression"), statement_(std::move(statement)) {
-  parser_ = std::make_unique<ExpressionParser>(statement_);
+  this->Compile();
+}
+
+void ExpressionLayer::Compile() {
+  ExpressionParser parser(statement_);
+  parser.Tokenizer(false);
+  CHECK(!parser.tokens().empty())
+      << "The expression parser failed to parse " << statement_;
+
+  // 逆波兰式中的每个节点对应一条指令，同时模拟求值栈的深度
+  uint32_t stack_depth = 0;
+  uint32_t max_stack_depth = 0;
+  this->program_.clear();
+  this->operand_count_ = 0;
+  for (const auto& token_node : parser.Generate()) {
+    ExpressionInstruction instruction;
+    if (token_node->num_index >= 0) {
+      instruction.opcode = ExpressionOpcode::kLoad;
+      instruction.operand = token_node->num_index;
+      operand_count_ = std::max(operand_count_, instruction.operand + 1);
+      stack_depth += 1;
+      max_stack_depth = std::max(max_stack_depth, stack_depth);
+    } else {
+      const int32_t op = token_node->num_index;
+      if (op == int(TokenType::TokenAdd)) {
+        instruction.opcode = ExpressionOpcode::kAdd;
+      } else if (op == int(TokenType::TokenMul)) {
+        instruction.opcode = ExpressionOpcode::kMul;
+      } else {
+        LOG(FATAL) << "Unknown operator type: " << op;
+      }
+      CHECK(stack_depth >= 2) << "The number of operand is less than two";
+      stack_depth -= 1;
+    }
+    this->program_.push_back(instruction);
+  }
+  CHECK(stack_depth == 1)
+      << "The expression has more than one output operand!";
+
+  // 推理时只使用这里分配的空间
+  this->value_stack_.resize(max_stack_depth);
+  this->stack_tiles_.resize(size_t(max_stack_depth) * kExpressionTileSize);
+  this->operand_ptrs_.resize(operand_count_);
+  this->operand_broadcast_.resize(operand_count_);
+}
+
+const std::vector<ExpressionInstruction>& ExpressionLayer::program() const {
+  return this->program_;
+}
+
+using ExpressionBinaryKernel = void (*)(const ExpressionValue&,
+                                        const ExpressionValue&, uint32_t,
+                                        float*);
+
+struct ExpressionKernels {
+  bool avx2 = false;
+  ExpressionBinaryKernel add = nullptr;
+  ExpressionBinaryKernel mul = nullptr;
+};
+
+template <bool kMul>
+static inline float BinaryScalar(float a, float b) {
+  return kMul ? a * b : a + b;
+}
+
+template <bool kMul>
+static void EvaluateBinaryScalar(const ExpressionValue& lhs,
+                                 const ExpressionValue& rhs, uint32_t size,
+                                 float* result_ptr) {
+  if (lhs.data != nullptr && rhs.data != nullptr) {
+    for (uint32_t j = 0; j < size; ++j) {
+      result_ptr[j] = BinaryScalar<kMul>(lhs.data[j], rhs.data[j]);
+    }
+  } else if (lhs.data != nullptr) {
+    const float rhs_value = rhs.scalar;
+    for (uint32_t j = 0; j < size; ++j) {
+      result_ptr[j] = BinaryScalar<kMul>(lhs.data[j], rhs_value);
+    }
+  } else {
+    const float lhs_value = lhs.scalar;
+    for (uint32_t j = 0; j < size; ++j) {
+      result_ptr[j] = BinaryScalar<kMul>(lhs_value, rhs.data[j]);
+    }
+  }
+}
+
+#ifdef FMATH_TARGET_AVX2
+template <bool kMul>
+__attribute__((target("avx2"))) static inline __m256 BinaryAVX2(__m256 a,
+                                                                __m256 b) {
+  if constexpr (kMul) {
+    return _mm256_mul_ps(a, b);
+  } else {
+    return _mm256_add_ps(a, b);
+  }
+}
+
+// 每次计算8个元素，剩余不足8个的元素逐个计算。结果可能和左操作数是同一块空间，
+// 每组元素都是先读取再写入，所以原地计算是安全的
+template <bool kMul>
+__attribute__((target("avx2"))) static void EvaluateBinaryAVX2(
+    const ExpressionValue& lhs, const ExpressionValue& rhs, uint32_t size,
+    float* result_ptr) {
+  const uint32_t vec_size = size - size % 8;
+  if (lhs.data != nullptr && rhs.data != nullptr) {
+    for (uint32_t j = 0; j < vec_size; j += 8) {
+      const __m256 lhs_value = _mm256_loadu_ps(lhs.data + j);
+      const __m256 rhs_value = _mm256_loadu_ps(rhs.data + j);
+      _mm256_storeu_ps(result_ptr + j, BinaryAVX2<kMul>(lhs_value, rhs_value));
+    }
+    for (uint32_t j = vec_size; j < size; ++j) {
+      result_ptr[j] = BinaryScalar<kMul>(lhs.data[j], rhs.data[j]);
+    }
+  } else if (lhs.data != nullptr) {
+    const __m256 rhs_value = _mm256_set1_ps(rhs.scalar);
+    for (uint32_t j = 0; j < vec_size; j += 8) {
+      const __m256 lhs_value = _mm256_loadu_ps(lhs.data + j);
+      _mm256_storeu_ps(result_ptr + j, BinaryAVX2<kMul>(lhs_value, rhs_value));
+    }
+    for (uint32_t j = vec_size; j < size; ++j) {
+      result_ptr[j] = BinaryScalar<kMul>(lhs.data[j], rhs.scalar);
+    }
+  } else {
+    const __m256 lhs_value = _mm256_set1_ps(lhs.scalar);
+    for (uint32_t j = 0; j < vec_size; j += 8) {
+      const __m256 rhs_value = _mm256_loadu_ps(rhs.data + j);
+      _mm256_storeu_ps(result_ptr + j, BinaryAVX2<kMul>(lhs_value, rhs_value));
+    }
+    for (uint32_t j = vec_size; j < size; ++j) {
+      result_ptr[j] = BinaryScalar<kMul>(lhs.scalar, rhs.data[j]);
+    }
+  }
+}
+#endif
+
+static ExpressionKernels SelectExpressionKernels() {
+  ExpressionKernels kernels;
+  kernels.add = EvaluateBinaryScalar<false>;
+  kernels.mul = EvaluateBinaryScalar<true>;
+#if defined(__GNUC__) && defined(FMATH_TARGET_AVX2)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.avx2 = true;
+    kernels.add = EvaluateBinaryAVX2<false>;
+    kernels.mul = EvaluateBinaryAVX2<true>;
+  }
+#endif
+  return kernels;
+}
+
+static const ExpressionKernels& GetExpressionKernels() {
+  static const ExpressionKernels kernels = SelectExpressionKernels();
+  return kernels;
+}
+
+bool ExpressionLayer::UseAVX2() { return GetExpressionKernels().avx2; }
+
+void ExpressionLayer::EvaluateTile(uint32_t channel, uint32_t offset,
+                                   uint32_t size, float* output_ptr) {
+  const ExpressionKernels& kernels = GetExpressionKernels();
+  uint32_t depth = 0;
+  for (size_t pc = 0; pc < program_.size(); ++pc) {
+    const ExpressionInstruction& instruction = program_.at(pc);
+    if (instruction.opcode == ExpressionOpcode::kLoad) {
+      const uint32_t operand = instruction.operand;
+      ExpressionValue& value = value_stack_.at(depth++);
+      if (operand_broadcast_.at(operand)) {
+        value.data = nullptr;
+        value.scalar = operand_ptrs_.at(operand)[channel];
+      } else {
+        value.data = operand_ptrs_.at(operand) + offset;
+      }
+      continue;
+    }
+
+    const ExpressionValue rhs = value_stack_.at(--depth);
+    const ExpressionValue lhs = value_stack_.at(--depth);
+    ExpressionValue& result = value_stack_.at(depth++);
+    if (lhs.data == nullptr && rhs.data == nullptr) {
+      result.scalar = instruction.opcode == ExpressionOpcode::kAdd
+                          ? lhs.scalar + rhs.scalar
+                          : lhs.scalar * rhs.scalar;
+      continue;
+    }
+    // 最后一条指令直接写入输出张量，其他指令写入这一层求值栈的临时空间，
+    // 左操作数可能就在这块空间中，逐元素原地计算不会覆盖还未读取的数据
+    float* result_ptr = pc + 1 == program_.size()
+                            ? output_ptr
+                            : stack_tiles_.data() +
+                                  size_t(depth - 1) * kExpressionTileSize;
+    if (instruction.opcode == ExpressionOpcode::kAdd) {
+      kernels.add(lhs, rhs, size, result_ptr);
+    } else {
+      kernels.mul(lhs, rhs, size, result_ptr);
+    }
+    result.data = result_ptr;
+  }
+
+  // 表达式只有一个输入或者结果是广播的标量时，结果还没有写入输出张量
+  const ExpressionValue& value = value_stack_.front();
+  if (value.data == nullptr) {
+    std::fill(output_ptr, output_ptr + size, value.scalar);
+  } else if (value.data != output_ptr) {
+    std::copy(value.data, value.data + size, output_ptr);
+  }
 }
 
 InferStatus ExpressionLayer::Forward(
@@ -45,12 +250,8 @@ InferStatus ExpressionLayer::Forward(
     return InferStatus::kInferFailedOutputEmpty;
   }
 
-  CHECK(this->parser_ != nullptr)
-      << "The parser in the expression layer is null!";
-  this->parser_->Tokenizer(false);
-  const auto& expressions = this->parser_->tokens();
-  CHECK(!expressions.empty())
-      << "The expression parser failed to parse " << statement_;
+  CHECK(!this->program_.empty())
+      << "The expression layer has not been compiled: " << statement_;
 
   for (uint32_t i = 0; i < inputs.size(); ++i) {
     const sftensor& input_data = inputs.at(i);
@@ -63,80 +264,59 @@ InferStatus ExpressionLayer::Forward(
   }
 
   const uint32_t batch_size = outputs.size();
+  if (inputs.size() < operand_count_ * batch_size) {
+    LOG(ERROR) << "The expression layer needs " << operand_count_
+               << " operands, but the number of input tensors is "
+               << inputs.size();
+    return InferStatus::kInferFailedInputOutSizeMatchError;
+  }
+
   for (uint32_t i = 0; i < batch_size; ++i) {
-    if (outputs.at(i) == nullptr || outputs.at(i)->empty()) {
+    const sftensor& output = outputs.at(i);
+    if (output == nullptr || output->empty()) {
       DLOG(ERROR) << "The output tensor array in the expression layer has an "
                      "empty tensor "
                   << i << "th";
       return InferStatus::kInferFailedOutputEmpty;
     }
-    outputs.at(i)->Fill(0.f);
-  }
 
-  std::stack<std::vector<std::shared_ptr<Tensor<float>>>> op_stack;
-  const std::vector<std::shared_ptr<TokenNode>>& token_nodes =
-      this->parser_->Generate();
-  for (const auto& token_node : token_nodes) {
-    if (token_node->num_index >= 0) {
-      // process operator
-      uint32_t start_pos = token_node->num_index * batch_size;
-      std::vector<std::shared_ptr<Tensor<float>>> input_token_nodes;
-      for (uint32_t i = 0; i < batch_size; ++i) {
-        CHECK(i + start_pos < inputs.size())
-            << "The " << i
-            << "th operand doesn't have appropriate number of tensors";
-        // fixme 这里的张量拷贝是否有必要
-        input_token_nodes.push_back(inputs.at(i + start_pos));
+    // 和输出形状相同的输入逐元素读取，形状为channels x 1 x 1的输入按通道广播
+    const std::vector<uint32_t>& output_shapes = output->shapes();
+    bool has_broadcast = false;
+    for (uint32_t k = 0; k < operand_count_; ++k) {
+      const sftensor& input = inputs.at(k * batch_size + i);
+      const bool broadcast = input->shapes() != output_shapes;
+      if (broadcast && (input->channels() != output->channels() ||
+                        input->rows() != 1 || input->cols() != 1)) {
+        LOG(ERROR) << "Broadcast shape is not adapting! The " << k
+                   << "th operand of the expression layer";
+        return InferStatus::kInferFailedInputOutSizeMatchError;
       }
-      op_stack.push(input_token_nodes);
-    } else {
-      // process operation
-      const int32_t op = token_node->num_index;
-      if (op != int(TokenType::TokenAdd) && op != int(TokenType::TokenMul)) {
-        LOG(FATAL) << "Unknown operator type: " << op;
-      }
-      CHECK(op_stack.size() >= 2) << "The number of operand is less than two";
-      std::vector<std::shared_ptr<Tensor<float>>> input_node1 = op_stack.top();
-
-      CHECK(input_node1.size() == batch_size)
-          << "The first operand doesn't have appropriate number of tensors, "
-             "which need "
-          << batch_size;
-      op_stack.pop();
-
-      std::vector<std::shared_ptr<Tensor<float>>> input_node2 = op_stack.top();
-      CHECK(input_node2.size() == batch_size)
-          << "The second operand doesn't have appropriate number of tensors, "
-             "which need "
-          << batch_size;
-      op_stack.pop();
-
-      std::vector<std::shared_ptr<Tensor<float>>> output_token_nodes(
-          batch_size);
-      for (uint32_t i = 0; i < batch_size; ++i) {
-        // do execution
-        if (op == int(TokenType::TokenAdd)) {
-          output_token_nodes.at(i) =
-              TensorElementAdd(input_node1.at(i), input_node2.at(i));
-        } else if (op == int(TokenType::TokenMul)) {
-          output_token_nodes.at(i) =
-              TensorElementMultiply(input_node1.at(i), input_node2.at(i));
-        } else {
-          LOG(FATAL) << "Unknown operator type: " << op;
-        }
+      if (!broadcast && input->layout() != output->layout()) {
+        LOG(ERROR) << "The input and output tensor layout of the expression "
+                      "layer do not match, the "
+                   << k << "th operand";
+        return InferStatus::kInferFailedInputOutSizeMatchError;
       }
-      op_stack.push(output_token_nodes);
+      has_broadcast |= broadcast;
+      operand_ptrs_.at(k) = input->raw_ptr();
+      operand_broadcast_.at(k) = broadcast;
     }
-  }
+    CHECK(!has_broadcast || output->layout() == TensorLayout::kNCHW)
+        << "The broadcast in the expression layer only supports the NCHW "
+           "layout";
 
-  CHECK(op_stack.size() == 1)
-      << "The expression has more than one output operand!";
-  std::vector<sftensor> output_node = op_stack.top();
-  op_stack.pop();
-  for (int i = 0; i < batch_size; ++i) {
-    CHECK(outputs.at(i) != nullptr && !outputs.at(i)->empty());
-    CHECK(outputs.at(i)->shapes() == output_node.at(i)->shapes());
-    outputs.at(i) = output_node.at(i);
+    // 没有广播时所有张量按照一维数组计算，否则逐个通道计算
+    const uint32_t channels = has_broadcast ? output->channels() : 1;
+    const uint32_t plane_size = output->size() / channels;
+    float* output_ptr = output->raw_ptr();
+    for (uint32_t c = 0; c < channels; ++c) {
+      for (uint32_t j = 0; j < plane_size; j += kExpressionTileSize) {
+        const uint32_t offset = c * plane_size + j;
+        const uint32_t size = std::min(kExpressionTileSize, plane_size - j);
+        this->EvaluateTile(c, offset, size, output_ptr + offset);
+      }
+    }
   }
   return InferStatus::kInferSuccess;
 }
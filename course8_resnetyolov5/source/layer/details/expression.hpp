@@ -27,6 +27,25 @@
 #include "parser/parse_expression.hpp"
 
 namespace kuiper_infer {
+/// 表达式编译之后的指令类型
+enum class ExpressionOpcode {
+  kLoad = 0,  /// 将第operand个输入压入求值栈
+  kAdd = 1,   /// 弹出栈顶的两个值，相加之后压入求值栈
+  kMul = 2,   /// 弹出栈顶的两个值，相乘之后压入求值栈
+};
+
+/// 表达式编译之后的一条指令
+struct ExpressionInstruction {
+  ExpressionOpcode opcode = ExpressionOpcode::kLoad;
+  uint32_t operand = 0;  /// kLoad指令读取的输入序号
+};
+
+/// 求值栈中的一个值，指向一段连续的数据，或者是按通道广播的标量
+struct ExpressionValue {
+  const float* data = nullptr;  /// 为空时使用scalar
+  float scalar = 0.f;
+};
+
 class ExpressionLayer : public NonParamLayer {
  public:
   explicit ExpressionLayer( std::string statement);
@@ -39,9 +58,44 @@ class ExpressionLayer : public NonParamLayer {
       const std::shared_ptr<RuntimeOperator>& op,
       std::shared_ptr<Layer>& expression_layer);
 
+  /**
+   * 返回表达式编译之后的指令
+   * @return 按逆波兰式排列的指令
+   */
+  const std::vector<ExpressionInstruction>& program() const;
+
+  /**
+   * 返回逐元素计算是否使用了AVX2指令，在运行时根据CPU支持的指令集选择
+   * @return 使用AVX2时返回true
+   */
+  static bool UseAVX2();
+
  private:
+  /**
+   * 将表达式编译为指令，并计算求值栈的最大深度
+   */
+  void Compile();
+
+  /**
+   * 计算输出张量中连续的一段元素，中间结果存放在求值栈的临时空间中，
+   * 最后一条指令的结果直接写入输出张量
+   * @param channel 当前元素所在的通道，用于读取广播的输入
+   * @param offset 当前元素在参与计算的张量中的偏移量
+   * @param size 元素的数量，不超过kExpressionTileSize
+   * @param output_ptr 输出张量中对应的地址
+   */
+  void EvaluateTile(uint32_t channel, uint32_t offset, uint32_t size,
+                    float* output_ptr);
+
+  static constexpr uint32_t kExpressionTileSize = 256;  /// 每次计算的元素数量
+
   std::string statement_;
-  std::unique_ptr<ExpressionParser> parser_;
+  std::vector<ExpressionInstruction> program_;  /// 编译之后的指令
+  uint32_t operand_count_ = 0;                  /// 表达式中输入的数量
+  std::vector<ExpressionValue> value_stack_;    /// 求值栈
+  std::vector<float> stack_tiles_;  /// 求值栈中每一层中间结果的临时空间
+  std::vector<const float*> operand_ptrs_;  /// 当前批次中每个输入的数据
+  std::vector<bool> operand_broadcast_;     /// 输入是否按通道广播
 };
 }  // namespace kuiper_infer
 #endif  // KUIPER_INFER_SOURCE_LAYER_MONOCULAR_EXPRESSION_HPP_
@@ -76,6 +76,12 @@ InferStatus FlattenLayer::Forward(
                         shapes.begin() + end_dim + 1, 1, std::multiplies());
 
     std::shared_ptr<Tensor<float>> output = outputs.at(i);
+    // 计算图已经让输出张量直接使用输入张量的存储，不需要复制
+    if (output != nullptr && !output->empty() &&
+        output->size() == input->size() &&
+        output->raw_ptr() == input->raw_ptr()) {
+      continue;
+    }
     output = TensorClone(input);
     CHECK(input->size() == output->size())
         << "The output and input shapes of the flatten layer do "
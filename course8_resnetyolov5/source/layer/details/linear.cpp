@@ -81,6 +81,7 @@ InferStatus LinearLayer::Forward(
                          true);
   const arma::fmat& weight_data_t = weight_data.t();
 
+  uint32_t feature_dims = 0;
   for (uint32_t i = 0; i < batch; ++i) {
     const std::shared_ptr<Tensor<float>>& input = inputs.at(i);
     CHECK(input != nullptr && !input->empty())
@@ -88,16 +89,18 @@ InferStatus LinearLayer::Forward(
         << i << " th";
     const std::vector<uint32_t>& input_shapes = input->shapes();
 
-    const uint32_t feature_dims = input_shapes.at(1);
     const uint32_t in_features = input_shapes.at(2);
+    if (i == 0) {
+      feature_dims = input_shapes.at(1);
+    }
+    CHECK(input_shapes.at(1) == feature_dims)
+        << "The feature dims of inputs in the linear layer should be same "
+        << i << " th";
     CHECK(weight_data.n_rows == out_features_)
         << "The row of weight tensor should be same to output_features_";
     CHECK(weight_data.n_cols == in_features && in_features == in_features_)
         << "The col of weight tensor should be same to input_features_";
 
-    arma::fmat input_vec((float*)input->raw_ptr(), feature_dims, in_features_,
-                         false, true);
-
     std::shared_ptr<Tensor<float>> output = outputs.at(i);
     if (output == nullptr || output->empty()) {
       output = std::make_shared<Tensor<float>>(1, out_features_, feature_dims);
@@ -116,22 +119,38 @@ InferStatus LinearLayer::Forward(
     if (output_raw_shapes.size() == 1) {
       CHECK(output_raw_shapes.at(0) == out_features_);
     }
+  }
 
-    arma::fmat& result = output->slice(0);
+  // 批次中的样本按行堆叠成batch * feature_dims行的矩阵，只做一次矩阵乘法
+  arma::fmat result;
+  if (batch == 1) {
+    const arma::fmat input_vec((float*)inputs.front()->raw_ptr(), feature_dims,
+                               in_features_, false, true);
     result = input_vec * weight_data_t;
-    if (use_bias_) {
-      CHECK(!this->bias_.empty() && this->bias_.size() == 1)
-          << "The bias tensor is empty, but use_bias is true";
-
-      const auto& bias_data = bias_.front()->data();
-      CHECK(!bias_data.empty() && bias_data.n_slices == 1 &&
-            bias_data.n_cols == out_features_)
-          << "The col of bias tensor is not same to output_features_";
-      const auto& bias_tensor = bias_data.slice(0);
-      for (uint32_t row = 0; row < result.n_rows; ++row) {
-        result.row(row) += bias_tensor;
-      }
+  } else {
+    arma::fmat input_vec(batch * feature_dims, in_features_);
+    for (uint32_t i = 0; i < batch; ++i) {
+      input_vec.rows(i * feature_dims, (i + 1) * feature_dims - 1) =
+          arma::fmat((float*)inputs.at(i)->raw_ptr(), feature_dims,
+                     in_features_, false, true);
     }
+    result = input_vec * weight_data_t;
+  }
+
+  if (use_bias_) {
+    CHECK(!this->bias_.empty() && this->bias_.size() == 1)
+        << "The bias tensor is empty, but use_bias is true";
+
+    const auto& bias_data = bias_.front()->data();
+    CHECK(!bias_data.empty() && bias_data.n_slices == 1 &&
+          bias_data.n_cols == out_features_)
+        << "The col of bias tensor is not same to output_features_";
+    result.each_row() += bias_data.slice(0);
+  }
+
+  for (uint32_t i = 0; i < batch; ++i) {
+    outputs.at(i)->slice(0) =
+        result.rows(i * feature_dims, (i + 1) * feature_dims - 1);
   }
   return InferStatus::kInferSuccess;
 }
@@ -182,11 +201,15 @@ ParseParameterAttrStatus LinearLayer::GetInstance(
   linear_layer =
       std::make_shared<LinearLayer>(in_features, out_features, use_bias);
   if (use_bias) {
-    linear_layer->set_bias(bias->get<float>());
+    linear_layer->set_bias(bias->weight_ptr<float>(),
+                           bias->weight_count<float>());
+    bias->ClearWeight();
   }
 
   // load weights
-  linear_layer->set_weights(weight->get<float>());
+  linear_layer->set_weights(weight->weight_ptr<float>(),
+                            weight->weight_count<float>());
+  weight->ClearWeight();
   return ParseParameterAttrStatus::kParameterAttrParseSuccess;
 }
 
@@ -22,10 +22,84 @@
 // Created by fss on 22-11-18.
 
 #include "maxpooling.hpp"
+#include <algorithm>
+#include <limits>
 #include "data/tensor_util.hpp"
 #include "layer/abstract/layer_factory.hpp"
 #include "runtime/runtime_ir.hpp"
+#include "utils/math/blocked.hpp"
 namespace kuiper_infer {
+/**
+ * 一维的滑动窗口最大值(van Herk/Gil-Werman)，序列中的每个元素是连续的width个数。
+ * 填充之后的序列按照窗口大小分段，分别计算段内的前缀最大值和后缀最大值，
+ * 每个窗口的最大值等于窗口起点的后缀最大值和终点的前缀最大值中较大的一个，
+ * 所以每个位置只需要常数次比较，和窗口大小无关
+ * @param input 输入序列
+ * @param length 输入序列的长度
+ * @param width 每个元素中数的个数
+ * @param window 窗口的大小
+ * @param padding 序列两端填充的长度，填充的位置不会成为最大值
+ * @param output 输出序列，长度为length + 2 * padding - window + 1
+ * @param prefix 存放前缀最大值的空间，至少(length + 2 * padding) * width个数
+ * @param suffix 存放后缀最大值的空间，大小和prefix相同
+ */
+static void SlidingMax(const float* input, uint32_t length, uint32_t width,
+                       uint32_t window, uint32_t padding, float* output,
+                       float* prefix, float* suffix) {
+  const uint32_t padded_length = length + 2 * padding;
+  const uint32_t output_length = padded_length - window + 1;
+  const float lowest = std::numeric_limits<float>::lowest();
+  for (uint32_t j = 0; j < padded_length; ++j) {
+    float* prefix_ptr = prefix + size_t(j) * width;
+    const bool is_padding = j < padding || j >= padding + length;
+    const float* input_ptr =
+        is_padding ? nullptr : input + size_t(j - padding) * width;
+    if (j % window == 0) {
+      if (is_padding) {
+        std::fill(prefix_ptr, prefix_ptr + width, lowest);
+      } else {
+        std::copy(input_ptr, input_ptr + width, prefix_ptr);
+      }
+    } else if (is_padding) {
+      std::copy(prefix_ptr - width, prefix_ptr, prefix_ptr);
+    } else {
+      const float* last_ptr = prefix_ptr - width;
+      for (uint32_t k = 0; k < width; ++k) {
+        prefix_ptr[k] = std::max(last_ptr[k], input_ptr[k]);
+      }
+    }
+  }
+
+  for (uint32_t j = padded_length; j-- > 0;) {
+    float* suffix_ptr = suffix + size_t(j) * width;
+    const bool is_padding = j < padding || j >= padding + length;
+    const float* input_ptr =
+        is_padding ? nullptr : input + size_t(j - padding) * width;
+    if (j % window == window - 1 || j == padded_length - 1) {
+      if (is_padding) {
+        std::fill(suffix_ptr, suffix_ptr + width, lowest);
+      } else {
+        std::copy(input_ptr, input_ptr + width, suffix_ptr);
+      }
+    } else if (is_padding) {
+      std::copy(suffix_ptr + width, suffix_ptr + 2 * width, suffix_ptr);
+    } else {
+      const float* next_ptr = suffix_ptr + width;
+      for (uint32_t k = 0; k < width; ++k) {
+        suffix_ptr[k] = std::max(next_ptr[k], input_ptr[k]);
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < output_length; ++i) {
+    const float* suffix_ptr = suffix + size_t(i) * width;
+    const float* prefix_ptr = prefix + size_t(i + window - 1) * width;
+    float* output_ptr = output + size_t(i) * width;
+    for (uint32_t k = 0; k < width; ++k) {
+      output_ptr[k] = std::max(suffix_ptr[k], prefix_ptr[k]);
+    }
+  }
+}
 
 MaxPoolingLayer::MaxPoolingLayer(uint32_t padding_h, uint32_t padding_w,
                                  uint32_t pooling_size_h,
@@ -54,6 +128,11 @@ InferStatus MaxPoolingLayer::Forward(
     return InferStatus::kInferFailedInputOutSizeMatchError;
   }
 
+  if (cascaded_) {
+    // 输出已经由前面的池化在级联计算时写入
+    return InferStatus::kInferSuccess;
+  }
+
   const uint32_t batch = inputs.size();
   const uint32_t pooling_h = pooling_size_h_;
   const uint32_t pooling_w = pooling_size_w_;
@@ -119,6 +198,7 @@ InferStatus MaxPoolingLayer::Forward(
     if (output_data == nullptr || output_data->empty()) {
       output_data =
           std::make_shared<Tensor<float>>(input_c, output_h, output_w);
+      output_data->set_layout(input_data->layout());
       outputs.at(i) = output_data;
     }
 
@@ -127,7 +207,30 @@ InferStatus MaxPoolingLayer::Forward(
         << "The output tensor array in the max pooling layer "
            "has an incorrectly sized tensor "
         << i << "th";
+    CHECK(output_data->layout() == input_data->layout())
+        << "The input and output tensor layout of the max pooling layer do "
+           "not match "
+        << i << "th";
+    if (stride_h_ == 1 && stride_w_ == 1) {
+      std::vector<sftensor> stage_outputs{output_data};
+      for (const auto& cascade_output : cascade_outputs_) {
+        CHECK(cascade_output != nullptr && i < cascade_output->datas.size())
+            << "The cascaded output tensor array in the max pooling layer "
+               "has a wrong size";
+        stage_outputs.push_back(cascade_output->datas.at(i));
+      }
+      PoolingSeparable(input_data, stage_outputs);
+      continue;
+    }
+    CHECK(cascade_outputs_.empty())
+        << "Only the max pooling layer with stride 1 can be cascaded";
 
+    if (input_data->layout() == TensorLayout::kNCHW8c) {
+      PoolingBlocked(input_data, output_data);
+      continue;
+    }
+
+#pragma omp parallel for
     for (uint32_t ic = 0; ic < input_c; ++ic) {
       const arma::fmat& input_channel = input_data->slice(ic);
       arma::fmat& output_channel = output_data->slice(ic);
@@ -160,6 +263,107 @@ InferStatus MaxPoolingLayer::Forward(
   return InferStatus::kInferSuccess;
 }
 
+void MaxPoolingLayer::PoolingBlocked(const sftensor& input,
+                                     const sftensor& output) const {
+  const uint32_t blocks = input->channels() / kChannelBlockSize;
+  const size_t input_block_size =
+      size_t(kChannelBlockSize) * input->rows() * input->cols();
+  const size_t output_block_size =
+      size_t(kChannelBlockSize) * output->rows() * output->cols();
+
+#pragma omp parallel for
+  for (uint32_t b = 0; b < blocks; ++b) {
+    BlockedMaxPooling(input->raw_ptr() + b * input_block_size, input->rows(),
+                      input->cols(), output->raw_ptr() + b * output_block_size,
+                      output->rows(), output->cols(), pooling_size_h_,
+                      pooling_size_w_, stride_h_, stride_w_, padding_h_,
+                      padding_w_);
+  }
+}
+
+void MaxPoolingLayer::PoolingSeparable(
+    const sftensor& input, const std::vector<sftensor>& outputs) const {
+  const bool blocked = input->layout() == TensorLayout::kNCHW8c;
+  // 分块排布时一个位置上的kChannelBlockSize个通道作为一个整体计算
+  const uint32_t lanes = blocked ? kChannelBlockSize : 1;
+  const uint32_t planes = input->channels() / lanes;
+
+  // 每一级池化的输入和输出大小，以及计算时需要的临时空间大小
+  std::vector<uint32_t> stage_h{input->rows()};
+  std::vector<uint32_t> stage_w{input->cols()};
+  size_t column_max_size = 0;
+  size_t buffer_size = 0;
+  for (const auto& output : outputs) {
+    const uint32_t input_h = stage_h.back();
+    const uint32_t input_w = stage_w.back();
+    CHECK(input_h + 2 * padding_h_ >= pooling_size_h_ &&
+          input_w + 2 * padding_w_ >= pooling_size_w_)
+        << "The output size of the max pooling layer is less than zero";
+    const uint32_t output_h = input_h + 2 * padding_h_ - pooling_size_h_ + 1;
+    const uint32_t output_w = input_w + 2 * padding_w_ - pooling_size_w_ + 1;
+    CHECK(output != nullptr && output->rows() == output_h &&
+          output->cols() == output_w &&
+          output->channels() == input->channels())
+        << "The output tensor array in the max pooling layer has an "
+           "incorrectly sized tensor";
+    CHECK(output->layout() == input->layout())
+        << "The input and output tensor layout of the max pooling layer do "
+           "not match";
+    column_max_size = std::max(column_max_size, size_t(output_h) * input_w);
+    buffer_size = std::max(
+        {buffer_size, size_t(input_h + 2 * padding_h_),
+         size_t(input_w + 2 * padding_w_) * output_h});
+    stage_h.push_back(output_h);
+    stage_w.push_back(output_w);
+  }
+
+#pragma omp parallel
+  {
+    std::vector<float> column_max(column_max_size * lanes);
+    std::vector<float> prefix(buffer_size * lanes);
+    std::vector<float> suffix(buffer_size * lanes);
+#pragma omp for
+    for (uint32_t p = 0; p < planes; ++p) {
+      // 一个通道的所有级联池化连续计算，前一级的输出仍然在缓存中
+      const float* stage_input = input->channel_raw_ptr(p * lanes);
+      for (uint32_t s = 0; s < outputs.size(); ++s) {
+        const uint32_t input_h = stage_h.at(s);
+        const uint32_t input_w = stage_w.at(s);
+        const uint32_t output_h = stage_h.at(s + 1);
+        // 先在每一列上沿着高度方向计算窗口的最大值
+        for (uint32_t w = 0; w < input_w; ++w) {
+          SlidingMax(stage_input + size_t(w) * input_h * lanes, input_h, lanes,
+                     pooling_size_h_, padding_h_,
+                     column_max.data() + size_t(w) * output_h * lanes,
+                     prefix.data(), suffix.data());
+        }
+        // 再把每一列作为一个元素，沿着宽度方向计算窗口的最大值
+        float* stage_output = outputs.at(s)->channel_raw_ptr(p * lanes);
+        SlidingMax(column_max.data(), input_w, output_h * lanes,
+                   pooling_size_w_, padding_w_, stage_output, prefix.data(),
+                   suffix.data());
+        stage_input = stage_output;
+      }
+    }
+  }
+}
+
+bool MaxPoolingLayer::IsCascadable(const MaxPoolingLayer& next) const {
+  return stride_h_ == 1 && stride_w_ == 1 && next.stride_h_ == 1 &&
+         next.stride_w_ == 1 && next.pooling_size_h_ == pooling_size_h_ &&
+         next.pooling_size_w_ == pooling_size_w_ &&
+         next.padding_h_ == padding_h_ && next.padding_w_ == padding_w_;
+}
+
+void MaxPoolingLayer::set_cascade_outputs(
+    std::vector<std::shared_ptr<RuntimeOperand>> cascade_outputs) {
+  this->cascade_outputs_ = std::move(cascade_outputs);
+}
+
+void MaxPoolingLayer::set_cascaded(bool cascaded) {
+  this->cascaded_ = cascaded;
+}
+
 ParseParameterAttrStatus MaxPoolingLayer::GetInstance(
     const std::shared_ptr<RuntimeOperator>& op,
     std::shared_ptr<Layer>& max_layer) {
@@ -24,6 +24,7 @@
 #ifndef KUIPER_INFER_SOURCE_LAYER_MAX_POOLING_
 #define KUIPER_INFER_SOURCE_LAYER_MAX_POOLING_
 #include "layer/abstract/non_param_layer.hpp"
+#include "runtime/runtime_operand.hpp"
 namespace kuiper_infer {
 class MaxPoolingLayer : public NonParamLayer {
  public:
@@ -39,13 +40,55 @@ class MaxPoolingLayer : public NonParamLayer {
       const std::shared_ptr<RuntimeOperator>& op,
       std::shared_ptr<Layer>& max_layer);
 
+  /**
+   * 判断后继的池化能否和当前池化级联计算，两个池化的步长都为1并且窗口和填充
+   * 相同时，后继池化的输入在计算完一个通道之后就可以直接使用
+   * @param next 以当前池化的输出作为输入的池化
+   * @return 可以级联计算时返回true
+   */
+  bool IsCascadable(const MaxPoolingLayer& next) const;
+
+  /**
+   * 设置和当前池化级联计算的后继池化的输出，当前池化在一次遍历中逐个通道
+   * 依次计算自己和后继池化的输出。例如yolov5的SPPF中连续三个5x5池化，
+   * 三个输出分别等于5x5、9x9和13x13的池化
+   * @param cascade_outputs 后继池化的输出操作数，按照级联的顺序排列
+   */
+  void set_cascade_outputs(
+      std::vector<std::shared_ptr<RuntimeOperand>> cascade_outputs);
+
+  /**
+   * 设置当前池化的输出是否已经由前面的池化级联计算，为true时Forward不再计算
+   * @param cascaded 输出是否已经被级联计算
+   */
+  void set_cascaded(bool cascaded);
+
  private:
+  /**
+   * 分块排布的最大池化，每次计算一个位置上的kChannelBlockSize个通道
+   * @param input 分块排布的输入张量
+   * @param output 分块排布的输出张量
+   */
+  void PoolingBlocked(const sftensor& input, const sftensor& output) const;
+
+  /**
+   * 步长为1的最大池化，先沿着高度方向再沿着宽度方向计算窗口的最大值，
+   * 每个位置的计算量和窗口大小无关。多个输出时依次级联计算，
+   * 前一个输出作为后一个池化的输入，两种排布的张量都可以使用
+   * @param input 输入张量
+   * @param outputs 每一级池化的输出张量，排布和输入相同
+   */
+  void PoolingSeparable(const sftensor& input,
+                        const std::vector<sftensor>& outputs) const;
+
   uint32_t padding_h_ = 0;
   uint32_t padding_w_ = 0;
   uint32_t pooling_size_h_ = 0;
   uint32_t pooling_size_w_ = 0;
   uint32_t stride_h_ = 1;
   uint32_t stride_w_ = 1;
+  bool cascaded_ = false;
+  std::vector<std::shared_ptr<RuntimeOperand>> cascade_outputs_;
 };
 }  // namespace kuiper_infer
 #endif  // KUIPER_INFER_SOURCE_LAYER_MAX_POOLING_
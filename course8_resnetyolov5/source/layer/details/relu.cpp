@@ -69,14 +69,21 @@ InferStatus ReluLayer::Forward(
           << "The output tensor array in the relu layer has an empty tensor "
           << i << " th";
       output = std::make_shared<Tensor<float>>(input->shapes());
+      output->set_layout(input->layout());
       outputs.at(i) = output;
     }
     CHECK(output->shapes() == input->shapes())
             << "The input and output tensor shapes of the relu layer do not match "
             << i << " th";
-    for (uint32_t j = 0; j < input->size(); ++j) {
-      float value = input->index(j);
-      output->index(j) = value > 0.f ? value : 0.f;
+    // 逐元素计算，两种排布的张量只需要排布相同
+    CHECK(output->layout() == input->layout())
+            << "The input and output tensor layout of the relu layer do not match "
+            << i << " th";
+    const uint32_t size = input->size();
+    const float* input_ptr = input->raw_ptr();
+    float* output_ptr = output->raw_ptr();
+    for (uint32_t j = 0; j < size; ++j) {
+      output_ptr[j] = input_ptr[j] > 0.f ? input_ptr[j] : 0.f;
     }
   }
   return InferStatus::kInferSuccess;
@@ -23,6 +23,7 @@
 
 #include "silu.hpp"
 #include "layer/abstract/layer_factory.hpp"
+#include "utils/math/activation.hpp"
 namespace kuiper_infer {
 
 SiLULayer::SiLULayer() : NonParamLayer("SiLU") {}
@@ -70,16 +71,19 @@ InferStatus SiLULayer::Forward(
     std::shared_ptr<Tensor<float>> output = outputs.at(i);
     if (output == nullptr || output->empty()) {
       output = std::make_shared<Tensor<float>>(input->shapes());
+      output->set_layout(input->layout());
       outputs.at(i) = output;
     }
 
     CHECK(output->shapes() == input->shapes())
             << "The input and output tensor shapes of the silu layer do not match "
             << i << " th";
-    uint32_t size = output->size();
-    arma::fcube &input_data = input->data();
-    output->set_data(input_data / (1.f + arma::exp(-input_data)));
-
+    // 逐元素计算，两种排布的张量只需要排布相同
+    CHECK(output->layout() == input->layout())
+            << "The input and output tensor layout of the silu layer do not match "
+            << i << " th";
+    // 直接写入输出张量的存储，输入和输出是同一个张量时原地计算
+    ApplySiLU(input->raw_ptr(), output->raw_ptr(), output->size());
   }
   return InferStatus::kInferSuccess;
 }
@@ -21,8 +21,10 @@
 
 // Created by fss on 22-12-25.
 #include "upsample.hpp"
+#include <algorithm>
 #include <cmath>
 #include "layer/abstract/layer_factory.hpp"
+#include "utils/math/blocked.hpp"
 namespace kuiper_infer {
 
 UpSampleLayer::UpSampleLayer(float scale_h, float scale_w, UpSampleMode mode)
@@ -79,6 +81,7 @@ InferStatus UpSampleLayer::Forward(
       output = std::make_shared<Tensor<float>>(
           input_data.n_slices, uint32_t(input_data.n_rows * scale_h),
           uint32_t(input_data.n_cols * scale_w));
+      output->set_layout(inputs.at(i)->layout());
       outputs.at(i) = output;
     }
     auto& output_data = output->data();
@@ -95,6 +98,14 @@ InferStatus UpSampleLayer::Forward(
         << "The input and output tensor channel of the upsample layer do not "
            "match "
         << i << "th";
+    CHECK(inputs.at(i)->layout() == output->layout())
+        << "The input and output tensor layout of the upsample layer do not "
+           "match "
+        << i << "th";
+    if (output->layout() == TensorLayout::kNCHW8c) {
+      UpSampleBlocked(inputs.at(i), output);
+      continue;
+    }
 
     const uint32_t channels = input_data.n_slices;
     for (uint32_t c = 0; c < channels; ++c) {
@@ -131,6 +142,23 @@ InferStatus UpSampleLayer::Forward(
   return InferStatus::kInferSuccess;
 }
 
+void UpSampleLayer::UpSampleBlocked(const sftensor& input,
+                                    const sftensor& output) const {
+  const uint32_t blocks = input->channels() / kChannelBlockSize;
+  const size_t input_block_size =
+      size_t(kChannelBlockSize) * input->rows() * input->cols();
+  const size_t output_block_size =
+      size_t(kChannelBlockSize) * output->rows() * output->cols();
+
+  for (uint32_t b = 0; b < blocks; ++b) {
+    BlockedUpSampleNearest(input->raw_ptr() + b * input_block_size,
+                           input->rows(),
+                           output->raw_ptr() + b * output_block_size,
+                           output->rows(), output->cols(), uint32_t(scale_h_),
+                           uint32_t(scale_w_));
+  }
+}
+
 ParseParameterAttrStatus UpSampleLayer::GetInstance(
     const std::shared_ptr<RuntimeOperator>& op,
     std::shared_ptr<Layer>& upsample_layer) {
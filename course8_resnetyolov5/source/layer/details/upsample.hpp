@@ -44,6 +44,13 @@ class UpSampleLayer : public NonParamLayer {
       std::shared_ptr<Layer>& upsample_layer);
 
  private:
+  /**
+   * 分块排布的邻近上采样，每个位置上的kChannelBlockSize个通道一起复制
+   * @param input 分块排布的输入张量
+   * @param output 分块排布的输出张量
+   */
+  void UpSampleBlocked(const sftensor& input, const sftensor& output) const;
+
   float scale_h_ = 1.f;
   float scale_w_ = 1.f;
   UpSampleMode mode_ = UpSampleMode::kModeNearest;
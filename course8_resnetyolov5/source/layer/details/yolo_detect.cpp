@@ -22,7 +22,9 @@
 // Created by fss on 22-12-26.
 #include "yolo_detect.hpp"
 #include "data/tensor_util.hpp"
+#include "data/tensor_view.hpp"
 #include "layer/abstract/layer_factory.hpp"
+#include "utils/math/activation.hpp"
 
 namespace kuiper_infer {
 
@@ -117,20 +119,33 @@ InferStatus YoloDetectLayer::Forward(
       CHECK(input != nullptr && !input->empty());
       CHECK_EQ(input->rows(), nx);
       CHECK_EQ(input->cols(), ny);
-      input->Reshape({stages, uint32_t(classes_info), ny * nx}, true);
+      // 输入的通道按照[stages, classes_info]排列，拆分通道维度的视图
+      // 不复制数据，直接按照行主序的像素顺序读取每个通道
+      const TensorView input_view =
+          TensorView(input).Reshape({stages, classes_info, nx, ny});
+      const std::vector<uint32_t> &view_strides = input_view.strides();
 
       CHECK_EQ(stages_tensor->channels(), batch_size);
       CHECK_EQ(stages_tensor->rows(), stages_ * nx * ny);
       CHECK_EQ(stages_tensor->cols(), classes_info);
 
-      const arma::fcube &input_data = input->data();
-      const arma::fcube &input_data_exp = 1.f / (1.f + arma::exp(-input_data));
-
       arma::fmat &x_stages = stages_tensor->slice(b);
       for (uint32_t na = 0; na < num_anchors_; ++na) {
-        x_stages.submat(ny * nx * na, 0, ny * nx * (na + 1) - 1,
-                        classes_info - 1) = input_data_exp.slice(na).t();
+        for (uint32_t k = 0; k < classes_info; ++k) {
+          const float *channel_ptr = input_view.data() +
+                                     na * view_strides.at(0) +
+                                     k * view_strides.at(1);
+          float *x_stages_ptr = x_stages.colptr(k) + ny * nx * na;
+          for (uint32_t r = 0; r < nx; ++r) {
+            for (uint32_t c = 0; c < ny; ++c) {
+              x_stages_ptr[r * ny + c] =
+                  channel_ptr[r * view_strides.at(2) + c * view_strides.at(3)];
+            }
+          }
+        }
       }
+      // 收集完所有的输出之后整体原地计算sigmoid
+      ApplySigmoid(x_stages.memptr(), x_stages.memptr(), x_stages.n_elem);
 
       const arma::fmat &xy = x_stages.submat(0, 0, x_stages.n_rows - 1, 1);
       const arma::fmat &wh = x_stages.submat(0, 2, x_stages.n_rows - 1, 3);
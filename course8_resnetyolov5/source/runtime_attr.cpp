@@ -9,5 +9,7 @@ void RuntimeAttribute::ClearWeight() {
     std::vector<char> tmp = std::vector<char>();
     this->weight_data.swap(tmp);
   }
+  this->mapped_weight.reset();
+  this->mapped_weight_size = 0;
 }
 }  // namespace kuiper_infer
\ No newline at end of file
@@ -1,6 +1,18 @@
 #include "runtime/runtime_ir.hpp"
 #include "status_code.hpp"
+#include "data/tensor_util.hpp"
+#include "data/tensor_view.hpp"
 #include "layer/abstract/layer_factory.hpp"
+#include "layer/abstract/param_layer.hpp"
+#include "layer/details/maxpooling.hpp"
+#include "utils/time/time_logging.hpp"
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <set>
 #include <deque>
 #include <iostream>
 #include <memory>
@@ -144,7 +156,8 @@ bool RuntimeGraph::Init() {
   }
 
   this->graph_ = std::make_unique<pnnx::Graph>();
-  int load_result = this->graph_->load(param_path_, bin_path_);
+  // 权重留在内存映射的权重文件中，由计算节点的属性直接引用
+  int load_result = this->graph_->load(param_path_, bin_path_, true);
   if (load_result != 0) {
     LOG(ERROR) << "Can not find the param path or bin path: " << param_path_
                << " " << bin_path_;
@@ -253,26 +266,24 @@ std::vector<std::shared_ptr<Tensor<float>>> RuntimeGraph::Forward(
   CHECK(topo_operators_.size() == operators_.size())
           << "Build wrong topo queue";
 
+  // 第一次推理或者批次大小变化时划分输出张量
+  const uint32_t batch_size = inputs.size();
+  if (batch_size != batch_size_) {
+    this->InitGraphBatch(batch_size);
+  }
+
   for (const auto& op : topo_operators_) {
     op->has_forward = false;
   }
 
-  for (const auto& current_op : topo_operators_) {
-    if (current_op->type == "pnnx.Input") {
-      current_op->has_forward = true;
-      ProbeNextLayer(current_op, inputs);
-    } else if (current_op->type == "pnnx.Output") {
-      current_op->has_forward = true;
-      CHECK(current_op->input_operands_seq.size() == 1);
-      current_op->output_operands = current_op->input_operands_seq.front();
-    } else {
-      InferStatus status = current_op->layer->Forward();
-      CHECK(status == InferStatus::kInferSuccess)
-              << current_op->layer->layer_name()
-              << " layer forward failed, error code: " << int(status);
-      current_op->has_forward = true;
-      ProbeNextLayer(current_op, current_op->output_operands->datas);
-    }
+  if (debug) {
+    utils::LayerTimeStatesSingleton::LayerTimeStatesCollectorInit();
+  }
+
+  if (parallel_execution_) {
+    ForwardParallel(inputs, debug);
+  } else {
+    ForwardSerial(inputs, debug);
   }
 
   for (const auto& op : topo_operators_) {
@@ -280,6 +291,14 @@ std::vector<std::shared_ptr<Tensor<float>>> RuntimeGraph::Forward(
             << "The operator: " << op->name << " has not been forward yet!";
   }
 
+  if (debug) {
+    utils::LayerTimeLogging::SummaryLogging();
+    if (!trace_path_.empty()) {
+      LOG_IF(ERROR, !utils::LayerTimeLogging::WriteChromeTrace(trace_path_))
+              << "Write the trace file failed: " << trace_path_;
+    }
+  }
+
   if (operators_maps_.find(output_name_) != operators_maps_.end()) {
     const auto& output_op = operators_maps_.at(output_name_);
     CHECK(output_op->output_operands != nullptr)
@@ -292,6 +311,949 @@ std::vector<std::shared_ptr<Tensor<float>>> RuntimeGraph::Forward(
   }
 }
 
+void RuntimeGraph::ExecuteOperator(
+    const std::shared_ptr<RuntimeOperator>& current_op,
+    const std::vector<std::shared_ptr<Tensor<float>>>& inputs, bool debug) {
+  if (current_op->type == "pnnx.Input") {
+    current_op->has_forward = true;
+    ProbeNextLayer(current_op, inputs);
+  } else if (current_op->type == "pnnx.Output") {
+    current_op->has_forward = true;
+    CHECK(current_op->input_operands_seq.size() == 1);
+    current_op->output_operands = current_op->input_operands_seq.front();
+  } else {
+    InferStatus status;
+    if (debug) {
+      const int thread_id = omp_in_parallel() ? omp_get_thread_num() : 0;
+      utils::LayerTimeLogging layer_time_logging(
+          current_op->name, current_op->type, OperatorShapes(current_op),
+          OperatorFlops(current_op), OperatorBytes(current_op), thread_id);
+      status = current_op->layer->Forward();
+    } else {
+      status = current_op->layer->Forward();
+    }
+    CHECK(status == InferStatus::kInferSuccess)
+            << current_op->layer->layer_name()
+            << " layer forward failed, error code: " << int(status);
+    current_op->has_forward = true;
+    ProbeNextLayer(current_op, current_op->output_operands->datas);
+  }
+}
+
+void RuntimeGraph::ForwardSerial(
+    const std::vector<std::shared_ptr<Tensor<float>>>& inputs, bool debug) {
+  for (const auto& current_op : topo_operators_) {
+    ExecuteOperator(current_op, inputs, debug);
+  }
+}
+
+void RuntimeGraph::ForwardParallel(
+    const std::vector<std::shared_ptr<Tensor<float>>>& inputs, bool debug) {
+  const int num_threads =
+      num_threads_ > 0 ? int(num_threads_) : omp_get_max_threads();
+
+  // 同时执行的Layer不能共享同一块临时空间，每个线程各自持有一块。
+  // 0号线程复用串行执行时的临时空间，其余线程在执行需要临时空间的Layer时
+  // 才分配，大小只满足该线程执行过的Layer
+  if (workspace_size_ > 0 && thread_workspaces_.size() != size_t(num_threads)) {
+    thread_workspaces_.assign(num_threads, nullptr);
+    thread_workspaces_.front() = workspace_;
+  }
+
+  // 同一层级的节点由不同的线程执行，节点内部的并行循环需要嵌套的并行区域
+  const int max_active_levels = omp_get_max_active_levels();
+  const int max_threads = omp_get_max_threads();
+  omp_set_max_active_levels(std::max(max_active_levels, 2));
+  omp_set_num_threads(num_threads);
+  for (const auto& level_ops : schedule_levels_) {
+    if (level_ops.size() == 1 || num_threads == 1) {
+      // 没有可以同时执行的节点，例如ResNet中的主干部分
+      for (const auto& op : level_ops) {
+        ExecuteOperatorOnThread(op, 0, inputs, debug);
+      }
+      continue;
+    }
+
+    const int level_threads = std::min(num_threads, int(level_ops.size()));
+    const int inner_threads = std::max(1, num_threads / level_threads);
+#pragma omp parallel for num_threads(level_threads) schedule(dynamic)
+    for (size_t i = 0; i < level_ops.size(); ++i) {
+      // 只修改当前线程的设置，影响节点内部嵌套的并行区域
+      omp_set_num_threads(inner_threads);
+      ExecuteOperatorOnThread(level_ops.at(i), omp_get_thread_num(), inputs,
+                              debug);
+    }
+  }
+  omp_set_num_threads(max_threads);
+  omp_set_max_active_levels(max_active_levels);
+}
+
+void RuntimeGraph::ExecuteOperatorOnThread(
+    const std::shared_ptr<RuntimeOperator>& op, int thread_id,
+    const std::vector<std::shared_ptr<Tensor<float>>>& inputs, bool debug) {
+  const size_t workspace_size =
+      op->layer != nullptr ? op->layer->workspace_size() : 0;
+  if (workspace_size > 0 && !thread_workspaces_.empty()) {
+    // 每个线程只访问自己的临时空间，分配时不需要加锁
+    std::shared_ptr<arma::fvec>& workspace = thread_workspaces_.at(thread_id);
+    if (workspace == nullptr || workspace->n_elem < workspace_size) {
+      workspace = std::make_shared<arma::fvec>(workspace_size);
+    }
+    op->layer->set_workspace(workspace);
+  }
+  ExecuteOperator(op, inputs, debug);
+}
+
+void RuntimeGraph::set_trace_path(const std::string& trace_path) {
+  this->trace_path_ = trace_path;
+}
+
+static uint64_t OperandElements(const std::vector<int32_t>& shapes) {
+  uint64_t elements = 1;
+  for (const int32_t dim : shapes) {
+    elements *= dim > 0 ? uint64_t(dim) : 1;
+  }
+  return elements;
+}
+
+static int32_t OperatorIntParam(const std::shared_ptr<RuntimeOperator>& op,
+                                const std::string& name, int32_t default_value) {
+  const auto& param_iter = op->params.find(name);
+  if (param_iter == op->params.end()) {
+    return default_value;
+  }
+  auto param = std::dynamic_pointer_cast<RuntimeParameterInt>(param_iter->second);
+  return param != nullptr ? param->value : default_value;
+}
+
+static int32_t OperatorKernelElements(const std::shared_ptr<RuntimeOperator>& op) {
+  const auto& param_iter = op->params.find("kernel_size");
+  if (param_iter == op->params.end()) {
+    return 1;
+  }
+  auto param =
+      std::dynamic_pointer_cast<RuntimeParameterIntArray>(param_iter->second);
+  if (param == nullptr) {
+    return 1;
+  }
+  int32_t kernel_elements = 1;
+  for (const int32_t kernel : param->value) {
+    kernel_elements *= kernel;
+  }
+  return kernel_elements;
+}
+
+uint64_t RuntimeGraph::OperatorFlops(
+    const std::shared_ptr<RuntimeOperator>& op) {
+  if (op->output_operands == nullptr) {
+    return 0;
+  }
+  const uint64_t output_elements =
+      OperandElements(op->output_operands->shapes);
+  uint64_t input_elements = 0;
+  for (const auto& input_operand : op->input_operands_seq) {
+    input_elements += OperandElements(input_operand->shapes);
+  }
+
+  if (op->type == "nn.Conv2d") {
+    // 每个输出元素需要in_channels / groups * kernel_h * kernel_w次乘加
+    const int32_t groups = OperatorIntParam(op, "groups", 1);
+    const int32_t in_channels = OperatorIntParam(op, "in_channels", 1);
+    return 2 * output_elements * (in_channels / std::max(groups, 1)) *
+           OperatorKernelElements(op);
+  } else if (op->type == "nn.Linear") {
+    return 2 * output_elements * OperatorIntParam(op, "in_features", 1);
+  } else if (op->type == "nn.MaxPool2d") {
+    return output_elements * OperatorKernelElements(op);
+  } else if (op->type == "torch.flatten" || op->type == "torch.cat") {
+    return 0;
+  } else {
+    // 逐元素的算子以及池化等算子，计算量和访问的元素数量相当
+    return std::max(input_elements, output_elements);
+  }
+}
+
+uint64_t RuntimeGraph::OperatorBytes(
+    const std::shared_ptr<RuntimeOperator>& op) {
+  uint64_t elements = 0;
+  for (const auto& input_operand : op->input_operands_seq) {
+    elements += OperandElements(input_operand->shapes);
+  }
+  if (op->output_operands != nullptr) {
+    elements += OperandElements(op->output_operands->shapes);
+  }
+  if (auto param_layer = std::dynamic_pointer_cast<ParamLayer>(op->layer)) {
+    for (const auto& weight : param_layer->weights()) {
+      elements += weight->size();
+    }
+    for (const auto& bias : param_layer->bias()) {
+      elements += bias->size();
+    }
+  }
+  return elements * sizeof(float);
+}
+
+std::string RuntimeGraph::OperatorShapes(
+    const std::shared_ptr<RuntimeOperator>& op) {
+  auto shapes_to_string = [](const std::vector<int32_t>& shapes) {
+    std::string shapes_str = "[";
+    for (size_t i = 0; i < shapes.size(); ++i) {
+      shapes_str += std::to_string(shapes.at(i));
+      if (i + 1 < shapes.size()) {
+        shapes_str += ",";
+      }
+    }
+    return shapes_str + "]";
+  };
+
+  std::string shapes_str;
+  for (size_t i = 0; i < op->input_operands_seq.size(); ++i) {
+    shapes_str += shapes_to_string(op->input_operands_seq.at(i)->shapes);
+    if (i + 1 < op->input_operands_seq.size()) {
+      shapes_str += "+";
+    }
+  }
+  if (op->output_operands != nullptr) {
+    shapes_str += " -> " + shapes_to_string(op->output_operands->shapes);
+  }
+  return shapes_str;
+}
+
+void RuntimeGraph::set_parallel_execution(bool parallel, uint32_t num_threads) {
+  const bool planned_before = memory_planning_ && !parallel_execution_;
+  this->parallel_execution_ = parallel;
+  this->num_threads_ = num_threads;
+  const bool planned_after = memory_planning_ && !parallel_execution_;
+  if (graph_state_ == GraphState::Complete && planned_before != planned_after) {
+    this->InitGraphOutputs(planned_after);
+  }
+  if (!parallel) {
+    // 恢复为所有Layer共享同一块临时空间
+    thread_workspaces_.clear();
+    for (const auto& kOperator : this->operators_) {
+      if (kOperator->layer != nullptr) {
+        kOperator->layer->set_workspace(this->workspace_);
+      }
+    }
+  }
+}
+
+bool RuntimeGraph::parallel_execution() const {
+  return this->parallel_execution_;
+}
+
+void RuntimeGraph::set_operator_fusion(bool operator_fusion) {
+  LOG_IF(WARNING, graph_state_ == GraphState::Complete)
+          << "The graph has been built, operator fusion will not be changed";
+  this->operator_fusion_ = operator_fusion;
+}
+
+bool RuntimeGraph::operator_fusion() const { return this->operator_fusion_; }
+
+void RuntimeGraph::FuseOperators() {
+  std::set<std::string> fused_names;
+  for (const auto &op : this->operators_) {
+    if (op->type != "nn.Conv2d" || fused_names.count(op->name)) {
+      continue;
+    }
+    // 一个卷积节点可以依次合并BatchNorm和激活函数
+    while (op->output_names.size() == 1 &&
+           op->params.find("activation") == op->params.end()) {
+      const auto &next_iter = operators_maps_.find(op->output_names.front());
+      if (next_iter == operators_maps_.end()) {
+        break;
+      }
+      const std::shared_ptr<RuntimeOperator> next_op = next_iter->second;
+      if (next_op->input_operands_seq.size() != 1) {
+        break;
+      }
+
+      if (next_op->type == "nn.ReLU") {
+        op->params.insert(
+            {"activation", std::make_shared<RuntimeParameterString>("relu")});
+      } else if (next_op->type == "nn.SiLU") {
+        op->params.insert(
+            {"activation", std::make_shared<RuntimeParameterString>("silu")});
+      } else if (next_op->type != "nn.BatchNorm2d" ||
+                 !FoldBatchNorm(op, next_op)) {
+        break;
+      }
+
+      // 被合并节点的后继节点改为使用卷积节点的输出
+      op->output_names = next_op->output_names;
+      for (const auto &output_name : next_op->output_names) {
+        const auto &consumer = operators_maps_.find(output_name);
+        if (consumer == operators_maps_.end()) {
+          continue;
+        }
+        auto &input_operands = consumer->second->input_operands;
+        const auto &operand_iter = input_operands.find(next_op->name);
+        if (operand_iter == input_operands.end()) {
+          continue;
+        }
+        std::shared_ptr<RuntimeOperand> input_operand = operand_iter->second;
+        input_operands.erase(operand_iter);
+        input_operand->name = op->name;
+        input_operands.insert({op->name, input_operand});
+      }
+      fused_names.insert(next_op->name);
+      operators_maps_.erase(next_op->name);
+    }
+  }
+
+  if (!fused_names.empty()) {
+    this->operators_.erase(
+        std::remove_if(this->operators_.begin(), this->operators_.end(),
+                       [&fused_names](const auto &op) {
+                         return fused_names.count(op->name) > 0;
+                       }),
+        this->operators_.end());
+    LOG(INFO) << "Fused " << fused_names.size()
+              << " operators into the convolution layers";
+  }
+}
+
+bool RuntimeGraph::FoldBatchNorm(
+    const std::shared_ptr<RuntimeOperator> &conv_op,
+    const std::shared_ptr<RuntimeOperator> &bn_op) {
+  const auto &bn_attrs = bn_op->attribute;
+  if (bn_attrs.find("running_mean") == bn_attrs.end() ||
+      bn_attrs.find("running_var") == bn_attrs.end() ||
+      conv_op->attribute.find("weight") == conv_op->attribute.end()) {
+    return false;
+  }
+  float eps = 1e-5f;
+  if (bn_op->params.find("eps") != bn_op->params.end()) {
+    auto eps_param = std::dynamic_pointer_cast<RuntimeParameterFloat>(
+        bn_op->params.at("eps"));
+    if (eps_param == nullptr) {
+      return false;
+    }
+    eps = eps_param->value;
+  }
+
+  const std::vector<float> &mean = bn_attrs.at("running_mean")->get<float>(false);
+  const std::vector<float> &var = bn_attrs.at("running_var")->get<float>(false);
+  const uint32_t channels = mean.size();
+  std::vector<float> gamma(channels, 1.f);
+  std::vector<float> beta(channels, 0.f);
+  if (bn_attrs.find("weight") != bn_attrs.end()) {
+    gamma = bn_attrs.at("weight")->get<float>(false);
+  }
+  if (bn_attrs.find("bias") != bn_attrs.end()) {
+    beta = bn_attrs.at("bias")->get<float>(false);
+  }
+  if (var.size() != channels || gamma.size() != channels ||
+      beta.size() != channels) {
+    return false;
+  }
+
+  const auto &weight_attr = conv_op->attribute.at("weight");
+  std::vector<float> weight = weight_attr->get<float>(false);
+  if (weight_attr->shape.empty() || weight_attr->shape.at(0) != channels ||
+      weight.size() % channels != 0) {
+    return false;
+  }
+
+  std::vector<float> bias(channels, 0.f);
+  const auto &bias_iter = conv_op->attribute.find("bias");
+  if (bias_iter != conv_op->attribute.end()) {
+    bias = bias_iter->second->get<float>(false);
+    if (bias.size() != channels) {
+      return false;
+    }
+  }
+
+  // w' = w * gamma / sqrt(var + eps)
+  // b' = (b - mean) * gamma / sqrt(var + eps) + beta
+  const uint32_t kernel_size = weight.size() / channels;
+  for (uint32_t k = 0; k < channels; ++k) {
+    const float scale = gamma.at(k) / std::sqrt(var.at(k) + eps);
+    for (uint32_t j = 0; j < kernel_size; ++j) {
+      weight.at(k * kernel_size + j) *= scale;
+    }
+    bias.at(k) = (bias.at(k) - mean.at(k)) * scale + beta.at(k);
+  }
+
+  // 折叠后的权重不再引用权重文件的内存映射
+  weight_attr->ClearWeight();
+  weight_attr->weight_data.resize(weight.size() * sizeof(float));
+  memcpy(weight_attr->weight_data.data(), weight.data(),
+         weight.size() * sizeof(float));
+
+  std::shared_ptr<RuntimeAttribute> bias_attr =
+      std::make_shared<RuntimeAttribute>();
+  bias_attr->type = RuntimeDataType::kTypeFloat32;
+  bias_attr->shape = {int(channels)};
+  bias_attr->weight_data.resize(bias.size() * sizeof(float));
+  memcpy(bias_attr->weight_data.data(), bias.data(),
+         bias.size() * sizeof(float));
+  conv_op->attribute["bias"] = bias_attr;
+  conv_op->params["bias"] = std::make_shared<RuntimeParameterBool>(true);
+  return true;
+}
+
+void RuntimeGraph::set_memory_planning(bool memory_planning) {
+  const bool planned_before = memory_planning_ && !parallel_execution_;
+  this->memory_planning_ = memory_planning;
+  const bool planned_after = memory_planning_ && !parallel_execution_;
+  if (graph_state_ == GraphState::Complete && planned_before != planned_after) {
+    this->InitGraphOutputs(planned_after);
+  }
+}
+
+bool RuntimeGraph::memory_planning() const { return this->memory_planning_; }
+
+void RuntimeGraph::set_cat_views(bool cat_views) {
+  const bool changed = this->cat_views_ != cat_views;
+  this->cat_views_ = cat_views;
+  if (graph_state_ == GraphState::Complete && changed) {
+    this->InitGraphOutputs(memory_planning_ && !parallel_execution_);
+  }
+}
+
+bool RuntimeGraph::cat_views() const { return this->cat_views_; }
+
+void RuntimeGraph::set_plan_export(bool plan_export) {
+  this->plan_export_ = plan_export;
+}
+
+bool RuntimeGraph::plan_export() const { return this->plan_export_; }
+
+void RuntimeGraph::set_blocked_layout(bool blocked_layout) {
+  this->blocked_layout_ = blocked_layout;
+}
+
+bool RuntimeGraph::blocked_layout() const { return this->blocked_layout_; }
+
+void RuntimeGraph::set_max_batch_size(uint32_t max_batch_size) {
+  LOG_IF(WARNING, graph_state_ == GraphState::Complete)
+          << "The graph has been built, max batch size will not be changed";
+  this->max_batch_size_ = max_batch_size;
+}
+
+uint32_t RuntimeGraph::max_batch_size() const { return this->max_batch_size_; }
+
+std::map<std::string, std::pair<std::shared_ptr<RuntimeOperator>, uint32_t>>
+RuntimeGraph::CatChannelViews() const {
+  std::map<std::string, std::pair<std::shared_ptr<RuntimeOperator>, uint32_t>>
+      cat_views;
+  for (const auto &op : topo_operators_) {
+    if (op->type != "torch.cat" || op->output_operands == nullptr) {
+      continue;
+    }
+    const auto &dim_iter = op->params.find("dim");
+    if (dim_iter == op->params.end()) {
+      continue;
+    }
+    const auto dim =
+        std::dynamic_pointer_cast<RuntimeParameterInt>(dim_iter->second);
+    const std::vector<int32_t> &output_shapes = op->output_operands->shapes;
+    if (dim == nullptr || (dim->value != 1 && dim->value != -3) ||
+        output_shapes.size() != 4) {
+      continue;
+    }
+
+    bool channel_concat = true;
+    uint32_t start_channel = 0;
+    std::map<std::string, std::pair<std::shared_ptr<RuntimeOperator>, uint32_t>>
+        op_views;
+    for (const auto &input_operand : op->input_operands_seq) {
+      const std::vector<int32_t> &input_shapes = input_operand->shapes;
+      if (input_shapes.size() != 4 || input_shapes.at(0) != output_shapes.at(0) ||
+          input_shapes.at(2) != output_shapes.at(2) ||
+          input_shapes.at(3) != output_shapes.at(3)) {
+        channel_concat = false;
+        break;
+      }
+      // 输入节点的输出是计算图的输入，嵌套的cat和已经作为视图的输出仍然需要复制
+      const auto &producer_iter = operators_maps_.find(input_operand->name);
+      if (producer_iter != operators_maps_.end()) {
+        const auto &producer = producer_iter->second;
+        if (producer->type != "pnnx.Input" && producer->type != "torch.cat" &&
+            producer->output_operands != nullptr &&
+            producer->output_operands->shapes == input_shapes &&
+            cat_views.find(producer->name) == cat_views.end() &&
+            op_views.find(producer->name) == op_views.end()) {
+          op_views.insert({producer->name, {op, start_channel}});
+        }
+      }
+      start_channel += input_shapes.at(1);
+    }
+    if (channel_concat && start_channel == output_shapes.at(1)) {
+      cat_views.insert(op_views.begin(), op_views.end());
+    }
+  }
+  return cat_views;
+}
+
+void RuntimeGraph::InitGraphOutputs(bool memory_planning) {
+  // 输出操作数的批次大小统一为计算图的最大批次大小
+  this->output_plan_ = OutputPlan{};
+  this->batch_size_ = 0;
+  for (const auto &op : topo_operators_) {
+    if (op->output_operands != nullptr) {
+      auto &operand_shapes = op->output_operands->shapes;
+      operand_shapes.at(0) =
+          RuntimeOperatorUtils::OperandBatchSize(operand_shapes, max_batch_size_);
+      output_plan_.max_batch_size =
+          std::max(output_plan_.max_batch_size, uint32_t(operand_shapes.at(0)));
+    }
+  }
+  // 在通道维度上拼接时，前驱节点直接写入cat的输出张量
+  const auto cat_views =
+      cat_views_ ? this->CatChannelViews()
+                 : std::map<std::string,
+                            std::pair<std::shared_ptr<RuntimeOperator>, uint32_t>>{};
+  // 展平前后内存排布相同时，flatten直接使用前驱节点的输出张量
+  const auto flatten_views = this->FlattenViews(cat_views);
+  const std::set<std::string> blocked_operators =
+      blocked_layout_ ? this->BlockedLayoutOperators() : std::set<std::string>{};
+  // 连续的最大池化由第一个池化节点级联计算
+  const auto cascade_poolings =
+      operator_fusion_ ? this->CascadePoolings(blocked_operators)
+                       : std::map<std::string,
+                                  std::vector<std::shared_ptr<RuntimeOperator>>>{};
+  // 输出张量所在的内存块，以及共享这个内存块的其他节点
+  std::map<std::string, std::vector<std::shared_ptr<RuntimeOperator>>>
+      block_sharers;
+  for (const auto &[name, cat_view] : cat_views) {
+    block_sharers[cat_view.first->name].push_back(operators_maps_.at(name));
+  }
+  for (const auto &[name, producer] : flatten_views) {
+    block_sharers[producer->name].push_back(operators_maps_.at(name));
+  }
+  // 后继池化节点的输出在第一个池化节点执行时写入，内存块从那时开始使用
+  for (const auto &[name, cascade_ops] : cascade_poolings) {
+    for (const auto &cascade_op : cascade_ops) {
+      const auto &cat_iter = cat_views.find(cascade_op->name);
+      const std::string &block_owner = cat_iter != cat_views.end()
+                                           ? cat_iter->second.first->name
+                                           : cascade_op->name;
+      block_sharers[block_owner].push_back(operators_maps_.at(name));
+    }
+  }
+
+  std::vector<std::shared_ptr<RuntimeOperator>> output_operators;
+  std::vector<size_t> tensor_sizes;
+  for (const auto &op : topo_operators_) {
+    const auto &output_operand = op->output_operands;
+    // 输入节点的输出就是计算图的输入，输出节点的输出操作数是前驱节点的输出
+    if (output_operand == nullptr || op->type == "pnnx.Input" ||
+        op->type == "pnnx.Output" || cat_views.count(op->name) ||
+        flatten_views.count(op->name)) {
+      continue;
+    }
+    const std::vector<int32_t> &operand_shapes = output_operand->shapes;
+    CHECK(operand_shapes.size() >= 2 && operand_shapes.size() <= 4)
+            << "Unsupported shape sizes: " << operand_shapes.size();
+    size_t tensor_size = 1;
+    for (uint32_t i = 1; i < operand_shapes.size(); ++i) {
+      CHECK(operand_shapes.at(i) > 0);
+      tensor_size *= operand_shapes.at(i);
+    }
+    output_operators.push_back(op);
+    tensor_sizes.push_back(tensor_size);
+  }
+
+  // 内存块的大小和批次大小成正比，按照单个样本规划，推理时乘以批次大小
+  std::vector<size_t> operand_offsets(output_operators.size(), 0);
+  size_t arena_size = 0;
+  if (memory_planning) {
+    std::map<std::string, size_t> topo_indices;
+    for (size_t i = 0; i < topo_operators_.size(); ++i) {
+      topo_indices.insert({topo_operators_.at(i)->name, i});
+    }
+
+    // 按照拓扑顺序为每个输出操作数分配一个内存块，内存块在最后一个
+    // 后继节点执行完成后被释放，供之后的输出操作数复用
+    std::vector<size_t> block_sizes;
+    std::vector<size_t> block_last_use;
+    std::vector<size_t> operand_blocks(output_operators.size(), 0);
+    for (size_t i = 0; i < output_operators.size(); ++i) {
+      const auto &op = output_operators.at(i);
+      // 共享内存块的节点中最先执行的节点开始使用内存块，
+      // 直到这些节点的所有后继节点执行完成，例如cat和它的前驱节点
+      std::vector<std::shared_ptr<RuntimeOperator>> sharers{op};
+      if (const auto &sharers_iter = block_sharers.find(op->name);
+          sharers_iter != block_sharers.end()) {
+        sharers.insert(sharers.end(), sharers_iter->second.begin(),
+                       sharers_iter->second.end());
+      }
+      size_t first_use = topo_indices.at(op->name);
+      size_t last_use = first_use;
+      for (const auto &sharer : sharers) {
+        first_use = std::min(first_use, topo_indices.at(sharer->name));
+        for (const auto &[_, next_op] : sharer->output_operators) {
+          if (next_op->type == "pnnx.Output") {
+            // 计算图的输出需要保留到推理结束之后
+            last_use = std::numeric_limits<size_t>::max();
+          } else {
+            last_use = std::max(last_use, topo_indices.at(next_op->name));
+          }
+        }
+      }
+
+      const size_t operand_size = tensor_sizes.at(i);
+      // 优先选择能放下当前操作数的最小空闲块，否则扩大最大的空闲块
+      int64_t best_fit = -1;
+      int64_t largest_free = -1;
+      for (size_t b = 0; b < block_sizes.size(); ++b) {
+        if (block_last_use.at(b) >= first_use) {
+          continue;
+        }
+        if (block_sizes.at(b) >= operand_size &&
+            (best_fit < 0 || block_sizes.at(b) < block_sizes.at(best_fit))) {
+          best_fit = int64_t(b);
+        }
+        if (largest_free < 0 ||
+            block_sizes.at(b) > block_sizes.at(largest_free)) {
+          largest_free = int64_t(b);
+        }
+      }
+
+      size_t block = 0;
+      if (best_fit >= 0) {
+        block = best_fit;
+      } else if (largest_free >= 0) {
+        block = largest_free;
+        block_sizes.at(block) = operand_size;
+      } else {
+        block = block_sizes.size();
+        block_sizes.push_back(operand_size);
+        block_last_use.push_back(0);
+      }
+      block_last_use.at(block) = last_use;
+      operand_blocks.at(i) = block;
+    }
+
+    std::vector<size_t> block_offsets(block_sizes.size(), 0);
+    for (size_t b = 0; b < block_sizes.size(); ++b) {
+      block_offsets.at(b) = arena_size;
+      arena_size += block_sizes.at(b);
+    }
+    for (size_t i = 0; i < output_operators.size(); ++i) {
+      operand_offsets.at(i) = block_offsets.at(operand_blocks.at(i));
+    }
+
+    const size_t total_size =
+        std::accumulate(tensor_sizes.begin(), tensor_sizes.end(), size_t(0));
+    LOG(INFO) << "Activation memory per sample after planning: "
+              << arena_size * sizeof(float) << " bytes, before planning: "
+              << total_size * sizeof(float) << " bytes";
+  } else {
+    // 不进行内存规划时，每个输出操作数占用arena中独立的一段
+    for (size_t i = 0; i < output_operators.size(); ++i) {
+      operand_offsets.at(i) = arena_size;
+      arena_size += tensor_sizes.at(i);
+    }
+  }
+
+  output_plan_.operators = std::move(output_operators);
+  output_plan_.tensor_sizes = std::move(tensor_sizes);
+  output_plan_.offsets = std::move(operand_offsets);
+  output_plan_.arena_size = arena_size;
+  output_plan_.cat_views = cat_views;
+  output_plan_.flatten_views = flatten_views;
+  output_plan_.blocked_operators = blocked_operators;
+
+  // 标记使用通道分块排布的操作数，cat的输入和输出排布相同，
+  // 所以作为cat视图的张量和cat输出的分块位置一致
+  for (const auto &op : topo_operators_) {
+    for (const auto &[_, input_operand] : op->input_operands) {
+      input_operand->layout = blocked_operators.count(input_operand->name)
+                                  ? TensorLayout::kNCHW8c
+                                  : TensorLayout::kNCHW;
+    }
+    if (op->output_operands == nullptr || op->type == "pnnx.Input" ||
+        op->type == "pnnx.Output") {
+      continue;
+    }
+    op->output_operands->datas.clear();
+    op->output_operands->layout = blocked_operators.count(op->name)
+                                      ? TensorLayout::kNCHW8c
+                                      : TensorLayout::kNCHW;
+  }
+  if (!cat_views.empty()) {
+    LOG(INFO) << "Write the outputs of " << cat_views.size()
+              << " operators into the concatenated tensors directly";
+  }
+  if (!blocked_operators.empty()) {
+    LOG(INFO) << "The outputs of " << blocked_operators.size()
+              << " operators use the NCHW8c blocked layout";
+  }
+
+  for (const auto &op : topo_operators_) {
+    if (auto pooling_layer =
+            std::dynamic_pointer_cast<MaxPoolingLayer>(op->layer)) {
+      pooling_layer->set_cascade_outputs({});
+      pooling_layer->set_cascaded(false);
+    }
+  }
+  for (const auto &[name, cascade_ops] : cascade_poolings) {
+    std::vector<std::shared_ptr<RuntimeOperand>> cascade_outputs;
+    for (const auto &cascade_op : cascade_ops) {
+      std::dynamic_pointer_cast<MaxPoolingLayer>(cascade_op->layer)
+          ->set_cascaded(true);
+      cascade_outputs.push_back(cascade_op->output_operands);
+    }
+    std::dynamic_pointer_cast<MaxPoolingLayer>(operators_maps_.at(name)->layer)
+        ->set_cascade_outputs(std::move(cascade_outputs));
+  }
+  if (!cascade_poolings.empty()) {
+    LOG(INFO) << "Cascade " << cascade_poolings.size()
+              << " groups of consecutive max pooling operators";
+  }
+}
+
+std::shared_ptr<float> RuntimeGraph::ArenaPointer(float *ptr) const {
+  CHECK(activation_arena_ != nullptr);
+  CHECK(ptr >= activation_arena_->memptr() &&
+        ptr < activation_arena_->memptr() + activation_arena_->n_elem);
+  // 和arena共享引用计数，arena被替换或者计算图析构之后，
+  // 已经返回给调用者的输出张量仍然可以访问
+  return std::shared_ptr<float>(activation_arena_, ptr);
+}
+
+void RuntimeGraph::InitGraphBatch(uint32_t batch_size) {
+  CHECK(batch_size > 0 && batch_size <= output_plan_.max_batch_size)
+          << "The batch size " << batch_size
+          << " exceeds the max batch size of the graph "
+          << output_plan_.max_batch_size;
+  // 批次变小时复用已经分配的内存，只有超过已分配的大小时才重新分配
+  const size_t arena_size = output_plan_.arena_size * batch_size;
+  if (activation_arena_ == nullptr || activation_arena_->n_elem < arena_size) {
+    this->activation_arena_ = std::make_shared<arma::fvec>(arena_size);
+  }
+
+  for (const auto &op : topo_operators_) {
+    for (const auto &[_, input_operand] : op->input_operands) {
+      input_operand->datas.resize(batch_size);
+    }
+  }
+
+  for (size_t i = 0; i < output_plan_.operators.size(); ++i) {
+    const auto &output_operand = output_plan_.operators.at(i)->output_operands;
+    const std::vector<int32_t> &operand_shapes = output_operand->shapes;
+    const std::vector<uint32_t> tensor_shapes(operand_shapes.begin() + 1,
+                                              operand_shapes.end());
+    const size_t tensor_size = output_plan_.tensor_sizes.at(i);
+    float *operand_ptr =
+        activation_arena_->memptr() + output_plan_.offsets.at(i) * batch_size;
+    output_operand->datas.clear();
+    for (uint32_t b = 0; b < batch_size; ++b) {
+      output_operand->datas.push_back(std::make_shared<Tensor<float>>(
+          ArenaPointer(operand_ptr + b * tensor_size), tensor_shapes));
+    }
+  }
+
+  // 前驱节点的输出张量是cat输出张量中连续的若干个通道
+  for (const auto &[name, cat_view] : output_plan_.cat_views) {
+    const auto &[cat_op, start_channel] = cat_view;
+    const auto &output_operand = operators_maps_.at(name)->output_operands;
+    const std::vector<int32_t> &operand_shapes = output_operand->shapes;
+    const std::vector<uint32_t> tensor_shapes{uint32_t(operand_shapes.at(1)),
+                                              uint32_t(operand_shapes.at(2)),
+                                              uint32_t(operand_shapes.at(3))};
+    const uint32_t plane_size = operand_shapes.at(2) * operand_shapes.at(3);
+    const auto &cat_datas = cat_op->output_operands->datas;
+    output_operand->datas.clear();
+    for (const auto &cat_data : cat_datas) {
+      output_operand->datas.push_back(std::make_shared<Tensor<float>>(
+          ArenaPointer(cat_data->raw_ptr(start_channel * plane_size)),
+          tensor_shapes));
+    }
+  }
+
+  for (const auto &[name, producer] : output_plan_.flatten_views) {
+    const auto &output_operand = operators_maps_.at(name)->output_operands;
+    const std::vector<int32_t> &operand_shapes = output_operand->shapes;
+    const std::vector<uint32_t> tensor_shapes(operand_shapes.begin() + 1,
+                                              operand_shapes.end());
+    output_operand->datas.clear();
+    for (const auto &producer_data : producer->output_operands->datas) {
+      output_operand->datas.push_back(std::make_shared<Tensor<float>>(
+          ArenaPointer(producer_data->raw_ptr()), tensor_shapes));
+    }
+  }
+
+  for (const auto &op : topo_operators_) {
+    if (op->output_operands == nullptr || op->type == "pnnx.Input" ||
+        op->type == "pnnx.Output") {
+      continue;
+    }
+    for (const auto &output_data : op->output_operands->datas) {
+      output_data->set_layout(op->output_operands->layout);
+    }
+  }
+  this->batch_size_ = batch_size;
+}
+
+std::map<std::string, std::vector<std::shared_ptr<RuntimeOperator>>>
+RuntimeGraph::CascadePoolings(
+    const std::set<std::string> &blocked_operators) const {
+  std::map<std::string, std::vector<std::shared_ptr<RuntimeOperator>>>
+      cascade_poolings;
+  std::set<std::string> cascaded_names;
+  for (const auto &op : topo_operators_) {
+    if (op->type != "nn.MaxPool2d" || cascaded_names.count(op->name)) {
+      continue;
+    }
+    std::vector<std::shared_ptr<RuntimeOperator>> cascade_ops;
+    std::shared_ptr<RuntimeOperator> current_op = op;
+    auto current_layer = std::dynamic_pointer_cast<MaxPoolingLayer>(op->layer);
+    while (current_layer != nullptr) {
+      // 后继节点中只以当前池化的输出作为输入的相同池化，例如SPPF中的下一个池化
+      std::shared_ptr<RuntimeOperator> next_op;
+      std::shared_ptr<MaxPoolingLayer> next_layer;
+      for (const auto &[_, consumer] : current_op->output_operators) {
+        auto consumer_layer =
+            std::dynamic_pointer_cast<MaxPoolingLayer>(consumer->layer);
+        if (consumer->type == "nn.MaxPool2d" && consumer_layer != nullptr &&
+            consumer->input_operands_seq.size() == 1 &&
+            current_layer->IsCascadable(*consumer_layer) &&
+            blocked_operators.count(consumer->name) ==
+                blocked_operators.count(op->name)) {
+          next_op = consumer;
+          next_layer = consumer_layer;
+          break;
+        }
+      }
+      if (next_op == nullptr) {
+        break;
+      }
+      cascade_ops.push_back(next_op);
+      cascaded_names.insert(next_op->name);
+      current_op = next_op;
+      current_layer = next_layer;
+    }
+    if (!cascade_ops.empty()) {
+      cascade_poolings.insert({op->name, cascade_ops});
+    }
+  }
+  return cascade_poolings;
+}
+
+std::set<std::string> RuntimeGraph::BlockedLayoutOperators() const {
+  // 卷积可以读取和写入任意一种排布，其他节点保持输入的排布
+  static const std::set<std::string> blocked_types{
+      "nn.Conv2d", "nn.MaxPool2d", "nn.Upsample", "nn.SiLU",
+      "nn.ReLU",   "nn.Sigmoid",   "F.sigmoid",   "torch.cat",
+      "pnnx.Expression"};
+  auto blocked_supported = [](const std::shared_ptr<RuntimeOperator> &op) {
+    if (!blocked_types.count(op->type)) {
+      return false;
+    }
+    if (op->type != "pnnx.Expression") {
+      return true;
+    }
+    // 表达式只在不需要广播时逐元素计算，和排布无关
+    if (op->output_operands == nullptr) {
+      return false;
+    }
+    for (const auto &input_operand : op->input_operands_seq) {
+      if (input_operand->shapes != op->output_operands->shapes) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  std::set<std::string> blocked_operators;
+  for (const auto &op : topo_operators_) {
+    if (!blocked_supported(op) || op->output_operands == nullptr ||
+        op->output_operators.empty()) {
+      continue;
+    }
+    const std::vector<int32_t> &output_shapes = op->output_operands->shapes;
+    if (output_shapes.size() != 4 ||
+        output_shapes.at(1) % kChannelBlockSize != 0) {
+      continue;
+    }
+    // 后继节点中有不支持分块排布的节点时，例如计算图的输出，仍然使用NCHW排布
+    bool consumers_blocked = true;
+    for (const auto &[_, next_op] : op->output_operators) {
+      if (!blocked_supported(next_op)) {
+        consumers_blocked = false;
+        break;
+      }
+    }
+    if (consumers_blocked) {
+      blocked_operators.insert(op->name);
+    }
+  }
+
+  // 输入和输出的排布不一致时，这些节点全部退回NCHW排布，直到没有冲突为止
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (const auto &op : topo_operators_) {
+      if (!blocked_supported(op) || op->type == "nn.Conv2d") {
+        continue;
+      }
+      const bool output_blocked = blocked_operators.count(op->name) > 0;
+      bool same_layout = true;
+      for (const auto &input_operand : op->input_operands_seq) {
+        if ((blocked_operators.count(input_operand->name) > 0) !=
+            output_blocked) {
+          same_layout = false;
+          break;
+        }
+      }
+      if (same_layout) {
+        continue;
+      }
+      changed |= blocked_operators.erase(op->name) > 0;
+      for (const auto &input_operand : op->input_operands_seq) {
+        changed |= blocked_operators.erase(input_operand->name) > 0;
+      }
+    }
+  }
+  return blocked_operators;
+}
+
+std::map<std::string, std::shared_ptr<RuntimeOperator>>
+RuntimeGraph::FlattenViews(
+    const std::map<std::string,
+                   std::pair<std::shared_ptr<RuntimeOperator>, uint32_t>>
+        &cat_views) const {
+  std::map<std::string, std::shared_ptr<RuntimeOperator>> flatten_views;
+  for (const auto &op : topo_operators_) {
+    if (op->type != "torch.flatten" || op->output_operands == nullptr ||
+        op->input_operands_seq.size() != 1) {
+      continue;
+    }
+    const auto &input_operand = op->input_operands_seq.front();
+    const auto &producer_iter = operators_maps_.find(input_operand->name);
+    if (producer_iter == operators_maps_.end()) {
+      continue;
+    }
+    // 计算图的输入和已经作为视图的输出不再被flatten共享
+    const auto &producer = producer_iter->second;
+    if (producer->type == "pnnx.Input" || producer->type == "torch.flatten" ||
+        producer->output_operands == nullptr ||
+        cat_views.find(producer->name) != cat_views.end()) {
+      continue;
+    }
+
+    const std::vector<int32_t> &input_shapes = producer->output_operands->shapes;
+    const std::vector<int32_t> &output_shapes = op->output_operands->shapes;
+    if (input_shapes.size() < 2 || output_shapes.size() < 2 ||
+        input_shapes.front() != output_shapes.front()) {
+      continue;
+    }
+    const std::vector<uint32_t> input_tensor_shapes(input_shapes.begin() + 1,
+                                                    input_shapes.end());
+    const std::vector<uint32_t> output_tensor_shapes(output_shapes.begin() + 1,
+                                                     output_shapes.end());
+    if (TensorView::IsReshapeInPlace(input_tensor_shapes,
+                                     output_tensor_shapes)) {
+      flatten_views.insert({op->name, producer});
+    }
+  }
+  return flatten_views;
+}
+
 void RuntimeGraph::Build(const std::string &input_name,
                          const std::string &output_name) {
   if (graph_state_ == GraphState::Complete) {
@@ -309,7 +1271,79 @@ void RuntimeGraph::Build(const std::string &input_name,
   LOG_IF(FATAL, this->operators_.empty())
           << "Graph operators is empty, may be no init";
 
+  if (operator_fusion_) {
+    this->FuseOperators();
+  }
+
   // 构建图关系
+  this->InitOperatorsOutputLink();
+  this->InitOperatorsLayer();
+
+  // 构建拓扑顺序
+  topo_operators_.clear();
+  for (const auto &[_, op] : operators_maps_) {
+    // 根据输入节点构建拓扑排序
+    if (op->type == "pnnx.Input" && !op->has_forward) {
+      this->ReverseTopo(op);
+    }
+  }
+
+  CHECK(topo_operators_.size() == operators_.size())
+          << "Build wrong topo queue";
+  std::reverse(topo_operators_.begin(), topo_operators_.end());
+  this->InitScheduleLevels();
+
+  // 初始化节点的输入和输出空间
+  RuntimeOperatorUtils::InitOperatorInput(operators_, max_batch_size_);
+  // 被融合的节点已经从计算图中删除，pnnx节点需要和计算节点一一对应
+  std::vector<pnnx::Operator *> pnnx_operators;
+  for (pnnx::Operator *op : graph_->ops) {
+    if (op != nullptr && operators_maps_.find(op->name) != operators_maps_.end()) {
+      pnnx_operators.push_back(op);
+    }
+  }
+  RuntimeOperatorUtils::InitOperatorOutput(pnnx_operators, operators_, false,
+                                           max_batch_size_);
+  // 并行执行时节点的执行顺序不固定，无法根据拓扑顺序复用内存
+  this->InitGraphOutputs(memory_planning_ && !parallel_execution_);
+
+  // 分配计算图中各个Layer共享的临时空间
+  this->InitGraphWorkspace();
+
+  graph_state_ = GraphState::Complete;
+  input_name_ = input_name;
+  output_name_ = output_name;
+  if (graph_ != nullptr) {
+    graph_.reset();
+    graph_ = nullptr;
+  }
+}
+
+void RuntimeGraph::InitGraphWorkspace() {
+  size_t workspace_size = 0;
+  for (const auto &kOperator : this->operators_) {
+    if (kOperator->layer != nullptr) {
+      workspace_size =
+          std::max(workspace_size, kOperator->layer->workspace_size());
+    }
+  }
+
+  this->workspace_.reset();
+  this->thread_workspaces_.clear();
+  this->workspace_size_ = workspace_size;
+  if (workspace_size == 0) {
+    return;
+  }
+  // 计算图中的算子是依次执行的，所以所有算子可以共享同一块临时空间
+  this->workspace_ = std::make_shared<arma::fvec>(workspace_size);
+  for (const auto &kOperator : this->operators_) {
+    if (kOperator->layer != nullptr) {
+      kOperator->layer->set_workspace(this->workspace_);
+    }
+  }
+}
+
+void RuntimeGraph::InitOperatorsOutputLink() {
   for (const auto &current_op : this->operators_) {
     // 获取当前节点的所有后继节点的names，遍历根据next_op_name从operators_maps_中插入所需要的节点
     const std::vector<std::string> &output_names = current_op->output_names;
@@ -320,8 +1354,19 @@ void RuntimeGraph::Build(const std::string &input_name,
       }
     }
   }
+}
 
+void RuntimeGraph::InitOperatorsLayer() {
+  this->plan_attributes_.clear();
   for (const auto &kOperator : this->operators_) {
+    if (plan_export_) {
+      // 内存映射中的权重只增加引用计数，算子融合产生的权重会复制一份
+      auto &attributes = this->plan_attributes_[kOperator->name];
+      for (const auto &[name, attribute] : kOperator->attribute) {
+        attributes.insert(
+            {name, std::make_shared<RuntimeAttribute>(*attribute)});
+      }
+    }
     // 除了输入和输出节点，都创建layer
     if (kOperator->type != "pnnx.Input" && kOperator->type != "pnnx.Output") {
       std::shared_ptr<Layer> layer = RuntimeGraph::CreateLayer(kOperator);
@@ -333,30 +1378,22 @@ void RuntimeGraph::Build(const std::string &input_name,
       }
     }
   }
+}
 
-  // 初始化节点的输入和输出空间
-  RuntimeOperatorUtils::InitOperatorInput(operators_);
-  RuntimeOperatorUtils::InitOperatorOutput(graph_->ops, operators_);
-
-  // 构建拓扑顺序
-  topo_operators_.clear();
-  for (const auto &[_, op] : operators_maps_) {
-    // 根据输入节点构建拓扑排序
-    if (op->type == "pnnx.Input" && !op->has_forward) {
-      this->ReverseTopo(op);
+void RuntimeGraph::InitScheduleLevels() {
+  std::map<std::string, uint32_t> op_levels;
+  schedule_levels_.clear();
+  for (const auto &op : topo_operators_) {
+    // 拓扑顺序保证前驱节点的层级已经确定
+    const uint32_t level = op_levels[op->name];
+    if (level >= schedule_levels_.size()) {
+      schedule_levels_.resize(level + 1);
+    }
+    schedule_levels_.at(level).push_back(op);
+    for (const auto &[_, next_op] : op->output_operators) {
+      uint32_t &next_level = op_levels[next_op->name];
+      next_level = std::max(next_level, level + 1);
     }
-  }
-
-  CHECK(topo_operators_.size() == operators_.size())
-          << "Build wrong topo queue";
-  std::reverse(topo_operators_.begin(), topo_operators_.end());
-
-  graph_state_ = GraphState::Complete;
-  input_name_ = input_name;
-  output_name_ = output_name;
-  if (graph_ != nullptr) {
-    graph_.reset();
-    graph_ = nullptr;
   }
 }
 
@@ -387,7 +1424,17 @@ void RuntimeGraph::InitGraphAttrs(
         std::shared_ptr<RuntimeAttribute> runtime_attribute =
             std::make_shared<RuntimeAttribute>();
         runtime_attribute->type = RuntimeDataType::kTypeFloat32;
-        runtime_attribute->weight_data = attr.data;
+        if (attr.mapped_data != nullptr) {
+          // 引用权重文件内存映射中的权重，不进行复制
+          size_t weight_count = 1;
+          for (int dim : attr.shape) {
+            weight_count *= dim;
+          }
+          runtime_attribute->mapped_weight = attr.mapped_data;
+          runtime_attribute->mapped_weight_size = weight_count * sizeof(float);
+        } else {
+          runtime_attribute->weight_data = attr.data;
+        }
         runtime_attribute->shape = attr.shape;
         runtime_operator->attribute.insert({name, runtime_attribute});
         break;
@@ -24,8 +24,20 @@
 #include "data/tensor_util.hpp"
 
 namespace kuiper_infer {
+int32_t RuntimeOperatorUtils::OperandBatchSize(
+    const std::vector<int32_t>& shapes, uint32_t max_batch_size) {
+  CHECK(!shapes.empty());
+  // 设置了最大批次大小时，模型文件中的批次大小只是导出时使用的示例
+  const int32_t batch =
+      max_batch_size > 0 ? int32_t(max_batch_size) : shapes.at(0);
+  CHECK(batch > 0) << "Dynamic batch size in the model file needs a max batch "
+                      "size of the graph!";
+  return batch;
+}
+
 void RuntimeOperatorUtils::InitOperatorInput(
-    const std::vector<std::shared_ptr<RuntimeOperator>>& operators) {
+    const std::vector<std::shared_ptr<RuntimeOperator>>& operators,
+    uint32_t max_batch_size) {
   if (operators.empty()) {
     LOG(ERROR) << "Operators for init input shapes is empty!";
     return;
@@ -42,23 +54,19 @@ void RuntimeOperatorUtils::InitOperatorInput(
         const auto& type = input_operand->type;
         CHECK(type == RuntimeDataType::kTypeFloat32)
             << "The graph only support float32 yet!";
-        const auto& input_operand_shape = input_operand->shapes;
+        auto& input_operand_shape = input_operand->shapes;
         // 得到需要初始化的空间
         auto& input_datas = input_operand->datas;
 
-        CHECK(!input_operand_shape.empty());
-        const int32_t batch = input_operand_shape.at(0);
-        CHECK(batch >= 0) << "Dynamic batch size is not supported!";
+        const int32_t batch =
+            OperandBatchSize(input_operand_shape, max_batch_size);
+        input_operand_shape.at(0) = batch;
         CHECK(input_operand_shape.size() == 2 ||
               input_operand_shape.size() == 4 ||
               input_operand_shape.size() == 3)
             << "Unsupported tensor shape sizes: " << input_operand_shape.size();
 
-        if (!input_datas.empty()) {
-          CHECK_EQ(input_datas.size(), batch);
-        } else {
-          input_datas.resize(batch);
-        }
+        input_datas.resize(batch);
       }
     }
   }
@@ -66,7 +74,8 @@ void RuntimeOperatorUtils::InitOperatorInput(
 
 void RuntimeOperatorUtils::InitOperatorOutput(
     const std::vector<pnnx::Operator*>& pnnx_operators,
-    const std::vector<std::shared_ptr<RuntimeOperator>>& operators) {
+    const std::vector<std::shared_ptr<RuntimeOperator>>& operators,
+    bool allocate_datas, uint32_t max_batch_size) {
   CHECK(!pnnx_operators.empty() && !operators.empty());
   CHECK(pnnx_operators.size() == operators.size());
   for (uint32_t i = 0; i < pnnx_operators.size(); ++i) {
@@ -81,12 +90,12 @@ void RuntimeOperatorUtils::InitOperatorOutput(
     pnnx::Operand* operand = operands.front();
     const auto& runtime_op = operators.at(i);
     CHECK(operand != nullptr) << "Operand output is null";
-    const std::vector<int32_t>& operand_shapes = operand->shape;
+    // 获取节点的输出张量应有形状，动态的批次大小替换为计算图的最大批次大小
+    std::vector<int32_t> operand_shapes = operand->shape;
+    const int32_t batch = OperandBatchSize(operand_shapes, max_batch_size);
+    operand_shapes.at(0) = batch;
     // 得到需要初始化的输出空间
     const auto& output_tensors = runtime_op->output_operands;
-    // 获取节点的输出张量应有形状
-    const int32_t batch = operand_shapes.at(0);
-    CHECK(batch >= 0) << "Dynamic batch size is not supported!";
     CHECK(operand_shapes.size() == 2 || operand_shapes.size() == 4 ||
           operand_shapes.size() == 3)
         << "Unsupported shape sizes: " << operand_shapes.size();
@@ -100,6 +109,10 @@ void RuntimeOperatorUtils::InitOperatorOutput(
       output_operand->shapes = operand_shapes;
       output_operand->type = RuntimeDataType::kTypeFloat32;
       output_operand->name = operand->name + "_output";
+      if (!allocate_datas) {
+        runtime_op->output_operands = std::move(output_operand);
+        continue;
+      }
       // 输出空间初始化
       for (int j = 0; j < batch; ++j) {
         if (operand_shapes.size() == 4) {
@@ -0,0 +1,538 @@
+// MIT License
+// Copyright (c) 2022 - 傅莘莘
+// Source URL: https://github.com/zjhellofss/KuiperInfer
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// 计算图的计划文件，保存构建完成的计算图，加载时不需要重新构建
+#include <glog/logging.h>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "layer/abstract/layer.hpp"
+#include "runtime/runtime_ir.hpp"
+
+namespace kuiper_infer {
+/**
+ * 计划文件的布局：
+ * 1. 文件头：magic、版本、描述部分的字节数和权重部分的起始位置
+ * 2. 描述部分：输入输出节点的名称，按照拓扑顺序排列的计算节点，
+ *    每个节点包含输入输出操作数的形状、参数以及权重在权重部分中的位置
+ * 3. 权重部分：每个权重按照kPlanAlignment字节对齐，加载时直接引用
+ */
+static constexpr uint32_t kPlanMagic = 0x4e4c504b;  // "KPLN"
+static constexpr uint32_t kPlanVersion = 1;
+static constexpr size_t kPlanAlignment = 64;
+static constexpr size_t kPlanHeaderSize = 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+
+static size_t AlignPlanOffset(size_t offset) {
+  return (offset + kPlanAlignment - 1) / kPlanAlignment * kPlanAlignment;
+}
+
+/// 将计划文件的描述部分写入内存中的缓冲区
+class PlanWriter {
+ public:
+  template <typename T>
+  void Write(const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value);
+    buffer_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  void Write(const std::string& value) {
+    Write(uint32_t(value.size()));
+    buffer_.append(value);
+  }
+
+  template <typename T>
+  void Write(const std::vector<T>& values) {
+    Write(uint32_t(values.size()));
+    for (const T& value : values) {
+      Write(value);
+    }
+  }
+
+  /**
+   * 记录一个权重，返回它在权重部分中的偏移量
+   * @param data 权重的起始地址
+   * @param size 权重的字节数
+   */
+  uint64_t AddBlob(const char* data, size_t size) {
+    const uint64_t offset = blob_size_;
+    blobs_.emplace_back(data, size);
+    blob_size_ = AlignPlanOffset(blob_size_ + size);
+    return offset;
+  }
+
+  const std::string& buffer() const { return buffer_; }
+
+  const std::vector<std::pair<const char*, size_t>>& blobs() const {
+    return blobs_;
+  }
+
+ private:
+  std::string buffer_;
+  std::vector<std::pair<const char*, size_t>> blobs_;
+  uint64_t blob_size_ = 0;
+};
+
+/// 读取计划文件的描述部分，越界时返回false
+class PlanReader {
+ public:
+  PlanReader(const char* begin, const char* end) : current_(begin), end_(end) {}
+
+  template <typename T>
+  bool Read(T& value) {
+    static_assert(std::is_trivially_copyable<T>::value);
+    if (size_t(end_ - current_) < sizeof(T)) {
+      return false;
+    }
+    memcpy(&value, current_, sizeof(T));
+    current_ += sizeof(T);
+    return true;
+  }
+
+  bool Read(std::string& value) {
+    uint32_t size = 0;
+    if (!Read(size) || size_t(end_ - current_) < size) {
+      return false;
+    }
+    value.assign(current_, size);
+    current_ += size;
+    return true;
+  }
+
+  template <typename T>
+  bool Read(std::vector<T>& values) {
+    uint32_t size = 0;
+    if (!Read(size)) {
+      return false;
+    }
+    // 元素数量来自文件，损坏的计划文件不能导致分配超出剩余字节数的内存；
+    // 字符串和数组元素至少包含一个uint32的长度
+    const size_t element_bytes = std::is_trivially_copyable<T>::value
+                                     ? sizeof(T)
+                                     : sizeof(uint32_t);
+    if (size_t(end_ - current_) / element_bytes < size) {
+      return false;
+    }
+    values.resize(size);
+    for (T& value : values) {
+      if (!Read(value)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  const char* current_;
+  const char* end_;
+};
+
+static void WritePlanParameter(PlanWriter& writer,
+                               const std::shared_ptr<RuntimeParameter>& param) {
+  writer.Write(int32_t(param->type));
+  switch (param->type) {
+    case RuntimeParameterType::kParameterBool: {
+      writer.Write(uint8_t(
+          std::dynamic_pointer_cast<RuntimeParameterBool>(param)->value));
+      break;
+    }
+    case RuntimeParameterType::kParameterInt: {
+      writer.Write(int32_t(
+          std::dynamic_pointer_cast<RuntimeParameterInt>(param)->value));
+      break;
+    }
+    case RuntimeParameterType::kParameterFloat: {
+      writer.Write(
+          std::dynamic_pointer_cast<RuntimeParameterFloat>(param)->value);
+      break;
+    }
+    case RuntimeParameterType::kParameterString: {
+      writer.Write(
+          std::dynamic_pointer_cast<RuntimeParameterString>(param)->value);
+      break;
+    }
+    case RuntimeParameterType::kParameterIntArray: {
+      writer.Write(
+          std::dynamic_pointer_cast<RuntimeParameterIntArray>(param)->value);
+      break;
+    }
+    case RuntimeParameterType::kParameterFloatArray: {
+      writer.Write(
+          std::dynamic_pointer_cast<RuntimeParameterFloatArray>(param)->value);
+      break;
+    }
+    case RuntimeParameterType::kParameterStringArray: {
+      writer.Write(
+          std::dynamic_pointer_cast<RuntimeParameterStringArray>(param)->value);
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+}
+
+static std::shared_ptr<RuntimeParameter> ReadPlanParameter(PlanReader& reader) {
+  int32_t type = 0;
+  if (!reader.Read(type)) {
+    return nullptr;
+  }
+  switch (RuntimeParameterType(type)) {
+    case RuntimeParameterType::kParameterUnknown: {
+      return std::make_shared<RuntimeParameter>();
+    }
+    case RuntimeParameterType::kParameterBool: {
+      uint8_t value = 0;
+      return reader.Read(value) ? std::make_shared<RuntimeParameterBool>(value)
+                                : nullptr;
+    }
+    case RuntimeParameterType::kParameterInt: {
+      int32_t value = 0;
+      return reader.Read(value) ? std::make_shared<RuntimeParameterInt>(value)
+                                : nullptr;
+    }
+    case RuntimeParameterType::kParameterFloat: {
+      float value = 0.f;
+      return reader.Read(value) ? std::make_shared<RuntimeParameterFloat>(value)
+                                : nullptr;
+    }
+    case RuntimeParameterType::kParameterString: {
+      std::string value;
+      return reader.Read(value)
+                 ? std::make_shared<RuntimeParameterString>(std::move(value))
+                 : nullptr;
+    }
+    case RuntimeParameterType::kParameterIntArray: {
+      std::vector<int> value;
+      return reader.Read(value)
+                 ? std::make_shared<RuntimeParameterIntArray>(std::move(value))
+                 : nullptr;
+    }
+    case RuntimeParameterType::kParameterFloatArray: {
+      std::vector<float> value;
+      return reader.Read(value) ? std::make_shared<RuntimeParameterFloatArray>(
+                                      std::move(value))
+                                : nullptr;
+    }
+    case RuntimeParameterType::kParameterStringArray: {
+      std::vector<std::string> value;
+      return reader.Read(value) ? std::make_shared<RuntimeParameterStringArray>(
+                                      std::move(value))
+                                : nullptr;
+    }
+    default: {
+      LOG(ERROR) << "Unknown parameter type in the plan: " << type;
+      return nullptr;
+    }
+  }
+}
+
+static void WritePlanAttribute(PlanWriter& writer, const std::string& name,
+                               const std::vector<int>& shape, const char* data,
+                               size_t size) {
+  writer.Write(name);
+  writer.Write(int32_t(RuntimeDataType::kTypeFloat32));
+  writer.Write(shape);
+  writer.Write(writer.AddBlob(data, size));
+  writer.Write(uint64_t(size));
+}
+
+/**
+ * 将计划文件映射到内存中，权重直接引用映射中的数据
+ * @param plan_path 计划文件的路径
+ * @param size 计划文件的字节数
+ * @return 计划文件的内容，打开失败时返回空
+ */
+static std::shared_ptr<const char> MapPlanFile(const std::string& plan_path,
+                                               size_t& size) {
+#if !defined(_WIN32)
+  const int fd = open(plan_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat file_stat {};
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0) {
+    close(fd);
+    return nullptr;
+  }
+  size = file_stat.st_size;
+  void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return nullptr;
+  }
+  return std::shared_ptr<const char>(
+      static_cast<const char*>(mapped),
+      [size](const char* data) { munmap((void*)data, size); });
+#else
+  std::ifstream plan_file(plan_path, std::ios::binary | std::ios::ate);
+  if (!plan_file.is_open()) {
+    return nullptr;
+  }
+  size = plan_file.tellg();
+  std::shared_ptr<char> data(new char[size], std::default_delete<char[]>());
+  plan_file.seekg(0);
+  if (!plan_file.read(data.get(), size)) {
+    return nullptr;
+  }
+  return data;
+#endif
+}
+
+bool RuntimeGraph::SavePlan(const std::string& plan_path) const {
+  if (graph_state_ != GraphState::Complete) {
+    LOG(ERROR) << "The graph need be built before saving the plan";
+    return false;
+  }
+  if (!plan_export_) {
+    LOG(ERROR) << "The weights of the graph are released, call "
+                  "set_plan_export(true) before building the graph";
+    return false;
+  }
+
+  PlanWriter writer;
+  writer.Write(input_name_);
+  writer.Write(output_name_);
+  writer.Write(uint32_t(topo_operators_.size()));
+  // Layer的排布结果需要保留到写入文件之后
+  std::vector<std::map<std::string, arma::fmat>> packed_weights;
+  packed_weights.reserve(topo_operators_.size());
+  for (const auto& op : topo_operators_) {
+    writer.Write(op->name);
+    writer.Write(op->type);
+
+    writer.Write(uint32_t(op->input_operands_seq.size()));
+    for (const auto& input_operand : op->input_operands_seq) {
+      writer.Write(input_operand->name);
+      writer.Write(int32_t(input_operand->type));
+      writer.Write(input_operand->shapes);
+    }
+    writer.Write(op->output_names);
+
+    const auto& output_operand = op->output_operands;
+    writer.Write(uint8_t(output_operand != nullptr));
+    if (output_operand != nullptr) {
+      writer.Write(output_operand->name);
+      writer.Write(output_operand->shapes);
+    }
+
+    writer.Write(uint32_t(op->params.size()));
+    for (const auto& [name, param] : op->params) {
+      writer.Write(name);
+      WritePlanParameter(writer, param);
+    }
+
+    // 从计划文件加载的排布结果不再重复保存，统一使用Layer当前的排布结果
+    std::map<std::string, std::shared_ptr<RuntimeAttribute>> attributes;
+    for (const auto& [name, attribute] : plan_attributes_.at(op->name)) {
+      if (name.find("packed.") != 0) {
+        attributes.insert({name, attribute});
+      }
+    }
+    packed_weights.push_back(op->layer != nullptr
+                                 ? op->layer->packed_weights()
+                                 : std::map<std::string, arma::fmat>{});
+    writer.Write(uint32_t(attributes.size() + packed_weights.back().size()));
+    for (const auto& [name, attribute] : attributes) {
+      CHECK(attribute->type == RuntimeDataType::kTypeFloat32)
+          << "The plan only support float32 weights yet!";
+      // 排布结果已经包含了全部的卷积核，原始的卷积核只保存形状
+      const bool shape_only = name == "weight" && !packed_weights.back().empty();
+      const size_t weight_count =
+          shape_only ? 0 : attribute->weight_count<float>();
+      WritePlanAttribute(
+          writer, name, attribute->shape,
+          reinterpret_cast<const char*>(attribute->weight_ptr<float>()),
+          weight_count * sizeof(float));
+    }
+    for (const auto& [name, matrix] : packed_weights.back()) {
+      WritePlanAttribute(writer, "packed." + name,
+                         {int(matrix.n_rows), int(matrix.n_cols)},
+                         reinterpret_cast<const char*>(matrix.memptr()),
+                         matrix.n_elem * sizeof(float));
+    }
+  }
+
+  std::ofstream plan_file(plan_path, std::ios::binary);
+  if (!plan_file.is_open()) {
+    LOG(ERROR) << "Can not open the plan file: " << plan_path;
+    return false;
+  }
+  const std::string& meta = writer.buffer();
+  const uint64_t data_offset = AlignPlanOffset(kPlanHeaderSize + meta.size());
+  PlanWriter header;
+  header.Write(kPlanMagic);
+  header.Write(kPlanVersion);
+  header.Write(uint64_t(meta.size()));
+  header.Write(data_offset);
+  plan_file.write(header.buffer().data(), header.buffer().size());
+  plan_file.write(meta.data(), meta.size());
+
+  const std::vector<char> padding(kPlanAlignment, 0);
+  uint64_t file_offset = kPlanHeaderSize + meta.size();
+  for (const auto& [data, size] : writer.blobs()) {
+    const uint64_t aligned_offset = AlignPlanOffset(file_offset);
+    plan_file.write(padding.data(), aligned_offset - file_offset);
+    plan_file.write(data, size);
+    file_offset = aligned_offset + size;
+  }
+  return plan_file.good();
+}
+
+bool RuntimeGraph::LoadPlan(const std::string& plan_path) {
+  size_t plan_size = 0;
+  std::shared_ptr<const char> plan_data = MapPlanFile(plan_path, plan_size);
+  if (plan_data == nullptr) {
+    LOG(ERROR) << "Can not open the plan file: " << plan_path;
+    return false;
+  }
+
+  PlanReader header(plan_data.get(), plan_data.get() + plan_size);
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  uint64_t meta_size = 0;
+  uint64_t data_offset = 0;
+  if (!header.Read(magic) || !header.Read(version) || !header.Read(meta_size) ||
+      !header.Read(data_offset) || magic != kPlanMagic ||
+      version != kPlanVersion || kPlanHeaderSize + meta_size > plan_size ||
+      data_offset > plan_size) {
+    LOG(ERROR) << "The plan file is broken or has a wrong version: "
+               << plan_path;
+    return false;
+  }
+
+  const char* meta_begin = plan_data.get() + kPlanHeaderSize;
+  PlanReader reader(meta_begin, meta_begin + meta_size);
+  std::string input_name;
+  std::string output_name;
+  uint32_t operator_count = 0;
+  bool read_success = reader.Read(input_name) && reader.Read(output_name) &&
+                      reader.Read(operator_count);
+
+  std::vector<std::shared_ptr<RuntimeOperator>> operators;
+  for (uint32_t i = 0; read_success && i < operator_count; ++i) {
+    std::shared_ptr<RuntimeOperator> runtime_operator =
+        std::make_shared<RuntimeOperator>();
+    uint32_t input_count = 0;
+    read_success = reader.Read(runtime_operator->name) &&
+                   reader.Read(runtime_operator->type) &&
+                   reader.Read(input_count);
+    for (uint32_t j = 0; read_success && j < input_count; ++j) {
+      std::shared_ptr<RuntimeOperand> input_operand =
+          std::make_shared<RuntimeOperand>();
+      int32_t type = 0;
+      read_success = reader.Read(input_operand->name) && reader.Read(type) &&
+                     reader.Read(input_operand->shapes) &&
+                     type >= int32_t(RuntimeDataType::kTypeUnknown) &&
+                     type <= int32_t(RuntimeDataType::kTypeUInt8);
+      input_operand->type = RuntimeDataType(type);
+      runtime_operator->input_operands.insert(
+          {input_operand->name, input_operand});
+      runtime_operator->input_operands_seq.push_back(input_operand);
+    }
+
+    uint8_t has_output = 0;
+    read_success = read_success &&
+                   reader.Read(runtime_operator->output_names) &&
+                   reader.Read(has_output);
+    if (read_success && has_output) {
+      // 输出张量在所有节点加载完成之后由内存规划统一分配
+      std::shared_ptr<RuntimeOperand> output_operand =
+          std::make_shared<RuntimeOperand>();
+      output_operand->type = RuntimeDataType::kTypeFloat32;
+      read_success = reader.Read(output_operand->name) &&
+                     reader.Read(output_operand->shapes);
+      runtime_operator->output_operands = output_operand;
+    }
+
+    uint32_t param_count = 0;
+    read_success = read_success && reader.Read(param_count);
+    for (uint32_t j = 0; read_success && j < param_count; ++j) {
+      std::string name;
+      read_success = reader.Read(name);
+      std::shared_ptr<RuntimeParameter> param =
+          read_success ? ReadPlanParameter(reader) : nullptr;
+      read_success = param != nullptr;
+      runtime_operator->params.insert({name, param});
+    }
+
+    uint32_t attribute_count = 0;
+    read_success = read_success && reader.Read(attribute_count);
+    for (uint32_t j = 0; read_success && j < attribute_count; ++j) {
+      std::string name;
+      int32_t type = 0;
+      uint64_t offset = 0;
+      uint64_t size = 0;
+      std::shared_ptr<RuntimeAttribute> attribute =
+          std::make_shared<RuntimeAttribute>();
+      // 计划文件中只保存float32的权重
+      read_success = reader.Read(name) && reader.Read(type) &&
+                     reader.Read(attribute->shape) && reader.Read(offset) &&
+                     reader.Read(size) &&
+                     type == int32_t(RuntimeDataType::kTypeFloat32) &&
+                     size % sizeof(float) == 0 && offset <= plan_size &&
+                     size <= plan_size &&
+                     data_offset + offset + size <= plan_size;
+      if (!read_success) {
+        break;
+      }
+      // 引用计划文件内存映射中的权重，不进行复制
+      attribute->type = RuntimeDataType(type);
+      attribute->mapped_weight = std::shared_ptr<const char>(
+          plan_data, plan_data.get() + data_offset + offset);
+      attribute->mapped_weight_size = size;
+      runtime_operator->attribute.insert({name, attribute});
+    }
+    operators.push_back(runtime_operator);
+  }
+
+  if (!read_success) {
+    LOG(ERROR) << "The plan file is broken: " << plan_path;
+    return false;
+  }
+
+  this->graph_.reset();
+  this->operators_ = std::move(operators);
+  this->operators_maps_.clear();
+  for (const auto& op : this->operators_) {
+    this->operators_maps_.insert({op->name, op});
+  }
+  this->InitOperatorsOutputLink();
+  this->InitOperatorsLayer();
+
+  // 计划文件中的节点已经按照拓扑顺序排列
+  this->topo_operators_ = this->operators_;
+  this->InitScheduleLevels();
+  RuntimeOperatorUtils::InitOperatorInput(operators_, max_batch_size_);
+  this->InitGraphOutputs(memory_planning_ && !parallel_execution_);
+  this->InitGraphWorkspace();
+
+  graph_state_ = GraphState::Complete;
+  input_name_ = input_name;
+  output_name_ = output_name;
+  return true;
+}
+}  // namespace kuiper_infer
@@ -16,6 +16,9 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
 #include <map>
 #include <string>
 #include <vector>
@@ -197,6 +200,22 @@ int StoreZipReader::open(const std::string& path)
     }
   }
 
+#if !defined(_WIN32)
+  // stored files are not compressed, so they can be referenced in place through a mapping
+  fseek(fp, 0, SEEK_END);
+  size_t file_size = ftell(fp);
+  if (file_size > 0)
+  {
+    void* addr = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (addr != MAP_FAILED)
+    {
+      mapping = std::shared_ptr<const char>((const char*)addr, [file_size](const char* p) {
+        munmap((void*)p, file_size);
+      });
+    }
+  }
+#endif
+
   return 0;
 }
 
@@ -228,8 +247,20 @@ int StoreZipReader::read_file(const std::string& name, char* data)
   return 0;
 }
 
+std::shared_ptr<const char> StoreZipReader::map_file(const std::string& name)
+{
+  if (!mapping || filemetas.find(name) == filemetas.end())
+    return std::shared_ptr<const char>();
+
+  // shares the ownership of the whole mapping but points at the stored file
+  return std::shared_ptr<const char>(mapping, mapping.get() + filemetas[name].offset);
+}
+
 int StoreZipReader::close()
 {
+  // the mapping stays alive as long as a pointer returned from map_file does
+  mapping.reset();
+
   if (!fp)
     return 0;
 
@@ -3,6 +3,7 @@
 //
 
 #include "data/tensor.hpp"
+#include "data/tensor_view.hpp"
 #include <glog/logging.h>
 #include <memory>
 #include <numeric>
@@ -50,10 +51,38 @@ Tensor<float>::Tensor(const std::vector<uint32_t> &shapes) {
   }
 }
 
+Tensor<float>::Tensor(float *raw_ptr, uint32_t channels, uint32_t rows,
+                      uint32_t cols)
+    : data_(raw_ptr, rows, cols, channels, false, true) {
+  CHECK(raw_ptr != nullptr);
+  if (channels == 1 && rows == 1) {
+    this->raw_shapes_ = std::vector<uint32_t>{cols};
+  } else if (channels == 1) {
+    this->raw_shapes_ = std::vector<uint32_t>{rows, cols};
+  } else {
+    this->raw_shapes_ = std::vector<uint32_t>{channels, rows, cols};
+  }
+}
+
+Tensor<float>::Tensor(float *raw_ptr, const std::vector<uint32_t> &shapes)
+    : Tensor(raw_ptr, shapes.size() >= 3 ? shapes.at(shapes.size() - 3) : 1,
+             shapes.size() >= 2 ? shapes.at(shapes.size() - 2) : 1,
+             shapes.empty() ? 0 : shapes.back()) {
+  CHECK(!shapes.empty() && shapes.size() <= 3);
+}
+
+Tensor<float>::Tensor(const std::shared_ptr<float> &raw_ptr,
+                      const std::vector<uint32_t> &shapes)
+    : Tensor(raw_ptr.get(), shapes) {
+  // 复制和移动张量时数据会被复制到新分配的内存中，只有这里需要持有外部内存
+  this->memory_holder_ = raw_ptr;
+}
+
 Tensor<float>::Tensor(const Tensor &tensor) {
   if (this != &tensor) {
     this->data_ = tensor.data_;
     this->raw_shapes_ = tensor.raw_shapes_;
+    this->layout_ = tensor.layout_;
   }
 }
 
@@ -61,6 +90,7 @@ Tensor<float>::Tensor(Tensor<float> &&tensor) noexcept {
   if (this != &tensor) {
     this->data_ = std::move(tensor.data_);
     this->raw_shapes_ = tensor.raw_shapes_;
+    this->layout_ = tensor.layout_;
   }
 }
 
@@ -68,6 +98,7 @@ Tensor<float> &Tensor<float>::operator=(Tensor<float> &&tensor) noexcept {
   if (this != &tensor) {
     this->data_ = std::move(tensor.data_);
     this->raw_shapes_ = tensor.raw_shapes_;
+    this->layout_ = tensor.layout_;
   }
   return *this;
 }
@@ -76,6 +107,7 @@ Tensor<float> &Tensor<float>::operator=(const Tensor &tensor) {
   if (this != &tensor) {
     this->data_ = tensor.data_;
     this->raw_shapes_ = tensor.raw_shapes_;
+    this->layout_ = tensor.layout_;
   }
   return *this;
 }
@@ -174,9 +206,14 @@ void Tensor<float>::Fill(float value) {
 }
 
 void Tensor<float>::Fill(const std::vector<float> &values, bool row_major) {
+  this->Fill(values.data(), values.size(), row_major);
+}
+
+void Tensor<float>::Fill(const float *values, uint32_t size, bool row_major) {
   CHECK(!this->data_.empty());
+  CHECK(values != nullptr);
   const uint32_t total_elems = this->data_.size();
-  CHECK_EQ(values.size(), total_elems);
+  CHECK_EQ(size, total_elems);
   if (row_major) {
     const uint32_t rows = this->rows();
     const uint32_t cols = this->cols();
@@ -186,12 +223,12 @@ void Tensor<float>::Fill(const std::vector<float> &values, bool row_major) {
     for (uint32_t i = 0; i < channels; ++i) {
       auto &channel_data = this->data_.slice(i);
       const arma::fmat &channel_data_t =
-          arma::fmat((float *) values.data() + i * planes, this->cols(),
+          arma::fmat((float *) values + i * planes, this->cols(),
                      this->rows(), false, true);
       channel_data = channel_data_t.t();
     }
   } else {
-    std::copy(values.begin(), values.end(), this->data_.memptr());
+    std::copy(values, values + size, this->data_.memptr());
   }
 }
 
@@ -204,7 +241,7 @@ void Tensor<float>::Show() {
 
 void Tensor<float>::Flatten(bool row_major) {
   CHECK(!this->data_.empty());
-  // 请补充代码
+  this->Reshape({this->size()}, row_major);
 }
 
 void Tensor<float>::Rand() {
@@ -238,7 +275,13 @@ void Tensor<float>::Reshape(const std::vector<uint32_t> &shapes,
       std::accumulate(shapes.begin(), shapes.end(), 1, std::multiplies());
   CHECK(shapes.size() <= 3);
   CHECK(current_size == origin_size);
+  CHECK(this->layout_ == TensorLayout::kNCHW)
+      << "Only the tensor in the NCHW layout can be reshaped";
 
+  // reshape前后内存排布相同时，行主序和列主序的reshape是等价的
+  if (row_major && TensorView::IsReshapeInPlace(this->shapes(), shapes)) {
+    row_major = false;
+  }
   std::vector<float> values;
   if (row_major) {
     values = this->values(true);
@@ -298,6 +341,33 @@ float *Tensor<float>::matrix_raw_ptr(uint32_t index) {
   return mem_ptr;
 }
 
+TensorLayout Tensor<float>::layout() const { return this->layout_; }
+
+void Tensor<float>::set_layout(TensorLayout layout) {
+  CHECK(!this->data_.empty());
+  if (layout == TensorLayout::kNCHW8c) {
+    CHECK_EQ(this->channels() % kChannelBlockSize, 0)
+        << "The number of channels must be a multiple of the channel block";
+  }
+  this->layout_ = layout;
+}
+
+uint32_t Tensor<float>::pixel_stride() const {
+  return this->layout_ == TensorLayout::kNCHW8c ? kChannelBlockSize : 1;
+}
+
+float *Tensor<float>::channel_raw_ptr(uint32_t channel) {
+  if (this->layout_ == TensorLayout::kNCHW) {
+    return this->matrix_raw_ptr(channel);
+  }
+  CHECK_LT(channel, this->channels());
+  // 第channel / 8块的起始地址，块内的通道按照channel % 8交错存放
+  const uint32_t plane_size = this->rows() * this->cols();
+  const uint32_t block = channel / kChannelBlockSize;
+  return this->raw_ptr() + block * kChannelBlockSize * plane_size +
+         channel % kChannelBlockSize;
+}
+
 sftensor operator-=(sftensor tensor, const float value) {
   CHECK(tensor != nullptr);
   tensor->data() -= value;
@@ -233,4 +233,24 @@ std::shared_ptr<Tensor<float>> TensorClone(
     std::shared_ptr<Tensor<float>> tensor) {
   return std::make_shared<Tensor<float>>(*tensor);
 }
-}  // namespace kuiper_infer
\ No newline at end of file
+
+std::shared_ptr<Tensor<float>> TensorReorder(
+    const std::shared_ptr<Tensor<float>>& tensor, TensorLayout layout) {
+  CHECK(tensor != nullptr && !tensor->empty());
+  sftensor output_tensor = TensorCreate(tensor->shapes());
+  output_tensor->set_layout(layout);
+
+  const uint32_t channels = tensor->channels();
+  const uint32_t plane_size = tensor->rows() * tensor->cols();
+  const uint32_t input_stride = tensor->pixel_stride();
+  const uint32_t output_stride = output_tensor->pixel_stride();
+  for (uint32_t c = 0; c < channels; ++c) {
+    const float* input_ptr = tensor->channel_raw_ptr(c);
+    float* output_ptr = output_tensor->channel_raw_ptr(c);
+    for (uint32_t i = 0; i < plane_size; ++i) {
+      output_ptr[i * output_stride] = input_ptr[i * input_stride];
+    }
+  }
+  return output_tensor;
+}
+}  // namespace kuiper_infer
@@ -0,0 +1,259 @@
+#include "data/tensor_view.hpp"
+#include <glog/logging.h>
+#include <numeric>
+
+namespace kuiper_infer {
+/**
+ * 返回Tensor在存储中的步长，Tensor的每个通道是一个列主序的矩阵
+ * @param shapes 张量的形状，最多三个维度
+ * @return 每个维度的步长
+ */
+static std::vector<uint32_t> TensorLayoutStrides(
+    const std::vector<uint32_t>& shapes) {
+  CHECK(!shapes.empty() && shapes.size() <= 3);
+  std::vector<uint32_t> shapes_(3, 1);
+  std::copy(shapes.begin(), shapes.end(),
+            shapes_.begin() + 3 - shapes.size());
+  const uint32_t rows = shapes_.at(1);
+  const uint32_t cols = shapes_.at(2);
+  const std::vector<uint32_t> strides{rows * cols, 1, rows};
+  return std::vector<uint32_t>(strides.end() - shapes.size(), strides.end());
+}
+
+static uint32_t ShapesSize(const std::vector<uint32_t>& shapes) {
+  return std::accumulate(shapes.begin(), shapes.end(), 1u,
+                         std::multiplies<uint32_t>());
+}
+
+/**
+ * 计算不复制数据reshape之后的步长，原形状中被合并的维度必须在存储中连续
+ * @param old_shapes 原来的形状
+ * @param old_strides 原来的步长
+ * @param shapes 新的形状
+ * @param strides 新的步长
+ * @return 可以不复制数据时返回true
+ */
+static bool AttemptReshapeStrides(const std::vector<uint32_t>& old_shapes,
+                                  const std::vector<uint32_t>& old_strides,
+                                  const std::vector<uint32_t>& shapes,
+                                  std::vector<uint32_t>& strides) {
+  CHECK_EQ(ShapesSize(old_shapes), ShapesSize(shapes));
+  // 长度为1的维度不影响排布
+  std::vector<uint32_t> dims;
+  std::vector<uint32_t> dim_strides;
+  for (uint32_t i = 0; i < old_shapes.size(); ++i) {
+    if (old_shapes.at(i) != 1) {
+      dims.push_back(old_shapes.at(i));
+      dim_strides.push_back(old_strides.at(i));
+    }
+  }
+
+  strides.assign(shapes.size(), 1);
+  uint32_t oi = 0;
+  uint32_t oj = 1;
+  uint32_t ni = 0;
+  uint32_t nj = 1;
+  while (ni < shapes.size() && oi < dims.size()) {
+    // 找到新旧形状中元素数量相同的一组维度
+    uint32_t np = shapes.at(ni);
+    uint32_t op = dims.at(oi);
+    while (np != op) {
+      if (np < op) {
+        np *= shapes.at(nj++);
+      } else {
+        op *= dims.at(oj++);
+      }
+    }
+
+    for (uint32_t ok = oi; ok + 1 < oj; ++ok) {
+      if (dim_strides.at(ok) != dims.at(ok + 1) * dim_strides.at(ok + 1)) {
+        return false;
+      }
+    }
+
+    strides.at(nj - 1) = dim_strides.at(oj - 1);
+    for (uint32_t nk = nj - 1; nk > ni; --nk) {
+      strides.at(nk - 1) = strides.at(nk) * shapes.at(nk);
+    }
+    ni = nj++;
+    oi = oj++;
+  }
+  return true;
+}
+
+TensorView::TensorView(const std::shared_ptr<Tensor<float>>& tensor)
+    : tensor_(tensor) {
+  CHECK(tensor_ != nullptr && !tensor_->empty());
+  this->data_ = tensor_->raw_ptr();
+  this->shapes_ = tensor_->shapes();
+  this->strides_ = TensorLayoutStrides(this->shapes_);
+}
+
+TensorView::TensorView(const std::shared_ptr<Tensor<float>>& tensor,
+                       std::vector<uint32_t> shapes,
+                       std::vector<uint32_t> strides, uint32_t offset)
+    : tensor_(tensor), shapes_(std::move(shapes)), strides_(std::move(strides)) {
+  CHECK(tensor_ != nullptr && !tensor_->empty());
+  CHECK(!shapes_.empty() && shapes_.size() == strides_.size());
+  uint32_t last_offset = offset;
+  for (uint32_t i = 0; i < shapes_.size(); ++i) {
+    CHECK_GT(shapes_.at(i), 0);
+    last_offset += (shapes_.at(i) - 1) * strides_.at(i);
+  }
+  CHECK_LT(last_offset, tensor_->size()) << "Tensor view out of bound!";
+  this->data_ = tensor_->raw_ptr() + offset;
+}
+
+const std::vector<uint32_t>& TensorView::shapes() const { return shapes_; }
+
+const std::vector<uint32_t>& TensorView::strides() const { return strides_; }
+
+uint32_t TensorView::size() const { return ShapesSize(shapes_); }
+
+float* TensorView::data() const { return data_; }
+
+float& TensorView::at(const std::vector<uint32_t>& indices) const {
+  CHECK_EQ(indices.size(), shapes_.size());
+  uint32_t offset = 0;
+  for (uint32_t i = 0; i < indices.size(); ++i) {
+    CHECK_LT(indices.at(i), shapes_.at(i));
+    offset += indices.at(i) * strides_.at(i);
+  }
+  return data_[offset];
+}
+
+TensorView TensorView::Slice(uint32_t dim, uint32_t start,
+                             uint32_t length) const {
+  CHECK_LT(dim, shapes_.size());
+  CHECK(length > 0 && start + length <= shapes_.at(dim));
+  std::vector<uint32_t> shapes = shapes_;
+  shapes.at(dim) = length;
+  const uint32_t offset =
+      uint32_t(data_ - tensor_->raw_ptr()) + start * strides_.at(dim);
+  return TensorView(tensor_, std::move(shapes), strides_, offset);
+}
+
+TensorView TensorView::Permute(const std::vector<uint32_t>& dims) const {
+  CHECK_EQ(dims.size(), shapes_.size());
+  std::vector<uint32_t> shapes(dims.size());
+  std::vector<uint32_t> strides(dims.size());
+  std::vector<bool> used(dims.size(), false);
+  for (uint32_t i = 0; i < dims.size(); ++i) {
+    const uint32_t dim = dims.at(i);
+    CHECK(dim < dims.size() && !used.at(dim)) << "Wrong permute dims";
+    used.at(dim) = true;
+    shapes.at(i) = shapes_.at(dim);
+    strides.at(i) = strides_.at(dim);
+  }
+  return TensorView(tensor_, std::move(shapes), std::move(strides),
+                    uint32_t(data_ - tensor_->raw_ptr()));
+}
+
+bool TensorView::ReshapeStrides(const std::vector<uint32_t>& shapes,
+                                std::vector<uint32_t>& strides) const {
+  return AttemptReshapeStrides(shapes_, strides_, shapes, strides);
+}
+
+bool TensorView::IsReshapeView(const std::vector<uint32_t>& shapes) const {
+  std::vector<uint32_t> strides;
+  return ReshapeStrides(shapes, strides);
+}
+
+TensorView TensorView::Reshape(const std::vector<uint32_t>& shapes) const {
+  CHECK(!shapes.empty());
+  CHECK_EQ(ShapesSize(shapes), this->size());
+  std::vector<uint32_t> strides;
+  if (ReshapeStrides(shapes, strides)) {
+    return TensorView(tensor_, shapes, std::move(strides),
+                      uint32_t(data_ - tensor_->raw_ptr()));
+  }
+
+  // 被合并的维度不连续，按照行主序复制到一段连续的存储中
+  const std::shared_ptr<Tensor<float>> contiguous =
+      std::make_shared<Tensor<float>>(this->size());
+  this->CopyRowMajor(contiguous->raw_ptr());
+
+  std::vector<uint32_t> contiguous_strides(shapes.size(), 1);
+  for (int32_t d = int32_t(shapes.size()) - 2; d >= 0; --d) {
+    contiguous_strides.at(d) = contiguous_strides.at(d + 1) * shapes.at(d + 1);
+  }
+  return TensorView(contiguous, shapes, std::move(contiguous_strides));
+}
+
+void TensorView::CopyRowMajor(float* output) const {
+  std::vector<uint32_t> indices(shapes_.size(), 0);
+  const uint32_t size = this->size();
+  for (uint32_t i = 0; i < size; ++i) {
+    uint32_t offset = 0;
+    for (uint32_t d = 0; d < indices.size(); ++d) {
+      offset += indices.at(d) * strides_.at(d);
+    }
+    output[i] = data_[offset];
+    for (int32_t d = int32_t(indices.size()) - 1; d >= 0; --d) {
+      if (++indices.at(d) < shapes_.at(d)) {
+        break;
+      }
+      indices.at(d) = 0;
+    }
+  }
+}
+
+bool TensorView::IsTensorLayout() const {
+  // 最多三个维度，多出来的维度长度必须为1
+  uint32_t leading_dims = 0;
+  while (shapes_.size() - leading_dims > 3) {
+    if (shapes_.at(leading_dims) != 1) {
+      return false;
+    }
+    leading_dims += 1;
+  }
+  const std::vector<uint32_t> shapes(shapes_.begin() + leading_dims,
+                                     shapes_.end());
+  const std::vector<uint32_t>& layout_strides = TensorLayoutStrides(shapes);
+  for (uint32_t i = 0; i < shapes.size(); ++i) {
+    if (shapes.at(i) != 1 &&
+        strides_.at(i + leading_dims) != layout_strides.at(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::shared_ptr<Tensor<float>> TensorView::ToTensor() const {
+  std::vector<uint32_t> shapes = shapes_;
+  while (shapes.size() > 3) {
+    CHECK_EQ(shapes.front(), 1)
+        << "Tensor only support three dimensions at most";
+    shapes.erase(shapes.begin());
+  }
+  if (IsTensorLayout()) {
+    return std::make_shared<Tensor<float>>(data_, shapes);
+  }
+
+  std::vector<float> values(this->size());
+  this->CopyRowMajor(values.data());
+  std::shared_ptr<Tensor<float>> tensor = std::make_shared<Tensor<float>>(shapes);
+  tensor->Fill(values, true);
+  return tensor;
+}
+
+bool TensorView::IsReshapeInPlace(const std::vector<uint32_t>& tensor_shapes,
+                                  const std::vector<uint32_t>& shapes) {
+  if (shapes.empty() || shapes.size() > 3 ||
+      ShapesSize(tensor_shapes) != ShapesSize(shapes)) {
+    return false;
+  }
+  std::vector<uint32_t> strides;
+  if (!AttemptReshapeStrides(tensor_shapes, TensorLayoutStrides(tensor_shapes),
+                             shapes, strides)) {
+    return false;
+  }
+  const std::vector<uint32_t>& layout_strides = TensorLayoutStrides(shapes);
+  for (uint32_t i = 0; i < shapes.size(); ++i) {
+    if (shapes.at(i) != 1 && strides.at(i) != layout_strides.at(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace kuiper_infer
@@ -0,0 +1,208 @@
+// MIT License
+// Copyright (c) 2022 - 傅莘莘
+// Source URL: https://github.com/zjhellofss/KuiperInfer
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "utils/time/time_logging.hpp"
+#include <glog/logging.h>
+#include <algorithm>
+#include <fstream>
+
+namespace kuiper_infer {
+namespace utils {
+std::mutex LayerTimeStatesSingleton::mutex_;
+PtrLayerTimeStatesCollector LayerTimeStatesSingleton::time_states_collector_;
+std::vector<LayerTraceEvent> LayerTimeStatesSingleton::trace_events_;
+
+void LayerTimeStatesSingleton::LayerTimeStatesCollectorInit() {
+  std::lock_guard<std::mutex> lock_(mutex_);
+  time_states_collector_ = std::make_shared<LayerTimeStatesCollector>();
+  trace_events_.clear();
+}
+
+PtrLayerTimeStatesCollector LayerTimeStatesSingleton::SingletonInstance() {
+  std::lock_guard<std::mutex> lock_(mutex_);
+  if (time_states_collector_ == nullptr) {
+    time_states_collector_ = std::make_shared<LayerTimeStatesCollector>();
+  }
+  return time_states_collector_;
+}
+
+void LayerTimeStatesSingleton::AddTraceEvent(LayerTraceEvent trace_event) {
+  std::lock_guard<std::mutex> lock_(mutex_);
+  trace_events_.push_back(std::move(trace_event));
+}
+
+std::vector<LayerTraceEvent> LayerTimeStatesSingleton::TraceEvents() {
+  std::lock_guard<std::mutex> lock_(mutex_);
+  return trace_events_;
+}
+
+LayerTimeLogging::LayerTimeLogging(std::string layer_name,
+                                   std::string layer_type)
+    : layer_name_(std::move(layer_name)),
+      layer_type_(std::move(layer_type)),
+      start_time_(Time::now()) {}
+
+LayerTimeLogging::LayerTimeLogging(std::string layer_name,
+                                   std::string layer_type, std::string shapes,
+                                   uint64_t flops, uint64_t bytes,
+                                   int thread_id)
+    : layer_name_(std::move(layer_name)),
+      layer_type_(std::move(layer_type)),
+      shapes_(std::move(shapes)),
+      flops_(flops),
+      bytes_(bytes),
+      thread_id_(thread_id),
+      start_time_(Time::now()) {}
+
+LayerTimeLogging::~LayerTimeLogging() {
+  const auto end_time = Time::now();
+  const long duration_time =
+      std::chrono::duration_cast<std::chrono::microseconds>(end_time -
+                                                            start_time_)
+          .count();
+
+  PtrLayerTimeStatesCollector layer_time_states =
+      LayerTimeStatesSingleton::SingletonInstance();
+  std::shared_ptr<LayerTimeState> layer_time_state;
+  {
+    // 同一类型的层共享一条记录
+    static std::mutex collector_mutex;
+    std::lock_guard<std::mutex> lock_(collector_mutex);
+    auto state_iter = layer_time_states->find(layer_type_);
+    if (state_iter == layer_time_states->end()) {
+      layer_time_state =
+          std::make_shared<LayerTimeState>(0, layer_name_, layer_type_);
+      layer_time_states->insert({layer_type_, layer_time_state});
+    } else {
+      layer_time_state = state_iter->second;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock_(layer_time_state->time_mutex_);
+    layer_time_state->duration_time_ += duration_time;
+    layer_time_state->call_count_ += 1;
+    layer_time_state->flops_ += flops_;
+    layer_time_state->bytes_ += bytes_;
+  }
+
+  LayerTraceEvent trace_event;
+  trace_event.layer_name_ = layer_name_;
+  trace_event.layer_type_ = layer_type_;
+  trace_event.shapes_ = shapes_;
+  trace_event.start_time_ =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          start_time_.time_since_epoch())
+          .count();
+  trace_event.duration_time_ = duration_time;
+  trace_event.thread_id_ = thread_id_;
+  trace_event.flops_ = flops_;
+  trace_event.bytes_ = bytes_;
+  LayerTimeStatesSingleton::AddTraceEvent(std::move(trace_event));
+}
+
+void LayerTimeLogging::SummaryLogging() {
+  PtrLayerTimeStatesCollector layer_time_states =
+      LayerTimeStatesSingleton::SingletonInstance();
+  CHECK(layer_time_states != nullptr);
+
+  for (const LayerTraceEvent& trace_event :
+       LayerTimeStatesSingleton::TraceEvents()) {
+    LOG(INFO) << "Layer: " << trace_event.layer_name_ << " ("
+              << trace_event.layer_type_ << ") " << trace_event.shapes_
+              << " time: " << trace_event.duration_time_ / 1000. << "ms"
+              << " FLOPs: " << trace_event.flops_
+              << " bytes: " << trace_event.bytes_;
+  }
+
+  // 按照时间消耗从大到小输出
+  std::vector<std::shared_ptr<LayerTimeState>> sorted_states;
+  long total_time = 0;
+  for (const auto& [_, layer_time_state] : *layer_time_states) {
+    sorted_states.push_back(layer_time_state);
+    total_time += layer_time_state->duration_time_;
+  }
+  std::sort(sorted_states.begin(), sorted_states.end(),
+            [](const auto& state1, const auto& state2) {
+              return state1->duration_time_ > state2->duration_time_;
+            });
+
+  for (const auto& layer_time_state : sorted_states) {
+    const double duration_ms = layer_time_state->duration_time_ / 1000.;
+    const double percent =
+        total_time > 0 ? 100. * layer_time_state->duration_time_ / total_time
+                       : 0.;
+    const double gflops = layer_time_state->flops_ / 1e9;
+    const double gflops_per_second =
+        layer_time_state->duration_time_ > 0
+            ? layer_time_state->flops_ / 1e3 / layer_time_state->duration_time_
+            : 0.;
+    const double megabytes = layer_time_state->bytes_ / (1024. * 1024.);
+    LOG(INFO) << "Layer type: " << layer_time_state->layer_type_
+              << " count: " << layer_time_state->call_count_
+              << " time: " << duration_ms << "ms (" << percent << "%)"
+              << " GFLOPs: " << gflops << " GFLOP/s: " << gflops_per_second
+              << " memory: " << megabytes << "MB";
+  }
+  LOG(INFO) << "Total time: " << total_time / 1000. << "ms";
+}
+
+bool LayerTimeLogging::WriteChromeTrace(const std::string& trace_path) {
+  std::ofstream trace_file(trace_path);
+  if (!trace_file.is_open()) {
+    LOG(ERROR) << "Can not open the trace file: " << trace_path;
+    return false;
+  }
+
+  const std::vector<LayerTraceEvent>& trace_events =
+      LayerTimeStatesSingleton::TraceEvents();
+  long base_time = 0;
+  if (!trace_events.empty()) {
+    base_time = std::min_element(trace_events.begin(), trace_events.end(),
+                                 [](const auto& event1, const auto& event2) {
+                                   return event1.start_time_ <
+                                          event2.start_time_;
+                                 })
+                    ->start_time_;
+  }
+
+  // 每个层作为一个完整事件("ph": "X")，时间单位为微秒
+  trace_file << "{\"traceEvents\": [\n";
+  for (size_t i = 0; i < trace_events.size(); ++i) {
+    const LayerTraceEvent& trace_event = trace_events.at(i);
+    trace_file << "  {\"name\": \"" << trace_event.layer_name_
+               << "\", \"cat\": \"" << trace_event.layer_type_
+               << "\", \"ph\": \"X\", \"ts\": "
+               << trace_event.start_time_ - base_time
+               << ", \"dur\": " << trace_event.duration_time_
+               << ", \"pid\": 0, \"tid\": " << trace_event.thread_id_
+               << ", \"args\": {\"shapes\": \"" << trace_event.shapes_
+               << "\", \"flops\": " << trace_event.flops_
+               << ", \"bytes\": " << trace_event.bytes_ << "}}";
+    if (i + 1 < trace_events.size()) {
+      trace_file << ",";
+    }
+    trace_file << "\n";
+  }
+  trace_file << "]}\n";
+  return trace_file.good();
+}
+}  // namespace utils
+}  // namespace kuiper_infer
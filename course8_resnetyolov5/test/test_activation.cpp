@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+#include <cmath>
+#include <vector>
+#include "../source/layer/details/sigmoid.hpp"
+#include "../source/layer/details/silu.hpp"
+#include "utils/math/activation.hpp"
+
+using namespace kuiper_infer;
+
+TEST(test_activation, kernels) {
+    LOG(INFO) << "Activation isa: " << int(ActivationDispatchIsa());
+    // 长度不是向量宽度的整数倍时，剩余的元素也需要正确计算
+    for (uint32_t size : {1, 7, 8, 15, 16, 17, 1031}) {
+        std::vector<float> input(size);
+        for (uint32_t i = 0; i < size; ++i) {
+            input.at(i) = (float(i % 97) - 48.f) * 0.25f;
+        }
+        std::vector<float> sigmoid(size);
+        ApplySigmoid(input.data(), sigmoid.data(), size);
+        std::vector<float> silu = input;
+        ApplySiLU(silu.data(), silu.data(), size);
+        for (uint32_t i = 0; i < size; ++i) {
+            const float x = input.at(i);
+            const float expected = 1.f / (1.f + std::exp(-x));
+            ASSERT_NEAR(sigmoid.at(i), expected, 1e-6f);
+            ASSERT_NEAR(silu.at(i), x * expected, 1e-5f);
+        }
+    }
+}
+
+TEST(test_activation, layers_inplace) {
+    sftensor input = std::make_shared<ftensor>(3, 17, 13);
+    input->Rand();
+    const sftensor original = std::make_shared<ftensor>(*input);
+
+    std::vector<sftensor> inputs{input};
+    std::vector<sftensor> outputs{input};
+    SigmoidLayer sigmoid_layer;
+    ASSERT_EQ(sigmoid_layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+    ASSERT_EQ(outputs.front(), input);
+    const arma::fcube sigmoid = 1.f / (1.f + arma::exp(-original->data()));
+    ASSERT_TRUE(arma::approx_equal(input->data(), sigmoid, "absdiff", 1e-6f));
+
+    // SiLU使用新的输入，期望值不依赖于sigmoid层已经改写的数据
+    sftensor silu_input = std::make_shared<ftensor>(3, 17, 13);
+    silu_input->Rand();
+    const sftensor silu_original = std::make_shared<ftensor>(*silu_input);
+
+    std::vector<sftensor> silu_inputs{silu_input};
+    std::vector<sftensor> silu_outputs{silu_input};
+    SiLULayer silu_layer;
+    ASSERT_EQ(silu_layer.Forward(silu_inputs, silu_outputs), InferStatus::kInferSuccess);
+    ASSERT_EQ(silu_outputs.front(), silu_input);
+    const arma::fcube silu = silu_original->data() / (1.f + arma::exp(-silu_original->data()));
+    ASSERT_TRUE(arma::approx_equal(silu_input->data(), silu, "absdiff", 1e-6f));
+}
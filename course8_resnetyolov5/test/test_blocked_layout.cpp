@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "../source/layer/details/convolution.hpp"
+#include "../source/layer/details/maxpooling.hpp"
+#include "../source/layer/details/upsample.hpp"
+#include "data/tensor_util.hpp"
+#include "runtime/runtime_ir.hpp"
+#include "utils/math/blocked.hpp"
+
+using namespace kuiper_infer;
+
+// 定义于test_yolov5.cpp中的预处理函数
+kuiper_infer::sftensor PreProcessImage(const cv::Mat &image,
+                                       const int32_t input_h,
+                                       const int32_t input_w);
+
+static sftensor LayerForward(Layer &layer, const sftensor &input, const sftensor &output) {
+    std::vector<sftensor> inputs{input};
+    std::vector<sftensor> outputs{output};
+    const auto status = layer.Forward(inputs, outputs);
+    EXPECT_EQ(status, InferStatus::kInferSuccess);
+    return outputs.front();
+}
+
+static sftensor BlockedTensor(uint32_t channels, uint32_t rows, uint32_t cols) {
+    sftensor tensor = std::make_shared<ftensor>(channels, rows, cols);
+    tensor->set_layout(TensorLayout::kNCHW8c);
+    return tensor;
+}
+
+TEST(test_blocked_layout, reorder) {
+    sftensor tensor = std::make_shared<ftensor>(16, 5, 7);
+    tensor->Rand();
+    const sftensor blocked = TensorReorder(tensor, TensorLayout::kNCHW8c);
+    ASSERT_EQ(blocked->layout(), TensorLayout::kNCHW8c);
+    for (uint32_t c = 0; c < 16; ++c) {
+        for (uint32_t r = 0; r < 5; ++r) {
+            for (uint32_t w = 0; w < 7; ++w) {
+                // 第c / 8块中位置(r, w)上的8个通道是连续的
+                const uint32_t offset = (c / 8) * 8 * 35 + (r + w * 5) * 8 + c % 8;
+                ASSERT_EQ(blocked->index(offset), tensor->at(c, r, w));
+            }
+        }
+    }
+    ASSERT_TRUE(TensorIsSame(TensorReorder(blocked, TensorLayout::kNCHW), tensor));
+}
+
+TEST(test_blocked_layout, conv) {
+    // 分别使用im2col、Winograd、1x1和带步长的1x1卷积
+    const std::vector<std::vector<uint32_t>> params{
+            {3, 1, 2, 1}, {3, 1, 1, 1}, {1, 0, 1, 1}, {1, 0, 2, 1}, {3, 1, 1, 2}};
+    for (const auto &param : params) {
+        const uint32_t kernel = param.at(0);
+        const uint32_t padding = param.at(1);
+        const uint32_t stride = param.at(2);
+        const uint32_t groups = param.at(3);
+        ConvolutionLayer conv_layer(32, 16, kernel, kernel, padding, padding, stride, stride,
+                                    groups, true);
+        for (const auto &weight : conv_layer.weights()) {
+            weight->Rand();
+        }
+        for (const auto &bias : conv_layer.bias()) {
+            bias->Rand();
+        }
+        conv_layer.set_activation(ConvActivation::kSiLU);
+
+        sftensor input = std::make_shared<ftensor>(16, 14, 11);
+        input->Rand();
+        const sftensor output = LayerForward(conv_layer, input, nullptr);
+        const sftensor blocked_input = TensorReorder(input, TensorLayout::kNCHW8c);
+        // 输入和输出的排布任意组合，结果都和NCHW排布相同
+        for (const sftensor &conv_input : {input, blocked_input}) {
+            const sftensor blocked_output = LayerForward(
+                    conv_layer, conv_input,
+                    BlockedTensor(output->channels(), output->rows(), output->cols()));
+            ASSERT_TRUE(TensorIsSame(TensorReorder(blocked_output, TensorLayout::kNCHW), output,
+                                     1e-4f));
+        }
+        const sftensor nchw_output = LayerForward(conv_layer, blocked_input, nullptr);
+        ASSERT_TRUE(TensorIsSame(nchw_output, output, 1e-4f));
+    }
+}
+
+TEST(test_blocked_layout, pooling_upsample) {
+    LOG(INFO) << "Blocked kernels use avx2: " << BlockedKernelsUseAVX2();
+    sftensor input = std::make_shared<ftensor>(24, 13, 10);
+    input->Rand();
+    const sftensor blocked_input = TensorReorder(input, TensorLayout::kNCHW8c);
+
+    // yolov5的SPPF中5x5步长为1的池化，以及带填充的3x3步长为2的池化
+    for (uint32_t pooling : {5, 3}) {
+        const uint32_t stride = pooling == 5 ? 1 : 2;
+        MaxPoolingLayer max_layer(pooling / 2, pooling / 2, pooling, pooling, stride, stride);
+        const sftensor output = LayerForward(max_layer, input, nullptr);
+        const sftensor blocked_output = LayerForward(max_layer, blocked_input, nullptr);
+        ASSERT_EQ(blocked_output->layout(), TensorLayout::kNCHW8c);
+        ASSERT_TRUE(TensorIsSame(TensorReorder(blocked_output, TensorLayout::kNCHW), output));
+    }
+
+    UpSampleLayer upsample_layer(2.f, 2.f);
+    const sftensor output = LayerForward(upsample_layer, input, nullptr);
+    const sftensor blocked_output = LayerForward(upsample_layer, blocked_input, nullptr);
+    ASSERT_EQ(blocked_output->layout(), TensorLayout::kNCHW8c);
+    ASSERT_TRUE(TensorIsSame(TensorReorder(blocked_output, TensorLayout::kNCHW), output));
+}
+
+TEST(test_blocked_layout, yolov5) {
+    const std::string &param_path = "course8_resnetyolov5/model_file/yolov5s.pnnx.param";
+    const std::string &bin_path = "course8_resnetyolov5/model_file/yolov5s.pnnx.bin";
+    cv::Mat image = cv::imread("course8_resnetyolov5/model_file/bus.jpg");
+    std::vector<sftensor> inputs{PreProcessImage(image, 640, 640)};
+
+    RuntimeGraph graph(param_path, bin_path);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+    std::vector<sftensor> outputs;
+    for (const auto &output : graph.Forward(inputs, false)) {
+        outputs.push_back(std::make_shared<ftensor>(*output));
+    }
+
+    RuntimeGraph blocked_graph(param_path, bin_path);
+    blocked_graph.set_blocked_layout(true);
+    blocked_graph.Build("pnnx_input_0", "pnnx_output_0");
+    // 计算图的输出仍然是NCHW排布
+    const auto blocked_outputs = blocked_graph.Forward(inputs, false);
+    ASSERT_EQ(blocked_outputs.size(), outputs.size());
+    for (uint32_t i = 0; i < outputs.size(); ++i) {
+        ASSERT_EQ(blocked_outputs.at(i)->layout(), TensorLayout::kNCHW);
+        ASSERT_TRUE(TensorIsSame(blocked_outputs.at(i), outputs.at(i), 1e-3f));
+    }
+}
@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+#include <chrono>
+#include <vector>
+#include "../source/layer/details/convolution.hpp"
+#include "data/tensor_util.hpp"
+
+using namespace kuiper_infer;
+
+static sftensor ConvForward(ConvolutionLayer &conv_layer, const sftensor &input) {
+    std::vector<sftensor> inputs{input};
+    std::vector<sftensor> outputs(1);
+    const auto status = conv_layer.Forward(inputs, outputs);
+    EXPECT_EQ(status, InferStatus::kInferSuccess);
+    return outputs.front();
+}
+
+static double ConvForwardTime(ConvolutionLayer &conv_layer, const sftensor &input,
+                              uint32_t repeat) {
+    std::vector<sftensor> inputs{input};
+    std::vector<sftensor> outputs(1);
+    // 第一次推理会初始化卷积核的排布和临时空间，不计入耗时
+    conv_layer.Forward(inputs, outputs);
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < repeat; ++i) {
+        conv_layer.Forward(inputs, outputs);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / repeat;
+}
+
+TEST(test_conv, winograd_vs_im2col) {
+    using namespace kuiper_infer;
+    // 输出的宽高分别覆盖了奇数和偶数的情况
+    const std::vector<std::vector<uint32_t>> shapes{
+            {16, 16, 8, 8, 1}, {32, 16, 7, 9, 1}, {16, 24, 13, 10, 0}, {64, 64, 20, 20, 1}};
+    for (const auto &shape : shapes) {
+        const uint32_t in_channel = shape.at(0);
+        const uint32_t out_channel = shape.at(1);
+        const uint32_t padding = shape.at(4);
+        ConvolutionLayer conv_layer(out_channel, in_channel, 3, 3, padding, padding, 1, 1, 1, true);
+        ASSERT_EQ(conv_layer.algorithm(), ConvAlgorithm::kWinograd);
+        for (const auto &weight : conv_layer.weights()) {
+            weight->Rand();
+        }
+        for (const auto &bias : conv_layer.bias()) {
+            bias->Rand();
+        }
+
+        sftensor input = std::make_shared<ftensor>(in_channel, shape.at(2), shape.at(3));
+        input->Rand();
+        const sftensor winograd_output = ConvForward(conv_layer, input);
+
+        conv_layer.set_algorithm(ConvAlgorithm::kIm2Col);
+        const sftensor im2col_output = ConvForward(conv_layer, input);
+        ASSERT_TRUE(TensorIsSame(winograd_output, im2col_output, 1e-3f));
+    }
+}
+
+TEST(test_conv, pointwise_vs_im2col) {
+    using namespace kuiper_infer;
+    for (uint32_t stride : {1, 2}) {
+        ConvolutionLayer conv_layer(32, 16, 1, 1, 0, 0, stride, stride, 1, true);
+        ASSERT_EQ(conv_layer.algorithm(), stride == 1 ? ConvAlgorithm::kPointwise
+                                                      : ConvAlgorithm::kPointwiseStrided);
+        for (const auto &weight : conv_layer.weights()) {
+            weight->Rand();
+        }
+        for (const auto &bias : conv_layer.bias()) {
+            bias->Rand();
+        }
+
+        sftensor input = std::make_shared<ftensor>(16, 15, 12);
+        input->Rand();
+        const sftensor pointwise_output = ConvForward(conv_layer, input);
+
+        conv_layer.set_algorithm(ConvAlgorithm::kIm2Col);
+        const sftensor im2col_output = ConvForward(conv_layer, input);
+        ASSERT_TRUE(TensorIsSame(pointwise_output, im2col_output, 1e-4f));
+    }
+}
+
+TEST(test_conv, batch_fold) {
+    // im2col、1x1、带步长的1x1以及分组卷积，多个样本合并到一次矩阵乘中
+    const std::vector<std::vector<uint32_t>> params{
+            {3, 1, 2, 1}, {1, 0, 1, 1}, {1, 0, 2, 1}, {3, 1, 1, 2}};
+    const uint32_t batch_size = 5;
+    for (const auto &param : params) {
+        const uint32_t kernel = param.at(0);
+        const uint32_t padding = param.at(1);
+        const uint32_t stride = param.at(2);
+        ConvolutionLayer conv_layer(16, 16, kernel, kernel, padding, padding, stride, stride,
+                                    param.at(3), true);
+        for (const auto &weight : conv_layer.weights()) {
+            weight->Rand();
+        }
+        for (const auto &bias : conv_layer.bias()) {
+            bias->Rand();
+        }
+        conv_layer.set_activation(ConvActivation::kSiLU);
+        if (conv_layer.algorithm() == ConvAlgorithm::kWinograd) {
+            conv_layer.set_algorithm(ConvAlgorithm::kIm2Col);
+        }
+
+        std::vector<sftensor> inputs;
+        for (uint32_t i = 0; i < batch_size; ++i) {
+            sftensor input = std::make_shared<ftensor>(16, 13, 10);
+            input->Rand();
+            inputs.push_back(input);
+        }
+        std::vector<sftensor> outputs(batch_size);
+        ASSERT_EQ(conv_layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+
+        // 分块排布的输出同样按样本写入
+        std::vector<sftensor> blocked_outputs;
+        for (const sftensor &output : outputs) {
+            sftensor blocked_output =
+                    std::make_shared<ftensor>(output->channels(), output->rows(), output->cols());
+            blocked_output->set_layout(TensorLayout::kNCHW8c);
+            blocked_outputs.push_back(blocked_output);
+        }
+        ASSERT_EQ(conv_layer.Forward(inputs, blocked_outputs), InferStatus::kInferSuccess);
+
+        for (uint32_t i = 0; i < batch_size; ++i) {
+            const sftensor single_output = ConvForward(conv_layer, inputs.at(i));
+            ASSERT_TRUE(TensorIsSame(outputs.at(i), single_output, 1e-4f));
+            ASSERT_TRUE(TensorIsSame(TensorReorder(blocked_outputs.at(i), TensorLayout::kNCHW),
+                                     single_output, 1e-4f));
+        }
+    }
+}
+
+// 只用于对比两种算法的耗时，没有断言，需要时使用--gtest_also_run_disabled_tests运行
+TEST(test_conv, DISABLED_winograd_benchmark) {
+    using namespace kuiper_infer;
+    // resnet18和yolov5s中3x3步长为1的卷积层
+    const std::vector<std::vector<uint32_t>> shapes{
+            {64, 64, 56, 56}, {128, 128, 28, 28}, {256, 256, 14, 14},
+            {512, 512, 7, 7}, {64, 64, 80, 80}, {128, 128, 40, 40}};
+    const uint32_t repeat = 5;
+    for (const auto &shape : shapes) {
+        const uint32_t in_channel = shape.at(0);
+        const uint32_t out_channel = shape.at(1);
+        ConvolutionLayer conv_layer(out_channel, in_channel, 3, 3, 1, 1, 1, 1, 1, true);
+        for (const auto &weight : conv_layer.weights()) {
+            weight->Rand();
+        }
+        sftensor input = std::make_shared<ftensor>(in_channel, shape.at(2), shape.at(3));
+        input->Rand();
+
+        conv_layer.set_algorithm(ConvAlgorithm::kWinograd);
+        const double winograd_time = ConvForwardTime(conv_layer, input, repeat);
+        conv_layer.set_algorithm(ConvAlgorithm::kIm2Col);
+        const double im2col_time = ConvForwardTime(conv_layer, input, repeat);
+        LOG(INFO) << "conv3x3 " << in_channel << "x" << shape.at(2) << "x" << shape.at(3)
+                  << " -> " << out_channel << " im2col: " << im2col_time
+                  << "ms winograd: " << winograd_time
+                  << "ms speedup: " << im2col_time / winograd_time;
+    }
+}
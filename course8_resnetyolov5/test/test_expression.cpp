@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+#include <vector>
+#include "../source/layer/details/expression.hpp"
+#include "data/tensor_util.hpp"
+
+using namespace kuiper_infer;
+
+TEST(test_expression, compile) {
+    ExpressionLayer layer("add(@0,mul(@1,@2))");
+    const auto &program = layer.program();
+    ASSERT_EQ(program.size(), 5);
+    ASSERT_EQ(program.at(0).opcode, ExpressionOpcode::kLoad);
+    ASSERT_EQ(program.at(0).operand, 0);
+    ASSERT_EQ(program.at(3).opcode, ExpressionOpcode::kMul);
+    ASSERT_EQ(program.at(4).opcode, ExpressionOpcode::kAdd);
+}
+
+TEST(test_expression, fused_broadcast) {
+    const uint32_t batch_size = 2;
+    std::vector<sftensor> inputs;
+    // 第三个输入的形状为channels x 1 x 1，按通道广播
+    for (uint32_t k = 0; k < 3; ++k) {
+        for (uint32_t i = 0; i < batch_size; ++i) {
+            sftensor input = k == 2 ? std::make_shared<ftensor>(16, 1, 1)
+                                    : std::make_shared<ftensor>(16, 23, 19);
+            input->Rand();
+            inputs.push_back(input);
+        }
+    }
+
+    std::vector<sftensor> outputs;
+    for (uint32_t i = 0; i < batch_size; ++i) {
+        outputs.push_back(std::make_shared<ftensor>(16, 23, 19));
+    }
+    const std::vector<sftensor> planned_outputs = outputs;
+
+    ExpressionLayer layer("add(@0,mul(@1,@2))");
+    ASSERT_EQ(layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+    for (uint32_t i = 0; i < batch_size; ++i) {
+        // 结果直接写入预先分配的输出张量
+        ASSERT_EQ(outputs.at(i), planned_outputs.at(i));
+        const sftensor &input1 = inputs.at(i);
+        const sftensor &input2 = inputs.at(batch_size + i);
+        const sftensor &input3 = inputs.at(2 * batch_size + i);
+        for (uint32_t c = 0; c < 16; ++c) {
+            const arma::fmat expected = input1->slice(c) + input2->slice(c) * input3->index(c);
+            ASSERT_TRUE(arma::approx_equal(outputs.at(i)->slice(c), expected, "absdiff", 1e-5f));
+        }
+    }
+}
+
+TEST(test_expression, broadcast_lhs) {
+    LOG(INFO) << "Expression kernels use AVX2: " << ExpressionLayer::UseAVX2();
+    // 广播的标量作为左操作数，平面大小不是8的倍数时剩余的元素单独计算
+    std::vector<sftensor> inputs;
+    sftensor input1 = std::make_shared<ftensor>(8, 13, 7);
+    sftensor input2 = std::make_shared<ftensor>(8, 1, 1);
+    input1->Rand();
+    input2->Rand();
+    inputs.push_back(input1);
+    inputs.push_back(input2);
+
+    std::vector<sftensor> outputs;
+    outputs.push_back(std::make_shared<ftensor>(8, 13, 7));
+    ExpressionLayer layer("add(mul(@1,@0),@0)");
+    ASSERT_EQ(layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+    for (uint32_t c = 0; c < 8; ++c) {
+        const arma::fmat expected = input2->index(c) * input1->slice(c) + input1->slice(c);
+        ASSERT_TRUE(arma::approx_equal(outputs.front()->slice(c), expected, "absdiff", 1e-5f));
+    }
+}
@@ -0,0 +1,199 @@
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+#include <opencv2/opencv.hpp>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "../source/layer/details/convolution.hpp"
+#include "data/tensor_util.hpp"
+#include "runtime/runtime_ir.hpp"
+
+using namespace kuiper_infer;
+
+// 定义于test_resnet.cpp和test_yolov5.cpp中的预处理函数
+kuiper_infer::sftensor PreProcessImage(const cv::Mat &image);
+
+kuiper_infer::sftensor PreProcessImage(const cv::Mat &image,
+                                       const int32_t input_h,
+                                       const int32_t input_w);
+
+static std::vector<sftensor> FusionForward(const std::string &param_path,
+                                           const std::string &bin_path,
+                                           const std::vector<sftensor> &inputs,
+                                           bool operator_fusion,
+                                           uint32_t &operator_count) {
+    RuntimeGraph graph(param_path, bin_path);
+    graph.set_operator_fusion(operator_fusion);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+    operator_count = graph.operators().size();
+
+    // 计算图析构之后输出张量的内存也会被释放，需要拷贝一份
+    std::vector<sftensor> outputs;
+    for (const auto &output : graph.Forward(inputs, false)) {
+        outputs.push_back(std::make_shared<ftensor>(*output));
+    }
+    return outputs;
+}
+
+static std::shared_ptr<RuntimeAttribute> MakeAttribute(const std::vector<float> &values,
+                                                       const std::vector<int> &shape) {
+    std::shared_ptr<RuntimeAttribute> attr = std::make_shared<RuntimeAttribute>();
+    attr->type = RuntimeDataType::kTypeFloat32;
+    attr->shape = shape;
+    attr->weight_data.resize(values.size() * sizeof(float));
+    memcpy(attr->weight_data.data(), values.data(), values.size() * sizeof(float));
+    return attr;
+}
+
+static std::vector<float> RandomValues(std::mt19937 &engine, uint32_t size, float min_value,
+                                       float max_value) {
+    std::uniform_real_distribution<float> distribution(min_value, max_value);
+    std::vector<float> values(size);
+    for (float &value : values) {
+        value = distribution(engine);
+    }
+    return values;
+}
+
+static sftensor ConvForward(const std::vector<float> &weight, const std::vector<float> &bias,
+                            uint32_t out_channel, uint32_t in_channel, const sftensor &input) {
+    ConvolutionLayer conv_layer(out_channel, in_channel, 3, 3, 1, 1, 1, 1, 1, true);
+    conv_layer.set_weights(weight.data(), weight.size());
+    conv_layer.set_bias(bias.data(), bias.size());
+    std::vector<sftensor> inputs{input};
+    std::vector<sftensor> outputs(1);
+    EXPECT_EQ(conv_layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+    return std::make_shared<ftensor>(*outputs.front());
+}
+
+TEST(test_fusion, fold_batchnorm) {
+    using namespace kuiper_infer;
+    const uint32_t in_channel = 8;
+    const uint32_t out_channel = 16;
+    const float eps = 1e-5f;
+    std::mt19937 engine(42);
+    const std::vector<float> weight = RandomValues(engine, out_channel * in_channel * 9, -1.f, 1.f);
+    const std::vector<float> bias = RandomValues(engine, out_channel, -1.f, 1.f);
+    const std::vector<float> mean = RandomValues(engine, out_channel, -1.f, 1.f);
+    const std::vector<float> var = RandomValues(engine, out_channel, 0.1f, 2.f);
+    const std::vector<float> gamma = RandomValues(engine, out_channel, 0.5f, 1.5f);
+    const std::vector<float> beta = RandomValues(engine, out_channel, -1.f, 1.f);
+
+    std::shared_ptr<RuntimeOperator> conv_op = std::make_shared<RuntimeOperator>();
+    conv_op->type = "nn.Conv2d";
+    conv_op->attribute["weight"] =
+            MakeAttribute(weight, {int(out_channel), int(in_channel), 3, 3});
+    conv_op->attribute["bias"] = MakeAttribute(bias, {int(out_channel)});
+
+    std::shared_ptr<RuntimeOperator> bn_op = std::make_shared<RuntimeOperator>();
+    bn_op->type = "nn.BatchNorm2d";
+    bn_op->attribute["running_mean"] = MakeAttribute(mean, {int(out_channel)});
+    bn_op->attribute["running_var"] = MakeAttribute(var, {int(out_channel)});
+    bn_op->attribute["weight"] = MakeAttribute(gamma, {int(out_channel)});
+    bn_op->attribute["bias"] = MakeAttribute(beta, {int(out_channel)});
+    bn_op->params["eps"] = std::make_shared<RuntimeParameterFloat>(eps);
+    ASSERT_TRUE(RuntimeGraph::FoldBatchNorm(conv_op, bn_op));
+
+    sftensor input = std::make_shared<ftensor>(in_channel, 13, 11);
+    input->Rand();
+    // 先卷积再按照BatchNorm的定义逐通道归一化
+    sftensor expected = ConvForward(weight, bias, out_channel, in_channel, input);
+    for (uint32_t k = 0; k < out_channel; ++k) {
+        const float scale = gamma.at(k) / std::sqrt(var.at(k) + eps);
+        expected->slice(k) = (expected->slice(k) - mean.at(k)) * scale + beta.at(k);
+    }
+
+    const std::vector<float> &folded_weight = conv_op->attribute.at("weight")->get<float>(false);
+    const std::vector<float> &folded_bias = conv_op->attribute.at("bias")->get<float>(false);
+    const sftensor folded = ConvForward(folded_weight, folded_bias, out_channel, in_channel, input);
+    ASSERT_TRUE(TensorIsSame(folded, expected, 1e-4f));
+}
+
+TEST(test_fusion, resnet) {
+    using namespace kuiper_infer;
+    const std::string &param_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.param";
+    const std::string &weight_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.bin";
+    cv::Mat image = cv::imread("course8_resnetyolov5/model_file/car.jpg");
+    std::vector<sftensor> inputs{PreProcessImage(image)};
+
+    uint32_t fused_count = 0;
+    uint32_t unfused_count = 0;
+    const auto fused_outputs = FusionForward(param_path, weight_path, inputs, true, fused_count);
+    const auto outputs = FusionForward(param_path, weight_path, inputs, false, unfused_count);
+    // 17个ReLU中有9个紧跟在卷积之后
+    ASSERT_LT(fused_count, unfused_count);
+    ASSERT_EQ(fused_outputs.size(), outputs.size());
+    for (uint32_t i = 0; i < outputs.size(); ++i) {
+        ASSERT_TRUE(TensorIsSame(fused_outputs.at(i), outputs.at(i), 1e-4f));
+    }
+}
+
+TEST(test_fusion, yolov5) {
+    using namespace kuiper_infer;
+    const std::string &param_path = "course8_resnetyolov5/model_file/yolov5s.pnnx.param";
+    const std::string &weight_path = "course8_resnetyolov5/model_file/yolov5s.pnnx.bin";
+    cv::Mat image = cv::imread("course8_resnetyolov5/model_file/bus.jpg");
+    std::vector<sftensor> inputs{PreProcessImage(image, 640, 640)};
+
+    uint32_t fused_count = 0;
+    uint32_t unfused_count = 0;
+    const auto fused_outputs = FusionForward(param_path, weight_path, inputs, true, fused_count);
+    const auto outputs = FusionForward(param_path, weight_path, inputs, false, unfused_count);
+    // 所有的SiLU都紧跟在卷积之后
+    ASSERT_EQ(fused_count + 57, unfused_count);
+    ASSERT_EQ(fused_outputs.size(), outputs.size());
+    for (uint32_t i = 0; i < outputs.size(); ++i) {
+        ASSERT_TRUE(TensorIsSame(fused_outputs.at(i), outputs.at(i), 1e-4f));
+    }
+}
+
+static uint32_t CountCatAliases(const RuntimeGraph &graph) {
+    // 统计直接写入cat输出张量中对应通道的前驱节点输出
+    uint32_t alias_count = 0;
+    for (const auto &op : graph.operators()) {
+        if (op->type != "torch.cat" || op->output_operands == nullptr) {
+            continue;
+        }
+        const auto &cat_datas = op->output_operands->datas;
+        for (uint32_t b = 0; b < cat_datas.size(); ++b) {
+            const sftensor &cat_data = cat_datas.at(b);
+            const uint32_t plane_size = cat_data->rows() * cat_data->cols();
+            uint32_t start_channel = 0;
+            for (const auto &input_operand : op->input_operands_seq) {
+                const sftensor &input_data = input_operand->datas.at(b);
+                if (input_data->raw_ptr() == cat_data->raw_ptr(start_channel * plane_size)) {
+                    alias_count += 1;
+                }
+                start_channel += input_data->channels();
+            }
+        }
+    }
+    return alias_count;
+}
+
+TEST(test_fusion, yolov5_cat_views) {
+    using namespace kuiper_infer;
+    const std::string &param_path = "course8_resnetyolov5/model_file/yolov5s.pnnx.param";
+    const std::string &weight_path = "course8_resnetyolov5/model_file/yolov5s.pnnx.bin";
+    cv::Mat image = cv::imread("course8_resnetyolov5/model_file/bus.jpg");
+    std::vector<sftensor> inputs{PreProcessImage(image, 640, 640)};
+
+    RuntimeGraph view_graph(param_path, weight_path);
+    view_graph.Build("pnnx_input_0", "pnnx_output_0");
+    ASSERT_TRUE(view_graph.cat_views());
+    const auto view_outputs = view_graph.Forward(inputs, false);
+    // C3模块和SPPF中的cat节点，前驱节点的输出就是cat输出张量中的若干个通道
+    ASSERT_GT(CountCatAliases(view_graph), 0);
+
+    // 关闭之后cat节点把每个输入复制到输出张量中
+    RuntimeGraph copy_graph(param_path, weight_path);
+    copy_graph.set_cat_views(false);
+    copy_graph.Build("pnnx_input_0", "pnnx_output_0");
+    const auto copy_outputs = copy_graph.Forward(inputs, false);
+    ASSERT_EQ(CountCatAliases(copy_graph), 0);
+
+    ASSERT_EQ(view_outputs.size(), copy_outputs.size());
+    for (uint32_t i = 0; i < view_outputs.size(); ++i) {
+        ASSERT_TRUE(TensorIsSame(view_outputs.at(i), copy_outputs.at(i)));
+    }
+}
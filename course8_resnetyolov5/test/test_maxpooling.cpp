@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "../source/layer/details/maxpooling.hpp"
+#include "data/tensor_util.hpp"
+
+using namespace kuiper_infer;
+
+static sftensor NaiveMaxPooling(const sftensor &input, uint32_t pooling, uint32_t padding) {
+    const int32_t input_h = int32_t(input->rows());
+    const int32_t input_w = int32_t(input->cols());
+    const int32_t output_h = input_h + 2 * int32_t(padding) - int32_t(pooling) + 1;
+    const int32_t output_w = input_w + 2 * int32_t(padding) - int32_t(pooling) + 1;
+    sftensor output = std::make_shared<ftensor>(input->channels(), output_h, output_w);
+    for (uint32_t c = 0; c < input->channels(); ++c) {
+        for (int32_t oh = 0; oh < output_h; ++oh) {
+            for (int32_t ow = 0; ow < output_w; ++ow) {
+                float max_value = std::numeric_limits<float>::lowest();
+                for (int32_t h = oh - int32_t(padding); h < oh - int32_t(padding) + int32_t(pooling); ++h) {
+                    for (int32_t w = ow - int32_t(padding); w < ow - int32_t(padding) + int32_t(pooling); ++w) {
+                        if (h >= 0 && h < input_h && w >= 0 && w < input_w) {
+                            max_value = std::max(max_value, input->at(c, h, w));
+                        }
+                    }
+                }
+                output->at(c, oh, ow) = max_value;
+            }
+        }
+    }
+    return output;
+}
+
+TEST(test_maxpooling, separable) {
+    sftensor input = std::make_shared<ftensor>(5, 17, 12);
+    input->Rand();
+    // 步长为1时使用和窗口大小无关的可分离实现
+    for (uint32_t pooling : {1, 2, 3, 5, 9}) {
+        for (uint32_t padding = 0; padding <= pooling / 2; ++padding) {
+            MaxPoolingLayer max_layer(padding, padding, pooling, pooling, 1, 1);
+            std::vector<sftensor> inputs{input};
+            std::vector<sftensor> outputs(1);
+            ASSERT_EQ(max_layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+            ASSERT_TRUE(TensorIsSame(outputs.front(), NaiveMaxPooling(input, pooling, padding)));
+        }
+    }
+}
+
+TEST(test_maxpooling, cascade) {
+    sftensor input = std::make_shared<ftensor>(16, 20, 20);
+    input->Rand();
+    const sftensor blocked_input = TensorReorder(input, TensorLayout::kNCHW8c);
+
+    for (const sftensor &pooling_input : {input, blocked_input}) {
+        // yolov5的SPPF，三个级联的5x5池化等于5x5、9x9和13x13池化
+        std::vector<std::shared_ptr<RuntimeOperand>> cascade_outputs;
+        for (uint32_t i = 0; i < 2; ++i) {
+            auto operand = std::make_shared<RuntimeOperand>();
+            sftensor output = std::make_shared<ftensor>(16, 20, 20);
+            output->set_layout(pooling_input->layout());
+            operand->datas.push_back(output);
+            cascade_outputs.push_back(operand);
+        }
+
+        MaxPoolingLayer max_layer(2, 2, 5, 5, 1, 1);
+        max_layer.set_cascade_outputs(cascade_outputs);
+        std::vector<sftensor> inputs{pooling_input};
+        std::vector<sftensor> outputs(1);
+        ASSERT_EQ(max_layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+
+        const std::vector<sftensor> stage_outputs{outputs.front(),
+                                                  cascade_outputs.at(0)->datas.front(),
+                                                  cascade_outputs.at(1)->datas.front()};
+        for (uint32_t i = 0; i < stage_outputs.size(); ++i) {
+            const uint32_t pooling = 5 + i * 4;
+            ASSERT_TRUE(TensorIsSame(TensorReorder(stage_outputs.at(i), TensorLayout::kNCHW),
+                                     NaiveMaxPooling(input, pooling, pooling / 2)));
+        }
+    }
+}
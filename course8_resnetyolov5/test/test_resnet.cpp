@@ -2,10 +2,20 @@
 // Created by fss on 23-8-5.
 //
 #include <gtest/gtest.h>
+#include <glog/logging.h>
+#include <omp.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <vector>
 #include <opencv2/opencv.hpp>
+#include "../source/layer/details/convolution.hpp"
 #include "../source/layer/details/expression.hpp"
+#include "runtime/ir.h"
 #include "runtime/runtime_ir.hpp"
+#include "data/tensor_util.hpp"
+#include "utils/time/time_logging.hpp"
 #include "../source/layer/details/softmax.hpp"
 
 using namespace kuiper_infer;
@@ -91,4 +101,259 @@ TEST(test_net, resnet) {
         }
         printf("class with max prob is %f index %d\n", max_prob, max_index);
     }
-}
\ No newline at end of file
+}
+TEST(test_net, resnet_parallel) {
+    using namespace kuiper_infer;
+    const std::string &param_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.param";
+    const std::string &weight_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.bin";
+    RuntimeGraph graph(param_path, weight_path);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    cv::Mat image = cv::imread("course8_resnetyolov5/model_file/car.jpg");
+    std::vector<sftensor> inputs{PreProcessImage(image)};
+    const auto serial_outputs = graph.Forward(inputs, false);
+    ASSERT_EQ(serial_outputs.size(), 1);
+    // 输出张量会在下一次推理时被复用，需要先拷贝一份
+    const sftensor serial_output = std::make_shared<ftensor>(*serial_outputs.front());
+
+    graph.set_parallel_execution(true);
+    const auto parallel_outputs = graph.Forward(inputs, false);
+    ASSERT_EQ(parallel_outputs.size(), 1);
+    ASSERT_TRUE(TensorIsSame(serial_output, parallel_outputs.front()));
+}
+
+static double ForwardTime(RuntimeGraph &graph, const std::vector<sftensor> &inputs,
+                          uint32_t repeat) {
+    // 第一次推理会划分输出张量并分配临时空间，不计入耗时
+    graph.Forward(inputs, false);
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < repeat; ++i) {
+        graph.Forward(inputs, false);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / repeat;
+}
+
+// 比较串行和并行执行的耗时，在多核机器上通过--gtest_also_run_disabled_tests运行
+TEST(test_net, DISABLED_resnet_parallel_benchmark) {
+    using namespace kuiper_infer;
+    const std::string &param_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.param";
+    const std::string &weight_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.bin";
+    RuntimeGraph graph(param_path, weight_path);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    cv::Mat image = cv::imread("course8_resnetyolov5/model_file/car.jpg");
+    std::vector<sftensor> inputs{PreProcessImage(image)};
+    const double serial_time = ForwardTime(graph, inputs, 20);
+    graph.set_parallel_execution(true);
+    const double parallel_time = ForwardTime(graph, inputs, 20);
+    LOG(INFO) << "Serial forward: " << serial_time << " ms, parallel forward: " << parallel_time
+              << " ms, threads: " << omp_get_max_threads();
+    // 主干部分的节点在并行模式下仍然使用全部线程，不能比串行执行明显更慢
+    ASSERT_LT(parallel_time, serial_time * 1.2);
+}
+
+TEST(test_net, resnet_memory_planning) {
+    using namespace kuiper_infer;
+    const std::string &param_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.param";
+    const std::string &weight_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.bin";
+    RuntimeGraph graph(param_path, weight_path);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+    ASSERT_TRUE(graph.memory_planning());
+
+    cv::Mat image = cv::imread("course8_resnetyolov5/model_file/car.jpg");
+    std::vector<sftensor> inputs{PreProcessImage(image)};
+    const auto planned_outputs = graph.Forward(inputs, false);
+    ASSERT_EQ(planned_outputs.size(), 1);
+    const sftensor planned_output = std::make_shared<ftensor>(*planned_outputs.front());
+
+    // 关闭内存规划后每个节点的输出张量独立分配
+    graph.set_memory_planning(false);
+    const auto outputs = graph.Forward(inputs, false);
+    ASSERT_EQ(outputs.size(), 1);
+    ASSERT_TRUE(TensorIsSame(planned_output, outputs.front()));
+}
+
+TEST(test_net, resnet_output_lifetime) {
+    using namespace kuiper_infer;
+    const std::string &param_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.param";
+    const std::string &weight_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.bin";
+    cv::Mat image = cv::imread("course8_resnetyolov5/model_file/car.jpg");
+    std::vector<sftensor> inputs{PreProcessImage(image)};
+
+    std::vector<sftensor> outputs;
+    sftensor expected_output;
+    {
+        RuntimeGraph graph(param_path, weight_path);
+        graph.Build("pnnx_input_0", "pnnx_output_0");
+        outputs = graph.Forward(inputs, false);
+        ASSERT_EQ(outputs.size(), 1);
+        expected_output = std::make_shared<ftensor>(*outputs.front());
+    }
+
+    // 输出张量持有arena的引用，计算图析构并且另一个计算图分配内存之后仍然有效
+    RuntimeGraph other_graph(param_path, weight_path);
+    other_graph.Build("pnnx_input_0", "pnnx_output_0");
+    other_graph.Forward({PreProcessImage(cv::imread("course8_resnetyolov5/model_file/bus.jpg"))},
+                        false);
+    ASSERT_TRUE(TensorIsSame(expected_output, outputs.front()));
+}
+
+TEST(test_net, resnet_profiling) {
+    using namespace kuiper_infer;
+    const std::string &param_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.param";
+    const std::string &weight_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.bin";
+    RuntimeGraph graph(param_path, weight_path);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    const std::string &trace_path = testing::TempDir() + "resnet18_trace.json";
+    graph.set_trace_path(trace_path);
+    cv::Mat image = cv::imread("course8_resnetyolov5/model_file/car.jpg");
+    std::vector<sftensor> inputs{PreProcessImage(image)};
+    graph.Forward(inputs, true);
+
+    // 除了输入和输出节点，每个节点都有一条执行记录
+    const auto &trace_events = utils::LayerTimeStatesSingleton::TraceEvents();
+    ASSERT_EQ(trace_events.size(), graph.operators().size() - 2);
+    std::ifstream trace_file(trace_path, std::ios::ate);
+    ASSERT_TRUE(trace_file.is_open());
+    ASSERT_GT(trace_file.tellg(), 0);
+    trace_file.close();
+    ASSERT_EQ(std::remove(trace_path.c_str()), 0);
+}
+
+TEST(test_net, resnet_dynamic_batch) {
+    using namespace kuiper_infer;
+    const std::string &param_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.param";
+    const std::string &weight_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.bin";
+    RuntimeGraph graph(param_path, weight_path);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    std::vector<sftensor> inputs;
+    std::vector<sftensor> expected_outputs;
+    for (const std::string &name : {"car.jpg", "bus.jpg", "31.jpg"}) {
+        cv::Mat image = cv::imread("course8_resnetyolov5/model_file/" + name);
+        inputs.push_back(PreProcessImage(image));
+        const auto outputs = graph.Forward({inputs.back()}, false);
+        expected_outputs.push_back(std::make_shared<ftensor>(*outputs.front()));
+    }
+
+    // 同一个计算图按照不同的批次大小推理，批次变小时复用已经分配的内存
+    RuntimeGraph batch_graph(param_path, weight_path);
+    batch_graph.set_max_batch_size(4);
+    batch_graph.Build("pnnx_input_0", "pnnx_output_0");
+    for (uint32_t batch_size : {3, 1, 2, 3}) {
+        const std::vector<sftensor> batch_inputs(inputs.begin(), inputs.begin() + batch_size);
+        const auto outputs = batch_graph.Forward(batch_inputs, false);
+        ASSERT_EQ(outputs.size(), batch_size);
+        for (uint32_t i = 0; i < batch_size; ++i) {
+            ASSERT_TRUE(TensorIsSame(outputs.at(i), expected_outputs.at(i), 1e-4f));
+        }
+    }
+}
+
+TEST(test_net, resnet_batch_output_lifetime) {
+    using namespace kuiper_infer;
+    const std::string &param_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.param";
+    const std::string &weight_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.bin";
+    RuntimeGraph graph(param_path, weight_path);
+    graph.set_max_batch_size(4);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    std::vector<sftensor> inputs;
+    for (const std::string &name : {"car.jpg", "bus.jpg", "31.jpg"}) {
+        inputs.push_back(PreProcessImage(cv::imread("course8_resnetyolov5/model_file/" + name)));
+    }
+    const auto batch1_outputs = graph.Forward({inputs.front()}, false);
+    ASSERT_EQ(batch1_outputs.size(), 1);
+    const sftensor batch1_output = std::make_shared<ftensor>(*batch1_outputs.front());
+
+    // 批次变大时arena被重新分配，之前返回的输出张量仍然引用旧的arena
+    const auto batch3_outputs = graph.Forward(inputs, false);
+    ASSERT_EQ(batch3_outputs.size(), 3);
+    ASSERT_TRUE(TensorIsSame(batch1_outputs.front(), batch1_output));
+    ASSERT_TRUE(TensorIsSame(batch3_outputs.front(), batch1_output, 1e-4f));
+}
+
+TEST(test_net, resnet_mapped_weights) {
+    const std::string &param_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.param";
+    const std::string &weight_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.bin";
+    pnnx::Graph read_graph;
+    ASSERT_EQ(read_graph.load(param_path, weight_path), 0);
+    pnnx::Graph mapped_graph;
+    ASSERT_EQ(mapped_graph.load(param_path, weight_path, true), 0);
+    ASSERT_EQ(read_graph.ops.size(), mapped_graph.ops.size());
+
+    // 内存映射中引用的权重和读取出来的权重完全相同
+    uint32_t mapped_count = 0;
+    for (size_t i = 0; i < read_graph.ops.size(); ++i) {
+        for (const auto &[name, attr] : read_graph.ops.at(i)->attrs) {
+            const pnnx::Attribute &mapped_attr = mapped_graph.ops.at(i)->attrs.at(name);
+            if (mapped_attr.mapped_data == nullptr) {
+                ASSERT_EQ(attr.data, mapped_attr.data);
+                continue;
+            }
+            mapped_count += 1;
+            ASSERT_TRUE(mapped_attr.data.empty());
+            ASSERT_EQ(std::memcmp(attr.data.data(), mapped_attr.mapped_data.get(), attr.data.size()), 0);
+            // 比较和拼接都要使用内存映射中的权重
+            ASSERT_TRUE(attr == mapped_attr);
+            ASSERT_TRUE((attr + attr) == (mapped_attr + mapped_attr));
+        }
+    }
+    ASSERT_GT(mapped_count, 0);
+
+    // 保存内存映射的计算图时写出的是映射中的权重
+    const std::string &saved_param_path = testing::TempDir() + "resnet18_mapped.pnnx.param";
+    const std::string &saved_weight_path = testing::TempDir() + "resnet18_mapped.pnnx.bin";
+    ASSERT_EQ(mapped_graph.save(saved_param_path, saved_weight_path), 0);
+    pnnx::Graph saved_graph;
+    ASSERT_EQ(saved_graph.load(saved_param_path, saved_weight_path), 0);
+    std::remove(saved_param_path.c_str());
+    std::remove(saved_weight_path.c_str());
+    ASSERT_EQ(read_graph.ops.size(), saved_graph.ops.size());
+    for (size_t i = 0; i < read_graph.ops.size(); ++i) {
+        ASSERT_EQ(read_graph.ops.at(i)->attrs, saved_graph.ops.at(i)->attrs);
+    }
+}
+
+TEST(test_net, resnet_plan) {
+    using namespace kuiper_infer;
+    const std::string &param_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.param";
+    const std::string &weight_path = "course8_resnetyolov5/model_file/resnet18_batch1.pnnx.bin";
+    const std::string &plan_path = testing::TempDir() + "resnet18_batch1.plan";
+    RuntimeGraph graph(param_path, weight_path);
+    graph.set_plan_export(true);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+    ASSERT_TRUE(graph.SavePlan(plan_path));
+
+    cv::Mat image = cv::imread("course8_resnetyolov5/model_file/car.jpg");
+    std::vector<sftensor> inputs{PreProcessImage(image)};
+    const auto outputs = graph.Forward(inputs, false);
+    ASSERT_EQ(outputs.size(), 1);
+
+    // 从计划文件加载的计算图不需要pnnx模型文件
+    RuntimeGraph plan_graph("", "");
+    const bool plan_loaded = plan_graph.LoadPlan(plan_path);
+    // 排布后的卷积核直接引用计划文件的内存映射，删除文件不影响已经建立的映射
+    ASSERT_EQ(std::remove(plan_path.c_str()), 0);
+    ASSERT_TRUE(plan_loaded);
+    ASSERT_EQ(plan_graph.operators().size(), graph.operators().size());
+
+    // 计划文件中不保存原始的卷积核，卷积层只能使用保存的排布结果
+    uint32_t conv_count = 0;
+    for (const auto &op : plan_graph.operators()) {
+        if (op->type != "nn.Conv2d") {
+            continue;
+        }
+        const auto conv_layer = std::dynamic_pointer_cast<ConvolutionLayer>(op->layer);
+        ASSERT_NE(conv_layer, nullptr);
+        ASSERT_TRUE(conv_layer->weights().empty());
+        ASSERT_FALSE(conv_layer->packed_weights().empty());
+        conv_count += 1;
+    }
+    ASSERT_GT(conv_count, 0);
+    const auto plan_outputs = plan_graph.Forward(inputs, false);
+    ASSERT_EQ(plan_outputs.size(), 1);
+    ASSERT_TRUE(TensorIsSame(outputs.front(), plan_outputs.front()));
+}
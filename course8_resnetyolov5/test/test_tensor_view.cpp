@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+#include <vector>
+#include "data/tensor_view.hpp"
+#include "data/tensor_util.hpp"
+
+using namespace kuiper_infer;
+
+TEST(test_tensor_view, reshape_view) {
+    // 拆分通道维度不需要复制，视图和张量共享存储
+    sftensor tensor = std::make_shared<ftensor>(6, 4, 5);
+    tensor->Rand();
+    const TensorView view = TensorView(tensor).Reshape({2, 3, 4, 5});
+    ASSERT_EQ(view.data(), tensor->raw_ptr());
+    for (uint32_t c = 0; c < 6; ++c) {
+        for (uint32_t r = 0; r < 4; ++r) {
+            for (uint32_t w = 0; w < 5; ++w) {
+                ASSERT_EQ(view.at({c / 3, c % 3, r, w}), tensor->at(c, r, w));
+            }
+        }
+    }
+
+    // 每个通道只有一行时展平前后的排布相同
+    ASSERT_TRUE(TensorView::IsReshapeInPlace({512, 1, 1}, {512}));
+    ASSERT_FALSE(TensorView::IsReshapeInPlace({8, 4, 5}, {160}));
+}
+
+TEST(test_tensor_view, reshape_copy) {
+    // 合并行和列需要复制，结果和行主序的reshape相同
+    sftensor tensor = std::make_shared<ftensor>(3, 4, 5);
+    tensor->Rand();
+    const TensorView view = TensorView(tensor).Reshape({3, 20});
+    ASSERT_NE(view.data(), tensor->raw_ptr());
+
+    sftensor reshaped = TensorClone(tensor);
+    reshaped->Reshape({3, 20}, true);
+    ASSERT_TRUE(TensorIsSame(view.ToTensor(), reshaped));
+}
+
+TEST(test_tensor_view, slice_permute) {
+    sftensor tensor = std::make_shared<ftensor>(8, 4, 5);
+    tensor->Rand();
+    // 一段连续的通道可以直接作为张量使用
+    const TensorView channels = TensorView(tensor).Slice(0, 2, 3);
+    ASSERT_TRUE(channels.IsTensorLayout());
+    const sftensor channels_tensor = channels.ToTensor();
+    ASSERT_EQ(channels_tensor->raw_ptr(), tensor->matrix_raw_ptr(2));
+
+    const TensorView permuted = TensorView(tensor).Permute({0, 2, 1});
+    ASSERT_EQ(permuted.shapes(), std::vector<uint32_t>({8, 5, 4}));
+    ASSERT_EQ(permuted.data(), tensor->raw_ptr());
+    const sftensor transposed = permuted.ToTensor();
+    for (uint32_t c = 0; c < 8; ++c) {
+        ASSERT_TRUE(arma::approx_equal(transposed->slice(c), tensor->slice(c).t(),
+                                       "absdiff", 1e-5f));
+    }
+}
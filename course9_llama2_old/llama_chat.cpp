@@ -7,6 +7,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <deque>
+#include <list>
+#include <string>
+#include <unordered_map>
 #include "llama_chat.hpp"
 //#include "../../source/layer/details/matmul.hpp"
 //#include "../../source/layer/details/rms_norm.hpp"
@@ -15,16 +19,22 @@
 #include "source/layer/details/softmax.hpp"
 #include "source/layer/details/rms_norm.hpp"
 #include "source/layer/details/matmul.hpp"
+#include "source/layer/details/quant_matmul.hpp"
 
 #if defined _WIN32
 #include "win.h"
 #else
+#include <poll.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #endif
 // ----------------------------------------------------------------------------
 // Transformer model
 
+// the prompt is prefilled in chunks of at most this many tokens, every matmul of a chunk
+// reads the weights once for all of its tokens
+#define PREFILL_CHUNK_SIZE 64
+
 void malloc_run_state(RunState *s, Config *p) {
   // we calloc instead of malloc to keep valgrind happy
   int kv_dim = (p->dim * p->n_kv_heads) / p->n_heads;
@@ -34,13 +44,25 @@ void malloc_run_state(RunState *s, Config *p) {
   s->hb = static_cast<float *>(calloc(p->hidden_dim, sizeof(float)));
   s->hb2 = static_cast<float *>(calloc(p->hidden_dim, sizeof(float)));
   s->q = static_cast<float *>(calloc(p->dim, sizeof(float)));
-  s->key_cache = static_cast<float *>(calloc(p->n_layers * p->seq_len * kv_dim, sizeof(float)));
-  s->value_cache = static_cast<float *>(calloc(p->n_layers * p->seq_len * kv_dim, sizeof(float)));
+  s->k = static_cast<float *>(calloc(kv_dim, sizeof(float)));
+  s->v = static_cast<float *>(calloc(kv_dim, sizeof(float)));
   s->att = static_cast<float *>(calloc(p->n_heads * p->seq_len, sizeof(float)));
   s->logits = static_cast<float *>(calloc(p->vocab_size, sizeof(float)));
+  s->prefill_chunk = p->seq_len < PREFILL_CHUNK_SIZE ? p->seq_len : PREFILL_CHUNK_SIZE;
+  s->xs = static_cast<float *>(calloc(s->prefill_chunk * p->dim, sizeof(float)));
+  s->xbs = static_cast<float *>(calloc(s->prefill_chunk * p->dim, sizeof(float)));
+  s->xb2s = static_cast<float *>(calloc(s->prefill_chunk * p->dim, sizeof(float)));
+  s->hbs = static_cast<float *>(calloc(s->prefill_chunk * p->hidden_dim, sizeof(float)));
+  s->hb2s = static_cast<float *>(calloc(s->prefill_chunk * p->hidden_dim, sizeof(float)));
+  s->qs = static_cast<float *>(calloc(s->prefill_chunk * p->dim, sizeof(float)));
+  s->ks = static_cast<float *>(calloc(s->prefill_chunk * kv_dim, sizeof(float)));
+  s->vs = static_cast<float *>(calloc(s->prefill_chunk * kv_dim, sizeof(float)));
+  s->batch_logits = static_cast<float *>(calloc(s->prefill_chunk * p->vocab_size, sizeof(float)));
+  s->kv = NULL;  // the kv cache is paged, sessions are built over the pool of the Transformer
   // ensure all mallocs went fine
-  if (!s->x || !s->xb || !s->xb2 || !s->hb || !s->hb2 || !s->q || !s->key_cache ||
-      !s->value_cache || !s->att || !s->logits) {
+  if (!s->x || !s->xb || !s->xb2 || !s->hb || !s->hb2 || !s->q || !s->k || !s->v || !s->att ||
+      !s->logits || !s->xs || !s->xbs || !s->xb2s || !s->hbs || !s->hb2s || !s->qs || !s->ks ||
+      !s->vs || !s->batch_logits) {
     fprintf(stderr, "malloc failed!\n");
     exit(EXIT_FAILURE);
   }
@@ -53,10 +75,182 @@ void free_run_state(RunState *s) {
   free(s->hb);
   free(s->hb2);
   free(s->q);
+  free(s->k);
+  free(s->v);
   free(s->att);
   free(s->logits);
-  free(s->key_cache);
-  free(s->value_cache);
+  free(s->xs);
+  free(s->xbs);
+  free(s->xb2s);
+  free(s->hbs);
+  free(s->hb2s);
+  free(s->qs);
+  free(s->ks);
+  free(s->vs);
+  free(s->batch_logits);
+}
+
+// ----------------------------------------------------------------------------
+// paged kv cache: the sessions take fixed size blocks of positions from a shared pool
+
+// number of positions per block of the kv cache
+#define KV_BLOCK_SIZE 16
+// the pool holds at most the blocks of this many full length sessions, it only allocates
+// the blocks the sessions actually use
+#define KV_POOL_SESSIONS 8
+
+void build_kv_pool(KVPool *pool, Config *p, int block_size, int max_blocks) {
+  pool->block_size = block_size;
+  pool->max_blocks = max_blocks;
+  pool->n_allocated = 0;
+  pool->key_blocks = static_cast<float **>(calloc(max_blocks, sizeof(float *)));
+  pool->value_blocks = static_cast<float **>(calloc(max_blocks, sizeof(float *)));
+  pool->free_blocks = static_cast<int *>(calloc(max_blocks, sizeof(int)));
+  pool->n_free = 0;
+  pool->ref_counts = static_cast<int *>(calloc(max_blocks, sizeof(int)));
+  if (!pool->key_blocks || !pool->value_blocks || !pool->free_blocks || !pool->ref_counts) {
+    fprintf(stderr, "malloc failed!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void free_kv_pool(KVPool *pool) {
+  for (int i = 0; i < pool->n_allocated; i++) {
+    free(pool->key_blocks[i]);
+    free(pool->value_blocks[i]);
+  }
+  free(pool->key_blocks);
+  free(pool->value_blocks);
+  free(pool->free_blocks);
+  free(pool->ref_counts);
+}
+
+struct PrefixBlock;
+static bool prefix_cache_evict(PrefixCache *cache, const PrefixBlock *keep);
+
+static int alloc_kv_block(Transformer *t) {
+  // reuse a released block, or allocate a new one while the pool is below max_blocks. a full
+  // pool first evicts prefix cache blocks, a block is only released once no session holds it
+  // either. returns -1 when all the max_blocks blocks are still held, the caller holds the
+  // returned block once
+  KVPool *pool = &t->kv_pool;
+  while (pool->n_free == 0 && pool->n_allocated == pool->max_blocks) {
+    if (t->prefix_cache == NULL || !prefix_cache_evict(t->prefix_cache, NULL)) {
+      return -1;
+    }
+  }
+  if (pool->n_free > 0) {
+    int block = pool->free_blocks[--pool->n_free];
+    pool->ref_counts[block] = 1;
+    return block;
+  }
+  Config *p = &t->config;
+  int kv_dim = (p->dim * p->n_kv_heads) / p->n_heads;
+  size_t block_floats = (size_t) p->n_layers * pool->block_size * kv_dim;
+  int block = pool->n_allocated;
+  pool->key_blocks[block] = static_cast<float *>(calloc(block_floats, sizeof(float)));
+  pool->value_blocks[block] = static_cast<float *>(calloc(block_floats, sizeof(float)));
+  if (!pool->key_blocks[block] || !pool->value_blocks[block]) {
+    fprintf(stderr, "malloc failed!\n");
+    exit(EXIT_FAILURE);
+  }
+  pool->ref_counts[block] = 1;
+  pool->n_allocated++;
+  return block;
+}
+
+static void release_kv_block(KVPool *pool, int block) {
+  // drop one hold of the block, the last one returns it to the pool
+  if (--pool->ref_counts[block] == 0) {
+    pool->free_blocks[pool->n_free++] = block;
+  }
+}
+
+KVCache *build_kv_cache(Transformer *t) {
+  // an empty session, its blocks are taken from the pool as forward reaches them
+  int max_blocks = (t->config.seq_len + t->kv_pool.block_size - 1) / t->kv_pool.block_size;
+  KVCache *kv = static_cast<KVCache *>(malloc(sizeof(KVCache)));
+  kv->block_table = static_cast<int *>(calloc(max_blocks, sizeof(int)));
+  kv->n_blocks = 0;
+  if (!kv->block_table) {
+    fprintf(stderr, "malloc failed!\n");
+    exit(EXIT_FAILURE);
+  }
+  return kv;
+}
+
+void reset_kv_cache(Transformer *t, KVCache *kv) {
+  // release the blocks of the session back to the pool, e.g. to start a new sequence. blocks
+  // the prefix cache shares stay with it
+  KVPool *pool = &t->kv_pool;
+  for (int i = 0; i < kv->n_blocks; i++) {
+    release_kv_block(pool, kv->block_table[i]);
+  }
+  kv->n_blocks = 0;
+}
+
+void free_kv_cache(Transformer *t, KVCache *kv) {
+  reset_kv_cache(t, kv);
+  free(kv->block_table);
+  free(kv);
+}
+
+bool kv_cache_reserve(Transformer *t, KVCache *kv, int start, int n_positions) {
+  // make the block table of the session cover positions 0..n_positions-1, positions
+  // start..n_positions-1 are about to be written so their blocks are copied first when the
+  // prefix cache or another session shares them. returns false when the pool is out of
+  // blocks, the session keeps the blocks it got so far and the caller decides whether to give
+  // up on it or to free blocks elsewhere and retry
+  if (n_positions > t->config.seq_len) {
+    fprintf(stderr, "cannot reserve %d positions, seq_len is %d\n", n_positions,
+            t->config.seq_len);
+    exit(EXIT_FAILURE);
+  }
+  KVPool *pool = &t->kv_pool;
+  int block_size = pool->block_size;
+  int n_blocks = (n_positions + block_size - 1) / block_size;
+  for (int b = start / block_size; b < n_blocks && b < kv->n_blocks; b++) {
+    int shared = kv->block_table[b];
+    if (pool->ref_counts[shared] == 1) {
+      continue;
+    }
+    int block = alloc_kv_block(t);
+    if (block < 0) {
+      return false;
+    }
+    int kv_dim = (t->config.dim * t->config.n_kv_heads) / t->config.n_heads;
+    size_t block_floats = (size_t) t->config.n_layers * block_size * kv_dim;
+    memcpy(pool->key_blocks[block], pool->key_blocks[shared], block_floats * sizeof(float));
+    memcpy(pool->value_blocks[block], pool->value_blocks[shared], block_floats * sizeof(float));
+    release_kv_block(pool, shared);
+    kv->block_table[b] = block;
+  }
+  while (kv->n_blocks * block_size < n_positions) {
+    int block = alloc_kv_block(t);
+    if (block < 0) {
+      return false;
+    }
+    kv->block_table[kv->n_blocks++] = block;
+  }
+  return true;
+}
+
+float *kv_cache_key(Transformer *t, KVCache *kv, int layer, int pos) {
+  // the key at a position of the session, the position must be reserved
+  KVPool *pool = &t->kv_pool;
+  int kv_dim = (t->config.dim * t->config.n_kv_heads) / t->config.n_heads;
+  int block = kv->block_table[pos / pool->block_size];
+  return pool->key_blocks[block] +
+         ((size_t) layer * pool->block_size + pos % pool->block_size) * kv_dim;
+}
+
+float *kv_cache_value(Transformer *t, KVCache *kv, int layer, int pos) {
+  // the value at a position of the session, the position must be reserved
+  KVPool *pool = &t->kv_pool;
+  int kv_dim = (t->config.dim * t->config.n_kv_heads) / t->config.n_heads;
+  int block = kv->block_table[pos / pool->block_size];
+  return pool->value_blocks[block] +
+         ((size_t) layer * pool->block_size + pos % pool->block_size) * kv_dim;
 }
 
 void memory_map_weights(TransformerWeights *w, Config *p, float *ptr, int shared_weights) {
@@ -89,6 +283,83 @@ void memory_map_weights(TransformerWeights *w, Config *p, float *ptr, int shared
   ptr += p->seq_len * head_size / 2;  // skip what used to be freq_cis_real (for RoPE)
   ptr += p->seq_len * head_size / 2;  // skip what used to be freq_cis_imag (for RoPE)
   w->wcls = shared_weights ? w->token_embedding_table : ptr;
+  // fp32 checkpoint, no quantized weights
+  w->group_size = 0;
+  w->q_tokens = w->q_wq = w->q_wk = w->q_wv = w->q_wo = NULL;
+  w->q_w1 = w->q_w2 = w->q_w3 = w->q_wcls = NULL;
+}
+
+// ----------------------------------------------------------------------------
+// int8 quantized checkpoint. the header holds the magic number, the version, the Config,
+// whether the classifier is shared with the token embedding and the group size, padded
+// to QUANT_HEADER_SIZE bytes. it is followed by the fp32 rmsnorm weights and then by the
+// quantized tensors, each one stored as its int8 values followed by its fp32 group scales
+
+#define QUANT_MAGIC 0x616b3432  // "ak42" in ascii
+#define QUANT_VERSION 2
+#define QUANT_HEADER_SIZE 256
+
+QuantizedTensor *init_quantized_tensors(void **ptr, int n, size_t size_each, int group_size) {
+  void *p = *ptr;
+  QuantizedTensor *res = static_cast<QuantizedTensor *>(malloc(n * sizeof(QuantizedTensor)));
+  for (int i = 0; i < n; i++) {
+    // map the int8 values and then the scale factors
+    res[i].q = static_cast<int8_t *>(p);
+    p = static_cast<int8_t *>(p) + size_each;
+    res[i].s = static_cast<float *>(p);
+    p = static_cast<float *>(p) + size_each / group_size;
+  }
+  *ptr = p;  // advance ptr to current position
+  return res;
+}
+
+void memory_map_quantized_weights(TransformerWeights *w, Config *p, void *ptr,
+                                  uint8_t shared_classifier, int group_size) {
+  using namespace kuiper_infer;
+  int head_size = p->dim / p->n_heads;
+  unsigned long long n_layers = p->n_layers;
+  // first are the parameters that are kept in fp32 (the rmsnorm (1D) weights)
+  float *fptr = static_cast<float *>(ptr);
+  w->rms_att_weight = fptr;
+  fptr += n_layers * p->dim;
+  w->rms_ffn_weight = fptr;
+  fptr += n_layers * p->dim;
+  w->rms_final_weight = fptr;
+  fptr += p->dim;
+
+  // now read all the quantized weights
+  ptr = static_cast<void *>(fptr);
+  w->q_tokens = init_quantized_tensors(&ptr, 1, (size_t) p->vocab_size * p->dim, group_size);
+  // dequantize token embedding table, the rows are copied out one at a time in forward
+  size_t embedding_size = (size_t) p->vocab_size * p->dim;
+  w->token_embedding_table = static_cast<float *>(malloc(embedding_size * sizeof(float)));
+  if (!w->token_embedding_table) {
+    fprintf(stderr, "malloc failed!\n");
+    exit(EXIT_FAILURE);
+  }
+  LLamaQuantMatmulLayer::Dequantize(w->q_tokens->q, w->q_tokens->s, embedding_size, group_size,
+                                    w->token_embedding_table);
+
+  w->q_wq = init_quantized_tensors(&ptr, p->n_layers, (size_t) p->dim * (p->n_heads * head_size),
+                                   group_size);
+  w->q_wk = init_quantized_tensors(&ptr, p->n_layers,
+                                   (size_t) p->dim * (p->n_kv_heads * head_size), group_size);
+  w->q_wv = init_quantized_tensors(&ptr, p->n_layers,
+                                   (size_t) p->dim * (p->n_kv_heads * head_size), group_size);
+  w->q_wo = init_quantized_tensors(&ptr, p->n_layers, (size_t) (p->n_heads * head_size) * p->dim,
+                                   group_size);
+  w->q_w1 = init_quantized_tensors(&ptr, p->n_layers, (size_t) p->dim * p->hidden_dim, group_size);
+  w->q_w2 = init_quantized_tensors(&ptr, p->n_layers, (size_t) p->hidden_dim * p->dim, group_size);
+  w->q_w3 = init_quantized_tensors(&ptr, p->n_layers, (size_t) p->dim * p->hidden_dim, group_size);
+  w->q_wcls = shared_classifier
+                  ? w->q_tokens
+                  : init_quantized_tensors(&ptr, 1, (size_t) p->dim * p->vocab_size, group_size);
+
+  // the fp32 matmul weights are not present in a quantized checkpoint
+  w->wq = w->wk = w->wv = w->wo = NULL;
+  w->w1 = w->w2 = w->w3 = NULL;
+  w->wcls = NULL;
+  w->group_size = group_size;
 }
 
 void read_checkpoint(char *checkpoint, Config *config, TransformerWeights *weights, int *fd,
@@ -98,13 +369,36 @@ void read_checkpoint(char *checkpoint, Config *config, TransformerWeights *weigh
     fprintf(stderr, "Couldn't open file %s\n", checkpoint);
     exit(EXIT_FAILURE);
   }
-  // read in the config header
-  if (fread(config, sizeof(Config), 1, file) != 1) {
+  // a quantized checkpoint starts with the magic number, the fp32 one with the Config
+  uint32_t magic_number = 0;
+  if (fread(&magic_number, sizeof(uint32_t), 1, file) != 1) {
     exit(EXIT_FAILURE);
   }
-  // negative vocab size is hacky way of signaling unshared weights. bit yikes.
-  int shared_weights = config->vocab_size > 0 ? 1 : 0;
-  config->vocab_size = abs(config->vocab_size);
+  int quantized = magic_number == QUANT_MAGIC;
+  int shared_weights = 0;
+  uint8_t shared_classifier = 0;
+  int group_size = 0;
+  if (quantized) {
+    int version = 0;
+    if (fread(&version, sizeof(int), 1, file) != 1 || version != QUANT_VERSION) {
+      fprintf(stderr, "Bad version %d, need version %d\n", version, QUANT_VERSION);
+      exit(EXIT_FAILURE);
+    }
+    if (fread(config, sizeof(Config), 1, file) != 1 ||
+        fread(&shared_classifier, sizeof(uint8_t), 1, file) != 1 ||
+        fread(&group_size, sizeof(int), 1, file) != 1) {
+      exit(EXIT_FAILURE);
+    }
+  } else {
+    rewind(file);
+    // read in the config header
+    if (fread(config, sizeof(Config), 1, file) != 1) {
+      exit(EXIT_FAILURE);
+    }
+    // negative vocab size is hacky way of signaling unshared weights. bit yikes.
+    shared_weights = config->vocab_size > 0 ? 1 : 0;
+    config->vocab_size = abs(config->vocab_size);
+  }
   // figure out the file size
   fseek(file, 0, SEEK_END);  // move file pointer to end of file
   *file_size = ftell(file);  // get the file size, in bytes
@@ -120,8 +414,117 @@ void read_checkpoint(char *checkpoint, Config *config, TransformerWeights *weigh
     fprintf(stderr, "mmap failed!\n");
     exit(EXIT_FAILURE);
   }
-  float *weights_ptr = *data + sizeof(Config) / sizeof(float);
-  memory_map_weights(weights, config, weights_ptr, shared_weights);
+  if (quantized) {
+    void *weights_ptr = reinterpret_cast<char *>(*data) + QUANT_HEADER_SIZE;
+    memory_map_quantized_weights(weights, config, weights_ptr, shared_classifier, group_size);
+  } else {
+    float *weights_ptr = *data + sizeof(Config) / sizeof(float);
+    memory_map_weights(weights, config, weights_ptr, shared_weights);
+  }
+}
+
+static float write_quantized_tensors(FILE *file, const float *w, int n, size_t size_each,
+                                     int group_size) {
+  // quantize n tensors of size_each values one by one and append them to the file
+  using namespace kuiper_infer;
+  int8_t *q = static_cast<int8_t *>(malloc(size_each * sizeof(int8_t)));
+  float *s = static_cast<float *>(malloc(size_each / group_size * sizeof(float)));
+  if (!q || !s) {
+    fprintf(stderr, "malloc failed!\n");
+    exit(EXIT_FAILURE);
+  }
+  float max_error = 0.0f;
+  for (int i = 0; i < n; i++) {
+    float error = LLamaQuantMatmulLayer::Quantize(w + i * size_each, size_each, group_size, q, s);
+    if (error > max_error) {
+      max_error = error;
+    }
+    fwrite(q, sizeof(int8_t), size_each, file);
+    fwrite(s, sizeof(float), size_each / group_size, file);
+  }
+  free(q);
+  free(s);
+  return max_error;
+}
+
+void quantize_checkpoint(char *checkpoint, char *output_path, int group_size) {
+  Config config;
+  TransformerWeights weights;
+  int fd = -1;
+  float *data = NULL;
+  ssize_t file_size = 0;
+  read_checkpoint(checkpoint, &config, &weights, &fd, &data, &file_size);
+  if (weights.group_size > 0) {
+    fprintf(stderr, "%s is already quantized\n", checkpoint);
+    exit(EXIT_FAILURE);
+  }
+  // every row of a matmul weight has to hold whole groups, and the scales that follow
+  // the int8 values have to stay 4 bytes aligned
+  if (group_size <= 0 || group_size % 4 != 0 || config.dim % group_size != 0 ||
+      config.hidden_dim % group_size != 0) {
+    fprintf(stderr, "group size %d does not fit dim %d and hidden_dim %d\n", group_size,
+            config.dim, config.hidden_dim);
+    exit(EXIT_FAILURE);
+  }
+
+  FILE *file = fopen(output_path, "wb");
+  if (!file) {
+    fprintf(stderr, "Couldn't open file %s\n", output_path);
+    exit(EXIT_FAILURE);
+  }
+  // header, padded with zeros
+  uint32_t magic_number = QUANT_MAGIC;
+  int version = QUANT_VERSION;
+  uint8_t shared_classifier = weights.wcls == weights.token_embedding_table;
+  fwrite(&magic_number, sizeof(uint32_t), 1, file);
+  fwrite(&version, sizeof(int), 1, file);
+  fwrite(&config, sizeof(Config), 1, file);
+  fwrite(&shared_classifier, sizeof(uint8_t), 1, file);
+  fwrite(&group_size, sizeof(int), 1, file);
+  char padding[QUANT_HEADER_SIZE] = {0};
+  fwrite(padding, 1, QUANT_HEADER_SIZE - ftell(file), file);
+
+  // the rmsnorm weights stay in fp32
+  int head_size = config.dim / config.n_heads;
+  unsigned long long n_layers = config.n_layers;
+  fwrite(weights.rms_att_weight, sizeof(float), n_layers * config.dim, file);
+  fwrite(weights.rms_ffn_weight, sizeof(float), n_layers * config.dim, file);
+  fwrite(weights.rms_final_weight, sizeof(float), config.dim, file);
+
+  float max_error = 0.0f;
+  float errors[] = {
+      write_quantized_tensors(file, weights.token_embedding_table, 1,
+                              (size_t) config.vocab_size * config.dim, group_size),
+      write_quantized_tensors(file, weights.wq, config.n_layers,
+                              (size_t) config.dim * (config.n_heads * head_size), group_size),
+      write_quantized_tensors(file, weights.wk, config.n_layers,
+                              (size_t) config.dim * (config.n_kv_heads * head_size), group_size),
+      write_quantized_tensors(file, weights.wv, config.n_layers,
+                              (size_t) config.dim * (config.n_kv_heads * head_size), group_size),
+      write_quantized_tensors(file, weights.wo, config.n_layers,
+                              (size_t) (config.n_heads * head_size) * config.dim, group_size),
+      write_quantized_tensors(file, weights.w1, config.n_layers,
+                              (size_t) config.dim * config.hidden_dim, group_size),
+      write_quantized_tensors(file, weights.w2, config.n_layers,
+                              (size_t) config.hidden_dim * config.dim, group_size),
+      write_quantized_tensors(file, weights.w3, config.n_layers,
+                              (size_t) config.dim * config.hidden_dim, group_size),
+      shared_classifier ? 0.0f
+                        : write_quantized_tensors(file, weights.wcls, 1,
+                                                  (size_t) config.dim * config.vocab_size,
+                                                  group_size),
+  };
+  for (float error : errors) {
+    if (error > max_error) {
+      max_error = error;
+    }
+  }
+  fclose(file);
+  fprintf(stderr, "wrote %s, group size %d, max quantization error %f\n", output_path,
+          group_size, max_error);
+
+  munmap(data, file_size);
+  close(fd);
 }
 
 void build_transformer(Transformer *t, char *checkpoint_path) {
@@ -129,9 +532,19 @@ void build_transformer(Transformer *t, char *checkpoint_path) {
   read_checkpoint(checkpoint_path, &t->config, &t->weights, &t->fd, &t->data, &t->file_size);
   // allocate the RunState buffers
   malloc_run_state(&t->state, &t->config);
+  // the kv pool grows with the sessions, state.kv starts as an empty default session
+  int seq_blocks = (t->config.seq_len + KV_BLOCK_SIZE - 1) / KV_BLOCK_SIZE;
+  build_kv_pool(&t->kv_pool, &t->config, KV_BLOCK_SIZE, KV_POOL_SESSIONS * seq_blocks);
+  t->default_kv = build_kv_cache(t);
+  t->state.kv = t->default_kv;
+  t->prefix_cache = NULL;
+  // build the layers of the forward pass over the weights and the RunState buffers
+  build_run_layers(t);
 }
 
 void free_transformer(Transformer *t) {
+  // the layers hold views of the weights and the RunState buffers, release them first
+  free_run_layers(t);
   // close the memory mapping
   if (t->data != MAP_FAILED) {
     munmap(t->data, t->file_size);
@@ -139,52 +552,171 @@ void free_transformer(Transformer *t) {
   if (t->fd != -1) {
     close(t->fd);
   }
-  // free the RunState buffers
+  // free the quantized tensor headers and the dequantized token embedding table
+  TransformerWeights *w = &t->weights;
+  if (w->group_size > 0) {
+    if (w->q_wcls != w->q_tokens) {
+      free(w->q_wcls);
+    }
+    free(w->q_tokens);
+    free(w->q_wq);
+    free(w->q_wk);
+    free(w->q_wv);
+    free(w->q_wo);
+    free(w->q_w1);
+    free(w->q_w2);
+    free(w->q_w3);
+    free(w->token_embedding_table);
+  }
+  // free the RunState buffers and the kv cache blocks
   free_run_state(&t->state);
+  free_kv_cache(t, t->default_kv);
+  free_kv_pool(&t->kv_pool);
 }
 
 // ----------------------------------------------------------------------------
 // neural net blocks; the dynamics of the Transformer
 
-void rmsnorm(float *o, float *x, float *weight, int size) {
-  // calculate sum of squares
+void softmax(float *x, int size) {
+  // find max value (for numerical stability)
   using namespace kuiper_infer;
-  std::shared_ptr<Tensor<float>> weight_tensor = std::make_shared<Tensor<float>>(weight, size);
-
-  RMSNormLayer rms;
-  rms.set_weights({weight_tensor});
 
-  std::shared_ptr<Tensor<float>> input_tensor = std::make_shared<Tensor<float>>(x, size);
-  std::shared_ptr<Tensor<float>> output_tensor = std::make_shared<Tensor<float>>(o, size);
-  std::vector<std::shared_ptr<Tensor<float>>> output_tensors;
-  output_tensors.push_back(output_tensor);
-  rms.Forward({input_tensor}, output_tensors);
+  SoftmaxLayer::Softmax1D(x, x, size);
 }
 
-void softmax(float *x, int size) {
-  // find max value (for numerical stability)
+// ----------------------------------------------------------------------------
+// the layers of the forward pass, built once so that forward does no heap allocations
+
+struct RunLayers {
+  // LLamaMatmulLayer, or LLamaQuantMatmulLayer for a quantized checkpoint
+  std::vector<std::shared_ptr<kuiper_infer::Layer>> wq, wk, wv, wo, w1, w2, w3;  // (layer,)
+  std::shared_ptr<kuiper_infer::Layer> wcls;
+  std::vector<std::shared_ptr<kuiper_infer::RMSNormLayer>> rms_att, rms_ffn;  // (layer,)
+  std::shared_ptr<kuiper_infer::RMSNormLayer> rms_final;
+  // views over the RunState buffers, as the one element arrays the layers take
+  std::vector<kuiper_infer::sftensor> x, xb, xb2, hb, hb2, q, k, v, logits;
+};
+
+static std::vector<kuiper_infer::sftensor> wrap_buffer(float *buffer, int size,
+                                                      int tokens = 1) {
+  // one column of size values per token
   using namespace kuiper_infer;
+  return {std::make_shared<Tensor<float>>(buffer, size, tokens)};
+}
 
-  std::shared_ptr<Tensor<float>> input_tensor = std::make_shared<Tensor<float>>(x, size);
-  std::vector<std::shared_ptr<Tensor<float>>> tensors;
-  tensors.push_back(input_tensor);
-  SoftmaxLayer softmax_layer(0);
-  softmax_layer.Forward(tensors, tensors);
+static std::shared_ptr<kuiper_infer::Layer> make_matmul_layer(float *w, QuantizedTensor *q_w,
+                                                              unsigned long long l, int n, int d,
+                                                              int group_size) {
+  // wraps the l-th (d,n) weight of a layer stack, quantized when the checkpoint is
+  using namespace kuiper_infer;
+  if (group_size > 0) {
+    std::shared_ptr<LLamaQuantMatmulLayer> matmul_layer =
+        std::make_shared<LLamaQuantMatmulLayer>(d, n, group_size);
+    matmul_layer->set_quant_weights(q_w[l].q, q_w[l].s);
+    return matmul_layer;
+  }
+  std::shared_ptr<LLamaMatmulLayer> matmul_layer = std::make_shared<LLamaMatmulLayer>(d, n);
+  matmul_layer->set_weights({std::make_shared<Tensor<float>>(w + l * n * d, d, n)});
+  return matmul_layer;
 }
 
-void matmul(float *xout, float *x, float *w, int n, int d) {
-  // W (d,n) @ x (n,) -> xout (d,)
-  // by far the most amount of time is spent inside this little function
+static std::shared_ptr<kuiper_infer::RMSNormLayer> make_rmsnorm_layer(float *weight, int size) {
   using namespace kuiper_infer;
-  LLamaMatmulLayer matmul_layer(d, n);
-  std::shared_ptr<Tensor<float>> weight_tensor = std::make_shared<Tensor<float>>(w, d, n);
-  matmul_layer.set_weights({weight_tensor});
+  std::shared_ptr<RMSNormLayer> rms_layer = std::make_shared<RMSNormLayer>();
+  rms_layer->set_weights({std::make_shared<Tensor<float>>(weight, size)});
+  return rms_layer;
+}
 
-  std::shared_ptr<Tensor<float>> input_tensor = std::make_shared<Tensor<float>>(x, n, 1);
-  std::shared_ptr<Tensor<float>> output_tensor = std::make_shared<Tensor<float>>(xout, d, 1);
-  std::vector<std::shared_ptr<Tensor<float>>> output_tensors;
-  output_tensors.push_back(output_tensor);
-  matmul_layer.Forward({input_tensor}, output_tensors);
+void build_run_layers(Transformer *t) {
+  Config *p = &t->config;
+  TransformerWeights *w = &t->weights;
+  RunState *s = &t->state;
+  int dim = p->dim;
+  int kv_dim = (p->dim * p->n_kv_heads) / p->n_heads;
+  int hidden_dim = p->hidden_dim;
+  int group_size = w->group_size;
+
+  RunLayers *layers = new RunLayers;
+  for (unsigned long long l = 0; l < p->n_layers; l++) {
+    layers->rms_att.push_back(make_rmsnorm_layer(w->rms_att_weight + l * dim, dim));
+    layers->rms_ffn.push_back(make_rmsnorm_layer(w->rms_ffn_weight + l * dim, dim));
+    layers->wq.push_back(make_matmul_layer(w->wq, w->q_wq, l, dim, dim, group_size));
+    layers->wk.push_back(make_matmul_layer(w->wk, w->q_wk, l, dim, kv_dim, group_size));
+    layers->wv.push_back(make_matmul_layer(w->wv, w->q_wv, l, dim, kv_dim, group_size));
+    layers->wo.push_back(make_matmul_layer(w->wo, w->q_wo, l, dim, dim, group_size));
+    layers->w1.push_back(make_matmul_layer(w->w1, w->q_w1, l, dim, hidden_dim, group_size));
+    layers->w2.push_back(make_matmul_layer(w->w2, w->q_w2, l, hidden_dim, dim, group_size));
+    layers->w3.push_back(make_matmul_layer(w->w3, w->q_w3, l, dim, hidden_dim, group_size));
+  }
+  layers->rms_final = make_rmsnorm_layer(w->rms_final_weight, dim);
+  layers->wcls = make_matmul_layer(w->wcls, w->q_wcls, 0, dim, p->vocab_size, group_size);
+
+  layers->x = wrap_buffer(s->x, dim);
+  layers->xb = wrap_buffer(s->xb, dim);
+  layers->xb2 = wrap_buffer(s->xb2, dim);
+  layers->hb = wrap_buffer(s->hb, hidden_dim);
+  layers->hb2 = wrap_buffer(s->hb2, hidden_dim);
+  layers->q = wrap_buffer(s->q, dim);
+  layers->k = wrap_buffer(s->k, kv_dim);
+  layers->v = wrap_buffer(s->v, kv_dim);
+  layers->logits = wrap_buffer(s->logits, p->vocab_size);
+  t->layers = layers;
+}
+
+void free_run_layers(Transformer *t) {
+  delete t->layers;
+  t->layers = NULL;
+}
+
+static void attention_head(Transformer *transformer, KVCache *kv, int l, int h, float *q, int pos,
+                           float *att, float *xb) {
+  // attention of query q of head h over positions 0..pos of the session, into xb. walks the
+  // block table of the session, the positions of a block are contiguous
+  Config *p = &transformer->config;
+  KVPool *pool = &transformer->kv_pool;
+  int kv_dim = (p->dim * p->n_kv_heads) / p->n_heads;
+  int kv_mul = p->n_heads / p->n_kv_heads;  // integer multiplier of the kv sharing in multiquery
+  int head_size = p->dim / p->n_heads;
+  int block_size = pool->block_size;
+  // offset of the key/value vectors of this head at the first position of a block
+  size_t head_off = (size_t) l * block_size * kv_dim + (h / kv_mul) * head_size;
+
+  // iterate over all timesteps, including the current one
+  for (int b = 0; b * block_size <= pos; b++) {
+    float *keys = pool->key_blocks[kv->block_table[b]] + head_off;
+    int n = pos + 1 - b * block_size < block_size ? pos + 1 - b * block_size : block_size;
+    for (int t = 0; t < n; t++) {
+      // get the key vector for this head and at this timestep
+      float *k = keys + t * kv_dim;
+      // calculate the attention score as the dot product of q and k
+      float score = 0.0f;
+      for (int i = 0; i < head_size; i++) {
+        score += q[i] * k[i];
+      }
+      // save the score to the attention buffer
+      att[b * block_size + t] = score / sqrtf(head_size);
+    }
+  }
+
+  // softmax the scores to get attention weights, from 0..pos inclusively
+  kuiper_infer::SoftmaxLayer::Softmax1D(att, att, pos + 1);
+
+  // weighted sum of the values, store back into xb
+  memset(xb, 0, head_size * sizeof(float));
+  for (int b = 0; b * block_size <= pos; b++) {
+    float *values = pool->value_blocks[kv->block_table[b]] + head_off;
+    int n = pos + 1 - b * block_size < block_size ? pos + 1 - b * block_size : block_size;
+    for (int t = 0; t < n; t++) {
+      // get the value vector for this head and at this timestep
+      float *v = values + t * kv_dim;
+      // get the attention weight for this timestep
+      float a = att[b * block_size + t];
+      // accumulate the weighted value into xb
+      for (int i = 0; i < head_size; i++) {
+        xb[i] += a * v[i];
+      }
+    }
+  }
 }
 
 float *forward(Transformer *transformer, int token, int pos) {
@@ -192,10 +724,10 @@ float *forward(Transformer *transformer, int token, int pos) {
   Config *p = &transformer->config;
   TransformerWeights *w = &transformer->weights;
   RunState *s = &transformer->state;
+  RunLayers *layers = transformer->layers;
   float *x = s->x;
   int dim = p->dim;
   int kv_dim = (p->dim * p->n_kv_heads) / p->n_heads;
-  int kv_mul = p->n_heads / p->n_kv_heads;  // integer multiplier of the kv sharing in multiquery
   int hidden_dim = p->hidden_dim;
   int head_size = dim / p->n_heads;
 
@@ -203,20 +735,21 @@ float *forward(Transformer *transformer, int token, int pos) {
   float *content_row = w->token_embedding_table + token * dim;
   memcpy(x, content_row, dim * sizeof(*x));
 
+  // take the block of this position from the kv pool when the session enters it, there are
+  // no logits when the pool is out of blocks
+  if (!kv_cache_reserve(transformer, s->kv, pos, pos + 1)) {
+    return NULL;
+  }
+
   // forward all the layers
   for (unsigned long long l = 0; l < p->n_layers; l++) {
     // attention rmsnorm
-    rmsnorm(s->xb, x, w->rms_att_weight + l * dim, dim);
-
-    // key and value point to the kv cache
-    int loff = l * p->seq_len * kv_dim;  // kv cache layer offset for convenience
-    s->k = s->key_cache + loff + pos * kv_dim;
-    s->v = s->value_cache + loff + pos * kv_dim;
+    layers->rms_att[l]->Forward(layers->x, layers->xb);
 
     // qkv matmuls for this position
-    matmul(s->q, s->xb, w->wq + l * dim * dim, dim, dim);
-    matmul(s->k, s->xb, w->wk + l * dim * kv_dim, dim, kv_dim);
-    matmul(s->v, s->xb, w->wv + l * dim * kv_dim, dim, kv_dim);
+    layers->wq[l]->Forward(layers->xb, layers->q);
+    layers->wk[l]->Forward(layers->xb, layers->k);
+    layers->wv[l]->Forward(layers->xb, layers->v);
 
     // RoPE relative positional encoding: complex-valued rotate q and k in each head
     for (int i = 0; i < dim; i += 2) {
@@ -235,48 +768,20 @@ float *forward(Transformer *transformer, int token, int pos) {
       }
     }
 
+    // save the rotated key and the value into the kv cache at this position
+    memcpy(kv_cache_key(transformer, s->kv, l, pos), s->k, kv_dim * sizeof(float));
+    memcpy(kv_cache_value(transformer, s->kv, l, pos), s->v, kv_dim * sizeof(float));
+
     // multihead attention. iterate over all heads
     int h;
 #pragma omp parallel for private(h)
     for (h = 0; h < p->n_heads; h++) {
-      // get the query vector for this head
-      float *q = s->q + h * head_size;
-      // attention scores for this headf
-      float *att = s->att + h * p->seq_len;
-      // iterate over all timesteps, including the current one
-      for (int t = 0; t <= pos; t++) {
-        // get the key vector for this head and at this timestep
-        float *k = s->key_cache + loff + t * kv_dim + (h / kv_mul) * head_size;
-        // calculate the attention score as the dot product of q and k
-        float score = 0.0f;
-        for (int i = 0; i < head_size; i++) {
-          score += q[i] * k[i];
-        }
-        score /= sqrtf(head_size);
-        // save the score to the attention buffer
-        att[t] = score;
-      }
-
-      // softmax the scores to get attention weights, from 0..pos inclusively
-      softmax(att, pos + 1);
-
-      // weighted sum of the values, store back into xb
-      float *xb = s->xb + h * head_size;
-      memset(xb, 0, head_size * sizeof(float));
-      for (int t = 0; t <= pos; t++) {
-        // get the value vector for this head and at this timestep
-        float *v = s->value_cache + loff + t * kv_dim + (h / kv_mul) * head_size;
-        // get the attention weight for this timestep
-        float a = att[t];
-        // accumulate the weighted value into xb
-        for (int i = 0; i < head_size; i++) {
-          xb[i] += a * v[i];
-        }
-      }
+      attention_head(transformer, s->kv, l, h, s->q + h * head_size, pos,
+                     s->att + h * p->seq_len, s->xb + h * head_size);
     }
 
     // final matmul to get the output of the attention
-    matmul(s->xb2, s->xb, w->wo + l * dim * dim, dim, dim);
+    layers->wo[l]->Forward(layers->xb, layers->xb2);
 
     // residual connection back into x
     for (int i = 0; i < dim; i++) {
@@ -284,12 +789,12 @@ float *forward(Transformer *transformer, int token, int pos) {
     }
 
     // ffn rmsnorm
-    rmsnorm(s->xb, x, w->rms_ffn_weight + l * dim, dim);
+    layers->rms_ffn[l]->Forward(layers->x, layers->xb);
 
     // Now for FFN in PyTorch we have: self.w2(F.silu(self.w1(x)) * self.w3(x))
     // first calculate self.w1(x) and self.w3(x)
-    matmul(s->hb, s->xb, w->w1 + l * dim * hidden_dim, dim, hidden_dim);
-    matmul(s->hb2, s->xb, w->w3 + l * dim * hidden_dim, dim, hidden_dim);
+    layers->w1[l]->Forward(layers->xb, layers->hb);
+    layers->w3[l]->Forward(layers->xb, layers->hb2);
 
     // SwiGLU non-linearity
     for (int i = 0; i < hidden_dim; i++) {
@@ -302,7 +807,7 @@ float *forward(Transformer *transformer, int token, int pos) {
     }
 
     // final matmul to get the output of the ffn
-    matmul(s->xb, s->hb, w->w2 + l * dim * hidden_dim, hidden_dim, dim);
+    layers->w2[l]->Forward(layers->hb, layers->xb);
 
     // residual connection
     for (int i = 0; i < dim; i++) {
@@ -311,67 +816,428 @@ float *forward(Transformer *transformer, int token, int pos) {
   }
 
   // final rmsnorm
-  rmsnorm(x, x, w->rms_final_weight, dim);
+  layers->rms_final->Forward(layers->x, layers->x);
 
   // classifier into logits
-  matmul(s->logits, x, w->wcls, p->dim, p->vocab_size);
+  layers->wcls->Forward(layers->x, layers->logits);
   return s->logits;
 }
 
-// ----------------------------------------------------------------------------
-// The Byte Pair Encoding (BPE) Tokenizer that translates strings <-> tokens
+static void forward_columns(Transformer *transformer, int *tokens, KVCache **kvs, int *positions,
+                            int n_tokens) {
+  // the same layers as forward, but every activation is a (n_tokens, dim) block with one
+  // column per token, so that the matmuls become matrix-matrix products. token t is at
+  // positions[t] of session kvs[t], whose blocks must be reserved: the tokens of a prefill
+  // chunk share a session, the tokens of a batched decode step each have their own
+  Config *p = &transformer->config;
+  TransformerWeights *w = &transformer->weights;
+  RunState *s = &transformer->state;
+  RunLayers *layers = transformer->layers;
+  int dim = p->dim;
+  int kv_dim = (p->dim * p->n_kv_heads) / p->n_heads;
+  int hidden_dim = p->hidden_dim;
+  int head_size = dim / p->n_heads;
 
+  std::vector<kuiper_infer::sftensor> xs = wrap_buffer(s->xs, dim, n_tokens);
+  std::vector<kuiper_infer::sftensor> xbs = wrap_buffer(s->xbs, dim, n_tokens);
+  std::vector<kuiper_infer::sftensor> xb2s = wrap_buffer(s->xb2s, dim, n_tokens);
+  std::vector<kuiper_infer::sftensor> hbs = wrap_buffer(s->hbs, hidden_dim, n_tokens);
+  std::vector<kuiper_infer::sftensor> hb2s = wrap_buffer(s->hb2s, hidden_dim, n_tokens);
+  std::vector<kuiper_infer::sftensor> qs = wrap_buffer(s->qs, dim, n_tokens);
+  std::vector<kuiper_infer::sftensor> ks = wrap_buffer(s->ks, kv_dim, n_tokens);
+  std::vector<kuiper_infer::sftensor> vs = wrap_buffer(s->vs, kv_dim, n_tokens);
+
+  // copy the token embeddings into the columns of xs
+  for (int i = 0; i < n_tokens; i++) {
+    memcpy(s->xs + i * dim, w->token_embedding_table + tokens[i] * dim, dim * sizeof(float));
+  }
 
-int compare_tokens(const void *a, const void *b) {
-  return strcmp(((TokenIndex *) a)->str, ((TokenIndex *) b)->str);
-}
+  for (unsigned long long l = 0; l < p->n_layers; l++) {
+    // attention rmsnorm, column by column
+    layers->rms_att[l]->Forward(xs, xbs);
+
+    // qkv matmuls for the whole chunk
+    layers->wq[l]->Forward(xbs, qs);
+    layers->wk[l]->Forward(xbs, ks);
+    layers->wv[l]->Forward(xbs, vs);
+
+    // RoPE relative positional encoding, every token rotates by its own position
+#pragma omp parallel for
+    for (int t = 0; t < n_tokens; t++) {
+      float *q = s->qs + t * dim;
+      float *k = s->ks + t * kv_dim;
+      for (int i = 0; i < dim; i += 2) {
+        int head_dim = i % head_size;
+        float freq = 1.0f / powf(10000.0f, head_dim / (float) head_size);
+        float val = positions[t] * freq;
+        float fcr = cosf(val);
+        float fci = sinf(val);
+        int rotn = i < kv_dim ? 2 : 1;  // how many vectors? 2 = q & k, 1 = q only
+        for (int v = 0; v < rotn; v++) {
+          float *vec = v == 0 ? q : k;  // the vector to rotate (query or key)
+          float v0 = vec[i];
+          float v1 = vec[i + 1];
+          vec[i] = v0 * fcr - v1 * fci;
+          vec[i + 1] = v0 * fci + v1 * fcr;
+        }
+      }
+    }
 
-void build_tokenizer(Tokenizer *t, char *tokenizer_path, int vocab_size) {
-  // i should have written the vocab_size into the tokenizer file... sigh
-  t->vocab_size = vocab_size;
-  // malloc space to hold the scores and the strings
-  t->vocab = (char **) malloc(vocab_size * sizeof(char *));
-  t->vocab_scores = (float *) malloc(vocab_size * sizeof(float));
-  t->sorted_vocab = NULL;  // initialized lazily
-  for (int i = 0; i < 256; i++) {
-    t->byte_pieces[i * 2] = (unsigned char) i;
-    t->byte_pieces[i * 2 + 1] = '\0';
-  }
-  // read in the file
-  FILE *file = fopen(tokenizer_path, "rb");
-  if (!file) {
-    fprintf(stderr, "couldn't load %s\n", tokenizer_path);
-    exit(EXIT_FAILURE);
-  }
-  if (fread(&t->max_token_length, sizeof(int), 1, file) != 1) {
-    fprintf(stderr, "failed read\n");
-    exit(EXIT_FAILURE);
-  }
-  int len;
-  for (int i = 0; i < vocab_size; i++) {
-    if (fread(t->vocab_scores + i, sizeof(float), 1, file) != 1) {
-      fprintf(stderr, "failed read\n");
-      exit(EXIT_FAILURE);
+    // save the rotated keys and the values into the kv cache, a chunk can span blocks
+    for (int t = 0; t < n_tokens; t++) {
+      memcpy(kv_cache_key(transformer, kvs[t], l, positions[t]), s->ks + t * kv_dim,
+             kv_dim * sizeof(float));
+      memcpy(kv_cache_value(transformer, kvs[t], l, positions[t]), s->vs + t * kv_dim,
+             kv_dim * sizeof(float));
     }
-    if (fread(&len, sizeof(int), 1, file) != 1) {
-      fprintf(stderr, "failed read\n");
-      exit(EXIT_FAILURE);
+
+    // causal multihead attention, a token attends to the positions of its session up to its
+    // own, for a prefill chunk that is the cached positions and the chunk up to the token
+    int h;
+#pragma omp parallel for private(h)
+    for (h = 0; h < p->n_heads; h++) {
+      for (int i = 0; i < n_tokens; i++) {
+        attention_head(transformer, kvs[i], l, h, s->qs + i * dim + h * head_size, positions[i],
+                       s->att + h * p->seq_len, s->xbs + i * dim + h * head_size);
+      }
     }
-    t->vocab[i] = (char *) malloc(len + 1);
-    if (fread(t->vocab[i], len, 1, file) != 1) {
-      fprintf(stderr, "failed read\n");
-      exit(EXIT_FAILURE);
+
+    // final matmul to get the output of the attention
+    layers->wo[l]->Forward(xbs, xb2s);
+
+    // residual connection back into xs
+    for (int i = 0; i < n_tokens * dim; i++) {
+      s->xs[i] += s->xb2s[i];
+    }
+
+    // ffn rmsnorm
+    layers->rms_ffn[l]->Forward(xs, xbs);
+
+    // self.w2(F.silu(self.w1(x)) * self.w3(x)) for the whole block
+    layers->w1[l]->Forward(xbs, hbs);
+    layers->w3[l]->Forward(xbs, hb2s);
+
+    // SwiGLU non-linearity
+    for (int i = 0; i < n_tokens * hidden_dim; i++) {
+      float val = s->hbs[i];
+      val *= (1.0f / (1.0f + expf(-val)));
+      val *= s->hb2s[i];
+      s->hbs[i] = val;
+    }
+
+    // final matmul to get the output of the ffn
+    layers->w2[l]->Forward(hbs, xbs);
+
+    // residual connection
+    for (int i = 0; i < n_tokens * dim; i++) {
+      s->xs[i] += s->xbs[i];
     }
-    t->vocab[i][len] = '\0';  // add the string terminating token
   }
-  fclose(file);
 }
 
-void free_tokenizer(Tokenizer *t) {
-  for (int i = 0; i < t->vocab_size; i++) {
-    free(t->vocab[i]);
-  }
-  free(t->vocab);
+float *forward_prefill(Transformer *transformer, int *tokens, int n_tokens, int pos) {
+  // runs tokens[0..n_tokens) at positions pos..pos+n_tokens-1 and fills their kv cache,
+  // returns the logits of the last token only, as forward would for it
+  Config *p = &transformer->config;
+  RunState *s = &transformer->state;
+  RunLayers *layers = transformer->layers;
+  int dim = p->dim;
+  if (n_tokens < 1 || pos + n_tokens > p->seq_len) {
+    fprintf(stderr, "cannot prefill %d tokens at position %d, seq_len is %d\n", n_tokens, pos,
+            p->seq_len);
+    exit(EXIT_FAILURE);
+  }
+
+  // take the blocks of all the positions from the kv pool before the chunks run, there are
+  // no logits when the pool is out of blocks
+  if (!kv_cache_reserve(transformer, s->kv, pos, pos + n_tokens)) {
+    return NULL;
+  }
+  std::vector<KVCache *> kvs(s->prefill_chunk, s->kv);
+  std::vector<int> positions(s->prefill_chunk);
+
+  int chunk_tokens = 0;
+  for (int i = 0; i < n_tokens; i += chunk_tokens) {
+    chunk_tokens = n_tokens - i < s->prefill_chunk ? n_tokens - i : s->prefill_chunk;
+    for (int t = 0; t < chunk_tokens; t++) {
+      positions[t] = pos + i + t;
+    }
+    forward_columns(transformer, tokens + i, kvs.data(), positions.data(), chunk_tokens);
+  }
+
+  // final rmsnorm and the classifier, for the last token of the last chunk
+  memcpy(s->x, s->xs + (chunk_tokens - 1) * dim, dim * sizeof(float));
+  layers->rms_final->Forward(layers->x, layers->x);
+  layers->wcls->Forward(layers->x, layers->logits);
+  return s->logits;
+}
+
+float *forward_batch(Transformer *transformer, KVCache **kvs, int *tokens, int *positions,
+                     int n_seqs) {
+  // one decode step of n_seqs sequences at once, token i is at positions[i] of session kvs[i].
+  // every weight is read once for all of them, returns the (n_seqs, vocab_size) logits with
+  // the row of token i at i * vocab_size. the tokens can also be consecutive positions of one
+  // session, e.g. to verify drafted tokens with the logits of every position
+  Config *p = &transformer->config;
+  RunState *s = &transformer->state;
+  RunLayers *layers = transformer->layers;
+  if (n_seqs < 1 || n_seqs > s->prefill_chunk) {
+    fprintf(stderr, "cannot decode %d sequences at once, at most %d\n", n_seqs,
+            s->prefill_chunk);
+    exit(EXIT_FAILURE);
+  }
+  // there are no logits when the pool is out of blocks for one of the sessions
+  for (int i = 0; i < n_seqs; i++) {
+    if (!kv_cache_reserve(transformer, kvs[i], positions[i], positions[i] + 1)) {
+      return NULL;
+    }
+  }
+  forward_columns(transformer, tokens, kvs, positions, n_seqs);
+
+  // final rmsnorm and the classifier for every column
+  std::vector<kuiper_infer::sftensor> xs = wrap_buffer(s->xs, p->dim, n_seqs);
+  std::vector<kuiper_infer::sftensor> logits = wrap_buffer(s->batch_logits, p->vocab_size, n_seqs);
+  layers->rms_final->Forward(xs, xs);
+  layers->wcls->Forward(xs, logits);
+  return s->batch_logits;
+}
+
+// ----------------------------------------------------------------------------
+// prefix cache: kv pool blocks of prompt prefixes, shared by chat turns and requests
+
+struct PrefixBlock {
+  unsigned long long parent;  // hash of all the tokens before this block
+  std::vector<int> tokens;    // the block_size tokens of the block
+  int kv_block;               // the kv pool block with their kv, the cache holds it once
+  int n_children;             // cached blocks that continue this one, only leaves are evicted
+  std::list<unsigned long long>::iterator lru;  // the entry of the block in PrefixCache::lru
+};
+
+struct PrefixCache {
+  Transformer *transformer;  // the pool of its kv cache holds the blocks
+  int max_blocks;            // least recently used blocks are evicted beyond this
+  // hashes of the blocks from the least to the most recently used. a block is always used
+  // more recently than the blocks continuing it, so the front is a leaf
+  std::list<unsigned long long> lru;
+  // keyed by the hash of all the tokens up to and including the block, so a block is only
+  // found after the same prefix
+  std::unordered_map<unsigned long long, PrefixBlock> blocks;
+};
+
+// hash of the empty prefix, the parent of the first block of every prompt
+#define PREFIX_ROOT_HASH 0xcbf29ce484222325ULL
+
+static unsigned long long hash_prefix_block(unsigned long long parent, const int *tokens,
+                                            int n_tokens) {
+  // fnv-1a over the tokens of the block, chained from the hash of the prefix before it
+  unsigned long long hash = parent;
+  for (int i = 0; i < n_tokens; i++) {
+    unsigned int token = (unsigned int) tokens[i];
+    for (int b = 0; b < 4; b++) {
+      hash ^= (token >> (b * 8)) & 0xff;
+      hash *= 0x100000001b3ULL;
+    }
+  }
+  return hash;
+}
+
+static PrefixBlock *find_prefix_block(PrefixCache *cache, unsigned long long parent,
+                                      const int *tokens, unsigned long long *hash) {
+  int block_size = cache->transformer->kv_pool.block_size;
+  *hash = hash_prefix_block(parent, tokens, block_size);
+  auto it = cache->blocks.find(*hash);
+  if (it == cache->blocks.end() || it->second.parent != parent ||
+      memcmp(it->second.tokens.data(), tokens, block_size * sizeof(int)) != 0) {
+    return NULL;  // missing, or a hash collision
+  }
+  return &it->second;
+}
+
+static void touch_prefix_blocks(PrefixCache *cache,
+                                const std::vector<unsigned long long> &prefix) {
+  // marks the blocks of a prefix as the most recently used ones, the first block last so that
+  // every block stays more recent than the blocks continuing it
+  for (auto hash = prefix.rbegin(); hash != prefix.rend(); ++hash) {
+    PrefixBlock &block = cache->blocks.at(*hash);
+    cache->lru.splice(cache->lru.end(), cache->lru, block.lru);
+  }
+}
+
+static bool prefix_cache_evict(PrefixCache *cache, const PrefixBlock *keep) {
+  // drops the least recently used block and its hold on the kv pool block. it is a leaf, so no
+  // cached block loses its prefix. returns false when the cache is empty, or when that block
+  // is keep or still has children, which only happens while a prefix is being stored
+  if (cache->lru.empty()) {
+    return false;
+  }
+  auto it = cache->blocks.find(cache->lru.front());
+  PrefixBlock &block = it->second;
+  if (&block == keep || block.n_children > 0) {
+    return false;
+  }
+  auto parent = cache->blocks.find(block.parent);
+  if (parent != cache->blocks.end()) {
+    parent->second.n_children--;
+  }
+  release_kv_block(&cache->transformer->kv_pool, block.kv_block);
+  cache->lru.pop_front();
+  cache->blocks.erase(it);
+  return true;
+}
+
+PrefixCache *build_prefix_cache(Transformer *transformer, int max_tokens) {
+  // the pool of the transformer evicts from the cache when it runs out of blocks
+  PrefixCache *cache = new PrefixCache();
+  cache->transformer = transformer;
+  int block_size = transformer->kv_pool.block_size;
+  cache->max_blocks = max_tokens > 0 ? max_tokens / block_size : 0;
+  transformer->prefix_cache = cache;
+  return cache;
+}
+
+void free_prefix_cache(PrefixCache *cache) {
+  KVPool *pool = &cache->transformer->kv_pool;
+  for (auto &it : cache->blocks) {
+    release_kv_block(pool, it.second.kv_block);
+  }
+  if (cache->transformer->prefix_cache == cache) {
+    cache->transformer->prefix_cache = NULL;
+  }
+  delete cache;
+}
+
+int prefix_cache_restore(PrefixCache *cache, Transformer *transformer, int *tokens,
+                         int n_tokens) {
+  // shares the kv pool blocks of the longest cached prefix of tokens[0..n_tokens) with the
+  // current session and returns its length. at least the last token is left out, its logits
+  // are still needed. the session copies a shared block before it writes to it
+  KVPool *pool = &transformer->kv_pool;
+  KVCache *kv = transformer->state.kv;
+  int block_size = pool->block_size;
+  std::vector<unsigned long long> prefix;
+  unsigned long long hash = PREFIX_ROOT_HASH;
+  int n_cached = 0;
+  while (n_cached + block_size < n_tokens) {
+    PrefixBlock *block = find_prefix_block(cache, hash, tokens + n_cached, &hash);
+    if (block == NULL) {
+      break;
+    }
+    // the session may already hold the positions, e.g. from the previous turn of a chat
+    int b = n_cached / block_size;
+    if (b == kv->n_blocks || kv->block_table[b] != block->kv_block) {
+      if (b < kv->n_blocks) {
+        release_kv_block(pool, kv->block_table[b]);
+      } else {
+        kv->n_blocks++;
+      }
+      kv->block_table[b] = block->kv_block;
+      pool->ref_counts[block->kv_block]++;
+    }
+    prefix.push_back(hash);
+    n_cached += block_size;
+  }
+  touch_prefix_blocks(cache, prefix);
+  return n_cached;
+}
+
+void prefix_cache_store(PrefixCache *cache, Transformer *transformer, int *tokens,
+                        int n_tokens) {
+  // caches the full blocks of tokens[0..n_tokens) that are not cached yet by holding the kv
+  // pool blocks of the current session, their kv must be at positions 0..n_tokens-1
+  if (cache->max_blocks == 0) {
+    return;
+  }
+  KVPool *pool = &transformer->kv_pool;
+  KVCache *kv = transformer->state.kv;
+  int block_size = pool->block_size;
+  std::vector<unsigned long long> prefix;
+  PrefixBlock *parent_block = NULL;
+  unsigned long long hash = PREFIX_ROOT_HASH;
+  for (int pos = 0; pos + block_size <= n_tokens; pos += block_size) {
+    unsigned long long parent = hash;
+    PrefixBlock *block = find_prefix_block(cache, parent, tokens + pos, &hash);
+    if (block == NULL) {
+      if (cache->blocks.count(hash) > 0) {
+        break;  // a hash collision, the rest of the prefix is not cached
+      }
+      if ((int) cache->blocks.size() >= cache->max_blocks &&
+          !prefix_cache_evict(cache, parent_block)) {
+        break;  // the cache only holds this prefix, keep its first blocks
+      }
+      block = &cache->blocks[hash];
+      block->parent = parent;
+      block->tokens.assign(tokens + pos, tokens + pos + block_size);
+      block->kv_block = kv->block_table[pos / block_size];
+      block->n_children = 0;
+      block->lru = cache->lru.insert(cache->lru.end(), hash);
+      pool->ref_counts[block->kv_block]++;
+      if (parent_block != NULL) {
+        parent_block->n_children++;
+      }
+    } else {
+      // used right away so that an eviction for a later block does not take it
+      cache->lru.splice(cache->lru.end(), cache->lru, block->lru);
+    }
+    prefix.push_back(hash);
+    parent_block = block;
+  }
+  touch_prefix_blocks(cache, prefix);
+}
+
+// ----------------------------------------------------------------------------
+// The Byte Pair Encoding (BPE) Tokenizer that translates strings <-> tokens
+
+
+int compare_tokens(const void *a, const void *b) {
+  return strcmp(((TokenIndex *) a)->str, ((TokenIndex *) b)->str);
+}
+
+void build_tokenizer(Tokenizer *t, char *tokenizer_path, int vocab_size) {
+  // i should have written the vocab_size into the tokenizer file... sigh
+  t->vocab_size = vocab_size;
+  // malloc space to hold the scores and the strings
+  t->vocab = (char **) malloc(vocab_size * sizeof(char *));
+  t->vocab_scores = (float *) malloc(vocab_size * sizeof(float));
+  t->sorted_vocab = NULL;  // initialized lazily
+  for (int i = 0; i < 256; i++) {
+    t->byte_pieces[i * 2] = (unsigned char) i;
+    t->byte_pieces[i * 2 + 1] = '\0';
+  }
+  // read in the file
+  FILE *file = fopen(tokenizer_path, "rb");
+  if (!file) {
+    fprintf(stderr, "couldn't load %s\n", tokenizer_path);
+    exit(EXIT_FAILURE);
+  }
+  if (fread(&t->max_token_length, sizeof(int), 1, file) != 1) {
+    fprintf(stderr, "failed read\n");
+    exit(EXIT_FAILURE);
+  }
+  int len;
+  for (int i = 0; i < vocab_size; i++) {
+    if (fread(t->vocab_scores + i, sizeof(float), 1, file) != 1) {
+      fprintf(stderr, "failed read\n");
+      exit(EXIT_FAILURE);
+    }
+    if (fread(&len, sizeof(int), 1, file) != 1) {
+      fprintf(stderr, "failed read\n");
+      exit(EXIT_FAILURE);
+    }
+    t->vocab[i] = (char *) malloc(len + 1);
+    if (fread(t->vocab[i], len, 1, file) != 1) {
+      fprintf(stderr, "failed read\n");
+      exit(EXIT_FAILURE);
+    }
+    t->vocab[i][len] = '\0';  // add the string terminating token
+  }
+  fclose(file);
+}
+
+void free_tokenizer(Tokenizer *t) {
+  for (int i = 0; i < t->vocab_size; i++) {
+    free(t->vocab[i]);
+  }
+  free(t->vocab);
   free(t->vocab_scores);
   free(t->sorted_vocab);
 }
@@ -671,6 +1537,50 @@ int sample(Sampler *sampler, float *logits) {
   return next;
 }
 
+static void sampler_probabilities(Sampler *sampler, float *logits) {
+  // turns the logits in place into the distribution sample() draws from: one-hot for greedy
+  // sampling, otherwise the softmax with temperature, cut to the top-p nucleus
+  int n = sampler->vocab_size;
+  if (sampler->temperature == 0.0f) {
+    int next = sample_argmax(logits, n);
+    memset(logits, 0, n * sizeof(float));
+    logits[next] = 1.0f;
+    return;
+  }
+  for (int q = 0; q < n; q++) {
+    logits[q] /= sampler->temperature;
+  }
+  softmax(logits, n);
+  if (sampler->topp <= 0 || sampler->topp >= 1) {
+    return;
+  }
+  // the same nucleus as sample_topp, renormalized
+  ProbIndex *probindex = sampler->probindex;
+  int n0 = 0;
+  const float cutoff = (1.0f - sampler->topp) / (n - 1);
+  for (int i = 0; i < n; i++) {
+    if (logits[i] >= cutoff) {
+      probindex[n0].index = i;
+      probindex[n0].prob = logits[i];
+      n0++;
+    }
+  }
+  qsort(probindex, n0, sizeof(ProbIndex), compare);
+  float cumulative_prob = 0.0f;
+  int last_idx = n0 - 1;
+  for (int i = 0; i < n0; i++) {
+    cumulative_prob += probindex[i].prob;
+    if (cumulative_prob > sampler->topp) {
+      last_idx = i;
+      break;
+    }
+  }
+  memset(logits, 0, n * sizeof(float));
+  for (int i = 0; i <= last_idx; i++) {
+    logits[probindex[i].index] = probindex[i].prob / cumulative_prob;
+  }
+}
+
 // ----------------------------------------------------------------------------
 // utilities: time
 
@@ -684,48 +1594,69 @@ long time_in_ms() {
 // ----------------------------------------------------------------------------
 // generation loop
 
-void generate(Transformer *transformer, Tokenizer *tokenizer, Sampler *sampler, char *prompt,
-              int steps, bool is_benchmark) {
-  char *empty_prompt = "hello";
-  if (prompt == NULL) {
-    prompt = empty_prompt;
-  }
-
-  // encode the (string) prompt into tokens sequence
-  int num_prompt_tokens = 0;
-  int *prompt_tokens = (int *) malloc((strlen(prompt) + 3) * sizeof(int));  // +3 for '\0', ?BOS, ?EOS
-  encode(tokenizer, prompt, 1, 0, prompt_tokens, &num_prompt_tokens);
+static int generate_tokens(Transformer *transformer, Tokenizer *tokenizer, Sampler *sampler,
+                           PrefixCache *prefix_cache, int *tokens, int num_prompt_tokens,
+                           int steps, int stop_token, bool print_prompt, bool print_output) {
+  // continues tokens[0..num_prompt_tokens) until stop_token or steps positions, appending the
+  // sampled tokens to tokens (room for steps + 1 of them), returns the new number of tokens
   if (num_prompt_tokens < 1) {
     fprintf(stderr, "something is wrong, expected at least 1 prompt token\n");
     exit(EXIT_FAILURE);
   }
 
+  // resume from the longest cached prefix of the prompt and prefill only the rest of it in one
+  // pass, every prompt token but the last only fills the kv cache
+  long prefill_start = time_in_ms();
+  int num_prefill_tokens = num_prompt_tokens < steps ? num_prompt_tokens : steps;
+  int num_cached_tokens = 0;
+  if (prefix_cache != NULL) {
+    num_cached_tokens =
+        prefix_cache_restore(prefix_cache, transformer, tokens, num_prefill_tokens);
+  }
+  float *logits = forward_prefill(transformer, tokens + num_cached_tokens,
+                                  num_prefill_tokens - num_cached_tokens, num_cached_tokens);
+  long prefill_end = time_in_ms();
+  if (logits == NULL) {
+    fprintf(stderr, "the kv pool is out of blocks, cannot prefill %d tokens\n",
+            num_prefill_tokens);
+    return num_prompt_tokens;
+  }
+  for (int i = 1; i < num_prefill_tokens; i++) {
+    // print the prompt as the token by token loop used to
+    char *piece = decode(tokenizer, tokens[i - 1], tokens[i]);
+    if (print_prompt) {
+      safe_printf(piece);
+      fflush(stdout);
+    }
+  }
+
   // start the main loop
-  long start = 0;                // used to time our code, only initialized after first iteration
-  int next;                      // will store the next token in the sequence
-  int token = prompt_tokens[0];  // kick off with the first token in the prompt
-  int pos = 0;                   // position in the sequence
+  long start = 0;  // used to time our code, only initialized after first iteration
+  int next;        // will store the next token in the sequence
+  int token = tokens[num_prefill_tokens - 1];
+  int pos = num_prefill_tokens - 1;  // position of the token the logits were computed for
+  int num_tokens = num_prompt_tokens;
+  int num_generated = 0;
   while (pos < steps) {
-    // forward the transformer to get logits for the next token4
-    float *logits = forward(transformer, token, pos);
     // advance the state machine
     if (pos < num_prompt_tokens - 1) {
-      // if we are still processing the input prompt, force the next prompt token
-      next = prompt_tokens[pos + 1];
+      // the prompt is longer than steps, force the next prompt token
+      next = tokens[pos + 1];
     } else {
       // otherwise sample the next token from the logits
       next = sample(sampler, logits);
+      tokens[num_tokens++] = next;
     }
     pos++;
 
-    // data-dependent terminating condition: the BOS (=1) token delimits sequences
-    if (next == 1) {
+    // data-dependent terminating condition: BOS (=1) delimits sequences, EOS (=2) ends a turn
+    if (next == stop_token) {
       break;
     }
 
     // print the token as string, decode it with the Tokenizer object
     char *piece = decode(tokenizer, token, next);
-    if (!is_benchmark) {
+    if (print_output) {
       safe_printf(piece);  // same as printf("%s", piece), but skips "unsafe" bytes
       fflush(stdout);
     }
@@ -735,22 +1666,707 @@ void generate(Transformer *transformer, Tokenizer *tokenizer, Sampler *sampler,
     if (start == 0) {
       start = time_in_ms();
     }
+    if (pos >= steps) {
+      break;
+    }
+    // forward the transformer to get logits for the next token
+    logits = forward(transformer, token, pos);
+    if (logits == NULL) {
+      fprintf(stderr, "the kv pool is out of blocks, stopping at %d tokens\n", pos);
+      break;
+    }
+    num_generated++;
   }
-  if (!is_benchmark) {
+  if (print_output) {
     printf("\n");
   }
 
-  // report achieved tok/s (pos-1 because the timer starts after first iteration)
-  if (!is_benchmark) {
-    if (pos > 1) {
+  // snapshot the kv of the sequence so far, positions 0..num_prefill_tokens+num_generated-1
+  if (prefix_cache != NULL) {
+    prefix_cache_store(prefix_cache, transformer, tokens, num_prefill_tokens + num_generated);
+  }
+
+  // report the prefill time and the achieved tok/s of the decoding
+  if (print_prompt) {
+    fprintf(stderr, "prefill %d tokens (%d cached): %ld ms\n", num_prefill_tokens,
+            num_cached_tokens, prefill_end - prefill_start);
+    if (num_generated > 0) {
       long end = time_in_ms();
-      fprintf(stderr, "achieved tok/s: %f\n", (pos - 1) / (double) (end - start) * 1000);
+      fprintf(stderr, "achieved tok/s: %f\n", num_generated / (double) (end - start) * 1000);
     }
   }
+  return num_tokens;
+}
 
+void generate(Transformer *transformer, Tokenizer *tokenizer, Sampler *sampler, char *prompt,
+              int steps, bool is_benchmark, PrefixCache *prefix_cache) {
+  char *empty_prompt = "hello";
+  if (prompt == NULL) {
+    prompt = empty_prompt;
+  }
+
+  // encode the (string) prompt into tokens sequence, with room for the generated tokens
+  int num_prompt_tokens = 0;
+  // +3 for '\0', ?BOS, ?EOS
+  int *tokens = (int *) malloc((strlen(prompt) + 3 + steps + 1) * sizeof(int));
+  encode(tokenizer, prompt, 1, 0, tokens, &num_prompt_tokens);
+  // a new sequence, release the blocks of the previous one in the session
+  reset_kv_cache(transformer, transformer->state.kv);
+  generate_tokens(transformer, tokenizer, sampler, prefix_cache, tokens, num_prompt_tokens, steps,
+                  1, !is_benchmark, !is_benchmark);
+  free(tokens);
+}
+
+void chat(Transformer *transformer, Tokenizer *tokenizer, Sampler *sampler,
+          PrefixCache *prefix_cache, char *cli_user_prompt, char *cli_system_prompt, int steps) {
+  // the whole conversation is kept as tokens and continued every turn, the prefix cache skips
+  // the prefill of all but the new user message (and of the system prompt of a later chat)
+  char system_prompt[512];
+  char user_prompt[512];
+  char rendered_prompt[1152];
+  int *tokens = (int *) malloc((steps + 1 + sizeof(rendered_prompt) + 3) * sizeof(int));
+  int num_tokens = 0;
+  reset_kv_cache(transformer, transformer->state.kv);
+  for (int user_turn = 0;; user_turn++) {
+    // get the (optional) system prompt at the first turn
+    system_prompt[0] = '\0';
+    if (user_turn == 0) {
+      if (cli_system_prompt == NULL) {
+        read_stdin("Enter system prompt (optional): ", system_prompt, sizeof(system_prompt));
+      } else {
+        snprintf(system_prompt, sizeof(system_prompt), "%s", cli_system_prompt);
+      }
+    }
+    // get the user prompt, an empty line or the end of stdin ends the chat
+    user_prompt[0] = '\0';
+    if (user_turn == 0 && cli_user_prompt != NULL) {
+      snprintf(user_prompt, sizeof(user_prompt), "%s", cli_user_prompt);
+    } else {
+      read_stdin("User: ", user_prompt, sizeof(user_prompt));
+    }
+    if (user_prompt[0] == '\0') {
+      break;
+    }
+    // render the user/system prompts into the Llama 2 Chat schema
+    if (system_prompt[0] != '\0') {
+      snprintf(rendered_prompt, sizeof(rendered_prompt),
+               "[INST] <<SYS>>\n%s\n<</SYS>>\n\n%s [/INST]", system_prompt, user_prompt);
+    } else {
+      snprintf(rendered_prompt, sizeof(rendered_prompt), "[INST] %s [/INST]", user_prompt);
+    }
+    int num_turn_tokens = 0;
+    encode(tokenizer, rendered_prompt, 1, 0, tokens + num_tokens, &num_turn_tokens);
+    num_tokens += num_turn_tokens;
+    if (num_tokens >= steps) {
+      fprintf(stderr, "the conversation is longer than %d tokens\n", steps);
+      break;
+    }
+
+    printf("Assistant: ");
+    num_tokens = generate_tokens(transformer, tokenizer, sampler, prefix_cache, tokens,
+                                 num_tokens, steps, 2, false, true);
+  }
+  printf("\n");
+  free(tokens);
+}
+
+void generate_speculative(Transformer *transformer, Transformer *draft, Tokenizer *tokenizer,
+                          Sampler *sampler, char *prompt, int steps, int n_lookahead) {
+  // the draft model proposes n_lookahead tokens one by one, the model checks them all in one
+  // batched forward and keeps the longest accepted run plus one token of its own. accepting a
+  // draft token d with probability min(1, p(d) / q(d)) and otherwise sampling from
+  // max(0, p - q) draws every token from the distribution p of the model, as generate does
+  char *empty_prompt = "hello";
+  if (prompt == NULL) {
+    prompt = empty_prompt;
+  }
+  int vocab_size = transformer->config.vocab_size;
+  if (draft->config.vocab_size != vocab_size) {
+    fprintf(stderr, "the draft model has %d tokens, the model %d\n", draft->config.vocab_size,
+            vocab_size);
+    exit(EXIT_FAILURE);
+  }
+  RunState *s = &transformer->state;
+  // the verification decodes the current token and the drafted ones as one batch
+  if (n_lookahead > s->prefill_chunk - 1) n_lookahead = s->prefill_chunk - 1;
+  if (n_lookahead < 1) n_lookahead = 1;
+
+  // encode the (string) prompt into tokens sequence
+  int num_prompt_tokens = 0;
+  // +3 for '\0', ?BOS, ?EOS
+  int *prompt_tokens = (int *) malloc((strlen(prompt) + 3) * sizeof(int));
+  encode(tokenizer, prompt, 1, 0, prompt_tokens, &num_prompt_tokens);
+  if (num_prompt_tokens < 1) {
+    fprintf(stderr, "something is wrong, expected at least 1 prompt token\n");
+    exit(EXIT_FAILURE);
+  }
+  if (num_prompt_tokens > steps) {
+    num_prompt_tokens = steps;
+  }
+
+  // both models prefill the prompt but its last token, which the first round decodes
+  reset_kv_cache(transformer, s->kv);
+  reset_kv_cache(draft, draft->state.kv);
+  if (num_prompt_tokens > 1 &&
+      (forward_prefill(transformer, prompt_tokens, num_prompt_tokens - 1, 0) == NULL ||
+       forward_prefill(draft, prompt_tokens, num_prompt_tokens - 1, 0) == NULL)) {
+    fprintf(stderr, "the kv pool is out of blocks, cannot prefill %d tokens\n",
+            num_prompt_tokens - 1);
+    free(prompt_tokens);
+    return;
+  }
+  for (int i = 1; i < num_prompt_tokens; i++) {
+    safe_printf(decode(tokenizer, prompt_tokens[i - 1], prompt_tokens[i]));
+  }
+  fflush(stdout);
+
+  // the current token and the drafted ones, then the token sampled after the accepted ones
+  std::vector<int> tokens(n_lookahead + 2);
+  std::vector<int> positions(n_lookahead + 1);
+  std::vector<KVCache *> kvs(n_lookahead + 1, s->kv);
+  std::vector<float> draft_probs((size_t) n_lookahead * vocab_size);
+  long start = time_in_ms();
+  int num_generated = 0;
+  int num_drafted = 0;
+  int num_accepted = 0;
+  int token = prompt_tokens[num_prompt_tokens - 1];
+  int pos = num_prompt_tokens - 1;  // position of token, not forwarded by either model yet
+  bool stop = false;
+  while (pos < steps && !stop) {
+    // the draft model proposes the next tokens, keeping the distributions it sampled them from
+    int n_draft = steps - 1 - pos < n_lookahead ? steps - 1 - pos : n_lookahead;
+    tokens[0] = token;
+    for (int j = 0; j < n_draft; j++) {
+      float *draft_logits = forward(draft, tokens[j], pos + j);
+      if (draft_logits == NULL) {
+        n_draft = j;  // the draft pool is out of blocks, verify what was drafted
+        break;
+      }
+      float *q = draft_probs.data() + (size_t) j * vocab_size;
+      memcpy(q, draft_logits, vocab_size * sizeof(float));
+      sampler_probabilities(sampler, q);
+      tokens[j + 1] = sample_mult(q, vocab_size, random_f32(&sampler->rng_state));
+    }
+
+    // the model computes its distributions at all of these positions in one forward
+    for (int j = 0; j <= n_draft; j++) {
+      positions[j] = pos + j;
+    }
+    float *logits = forward_batch(transformer, kvs.data(), tokens.data(), positions.data(),
+                                  n_draft + 1);
+    if (logits == NULL) {
+      fprintf(stderr, "the kv pool is out of blocks, stopping at %d tokens\n", pos);
+      break;
+    }
+
+    // accept the drafted tokens while the model agrees, resample the first rejected one
+    int n_accepted = 0;
+    int next = -1;
+    for (int j = 0; j < n_draft; j++) {
+      float *p = logits + (size_t) j * vocab_size;
+      float *q = draft_probs.data() + (size_t) j * vocab_size;
+      sampler_probabilities(sampler, p);
+      int d = tokens[j + 1];
+      if (random_f32(&sampler->rng_state) * q[d] < p[d]) {
+        n_accepted++;
+        continue;
+      }
+      float norm = 0.0f;
+      for (int i = 0; i < vocab_size; i++) {
+        p[i] = p[i] > q[i] ? p[i] - q[i] : 0.0f;
+        norm += p[i];
+      }
+      for (int i = 0; i < vocab_size; i++) {
+        p[i] /= norm;
+      }
+      next = sample_mult(p, vocab_size, random_f32(&sampler->rng_state));
+      break;
+    }
+    if (n_accepted == n_draft) {
+      // every draft token was accepted, the model samples one more token after them and the
+      // draft model catches up on its last token
+      float *p = logits + (size_t) n_draft * vocab_size;
+      sampler_probabilities(sampler, p);
+      next = sample_mult(p, vocab_size, random_f32(&sampler->rng_state));
+      if (n_draft > 0) {
+        forward(draft, tokens[n_draft], pos + n_draft);
+      }
+    }
+    num_drafted += n_draft;
+    num_accepted += n_accepted;
+    tokens[n_accepted + 1] = next;
+
+    // print the accepted tokens and the new one, the BOS (=1) token delimits sequences
+    for (int j = 1; j <= n_accepted + 1; j++) {
+      if (tokens[j] == 1) {
+        stop = true;
+        break;
+      }
+      safe_printf(decode(tokenizer, tokens[j - 1], tokens[j]));
+      fflush(stdout);
+      num_generated++;
+    }
+    pos += n_accepted + 1;
+    token = next;
+  }
+  printf("\n");
+
+  // report the acceptance of the draft tokens and the achieved tok/s
+  long end = time_in_ms();
+  fprintf(stderr, "accepted %d of %d draft tokens\n", num_accepted, num_drafted);
+  if (num_generated > 0) {
+    fprintf(stderr, "achieved tok/s: %f\n",
+            num_generated / (double) (end > start ? end - start : 1) * 1000);
+  }
   free(prompt_tokens);
 }
 
+// ----------------------------------------------------------------------------
+// continuous batching: many sequences decoded together, joining and leaving between steps
+
+struct ServeSequence {
+  int id;                   // order of the request on stdin
+  KVCache *kv;              // the session of the sequence
+  std::vector<int> tokens;  // the prompt and then the generated tokens, the last not forwarded
+  int num_prompt_tokens;
+};
+
+static bool read_requests(char *buffer, int *len, int bufsize, std::deque<std::string> *pending,
+                          bool wait) {
+  // moves the lines available on stdin into pending without blocking, or waits for input first
+  // when wait is set. returns false once stdin is closed
+  struct pollfd stdin_fd = {0, POLLIN, 0};
+  while (poll(&stdin_fd, 1, wait ? -1 : 0) > 0) {
+    wait = false;
+    ssize_t n = read(0, buffer + *len, bufsize - *len);
+    if (n <= 0) {
+      if (*len > 0) {
+        pending->push_back(std::string(buffer, *len));  // the last line has no \n
+      }
+      return false;
+    }
+    *len += n;
+    int start = 0;
+    for (int i = 0; i < *len; i++) {
+      if (buffer[i] == '\n') {
+        if (i > start) {
+          pending->push_back(std::string(buffer + start, i - start));
+        }
+        start = i + 1;
+      }
+    }
+    memmove(buffer, buffer + start, *len - start);
+    *len -= start;
+    if (*len == bufsize) {
+      // a line longer than the buffer is cut into several requests
+      pending->push_back(std::string(buffer, *len));
+      *len = 0;
+    }
+  }
+  return true;
+}
+
+static bool sequence_done(const ServeSequence &seq, int steps) {
+  // BOS (=1) delimits sequences and EOS (=2) ends them, otherwise stop after steps positions
+  int last = seq.tokens.back();
+  return last == 1 || last == 2 || (int) seq.tokens.size() - 1 >= steps;
+}
+
+static void retire_sequence(Transformer *transformer, Tokenizer *tokenizer,
+                            PrefixCache *prefix_cache, ServeSequence *seq) {
+  // print the generated text as one "[id] text" line and release the blocks of the sequence
+  int num_tokens = (int) seq->tokens.size();
+  int last = seq->tokens.back();
+  int num_text_tokens = last == 1 || last == 2 ? num_tokens - 1 : num_tokens;
+  printf("[%d] ", seq->id);
+  for (int i = seq->num_prompt_tokens; i < num_text_tokens; i++) {
+    safe_printf(decode(tokenizer, seq->tokens[i - 1], seq->tokens[i]));
+  }
+  printf("\n");
+  fflush(stdout);
+
+  // every token but the last has its kv in the session
+  if (prefix_cache != NULL) {
+    transformer->state.kv = seq->kv;
+    prefix_cache_store(prefix_cache, transformer, seq->tokens.data(), num_tokens - 1);
+  }
+  reset_kv_cache(transformer, seq->kv);
+}
+
+void serve(Transformer *transformer, Tokenizer *tokenizer, Sampler *sampler,
+           PrefixCache *prefix_cache, int steps, int max_batch) {
+  // every line of stdin is a prompt. up to max_batch sequences run one decode step together,
+  // so every weight is read once per step for all of them. new prompts are prefilled and join
+  // between steps, finished sequences are printed as "[id] text" lines and leave
+  RunState *s = &transformer->state;
+  KVCache *default_kv = s->kv;
+  reset_kv_cache(transformer, default_kv);
+
+  // the batch is bounded by the prefill buffers it decodes in and by the blocks in the pool
+  int block_size = transformer->kv_pool.block_size;
+  int seq_blocks = (steps + block_size - 1) / block_size;
+  int pool_batch = transformer->kv_pool.max_blocks / seq_blocks;
+  if (max_batch > s->prefill_chunk) max_batch = s->prefill_chunk;
+  if (max_batch > pool_batch) max_batch = pool_batch;
+  if (max_batch < 1) max_batch = 1;
+  fprintf(stderr, "decoding up to %d sequences at once\n", max_batch);
+
+  std::vector<KVCache *> free_kvs;
+  for (int i = 0; i < max_batch; i++) {
+    free_kvs.push_back(build_kv_cache(transformer));
+  }
+  std::vector<ServeSequence> active;
+  std::deque<std::string> pending;
+  std::vector<KVCache *> kvs(max_batch);
+  std::vector<int> tokens(max_batch);
+  std::vector<int> positions(max_batch);
+  char buffer[4096];
+  int len = 0;
+  bool open = true;
+  int num_requests = 0;
+  long num_decoded = 0;
+  long start = time_in_ms();
+  while (open || !pending.empty() || !active.empty()) {
+    if (open) {
+      open = read_requests(buffer, &len, sizeof(buffer), &pending,
+                           active.empty() && pending.empty());
+    }
+
+    // admit the waiting prompts while there is room in the batch, prefilling each of them
+    while (!pending.empty() && (int) active.size() < max_batch) {
+      std::string prompt = pending.front();
+      pending.pop_front();
+      ServeSequence seq;
+      seq.id = num_requests++;
+      seq.kv = free_kvs.back();
+      free_kvs.pop_back();
+      seq.tokens.resize(prompt.size() + 3);  // +3 for '\0', ?BOS, ?EOS
+      encode(tokenizer, &prompt[0], 1, 0, seq.tokens.data(), &seq.num_prompt_tokens);
+      seq.tokens.resize(seq.num_prompt_tokens);
+      if (seq.num_prompt_tokens >= steps) {
+        fprintf(stderr, "[%d] the prompt is longer than %d tokens\n", seq.id, steps);
+        free_kvs.push_back(seq.kv);
+        continue;
+      }
+      s->kv = seq.kv;
+      int num_cached = 0;
+      if (prefix_cache != NULL) {
+        num_cached = prefix_cache_restore(prefix_cache, transformer, seq.tokens.data(),
+                                          seq.num_prompt_tokens);
+      }
+      float *logits = forward_prefill(transformer, seq.tokens.data() + num_cached,
+                                      seq.num_prompt_tokens - num_cached, num_cached);
+      if (logits == NULL) {
+        // the running sequences hold the pool, reject the request instead of stalling them
+        fprintf(stderr, "[%d] the kv pool is out of blocks, request rejected\n", seq.id);
+        reset_kv_cache(transformer, seq.kv);
+        free_kvs.push_back(seq.kv);
+        continue;
+      }
+      seq.tokens.push_back(sample(sampler, logits));
+      if (sequence_done(seq, steps)) {
+        retire_sequence(transformer, tokenizer, prefix_cache, &seq);
+        free_kvs.push_back(seq.kv);
+      } else {
+        active.push_back(std::move(seq));
+      }
+    }
+    if (active.empty()) {
+      continue;
+    }
+
+    // a sequence whose next position needs a block the pool no longer has ends early, the
+    // others keep decoding and its blocks go back to the pool
+    int num_reserved = 0;
+    for (int i = 0; i < (int) active.size(); i++) {
+      ServeSequence &seq = active[i];
+      if (!kv_cache_reserve(transformer, seq.kv, (int) seq.tokens.size() - 1,
+                            (int) seq.tokens.size())) {
+        fprintf(stderr, "[%d] the kv pool is out of blocks, stopping at %d tokens\n", seq.id,
+                (int) seq.tokens.size());
+        retire_sequence(transformer, tokenizer, prefix_cache, &seq);
+        free_kvs.push_back(seq.kv);
+        continue;
+      }
+      if (num_reserved != i) {
+        active[num_reserved] = std::move(seq);
+      }
+      num_reserved++;
+    }
+    active.resize(num_reserved);
+    if (active.empty()) {
+      continue;
+    }
+
+    // one decode step of all the active sequences
+    int n_seqs = (int) active.size();
+    for (int i = 0; i < n_seqs; i++) {
+      kvs[i] = active[i].kv;
+      tokens[i] = active[i].tokens.back();
+      positions[i] = (int) active[i].tokens.size() - 1;
+    }
+    float *logits = forward_batch(transformer, kvs.data(), tokens.data(), positions.data(), n_seqs);
+    num_decoded += n_seqs;
+
+    // sample the next token of every sequence and retire the finished ones
+    int num_active = 0;
+    for (int i = 0; i < n_seqs; i++) {
+      ServeSequence &seq = active[i];
+      seq.tokens.push_back(sample(sampler, logits + i * transformer->config.vocab_size));
+      if (sequence_done(seq, steps)) {
+        retire_sequence(transformer, tokenizer, prefix_cache, &seq);
+        free_kvs.push_back(seq.kv);
+      } else {
+        if (num_active != i) {
+          active[num_active] = std::move(seq);
+        }
+        num_active++;
+      }
+    }
+    active.resize(num_active);
+  }
+
+  long end = time_in_ms();
+  fprintf(stderr, "served %d requests, decoded %ld tokens: %f tok/s\n", num_requests,
+          num_decoded, num_decoded / (double) (end > start ? end - start : 1) * 1000);
+  for (KVCache *kv : free_kvs) {
+    free_kv_cache(transformer, kv);
+  }
+  s->kv = default_kv;
+}
+
+// ----------------------------------------------------------------------------
+// the decode loop of the baseline, kept as the reference the benchmark compares forward with.
+// it builds the layer and the tensors of every matmul, rmsnorm and softmax at each call and
+// keeps a contiguous kv cache of seq_len positions per layer
+
+static void baseline_rmsnorm(float *o, float *x, float *weight, int size) {
+  using namespace kuiper_infer;
+  std::shared_ptr<Tensor<float>> weight_tensor = std::make_shared<Tensor<float>>(weight, size);
+
+  RMSNormLayer rms;
+  rms.set_weights({weight_tensor});
+
+  std::shared_ptr<Tensor<float>> input_tensor = std::make_shared<Tensor<float>>(x, size);
+  std::shared_ptr<Tensor<float>> output_tensor = std::make_shared<Tensor<float>>(o, size);
+  std::vector<std::shared_ptr<Tensor<float>>> output_tensors;
+  output_tensors.push_back(output_tensor);
+  rms.Forward({input_tensor}, output_tensors);
+}
+
+static void baseline_softmax(float *x, int size) {
+  using namespace kuiper_infer;
+  std::shared_ptr<Tensor<float>> input_tensor = std::make_shared<Tensor<float>>(x, size);
+  std::vector<std::shared_ptr<Tensor<float>>> tensors;
+  tensors.push_back(input_tensor);
+  SoftmaxLayer softmax_layer(0);
+  softmax_layer.Forward(tensors, tensors);
+}
+
+static void baseline_matmul(float *xout, float *x, float *w, int n, int d) {
+  // W (d,n) @ x (n,) -> xout (d,)
+  using namespace kuiper_infer;
+  LLamaMatmulLayer matmul_layer(d, n);
+  std::shared_ptr<Tensor<float>> weight_tensor = std::make_shared<Tensor<float>>(w, d, n);
+  matmul_layer.set_weights({weight_tensor});
+
+  std::shared_ptr<Tensor<float>> input_tensor = std::make_shared<Tensor<float>>(x, n, 1);
+  std::shared_ptr<Tensor<float>> output_tensor = std::make_shared<Tensor<float>>(xout, d, 1);
+  std::vector<std::shared_ptr<Tensor<float>>> output_tensors;
+  output_tensors.push_back(output_tensor);
+  matmul_layer.Forward({input_tensor}, output_tensors);
+}
+
+static float *baseline_forward(Transformer *transformer, float *key_cache, float *value_cache,
+                               int token, int pos) {
+  // a few convenience variables
+  Config *p = &transformer->config;
+  TransformerWeights *w = &transformer->weights;
+  RunState *s = &transformer->state;
+  float *x = s->x;
+  int dim = p->dim;
+  int kv_dim = (p->dim * p->n_kv_heads) / p->n_heads;
+  int kv_mul = p->n_heads / p->n_kv_heads;  // integer multiplier of the kv sharing in multiquery
+  int hidden_dim = p->hidden_dim;
+  int head_size = dim / p->n_heads;
+
+  // copy the token embedding into x
+  float *content_row = w->token_embedding_table + token * dim;
+  memcpy(x, content_row, dim * sizeof(*x));
+
+  // forward all the layers
+  for (unsigned long long l = 0; l < p->n_layers; l++) {
+    // attention rmsnorm
+    baseline_rmsnorm(s->xb, x, w->rms_att_weight + l * dim, dim);
+
+    // key and value point to the kv cache
+    size_t loff = l * p->seq_len * kv_dim;  // kv cache layer offset for convenience
+    float *k = key_cache + loff + pos * kv_dim;
+    float *v = value_cache + loff + pos * kv_dim;
+
+    // qkv matmuls for this position
+    baseline_matmul(s->q, s->xb, w->wq + l * dim * dim, dim, dim);
+    baseline_matmul(k, s->xb, w->wk + l * dim * kv_dim, dim, kv_dim);
+    baseline_matmul(v, s->xb, w->wv + l * dim * kv_dim, dim, kv_dim);
+
+    // RoPE relative positional encoding: complex-valued rotate q and k in each head
+    for (int i = 0; i < dim; i += 2) {
+      int head_dim = i % head_size;
+      float freq = 1.0f / powf(10000.0f, head_dim / (float) head_size);
+      float val = pos * freq;
+      float fcr = cosf(val);
+      float fci = sinf(val);
+      int rotn = i < kv_dim ? 2 : 1;  // how many vectors? 2 = q & k, 1 = q only
+      for (int r = 0; r < rotn; r++) {
+        float *vec = r == 0 ? s->q : k;  // the vector to rotate (query or key)
+        float v0 = vec[i];
+        float v1 = vec[i + 1];
+        vec[i] = v0 * fcr - v1 * fci;
+        vec[i + 1] = v0 * fci + v1 * fcr;
+      }
+    }
+
+    // multihead attention. iterate over all heads
+    int h;
+#pragma omp parallel for private(h)
+    for (h = 0; h < p->n_heads; h++) {
+      // get the query vector for this head
+      float *q = s->q + h * head_size;
+      // attention scores for this head
+      float *att = s->att + h * p->seq_len;
+      // iterate over all timesteps, including the current one
+      for (int t = 0; t <= pos; t++) {
+        // get the key vector for this head and at this timestep
+        float *kt = key_cache + loff + t * kv_dim + (h / kv_mul) * head_size;
+        // calculate the attention score as the dot product of q and k
+        float score = 0.0f;
+        for (int i = 0; i < head_size; i++) {
+          score += q[i] * kt[i];
+        }
+        // save the score to the attention buffer
+        att[t] = score / sqrtf(head_size);
+      }
+
+      // softmax the scores to get attention weights, from 0..pos inclusively
+      baseline_softmax(att, pos + 1);
+
+      // weighted sum of the values, store back into xb
+      float *xb = s->xb + h * head_size;
+      memset(xb, 0, head_size * sizeof(float));
+      for (int t = 0; t <= pos; t++) {
+        // get the value vector for this head and at this timestep
+        float *vt = value_cache + loff + t * kv_dim + (h / kv_mul) * head_size;
+        // get the attention weight for this timestep
+        float a = att[t];
+        // accumulate the weighted value into xb
+        for (int i = 0; i < head_size; i++) {
+          xb[i] += a * vt[i];
+        }
+      }
+    }
+
+    // final matmul to get the output of the attention
+    baseline_matmul(s->xb2, s->xb, w->wo + l * dim * dim, dim, dim);
+
+    // residual connection back into x
+    for (int i = 0; i < dim; i++) {
+      x[i] += s->xb2[i];
+    }
+
+    // ffn rmsnorm
+    baseline_rmsnorm(s->xb, x, w->rms_ffn_weight + l * dim, dim);
+
+    // Now for FFN in PyTorch we have: self.w2(F.silu(self.w1(x)) * self.w3(x))
+    // first calculate self.w1(x) and self.w3(x)
+    baseline_matmul(s->hb, s->xb, w->w1 + l * dim * hidden_dim, dim, hidden_dim);
+    baseline_matmul(s->hb2, s->xb, w->w3 + l * dim * hidden_dim, dim, hidden_dim);
+
+    // SwiGLU non-linearity
+    for (int i = 0; i < hidden_dim; i++) {
+      float val = s->hb[i];
+      // silu(x)=x*σ(x), where σ(x) is the logistic sigmoid
+      val *= (1.0f / (1.0f + expf(-val)));
+      // elementwise multiply with w3(x)
+      val *= s->hb2[i];
+      s->hb[i] = val;
+    }
+
+    // final matmul to get the output of the ffn
+    baseline_matmul(s->xb, s->hb, w->w2 + l * dim * hidden_dim, hidden_dim, dim);
+
+    // residual connection
+    for (int i = 0; i < dim; i++) {
+      x[i] += s->xb[i];
+    }
+  }
+
+  // final rmsnorm
+  baseline_rmsnorm(x, x, w->rms_final_weight, dim);
+
+  // classifier into logits
+  baseline_matmul(s->logits, x, w->wcls, p->dim, p->vocab_size);
+  return s->logits;
+}
+
+void benchmark(Transformer *transformer, int steps) {
+  // decode greedily from the BOS token with forward and then with the decode loop of the
+  // baseline, both should pick the same tokens
+  Config *p = &transformer->config;
+  RunState *s = &transformer->state;
+  int kv_dim = (p->dim * p->n_kv_heads) / p->n_heads;
+  int *tokens = static_cast<int *>(malloc(steps * sizeof(int)));
+
+  reset_kv_cache(transformer, s->kv);
+  int token = 1;
+  long start = time_in_ms();
+  for (int pos = 0; pos < steps; pos++) {
+    float *logits = forward(transformer, token, pos);
+    if (logits == NULL) {
+      fprintf(stderr, "the kv pool is out of blocks, stopping at %d tokens\n", pos);
+      steps = pos;
+      break;
+    }
+    token = sample_argmax(logits, p->vocab_size);
+    tokens[pos] = token;
+  }
+  long end = time_in_ms();
+  double forward_speed = steps / (double) (end > start ? end - start : 1) * 1000;
+  fprintf(stderr, "forward: %d tokens, %f tok/s\n", steps, forward_speed);
+  reset_kv_cache(transformer, s->kv);
+
+  if (transformer->weights.group_size > 0) {
+    // the baseline has no quantized matmul
+    fprintf(stderr, "the baseline decode loop only runs fp32 checkpoints\n");
+    free(tokens);
+    return;
+  }
+
+  size_t cache_size = (size_t) p->n_layers * p->seq_len * kv_dim;
+  float *key_cache = static_cast<float *>(calloc(cache_size, sizeof(float)));
+  float *value_cache = static_cast<float *>(calloc(cache_size, sizeof(float)));
+  if (!key_cache || !value_cache) {
+    fprintf(stderr, "malloc failed!\n");
+    exit(EXIT_FAILURE);
+  }
+  int mismatches = 0;
+  token = 1;
+  start = time_in_ms();
+  for (int pos = 0; pos < steps; pos++) {
+    float *logits = baseline_forward(transformer, key_cache, value_cache, token, pos);
+    token = sample_argmax(logits, p->vocab_size);
+    mismatches += token != tokens[pos];
+  }
+  end = time_in_ms();
+  double baseline_speed = steps / (double) (end > start ? end - start : 1) * 1000;
+  fprintf(stderr, "baseline: %d tokens, %f tok/s\n", steps, baseline_speed);
+  fprintf(stderr, "speedup: %.2fx, %d of %d greedy tokens differ\n",
+          forward_speed / baseline_speed, mismatches, steps);
+
+  free(key_cache);
+  free(value_cache);
+  free(tokens);
+}
+
 void read_stdin(const char *guide, char *buffer, size_t bufsize) {
   // read a line from stdin, up to but not including \n
   printf("%s", guide);
@@ -776,8 +2392,15 @@ void error_usage() {
   fprintf(stderr, "  -n <int>    number of steps to run for, default 256. 0 = max_seq_len\n");
   fprintf(stderr, "  -i <string> input prompt\n");
   fprintf(stderr, "  -z <string> optional path to custom tokenizer\n");
-  fprintf(stderr, "  -m <string> mode: generate|chat, default: generate\n");
+  fprintf(stderr, "  -m <string> mode: generate|chat|serve|speculative|quantize|benchmark,\n");
+  fprintf(stderr, "              default: generate\n");
+  fprintf(stderr, "  -o <string> output path of the int8 checkpoint in quantize mode\n");
+  fprintf(stderr, "  -g <int>    group size of the int8 checkpoint in quantize mode, default 64\n");
   fprintf(stderr, "  -y <string> (optional) system prompt in chat mode\n");
+  fprintf(stderr, "  -c <int>    prefix cache size in tokens, default 1024. 0 = off\n");
+  fprintf(stderr, "  -b <int>    max sequences decoded at once in serve mode, default 8\n");
+  fprintf(stderr, "  -d <string> path to the draft checkpoint in speculative mode\n");
+  fprintf(stderr, "  -k <int>    draft tokens per step in speculative mode, default 4\n");
   exit(EXIT_FAILURE);
 }
 
@@ -30,6 +30,11 @@ typedef struct {
   int seq_len;     // max sequence length
 } Config;
 
+typedef struct {
+  int8_t* q;  // quantized values
+  float* s;   // scaling factors, one per group_size values
+} QuantizedTensor;
+
 typedef struct {
   // token embedding table
   float* token_embedding_table;  // (vocab_size, dim)
@@ -49,8 +54,38 @@ typedef struct {
   float* rms_final_weight;  // (dim,)
   // (optional) classifier weights for the logits, on the last layer
   float* wcls;
+  // int8 weight-only quantization, group_size == 0 means the weights above are fp32.
+  // when quantized, the float matmul weights are NULL and token_embedding_table is
+  // a dequantized copy owned by the weights
+  int group_size;
+  QuantizedTensor* q_tokens;  // (vocab_size, dim)
+  QuantizedTensor* q_wq;      // (layer,) each (dim, n_heads * head_size)
+  QuantizedTensor* q_wk;      // (layer,) each (dim, n_kv_heads * head_size)
+  QuantizedTensor* q_wv;      // (layer,) each (dim, n_kv_heads * head_size)
+  QuantizedTensor* q_wo;      // (layer,) each (n_heads * head_size, dim)
+  QuantizedTensor* q_w1;      // (layer,) each (hidden_dim, dim)
+  QuantizedTensor* q_w2;      // (layer,) each (dim, hidden_dim)
+  QuantizedTensor* q_w3;      // (layer,) each (hidden_dim, dim)
+  QuantizedTensor* q_wcls;    // (vocab_size, dim)
 } TransformerWeights;
 
+typedef struct {
+  int block_size;        // number of positions per block
+  int max_blocks;        // the pool never holds more blocks than this
+  int n_allocated;       // blocks allocated so far, the pool grows with the sessions
+  float** key_blocks;    // (max_blocks,) each (layer, block_size, kv_dim), NULL until allocated
+  float** value_blocks;  // (max_blocks,) each (layer, block_size, kv_dim), NULL until allocated
+  int* free_blocks;      // stack of the allocated blocks that nothing holds
+  int n_free;
+  int* ref_counts;       // (max_blocks,) sessions and prefix cache entries holding a block
+} KVPool;
+
+// the kv cache of one session, paged into blocks of a KVPool
+typedef struct {
+  int* block_table;  // (ceil(seq_len / block_size),) pool block of every block of positions
+  int n_blocks;      // blocks held, covering positions 0..n_blocks * block_size - 1
+} KVCache;
+
 typedef struct {
   // current wave of activations
   float* x;       // activation at current time stamp (dim,)
@@ -59,19 +94,41 @@ typedef struct {
   float* hb;      // buffer for hidden dimension in the ffn (hidden_dim,)
   float* hb2;     // buffer for hidden dimension in the ffn (hidden_dim,)
   float* q;       // query (dim,)
-  float* k;       // key (dim,)
-  float* v;       // value (dim,)
+  float* k;       // key (kv_dim,), copied into the kv cache after RoPE
+  float* v;       // value (kv_dim,), copied into the kv cache
   float* att;     // buffer for scores/attention values (n_heads, seq_len)
   float* logits;  // output logits
-  // kv cache
-  float* key_cache;    // (layer, seq_len, dim)
-  float* value_cache;  // (layer, seq_len, dim)
+  // prompt prefill and batched decode, one column of dim (or hidden_dim) values per token
+  int prefill_chunk;    // max number of tokens prefilled, or sequences decoded, at once
+  float* xs;            // (prefill_chunk, dim)
+  float* xbs;           // (prefill_chunk, dim)
+  float* xb2s;          // (prefill_chunk, dim)
+  float* hbs;           // (prefill_chunk, hidden_dim)
+  float* hb2s;          // (prefill_chunk, hidden_dim)
+  float* qs;            // (prefill_chunk, dim)
+  float* ks;            // (prefill_chunk, kv_dim), copied into the kv cache after RoPE
+  float* vs;            // (prefill_chunk, kv_dim), copied into the kv cache
+  float* batch_logits;  // (prefill_chunk, vocab_size), one row per sequence of a decode step
+  // kv cache of the session that forward reads and extends, switching it switches sessions
+  KVCache* kv;
 } RunState;
 
+// layers and tensor views over the RunState buffers that forward runs with, built once per
+// model in build_transformer. defined in llama_chat.cpp
+struct RunLayers;
+
+// kv pool blocks of the prompt prefixes seen so far, keyed by the hash of the whole prefix up
+// to each block. defined in llama_chat.cpp
+struct PrefixCache;
+
 typedef struct {
   Config config;               // the hyperparameters of the architecture (the blueprint)
   TransformerWeights weights;  // the weights of the model
   RunState state;              // buffers for the "wave" of activations in the forward pass
+  RunLayers* layers;           // pre-built layers of the forward pass
+  KVPool kv_pool;              // blocks of the kv caches of all the sessions
+  KVCache* default_kv;         // the session state.kv starts with
+  PrefixCache* prefix_cache;   // gives up blocks when the pool runs out, NULL without one
   // some more state needed to properly clean up the memory mapping (sigh)
   int fd;             // file descriptor for memory mapping
   float* data;        // memory mapped data pointer
@@ -93,10 +150,31 @@ typedef struct {
 
 void build_tokenizer(Tokenizer* t, char* tokenizer_path, int vocab_size);
 
+void benchmark(Transformer* transformer, int steps);
+
 void read_stdin(const char* guide, char* buffer, size_t bufsize);
 
+PrefixCache* build_prefix_cache(Transformer* transformer, int max_tokens);
+
+void free_prefix_cache(PrefixCache* cache);
+
+int prefix_cache_restore(PrefixCache* cache, Transformer* transformer, int* tokens,
+                         int n_tokens);
+
+void prefix_cache_store(PrefixCache* cache, Transformer* transformer, int* tokens,
+                        int n_tokens);
+
 void generate(Transformer* transformer, Tokenizer* tokenizer, Sampler* sampler, char* prompt,
-              int steps, bool is_benchmark = false);
+              int steps, bool is_benchmark = false, PrefixCache* prefix_cache = NULL);
+
+void chat(Transformer* transformer, Tokenizer* tokenizer, Sampler* sampler,
+          PrefixCache* prefix_cache, char* cli_user_prompt, char* cli_system_prompt, int steps);
+
+void generate_speculative(Transformer* transformer, Transformer* draft, Tokenizer* tokenizer,
+                          Sampler* sampler, char* prompt, int steps, int n_lookahead);
+
+void serve(Transformer* transformer, Tokenizer* tokenizer, Sampler* sampler,
+           PrefixCache* prefix_cache, int steps, int max_batch);
 
 void malloc_run_state(RunState* s, Config* p);
 
@@ -104,21 +182,47 @@ void free_run_state(RunState* s);
 
 void memory_map_weights(TransformerWeights* w, Config* p, float* ptr, int shared_weights);
 
+void memory_map_quantized_weights(TransformerWeights* w, Config* p, void* ptr,
+                                  uint8_t shared_classifier, int group_size);
+
 void read_checkpoint(char* checkpoint, Config* config, TransformerWeights* weights, int* fd,
                      float** data, ssize_t* file_size);
 
+void quantize_checkpoint(char* checkpoint, char* output_path, int group_size);
+
+void build_kv_pool(KVPool* pool, Config* p, int block_size, int max_blocks);
+
+void free_kv_pool(KVPool* pool);
+
+KVCache* build_kv_cache(Transformer* t);
+
+void free_kv_cache(Transformer* t, KVCache* kv);
+
+void reset_kv_cache(Transformer* t, KVCache* kv);
+
+bool kv_cache_reserve(Transformer* t, KVCache* kv, int start, int n_positions);
+
+float* kv_cache_key(Transformer* t, KVCache* kv, int layer, int pos);
+
+float* kv_cache_value(Transformer* t, KVCache* kv, int layer, int pos);
+
+void build_run_layers(Transformer* t);
+
+void free_run_layers(Transformer* t);
+
 void build_transformer(Transformer* t, char* checkpoint_path);
 
 void free_transformer(Transformer* t);
 
-void rmsnorm(float* o, float* x, float* weight, int size);
-
 void softmax(float* x, int size);
 
-void matmul(float* xout, float* x, float* w, int n, int d);
-
 float* forward(Transformer* transformer, int token, int pos);
 
+float* forward_prefill(Transformer* transformer, int* tokens, int n_tokens, int pos);
+
+float* forward_batch(Transformer* transformer, KVCache** kvs, int* tokens, int* positions,
+                     int n_seqs);
+
 void free_tokenizer(Tokenizer* t);
 
 char* decode(Tokenizer* t, int prev_token, int token);
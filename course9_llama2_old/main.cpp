@@ -2,6 +2,7 @@
 // Created by fss on 24-2-15.
 //
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <ctime>
 #include "llama_chat.hpp"
@@ -14,14 +15,70 @@ int main(int argc, char* argv[]) {
   int steps = 256;           // number of steps to run for
   char* prompt = NULL;       // prompt string
   unsigned long long rng_seed = 0;  // seed rng with time by default
-  char* mode = "generate";          // generate|chat
+  char* mode = "generate";          // generate|chat|serve|speculative|quantize|benchmark
+  char* system_prompt = NULL;       // the (optional) system prompt to use in chat mode
+  int prefix_cache_tokens = 1024;   // kv of up to this many prompt prefix tokens is kept
+  int max_batch = 8;                // max number of sequences decoded at once in serve mode
+  char* draft_path = NULL;          // the small draft model of the speculative mode
+  int n_lookahead = 4;              // number of draft tokens per step in speculative mode
+  char* output_path = NULL;         // output path of the int8 checkpoint in quantize mode
+  int group_size = 64;              // group size of the int8 checkpoint in quantize mode
   // poor man's C argparse so we can override the defaults above from the command line
+  if (argc >= 2) {
+    checkpoint_path = argv[1];
+  }
+  for (int i = 2; i < argc; i += 2) {
+    // do some basic validation
+    if (i + 1 >= argc) error_usage();             // must have arg after flag
+    if (argv[i][0] != '-') error_usage();         // must start with dash
+    if (strlen(argv[i]) != 2) error_usage();      // must be -x (one dash, one letter)
+    // read in the args
+    if (argv[i][1] == 't') {
+      temperature = atof(argv[i + 1]);
+    } else if (argv[i][1] == 'p') {
+      topp = atof(argv[i + 1]);
+    } else if (argv[i][1] == 's') {
+      rng_seed = atoi(argv[i + 1]);
+    } else if (argv[i][1] == 'n') {
+      steps = atoi(argv[i + 1]);
+    } else if (argv[i][1] == 'i') {
+      prompt = argv[i + 1];
+    } else if (argv[i][1] == 'z') {
+      tokenizer_path = argv[i + 1];
+    } else if (argv[i][1] == 'm') {
+      mode = argv[i + 1];
+    } else if (argv[i][1] == 'o') {
+      output_path = argv[i + 1];
+    } else if (argv[i][1] == 'g') {
+      group_size = atoi(argv[i + 1]);
+    } else if (argv[i][1] == 'y') {
+      system_prompt = argv[i + 1];
+    } else if (argv[i][1] == 'c') {
+      prefix_cache_tokens = atoi(argv[i + 1]);
+    } else if (argv[i][1] == 'b') {
+      max_batch = atoi(argv[i + 1]);
+    } else if (argv[i][1] == 'd') {
+      draft_path = argv[i + 1];
+    } else if (argv[i][1] == 'k') {
+      n_lookahead = atoi(argv[i + 1]);
+    } else {
+      error_usage();
+    }
+  }
+
+  // offline conversion of a fp32 checkpoint to the int8 one, no inference needed
+  if (strcmp(mode, "quantize") == 0) {
+    if (output_path == NULL) error_usage();
+    quantize_checkpoint(checkpoint_path, output_path, group_size);
+    return 0;
+  }
 
   // parameter validation/overrides
   if (rng_seed <= 0) rng_seed = (unsigned int)time(NULL);
   if (temperature < 0.0) temperature = 0.0;
   if (topp < 0.0 || 1.0 < topp) topp = 0.9;
   if (steps < 0) steps = 0;
+  if (prefix_cache_tokens < 0) prefix_cache_tokens = 0;
 
   // build the Transformer via the model .bin file
   Transformer transformer;
@@ -29,6 +86,14 @@ int main(int argc, char* argv[]) {
   if (steps == 0 || steps > transformer.config.seq_len)
     steps = transformer.config.seq_len;  // ovrerride to ~max length
 
+  // the draft model of the speculative mode is loaded the same way, usually a much smaller one
+  Transformer draft;
+  if (strcmp(mode, "speculative") == 0) {
+    if (draft_path == NULL) error_usage();
+    build_transformer(&draft, draft_path);
+    if (steps > draft.config.seq_len) steps = draft.config.seq_len;
+  }
+
   // build the Tokenizer via the tokenizer .bin file
   Tokenizer tokenizer;
   build_tokenizer(&tokenizer, tokenizer_path, transformer.config.vocab_size);
@@ -37,17 +102,32 @@ int main(int argc, char* argv[]) {
   Sampler sampler;
   build_sampler(&sampler, transformer.config.vocab_size, temperature, topp, rng_seed);
 
+  // the prefix cache lets requests and chat turns skip the prefill of a prompt prefix seen before
+  PrefixCache* prefix_cache = build_prefix_cache(&transformer, prefix_cache_tokens);
+
   // run!
   if (strcmp(mode, "generate") == 0) {
-    generate(&transformer, &tokenizer, &sampler, prompt, steps, false);
+    generate(&transformer, &tokenizer, &sampler, prompt, steps, false, prefix_cache);
+  } else if (strcmp(mode, "chat") == 0) {
+    chat(&transformer, &tokenizer, &sampler, prefix_cache, prompt, system_prompt, steps);
+  } else if (strcmp(mode, "serve") == 0) {
+    serve(&transformer, &tokenizer, &sampler, prefix_cache, steps, max_batch);
+  } else if (strcmp(mode, "speculative") == 0) {
+    generate_speculative(&transformer, &draft, &tokenizer, &sampler, prompt, steps, n_lookahead);
+  } else if (strcmp(mode, "benchmark") == 0) {
+    benchmark(&transformer, steps);
   } else {
     fprintf(stderr, "unknown mode: %s\n", mode);
     error_usage();
   }
 
   // memory and file handles cleanup
+  free_prefix_cache(prefix_cache);
   free_sampler(&sampler);
   free_tokenizer(&tokenizer);
+  if (strcmp(mode, "speculative") == 0) {
+    free_transformer(&draft);
+  }
   free_transformer(&transformer);
   return 0;
 }
\ No newline at end of file
@@ -71,7 +71,7 @@ StatusCode LLamaMatmulLayer::Forward(const std::vector<std::shared_ptr<Tensor<fl
   uint32_t batch = inputs.size();
 #pragma omp parallel for if (batch > 1) num_threads(batch)
   for (uint32_t i = 0; i < batch; ++i) {
-    std::shared_ptr<Tensor<float>> input = inputs.at(i);
+    const std::shared_ptr<Tensor<float>> &input = inputs.at(i);
     CHECK(input != nullptr && !input->empty())
             << "The input tensor array in the matmul layer has an empty tensor " << i << " th";
     const std::vector<uint32_t> &input_shapes = input->raw_shapes();
@@ -87,24 +87,18 @@ StatusCode LLamaMatmulLayer::Forward(const std::vector<std::shared_ptr<Tensor<fl
     }
     CHECK_EQ(input_dim0, weight_dim1_);
 
-    // xt
-    arma::fmat input_vec(input->raw_ptr(), input_dim1, input_dim0, false, true);
     const std::shared_ptr<Tensor<float>> &weight = weights_.front();
-    std::shared_ptr<Tensor<float>> output = outputs.at(i);
+    std::shared_ptr<Tensor<float>> &output = outputs.at(i);
     if (output == nullptr || output->empty()) {
-      output = std::make_shared<Tensor<float>>(1, input_dim1, weight_dim0_);
-      outputs.at(i) = output;
+      output = std::make_shared<Tensor<float>>(weight_dim0_, input_dim1);
     }
 
-    const auto &output_raw_shapes = output->shapes();
-    if (output_raw_shapes.size() == 3) {
-      CHECK(output_raw_shapes.at(1) == weight_dim0_ && output_raw_shapes.at(2) == input_dim1)
-              << "The row of output tensor should be same to input dim 1 and the "
-                 "col of output tensor should be same to weight dim 0.";
-    } else {
-      LOG(FATAL) << "The shape of output tensor need be equal to one or two";
-    }
+    CHECK(output->rows() == weight_dim0_ && output->cols() == input_dim1)
+            << "The row of output tensor should be same to weight dim 0 and the "
+               "col of output tensor should be same to input dim 1.";
     if (input_dim1 == 1) {
+      // xt
+      arma::fmat input_vec(input->raw_ptr(), input_dim1, input_dim0, false, true);
       float *output_ptr = output->raw_ptr();
       float *weight_ptr = weight->raw_ptr();
 #pragma omp parallel for
@@ -113,14 +107,11 @@ StatusCode LLamaMatmulLayer::Forward(const std::vector<std::shared_ptr<Tensor<fl
         *(output_ptr + j) = arma::as_scalar(input_vec * sub_weight);
       }
     } else {
+      // 输入和输出的每一列对应一个token，所有token共用一次权重的读取
+      arma::fmat input_mat(input->raw_ptr(), input_dim0, input_dim1, false, true);
       arma::fmat weight_data(weight->raw_ptr(), weight_dim1_, weight_dim0_, false, true);  // wt
-      if (weight_dim0_ == 1) {
-        arma::fmat output_mat(output->raw_ptr(), input_dim1, weight_dim0_, false, true);
-        output_mat = input_vec * weight_data;
-      } else {
-        arma::fmat output_mat(output->raw_ptr(), weight_dim0_, input_dim1, false, true);
-        output_mat = (input_vec * weight_data).t();
-      }
+      arma::fmat output_mat(output->raw_ptr(), weight_dim0_, input_dim1, false, true);
+      output_mat = weight_data.t() * input_mat;
     }
   }
   return StatusCode::kSuccess;
@@ -0,0 +1,203 @@
+// MIT License
+// Copyright (c) 2022 - 傅莘莘
+// Source URL: https://github.com/zjhellofss/KuiperInfer
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "quant_matmul.hpp"
+#include <algorithm>
+#include <cmath>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define QUANT_MATMUL_TARGET_AVX2
+#endif
+#include "status_code.hpp"
+namespace kuiper_infer {
+#ifdef QUANT_MATMUL_TARGET_AVX2
+// 只在该函数上开启avx2和fma指令，是否调用由运行时检测的cpu特性决定
+__attribute__((target("avx2,fma"))) static float RowDotAVX2(const int8_t *quant_row,
+                                                              const float *scales,
+                                                              const float *input,
+                                                              int32_t num_groups,
+                                                              int32_t group_size) {
+  // 每次将16个int8权重扩展为两组8个fp32，组内累加完成后再乘以该组的缩放系数
+  __m256 row_sum = _mm256_setzero_ps();
+  for (int32_t g = 0; g < num_groups; ++g) {
+    const int8_t *quant_group = quant_row + g * group_size;
+    const float *input_group = input + g * group_size;
+    __m256 group_sum0 = _mm256_setzero_ps();
+    __m256 group_sum1 = _mm256_setzero_ps();
+    for (int32_t k = 0; k < group_size; k += 16) {
+      const __m128i quant16 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(quant_group + k));
+      const __m256 weight0 = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(quant16));
+      const __m256 weight1 = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(quant16, 8)));
+      group_sum0 = _mm256_fmadd_ps(weight0, _mm256_loadu_ps(input_group + k), group_sum0);
+      group_sum1 = _mm256_fmadd_ps(weight1, _mm256_loadu_ps(input_group + k + 8), group_sum1);
+    }
+    row_sum =
+        _mm256_fmadd_ps(_mm256_set1_ps(scales[g]), _mm256_add_ps(group_sum0, group_sum1), row_sum);
+  }
+  __m128 sum128 = _mm_add_ps(_mm256_castps256_ps128(row_sum), _mm256_extractf128_ps(row_sum, 1));
+  sum128 = _mm_hadd_ps(sum128, sum128);
+  sum128 = _mm_hadd_ps(sum128, sum128);
+  return _mm_cvtss_f32(sum128);
+}
+
+static bool QuantMatmulUseAVX2() {
+  static const bool use_avx2 = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  }();
+  return use_avx2;
+}
+#endif
+
+LLamaQuantMatmulLayer::LLamaQuantMatmulLayer(int32_t weight_dim0, int32_t weight_dim1,
+                                             int32_t group_size)
+    : NonParamLayer("quant_matmul"),
+      weight_dim0_(weight_dim0),
+      weight_dim1_(weight_dim1),
+      group_size_(group_size) {
+  CHECK(group_size_ > 0 && weight_dim1_ % group_size_ == 0)
+      << "The weight dim1 " << weight_dim1_ << " should be divisible by the group size "
+      << group_size_;
+}
+
+void LLamaQuantMatmulLayer::set_quant_weights(const int8_t *quant_weight, const float *scales) {
+  CHECK(quant_weight != nullptr && scales != nullptr);
+  this->quant_weight_ = quant_weight;
+  this->scales_ = scales;
+}
+
+float LLamaQuantMatmulLayer::Quantize(const float *weight, size_t size, int32_t group_size,
+                                      int8_t *quant_weight, float *scales) {
+  CHECK(group_size > 0 && size % group_size == 0);
+  const float quant_max = 127.f;
+  float max_error = 0.f;
+  const size_t num_groups = size / group_size;
+  for (size_t g = 0; g < num_groups; ++g) {
+    const float *weight_group = weight + g * group_size;
+    int8_t *quant_group = quant_weight + g * group_size;
+    float abs_max = 0.f;
+    for (int32_t i = 0; i < group_size; ++i) {
+      abs_max = std::max(abs_max, std::fabs(weight_group[i]));
+    }
+    const float scale = abs_max / quant_max;
+    scales[g] = scale;
+    for (int32_t i = 0; i < group_size; ++i) {
+      const float quant_value = scale > 0.f ? std::round(weight_group[i] / scale) : 0.f;
+      quant_group[i] = static_cast<int8_t>(quant_value);
+      max_error = std::max(max_error, std::fabs(quant_value * scale - weight_group[i]));
+    }
+  }
+  return max_error;
+}
+
+void LLamaQuantMatmulLayer::Dequantize(const int8_t *quant_weight, const float *scales,
+                                       size_t size, int32_t group_size, float *weight) {
+  CHECK(group_size > 0 && size % group_size == 0);
+  for (size_t i = 0; i < size; ++i) {
+    weight[i] = quant_weight[i] * scales[i / group_size];
+  }
+}
+
+float LLamaQuantMatmulLayer::RowDot(const int8_t *quant_row, const float *scales,
+                                    const float *input) const {
+  const int32_t num_groups = weight_dim1_ / group_size_;
+#ifdef QUANT_MATMUL_TARGET_AVX2
+  if (group_size_ % 16 == 0 && QuantMatmulUseAVX2()) {
+    return RowDotAVX2(quant_row, scales, input, num_groups, group_size_);
+  }
+#endif
+  float row_sum = 0.f;
+  for (int32_t g = 0; g < num_groups; ++g) {
+    const int8_t *quant_group = quant_row + g * group_size_;
+    const float *input_group = input + g * group_size_;
+    float group_sum = 0.f;
+    for (int32_t k = 0; k < group_size_; ++k) {
+      group_sum += static_cast<float>(quant_group[k]) * input_group[k];
+    }
+    row_sum += group_sum * scales[g];
+  }
+  return row_sum;
+}
+
+StatusCode LLamaQuantMatmulLayer::Forward(
+    const std::vector<std::shared_ptr<Tensor<float>>> &inputs,
+    std::vector<std::shared_ptr<Tensor<float>>> &outputs) {
+  if (inputs.empty()) {
+    LOG(ERROR) << "The input tensor array in the quant matmul layer is empty";
+    return StatusCode::kInferInputsEmpty;
+  }
+
+  if (outputs.empty()) {
+    LOG(ERROR) << "The output tensor array in the quant matmul layer is empty";
+    return StatusCode::kInferOutputsEmpty;
+  }
+
+  if (inputs.size() != outputs.size()) {
+    LOG(ERROR) << "The input and output tensor array size of the quant matmul "
+                  "layer do not match";
+    return StatusCode::kInferDimMismatch;
+  }
+
+  if (quant_weight_ == nullptr || scales_ == nullptr) {
+    LOG(ERROR) << "The quantized weight in the quant matmul layer is empty";
+    return StatusCode::kInferParameterError;
+  }
+
+  // w @ x, 输入的每一列是一个长度为weight_dim1的向量
+  const uint32_t batch = inputs.size();
+  const int32_t groups_per_row = weight_dim1_ / group_size_;
+  for (uint32_t i = 0; i < batch; ++i) {
+    const std::shared_ptr<Tensor<float>> &input = inputs.at(i);
+    CHECK(input != nullptr && !input->empty())
+        << "The input tensor array in the quant matmul layer has an empty tensor " << i << " th";
+    if (input->size() % weight_dim1_ != 0) {
+      LOG(ERROR) << "The input size of the quant matmul layer should be a multiple of "
+                 << weight_dim1_;
+      return StatusCode::kInferDimMismatch;
+    }
+    const uint32_t input_cols = input->size() / weight_dim1_;
+
+    std::shared_ptr<Tensor<float>> &output = outputs.at(i);
+    if (output == nullptr || output->empty()) {
+      output = std::make_shared<Tensor<float>>(weight_dim0_, input_cols);
+    }
+    if (output->size() != static_cast<size_t>(weight_dim0_) * input_cols) {
+      LOG(ERROR) << "The output size of the quant matmul layer should be "
+                 << weight_dim0_ * input_cols;
+      return StatusCode::kInferDimMismatch;
+    }
+
+    const float *input_ptr = input->raw_ptr();
+    float *output_ptr = output->raw_ptr();
+    // 一行量化权重读入缓存之后依次和每一列输入计算点积，多个列时权重只需要读取一次
+#pragma omp parallel for
+    for (int32_t j = 0; j < weight_dim0_; ++j) {
+      const int8_t *quant_row = quant_weight_ + static_cast<size_t>(j) * weight_dim1_;
+      const float *row_scales = scales_ + static_cast<size_t>(j) * groups_per_row;
+      for (uint32_t c = 0; c < input_cols; ++c) {
+        output_ptr[static_cast<size_t>(c) * weight_dim0_ + j] =
+            RowDot(quant_row, row_scales, input_ptr + static_cast<size_t>(c) * weight_dim1_);
+      }
+    }
+  }
+  return StatusCode::kSuccess;
+}
+}  // namespace kuiper_infer
@@ -0,0 +1,94 @@
+// MIT License
+// Copyright (c) 2022 - 傅莘莘
+// Source URL: https://github.com/zjhellofss/KuiperInfer
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef KUIPER_INFER_SOURCE_LAYER_DETAILS_QUANT_MATMUL_HPP
+#define KUIPER_INFER_SOURCE_LAYER_DETAILS_QUANT_MATMUL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "layer/abstract/non_param_layer.hpp"
+#include "status_code.hpp"
+
+namespace kuiper_infer {
+/// 权重为int8、每group_size个连续元素共享一个fp32缩放系数的矩阵乘法，
+/// 权重在计算时逐组反量化，输入和输出仍然是fp32
+class LLamaQuantMatmulLayer : public NonParamLayer {
+ public:
+  /**
+   * @param weight_dim0 权重的行数，也就是输出的长度
+   * @param weight_dim1 权重的列数，也就是输入的长度，需要是group_size的整数倍
+   * @param group_size 共享一个缩放系数的权重元素数量
+   */
+  explicit LLamaQuantMatmulLayer(int32_t weight_dim0, int32_t weight_dim1,
+                                 int32_t group_size);
+
+  StatusCode Forward(const std::vector<std::shared_ptr<Tensor<float>>> &inputs,
+                     std::vector<std::shared_ptr<Tensor<float>>> &outputs) override;
+
+  /**
+   * 设置量化后的权重，层内不持有权重的所有权
+   * @param quant_weight int8权重，(weight_dim0, weight_dim1)行主序
+   * @param scales 缩放系数，数量为weight_dim0 * weight_dim1 / group_size
+   */
+  void set_quant_weights(const int8_t *quant_weight, const float *scales);
+
+  /**
+   * 对称量化，每组的缩放系数为该组绝对值的最大值除以127
+   * @param weight 待量化的fp32权重
+   * @param size 权重的元素数量，需要是group_size的整数倍
+   * @param group_size 共享一个缩放系数的权重元素数量
+   * @param quant_weight 量化后的int8权重
+   * @param scales 每组的缩放系数
+   * @return 量化前后的最大绝对误差
+   */
+  static float Quantize(const float *weight, size_t size, int32_t group_size,
+                        int8_t *quant_weight, float *scales);
+
+  /**
+   * 将int8权重反量化为fp32
+   * @param quant_weight int8权重
+   * @param scales 每组的缩放系数
+   * @param size 权重的元素数量
+   * @param group_size 共享一个缩放系数的权重元素数量
+   * @param weight 反量化后的fp32权重
+   */
+  static void Dequantize(const int8_t *quant_weight, const float *scales, size_t size,
+                         int32_t group_size, float *weight);
+
+ private:
+  /**
+   * 计算一行量化权重与输入向量的点积
+   * @param quant_row 该行的int8权重
+   * @param scales 该行各组的缩放系数
+   * @param input 输入向量
+   * @return 点积的结果
+   */
+  float RowDot(const int8_t *quant_row, const float *scales, const float *input) const;
+
+ private:
+  int32_t weight_dim0_ = 0;
+  int32_t weight_dim1_ = 0;
+  int32_t group_size_ = 0;
+  const int8_t *quant_weight_ = nullptr;  /// int8权重
+  const float *scales_ = nullptr;         /// 每组权重的缩放系数
+};
+}  // namespace kuiper_infer
+#endif  // KUIPER_INFER_SOURCE_LAYER_DETAILS_QUANT_MATMUL_HPP
@@ -59,7 +59,7 @@ StatusCode RMSNormLayer::Forward(const std::vector<std::shared_ptr<Tensor<float>
     return StatusCode::kInferParameterError;
   }
 
-  std::shared_ptr<Tensor<float>> weight = this->weight(0);
+  const std::shared_ptr<Tensor<float>>& weight = weights_.front();
   arma::fvec weight_vec(weight->raw_ptr(), weight->size(), false, true);
   const uint32_t batch_size = inputs.size();
 #pragma omp parallel for if (batch_size > 1) num_threads(batch_size)
@@ -70,24 +70,31 @@ StatusCode RMSNormLayer::Forward(const std::vector<std::shared_ptr<Tensor<float>
            "empty tensor "
         << i << " th";
 
-    std::shared_ptr<Tensor<float>> output = outputs.at(i);
+    std::shared_ptr<Tensor<float>>& output = outputs.at(i);
     if (output == nullptr || output->empty()) {
       output = std::make_shared<Tensor<float>>(input->shapes());
-      outputs.at(i) = output;
     }
-    CHECK(output->shapes() == input->shapes())
+    CHECK(output->raw_shapes() == input->raw_shapes())
         << "The input and output tensor shapes of the rmsnorm "
            "layer do not match "
         << i << " th";
 
+    // 二维的输入按列归一化，每一列是一个token的向量
     const size_t size = input->size();
-    arma::fvec input_vec(input->raw_ptr(), size, false, true);
+    const size_t norm_size =
+        input->raw_shapes().size() == 2 ? static_cast<size_t>(input->rows()) : size;
+    CHECK_EQ(norm_size, weight->size());
+    const size_t norm_count = size / norm_size;
+#pragma omp parallel for if (norm_count > 1)
+    for (size_t c = 0; c < norm_count; ++c) {
+      arma::fvec input_vec(input->raw_ptr() + c * norm_size, norm_size, false, true);
 
-    const arma::fvec& input_pow_vec = arma::pow(input_vec, 2.f);
-    const float mean_value = arma::mean(input_pow_vec);
-    const float norm_value = 1.f / std::sqrt(mean_value + eps_);
-    arma::fvec output_vec(output->raw_ptr(), size, false, true);
-    output_vec = weight_vec % (norm_value * input_vec);
+      // 平方和直接用点积求出，不产生临时向量
+      const float mean_value = arma::dot(input_vec, input_vec) / static_cast<float>(norm_size);
+      const float norm_value = 1.f / std::sqrt(mean_value + eps_);
+      arma::fvec output_vec(output->raw_ptr() + c * norm_size, norm_size, false, true);
+      output_vec = weight_vec % (norm_value * input_vec);
+    }
   }
   return StatusCode::kSuccess;
 }
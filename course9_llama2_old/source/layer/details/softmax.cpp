@@ -30,6 +30,45 @@ namespace kuiper_infer {
 
 SoftmaxLayer::SoftmaxLayer(int32_t dim) : NonParamLayer("Softmax"), softmax_dim_(dim) {}
 
+void SoftmaxLayer::Softmax1D(const float *input, float *output, int32_t size) {
+  CHECK(input != nullptr && output != nullptr && size > 0);
+  const float max_value = *std::max_element(input, input + size);
+
+  int32_t index = 0;
+  float sum_value = 0.f;
+#ifdef __AVX2__
+  const int32_t packet_size = 8;
+  __m256 sum_vec = _mm256_setzero_ps();
+  const __m256 max_value256 = _mm256_set1_ps(max_value);
+  for (; index <= size - packet_size; index += packet_size) {
+    __m256 p = _mm256_loadu_ps(input + index);
+    __m256 exp_sub_value = fmath::exp_ps256(_mm256_sub_ps(p, max_value256));
+    _mm256_storeu_ps(output + index, exp_sub_value);
+    sum_vec = _mm256_add_ps(sum_vec, exp_sub_value);
+  }
+  sum_vec = _mm256_hadd_ps(sum_vec, sum_vec);
+  sum_vec = _mm256_hadd_ps(sum_vec, sum_vec);
+  sum_value = ((float *)&sum_vec)[0] + ((float *)&sum_vec)[4];
+#endif
+  for (; index < size; ++index) {
+    const float exp_sub_value = fmath::exp(input[index] - max_value);
+    output[index] = exp_sub_value;
+    sum_value += exp_sub_value;
+  }
+
+  index = 0;
+#ifdef __AVX2__
+  const __m256 sum_value256 = _mm256_set1_ps(sum_value);
+  for (; index <= size - packet_size; index += packet_size) {
+    __m256 p = _mm256_loadu_ps(output + index);
+    _mm256_storeu_ps(output + index, _mm256_div_ps(p, sum_value256));
+  }
+#endif
+  for (; index < size; ++index) {
+    output[index] = output[index] / sum_value;
+  }
+}
+
 StatusCode SoftmaxLayer::Forward(const std::vector<std::shared_ptr<Tensor<float>>> &inputs,
                                  std::vector<std::shared_ptr<Tensor<float>>> &outputs) {
   if (inputs.empty()) {
@@ -78,62 +117,7 @@ StatusCode SoftmaxLayer::Forward(const std::vector<std::shared_ptr<Tensor<float>
     }
 
     if (raw_shapes.size() == 1 && dim == 0) {
-      float *input_ptr = input->raw_ptr();
-      float *output_ptr = output->raw_ptr();
-      int32_t size = static_cast<int32_t>(raw_shapes.front());
-      float max_value = *std::max_element(input_ptr, input_ptr + size);
-
-      int32_t index = 0;
-      float sum_value = 0.f;
-#ifdef __AVX2__
-      int32_t packet_size = 8;
-input_ptr = input->raw_ptr();
-__m256 sum_vec = _mm256_setzero_ps();
-__m256 max_value256 = _mm256_set1_ps(max_value);
-for (; index <= size - packet_size; index += packet_size) {
-__m256 p = _mm256_loadu_ps(input_ptr);
-__m256 exp_sub_value = fmath::exp_ps256(_mm256_sub_ps(p, max_value256));
-_mm256_storeu_ps(output_ptr, exp_sub_value);
-sum_vec = _mm256_add_ps(sum_vec, exp_sub_value);
-input_ptr += packet_size;
-output_ptr += packet_size;
-}
-sum_vec = _mm256_hadd_ps(sum_vec, sum_vec);
-sum_vec = _mm256_hadd_ps(sum_vec, sum_vec);
-sum_value = ((float*)&sum_vec)[0] + ((float*)&sum_vec)[4];
-#endif
-      if (index < size) {
-        input_ptr = input->raw_ptr(index);
-        output_ptr = output->raw_ptr(index);
-        for (; index < size; ++index) {
-          float cur_value = *input_ptr;
-          float exp_sub_value = fmath::exp(cur_value - max_value);
-          *output_ptr = exp_sub_value;
-          sum_value += exp_sub_value;
-
-          input_ptr += 1;
-          output_ptr += 1;
-        }
-      }
-
-      index = 0;
-#ifdef __AVX2__
-      output_ptr = output->raw_ptr();
-sum_vec = _mm256_set1_ps(sum_value);
-for (; index <= size - packet_size; index += packet_size) {
-__m256 p = _mm256_loadu_ps(output_ptr);
-__m256 div_value = _mm256_div_ps(p, sum_vec);
-_mm256_storeu_ps(output_ptr, div_value);
-output_ptr += packet_size;
-}
-#endif
-      if (index < size) {
-        output_ptr = output->raw_ptr(index);
-        for (; index < size; ++index) {
-          *output_ptr = *output_ptr / sum_value;
-          output_ptr += 1;
-        }
-      }
+      Softmax1D(input->raw_ptr(), output->raw_ptr(), static_cast<int32_t>(raw_shapes.front()));
     } else {
       const uint32_t padding_size_num = 3 - raw_shapes.size();
       for (uint32_t j = 0; j < padding_size_num; ++j) {
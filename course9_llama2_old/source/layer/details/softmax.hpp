@@ -36,6 +36,14 @@ class SoftmaxLayer : public NonParamLayer {
       const std::vector<std::shared_ptr<Tensor<float>>> &inputs,
       std::vector<std::shared_ptr<Tensor<float>>> &outputs) override;
 
+  /**
+   * 对连续存储的一维数据计算softmax，不会创建张量或分配内存
+   * @param input 输入数据
+   * @param output 输出数据，可以和输入是同一块内存
+   * @param size 数据的长度
+   */
+  static void Softmax1D(const float *input, float *output, int32_t size);
+
  private:
   int softmax_dim_ = -1;
 };